@@ -28,6 +28,8 @@
 #include "pt_terminal.h"
 #include "pt_visuals.h"
 #include "pt_scopes.h"
+#include "pt_spectrum.h"
+#include "pt_meters.h"
 
 #define INITIAL_DITHER_SEED 0x12345000
 
@@ -54,24 +56,39 @@ typedef struct ledFilterCoeff_t
 
 typedef struct voice_t
 {
-    volatile int8_t active, retriggered;
+    volatile int8_t active;
+    int8_t scopeVolume, loopFlag, newLoopFlag, didSwapData; // only used by the scopes
     const int8_t *data, *newData;
-    int32_t length, newLength, phase;
+    int32_t length, newLength, phase, loopStart, newLoopStart;
     float volume_f, delta_f, frac_f, lastDelta_f, lastFrac_f, panL_f, panR_f;
 } paulaVoice_t;
 
+// a jammed note, started by the mixer at the right sample position
+typedef struct scheduledNote_t
+{
+    int8_t pending, loopFlag;
+    const int8_t *data, *loopData;
+    int32_t length, loopLength, loopStart;
+    uint16_t period, volume;
+    uint64_t time64; // performance counter time the note should be mixed at, 0 = right away
+} scheduledNote_t;
+
 static volatile int8_t filterFlags = FILTER_LP_ENABLED;
 static int8_t amigaPanFlag, defStereoSep = 25, wavRenderingDone;
 int8_t forceMixerOff = false;
 static uint16_t ch1Pan, ch2Pan, ch3Pan, ch4Pan;
 int32_t samplesPerTick;
 static int32_t sampleCounter, maxSamplesToMix, rand32_val = INITIAL_DITHER_SEED;
-static float *mixBufferL_f, *mixBufferR_f;
+static uint64_t audioSamplePos; // samples sent to the audio device so far
+static float *mixBufferL_f, *mixBufferR_f, *voiceBuffer_f;
 static blep_t blep[AMIGA_VOICES], blepVol[AMIGA_VOICES];
 static lossyIntegrator_t filterLo, filterHi;
 static ledFilterCoeff_t filterLEDC;
 static ledFilter_t filterLED;
 static paulaVoice_t paula[AMIGA_VOICES];
+static scheduledNote_t scheduledNotes[AMIGA_VOICES];
+static uint64_t noteDelay64;
+static double samplesPerCount_d;
 static SDL_AudioDeviceID dev;
 
 int8_t intMusic(void);         // defined in pt_modplayer.c
@@ -187,30 +204,43 @@ static float cosApx(float x)
     return (x * 1.09742972f + x * x * 0.31678383f);
 }
 
+/* The voices and scheduled notes are shared with the audio callback. Note that
+** SDL_LockAudio() only locks the legacy device (ID 1), not one opened with
+** SDL_OpenAudioDevice(), so always lock through these.
+*/
+void lockAudio(void)
+{
+    if (dev > 0)
+        SDL_LockAudioDevice(dev);
+}
+
+void unlockAudio(void)
+{
+    if (dev > 0)
+        SDL_UnlockAudioDevice(dev);
+}
+
 void clearPaulaAndScopes(void)
 {
     uint8_t i;
     paulaVoice_t *v;
-    scopeChannel_t *sc;
 
-    SDL_LockAudio();
+    lockAudio();
 
     for (i = 0; i < AMIGA_VOICES; ++i)
     {
-        v  = &paula[i];
-        sc = &scope[i];
+        v = &paula[i];
 
         memset(v, 0, sizeof (paulaVoice_t));
         v->data = v->newData = NULL;
         // panL/panR are set up later
 
-        memset(sc, 0, sizeof (scopeChannel_t));
-        sc->data = sc->newData = NULL;
-
-        sc->length = sc->newLength = 2; // setting these to 2 is IMPORTANT for the scopes!
+        scheduledNotes[i].pending = false;
     }
 
-    SDL_UnlockAudio();
+    scopeClearSnapshots();
+
+    unlockAudio();
 }
 
 void mixerUpdateLoops(void) // updates Paula loop (+ scopes)
@@ -250,28 +280,51 @@ static void mixerSetVoicePan(uint8_t ch, uint16_t pan) // pan = 0..256
 void mixerKillVoice(uint8_t ch)
 {
     paulaVoice_t *v;
-    scopeChannel_t *sc;
-
-    v  = &paula[ch];
-    sc = &scope[ch];
 
-    v->active   = false;
-    v->volume_f = 0.0f;
+    v = &paula[ch];
 
-    sc->active = false;
-    sc->volume = 0;
-    sc->didSwapData = false;
+    v->active      = false;
+    v->volume_f    = 0.0f;
+    v->scopeVolume = 0;
+    v->didSwapData = false;
 
     memset(&blep[ch],    0, sizeof (blep_t));
     memset(&blepVol[ch], 0, sizeof (blep_t));
 }
 
+// voices stay active after a non-looped sample has ended (on its silent replen), those don't count here
+int8_t mixerVoicesActive(void)
+{
+    uint8_t i;
+    paulaVoice_t *v;
+
+    for (i = 0; i < AMIGA_VOICES; ++i)
+    {
+        if (scheduledNotes[i].pending)
+            return (true);
+
+        v = &paula[i];
+        if (!v->active || (v->data == NULL) || (v->volume_f == 0.0f) || (v->delta_f == 0.0f))
+            continue;
+
+        if (v->didSwapData && !v->loopFlag)
+            continue; // non-looped sample has played to the end
+
+        return (true);
+    }
+
+    return (false);
+}
+
 void turnOffVoices(void)
 {
     uint8_t i;
 
     for (i = 0; i < AMIGA_VOICES; ++i)
+    {
+        scheduledNotes[i].pending = false;
         mixerKillVoice(i);
+    }
 
     clearLossyIntegrator(&filterLo);
     clearLossyIntegrator(&filterHi);
@@ -287,10 +340,8 @@ void paulaRestartDMA(uint8_t ch)
     const int8_t *dat;
     int32_t length;
     paulaVoice_t *v;
-    scopeChannel_t *sc;
 
-    v  = &paula[ch];
-    sc = &scope[ch];
+    v = &paula[ch];
 
     dat = v->newData;
     if (dat == NULL)
@@ -306,26 +357,21 @@ void paulaRestartDMA(uint8_t ch)
     v->length = length;
     v->active = true;
 
-    dat = sc->newData;
-    if (dat == NULL)
-        dat = &modEntry->sampleData[RESERVED_SAMPLE_OFFSET]; // dummy sample
-
-    sc->length      = length;
-    sc->data        = dat;
-    sc->retriggered = true;
-    sc->active      = true;
+    v->loopFlag    = v->newLoopFlag;
+    v->loopStart   = v->newLoopStart;
+    v->didSwapData = false;
 }
 
 void paulaSetPeriod(uint8_t ch, uint16_t period)
 {
-    float hz_f, audioFreq_f;
+    float audioFreq_f;
     paulaVoice_t *v;
 
     v = &paula[ch];
 
     if (period == 0)
     {
-        hz_f = v->delta_f = 0.0f;
+        v->delta_f = 0.0f;
     }
     else
     {
@@ -337,12 +383,9 @@ void paulaSetPeriod(uint8_t ch, uint16_t period)
         if (editor.isSMPRendering)
             audioFreq_f = editor.pat2SmpHQ ? 28836.0f : 22168.0f;
 
-        hz_f = (float)(PAULA_PAL_CLK) / period;
-        v->delta_f = hz_f / audioFreq_f;
+        v->delta_f = ((float)(PAULA_PAL_CLK) / period) / audioFreq_f;
     }
 
-    scope[ch].delta_f = hz_f / VBLANK_HZ;
-
     if (v->lastDelta_f == 0.0f)
         v->lastDelta_f = v->delta_f;
 }
@@ -353,8 +396,8 @@ void paulaSetVolume(uint8_t ch, uint16_t vol)
     if (vol > 0x40)
         vol = 0x40;
 
-    paula[ch].volume_f = vol * (1.0f / 64.0f);
-    scope[ch].volume   = 0 - (vol / 2);
+    paula[ch].volume_f    = vol * (1.0f / 64.0f);
+    paula[ch].scopeVolume = 0 - (vol / 2);
 }
 
 // our Paula emulator takes sample lengths in bytes instead of words
@@ -363,16 +406,16 @@ void paulaSetLength(uint8_t ch, uint32_t len)
     if (len < 2)
         len = 2; // needed safety for mixer and scopes
 
-    scope[ch].newLength = paula[ch].newLength = len;
+    paula[ch].newLength = len;
 }
 
 void paulaSetData(uint8_t ch, const int8_t *src)
 {
     uint8_t smp;
     moduleSample_t *s;
-    scopeChannel_t *sc;
+    paulaVoice_t *v;
 
-    sc = &scope[ch];
+    v = &paula[ch];
 
     smp = modEntry->channels[ch].n_samplenum;
     PT_ASSERT(smp <= 30);
@@ -384,10 +427,117 @@ void paulaSetData(uint8_t ch, const int8_t *src)
     if (src == NULL)
         src = &modEntry->sampleData[RESERVED_SAMPLE_OFFSET]; // dummy sample
 
-    sc->newData = paula[ch].newData = src;
+    v->newData = src;
+
+    v->newLoopFlag  = (s->loopStart + s->loopLength) > 2;
+    v->newLoopStart = s->loopStart;
+}
+
+/* Plays the note set up in the channel's n_ variables (by jamAndPlaceSample())
+** at a fixed delay of one audio buffer after the key was pressed, instead of
+** at the start of whatever buffer is mixed next. This takes the buffer and
+** frame timing out of the note's latency. Notes handled too late for that are
+** started right away.
+*/
+void paulaScheduleNote(uint8_t ch, uint64_t eventTime64)
+{
+    uint8_t smp;
+    const int8_t *dummy;
+    moduleChannel_t *chn;
+    moduleSample_t *s;
+    scheduledNote_t *n;
+
+    chn = &modEntry->channels[ch];
+
+    // same safety checks as in paulaSetData()
+    smp = chn->n_samplenum;
+    PT_ASSERT(smp <= 30);
+    if (smp > 30)
+        smp = 30;
+
+    s = &modEntry->samples[smp];
+    dummy = &modEntry->sampleData[RESERVED_SAMPLE_OFFSET];
+
+    lockAudio();
+
+    n = &scheduledNotes[ch];
+
+    n->data       = (chn->n_start == NULL) ? dummy : chn->n_start;
+    n->length     = MAX(chn->n_length, 2);
+    n->loopData   = (chn->n_loopstart == NULL) ? dummy : chn->n_loopstart;
+    n->loopLength = MAX(chn->n_replen, 2);
+    n->loopFlag   = (s->loopStart + s->loopLength) > 2;
+    n->loopStart  = s->loopStart;
+    n->period     = chn->n_period;
+    n->volume     = chn->n_volume;
+    n->time64     = (eventTime64 == 0) ? 0 : (eventTime64 + noteDelay64);
+    n->pending    = true;
+
+    unlockAudio();
+}
+
+static void startScheduledNote(uint8_t ch)
+{
+    paulaVoice_t *v;
+    scheduledNote_t *n;
+
+    v = &paula[ch];
+    n = &scheduledNotes[ch];
+
+    paulaSetVolume(ch, n->volume);
+    paulaSetPeriod(ch, n->period);
+
+    v->newData      = n->data;
+    v->newLength    = n->length;
+    v->newLoopFlag  = n->loopFlag;
+    v->newLoopStart = n->loopStart;
+    paulaRestartDMA(ch);
+
+    // these take effect after the current DMA cycle is done
+    v->newData   = n->loopData;
+    v->newLength = n->loopLength;
+
+    n->pending = false;
+}
+
+// starts the notes due at or before blockPos, returns the block position of the next one (or INT32_MAX)
+static int32_t startDueNotes(int32_t blockPos, uint64_t clockTime64)
+{
+    uint8_t i;
+    int32_t notePos, nextPos;
+    scheduledNote_t *n;
+
+    nextPos = INT32_MAX;
+    for (i = 0; i < AMIGA_VOICES; ++i)
+    {
+        n = &scheduledNotes[i];
+        if (!n->pending)
+            continue;
+
+        if (n->time64 <= clockTime64)
+        {
+            notePos = 0;
+        }
+        else
+        {
+            // clamped, a note more than a second ahead is bogus anyway
+            notePos = (int32_t)(MIN((n->time64 - clockTime64) * samplesPerCount_d, (double)(editor.outputFreq)));
+        }
 
-    sc->newLoopFlag  = (s->loopStart + s->loopLength) > 2;
-    sc->newLoopStart = s->loopStart;
+        if (notePos <= blockPos)
+            startScheduledNote(i);
+        else if (notePos < nextPos)
+            nextPos = notePos;
+    }
+
+    return (nextPos);
+}
+
+// for data that isn't a module sample (tuning tone)
+void paulaSetScopeLoop(uint8_t ch, int8_t loopFlag, int32_t loopStart)
+{
+    paula[ch].loopFlag  = paula[ch].newLoopFlag  = loopFlag;
+    paula[ch].loopStart = paula[ch].newLoopStart = loopStart;
 }
 
 void toggleLowPassFilter(void)
@@ -412,8 +562,7 @@ void mixChannels(int32_t numSamples)
     const int8_t *dataPtr;
     uint8_t i;
     int32_t j;
-    volatile float *vuMeter_f;
-    float tempSample_f, tempVolume_f, mutedVol_f, tmp_f;
+    float tempSample_f, tempVolume_f, mutedVol_f;
     blep_t *bSmp, *bVol;
     paulaVoice_t *v;
 
@@ -425,7 +574,6 @@ void mixChannels(int32_t numSamples)
         v    = &paula[i];
         bSmp = &blep[i];
         bVol = &blepVol[i];
-        vuMeter_f = &editor.realVuMeterVolumes[i];
 
         mutedVol_f = -1.0f;
         if (editor.muted[i])
@@ -467,16 +615,7 @@ void mixChannels(int32_t numSamples)
             if (bVol->samplesLeft) tempVolume_f += blepRun(bVol);
 
             tempSample_f *= tempVolume_f;
-
-            // "real VU meter" mode handling
-            if (editor.ui.realVuMeters)
-            {
-                tmp_f = tempSample_f * 48.0f;
-                tmp_f = ABS(tmp_f);
-                if (tmp_f > *vuMeter_f)
-                    *vuMeter_f = tmp_f;
-            }
-            // ----------------------------
+            voiceBuffer_f[j] = tempSample_f;
 
             mixBufferL_f[j] += (tempSample_f * v->panL_f);
             mixBufferR_f[j] += (tempSample_f * v->panR_f);
@@ -496,12 +635,21 @@ void mixChannels(int32_t numSamples)
                     // re-fetch Paula register values now
                     v->length = v->newLength;
                     v->data   = v->newData;
+
+                    v->loopFlag    = v->newLoopFlag;
+                    v->loopStart   = v->newLoopStart;
+                    v->didSwapData = true;
                 }
 
                 // we don't need to insert ending BLEPs anymore with this constantly running mixer
             }
         }
 
+        if (j < numSamples)
+            memset(&voiceBuffer_f[j], 0, (numSamples - j) * sizeof (float));
+
+        meterVoiceBlock(i, voiceBuffer_f, numSamples);
+
         if (mutedVol_f != -1.0f)
             v->volume_f = mutedVol_f;
     }
@@ -584,6 +732,10 @@ void pat2SmpMixChannels(int32_t numSamples) // pat2smp needs a multi-step mixer
                     // re-fetch Paula register values now
                     v->length = v->newLength;
                     v->data   = v->newData;
+
+                    v->loopFlag    = v->newLoopFlag;
+                    v->loopStart   = v->newLoopStart;
+                    v->didSwapData = true;
                 }
             }
 
@@ -622,6 +774,10 @@ static inline void processMixedSamples(int32_t i, int16_t *out, uint8_t mono)
 
     lossyIntegratorHighPass(&filterHi, out_f, out_f);
 
+    // keep the filtered output for the spectrum analyzer
+    mixBufferL_f[i] = out_f[0];
+    mixBufferR_f[i] = out_f[1];
+
     // normalize
     out_f[0] *= (32767.0f / AMIGA_VOICES);
     out_f[1] *= (32767.0f / AMIGA_VOICES);
@@ -667,6 +823,9 @@ void outputAudio(int16_t *target, int32_t numSamples)
             *outStream++ = out[0];
             *outStream++ = out[1];
         }
+
+        meterMasterBlock(mixBufferL_f, mixBufferR_f, numSamples, AMIGA_VOICES);
+        meterPublish();
     }
     else if (editor.isSMPRendering)
     {
@@ -698,32 +857,78 @@ void outputAudio(int16_t *target, int32_t numSamples)
             *outStream++ = out[0];
             *outStream++ = out[1];
         }
+
+        meterMasterBlock(mixBufferL_f, mixBufferR_f, numSamples, AMIGA_VOICES);
+        meterPublish();
+
+        if (editor.ui.visualizerMode == VISUAL_SPECTRUM)
+            spectrumPushSamples(mixBufferL_f, mixBufferR_f, numSamples);
     }
 }
 
-void audioCallback(void *userdata, uint8_t *stream, int32_t len)
+// hands the current voice state over to the scopes, timestamped with the output position
+static void publishScopeSnapshot(uint64_t clockPos, uint64_t clockTime64)
 {
-    int16_t *out;
-    int32_t sampleBlock, samplesTodo;
+    uint8_t i;
+    scopeSnapshot_t *snap;
+    scopeVoice_t *sv;
+    paulaVoice_t *v;
 
-    (void)(userdata); // make compiler happy
+    snap = scopeGetSnapshotSlot();
 
-    if (forceMixerOff) // for MOD2WAV
+    snap->samplePos   = audioSamplePos;
+    snap->clockPos    = clockPos;
+    snap->clockTime64 = clockTime64;
+
+    for (i = 0; i < AMIGA_VOICES; ++i)
     {
-        memset(stream, 0, len); // mute
-        return;
+        v  = &paula[i];
+        sv = &snap->voice[i];
+
+        sv->active       = v->active;
+        sv->volume       = v->scopeVolume;
+        sv->data         = v->data;
+        sv->newData      = v->newData;
+        sv->length       = v->length;
+        sv->newLength    = v->newLength;
+        sv->phase        = v->phase;
+        sv->frac_f       = v->frac_f;
+        sv->delta_f      = v->delta_f;
+        sv->loopFlag     = v->loopFlag;
+        sv->newLoopFlag  = v->newLoopFlag;
+        sv->loopStart    = v->loopStart;
+        sv->newLoopStart = v->newLoopStart;
+        sv->didSwapData  = v->didSwapData;
     }
 
-    out = (int16_t *)(stream);
+    scopePublishSnapshot();
+}
+
+static void mixAudio(int16_t *out, int32_t sampleBlock, uint64_t clockTime64)
+{
+    int32_t samplesTodo, blockPos, notePos;
+    uint64_t clockPos;
+
+    clockPos = audioSamplePos;
+    blockPos = 0;
 
-    sampleBlock = len / 4;
     while (sampleBlock)
     {
+        notePos = startDueNotes(blockPos, clockTime64);
+
         samplesTodo = (sampleBlock < sampleCounter) ? sampleBlock : sampleCounter;
+        if ((notePos - blockPos) < samplesTodo)
+            samplesTodo = notePos - blockPos; // mix up to the next jammed note
+
         if (samplesTodo > 0)
         {
+            // once per replayer tick and buffer, the scopes extrapolate from there
+            publishScopeSnapshot(clockPos, clockTime64);
+
             outputAudio(out, samplesTodo);
             out += (2 * samplesTodo);
+            audioSamplePos += samplesTodo;
+            blockPos += samplesTodo;
 
             sampleBlock   -= samplesTodo;
             sampleCounter -= samplesTodo;
@@ -738,6 +943,42 @@ void audioCallback(void *userdata, uint8_t *stream, int32_t len)
     }
 }
 
+void audioCallback(void *userdata, uint8_t *stream, int32_t len)
+{
+    (void)(userdata); // make compiler happy
+
+    if (forceMixerOff) // for MOD2WAV
+    {
+        memset(stream, 0, len); // mute
+        return;
+    }
+
+    mixAudio((int16_t *)(stream), len / 4, SDL_GetPerformanceCounter());
+}
+
+// offscreen benchmark (pt_bench.c): the device is paused and audioMixOffline() is called per frame instead
+void audioSetOffline(void)
+{
+    if (dev > 0)
+        SDL_PauseAudioDevice(dev, true);
+}
+
+void audioMixOffline(int32_t numSamples)
+{
+    int16_t buffer[2 * 1024];
+    int32_t samplesTodo;
+
+    while (numSamples > 0)
+    {
+        samplesTodo = MIN(numSamples, 1024);
+
+        // with a clock time far in the past, the scopes show the start of the last block on every run
+        mixAudio(buffer, samplesTodo, 0);
+
+        numSamples -= samplesTodo;
+    }
+}
+
 static void calculateFilterCoeffs(void)
 {
     float lp_R, lp_C, lp_Hz;
@@ -864,6 +1105,13 @@ int8_t setupAudio(void)
         return (false);
     }
 
+    voiceBuffer_f = (float *)(calloc(maxSamplesToMix, sizeof (float)));
+    if (voiceBuffer_f == NULL)
+    {
+        showErrorMsgBox("Out of memory!");
+        return (false);
+    }
+
     editor.mod2WavBuffer = (int16_t *)(malloc(sizeof (int16_t) * maxSamplesToMix));
     if (editor.mod2WavBuffer == NULL)
     {
@@ -876,6 +1124,10 @@ int8_t setupAudio(void)
     editor.outputFreq       = ptConfig.soundFrequency;
     editor.outputFreq_f     = (float)(ptConfig.soundFrequency);
 
+    // jammed notes are delayed by one buffer, see paulaScheduleNote()
+    samplesPerCount_d = editor.outputFreq_f / (double)(SDL_GetPerformanceFrequency());
+    noteDelay64 = (uint64_t)((editor.audioBufferSize / samplesPerCount_d) + 0.5);
+
     mixerCalcVoicePans(ptConfig.stereoSeparation);
     defStereoSep = ptConfig.stereoSeparation;
 
@@ -917,6 +1169,12 @@ void audioClose(void)
         mixBufferR_f = NULL;
     }
 
+    if (voiceBuffer_f != NULL)
+    {
+        free(voiceBuffer_f);
+        voiceBuffer_f = NULL;
+    }
+
     if (editor.mod2WavBuffer != NULL)
     {
         free(editor.mod2WavBuffer);
@@ -1086,6 +1344,8 @@ int8_t renderToWav(char *fileName, int8_t checkIfFileExist)
     editor.isWAVRendering = true;
     renderMOD2WAVDialog();
 
+    meterReset();
+
     editor.abortMod2Wav = false;
     editor.mod2WavThread = SDL_CreateThread(mod2WavThreadFunc, "mod2wav ProTracker thread", fOut);
 
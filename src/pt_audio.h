@@ -36,14 +36,21 @@ void paulaSetPeriod(uint8_t ch, uint16_t period);
 void paulaSetVolume(uint8_t ch, uint16_t vol);
 void paulaSetLength(uint8_t ch, uint32_t len);
 void paulaSetData(uint8_t ch, const int8_t *src);
+void paulaSetScopeLoop(uint8_t ch, int8_t loopFlag, int32_t loopStart);
+void paulaScheduleNote(uint8_t ch, uint64_t eventTime64);
 
+void lockAudio(void);
+void unlockAudio(void);
 void clearPaulaAndScopes(void);
 void mixerUpdateLoops(void);
 void mixerKillVoice(uint8_t ch);
+int8_t mixerVoicesActive(void);
 void turnOffVoices(void);
 void mixerCalcVoicePans(uint8_t stereoSeparation);
 void mixerSetSamplesPerTick(int32_t val);
 void mixerClearSampleCounter(void);
 void outputAudio(int16_t *target, int32_t numSamples);
+void audioSetOffline(void);
+void audioMixOffline(int32_t numSamples);
 
 #endif
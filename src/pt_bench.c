@@ -0,0 +1,668 @@
+/*
+** Offscreen GUI benchmark: protracker --benchmark [--script <file>] [--dump <folder>] [module]
+**
+** Runs the GUI without a window or sound card (SDL's dummy drivers). Frames
+** are rendered into pixelBuffer back to back, and the mixer and the 50Hz
+** timer are run from the frame loop (1/60th of a second per frame) instead of
+** the audio device and SDL timer, so playback, scopes and the song timer come
+** out the same on every run. The sequence is read from a script, one command
+** per line ('#' starts a comment line):
+**
+**   load <file>            load a module
+**   play [pattern]         play the song (or the current pattern)
+**   stop                   stop playing
+**   frames <n>             render n frames
+**   key [mods+]<key>       press a key, by SDL key name ("ALT+F12", "Right Alt").
+**                          Modifiers are CTRL, ALT, SHIFT and AMIGA
+**   click <x> <y> [right]  click a mouse button at a screen position
+**   dump <name>            save the last frame as <folder>/<name>.png (with --dump)
+**
+** Without --script, the built-in script below is used. When done, the frame
+** times of each part of renderFrame() are printed as percentiles.
+*/
+
+#include <SDL2/SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include "pt_header.h"
+#include "pt_helpers.h"
+#include "pt_audio.h"
+#include "pt_keyboard.h"
+#include "pt_mouse.h"
+#include "pt_palette.h"
+#include "pt_textout.h"
+#include "pt_scopes.h"
+#include "pt_samplebatch.h"
+#include "pt_visuals.h"
+#include "pt_modloader.h"
+#include "pt_bench.h"
+
+#define SCRIPT_LINE_LEN 256
+#define TICKS_50HZ 50
+
+extern uint32_t *pixelBuffer; // pt_main.c
+int8_t loadModFromArg(char *arg); // pt_main.c
+void runInputTick(void); // pt_main.c
+void runLogicTick(void);
+
+static const char *defaultScript[] =
+{
+    "play",
+    "frames 600",
+    "dump main",
+    "click 200 70", // spectrum analyzer
+    "frames 600",
+    "dump spectrum",
+    "click 200 70", // monoscope
+    "click 200 70", // back to quadrascope
+    "key ALT+S",
+    "frames 600",
+    "dump sampler",
+    "key ESCAPE",
+    "key ALT+D",
+    "frames 300",
+    "dump diskop",
+    "key ESCAPE",
+    "key ALT+F12",
+    "frames 300",
+    "dump terminal",
+    "key ALT+F12",
+    "frames 300",
+    "stop",
+    NULL
+};
+
+static const char *sectionNames[BENCH_SECTIONS] =
+{
+    "Song info", "Pattern", "Disk op.", "Sampler", "Scopes", "Terminal", "Other", "Present", "Frame"
+};
+
+static int8_t active;
+static char *scriptPath, *dumpPath, *modulePath;
+static uint32_t numFrames, maxFrames, audioFrac, ticksFrac;
+static uint64_t lapTime64, frameTicks[BENCH_SECTIONS];
+static float *frameTimes[BENCH_SECTIONS]; // in ms, one per frame
+static double perfFreqMs;
+
+int8_t benchParseArgs(int32_t argc, char **argv)
+{
+    int32_t i;
+
+    for (i = 2; i < argc; ++i)
+    {
+        if ((strcmp(argv[i], "--script") == 0) && ((i + 1) < argc))
+            scriptPath = argv[++i];
+        else if ((strcmp(argv[i], "--dump") == 0) && ((i + 1) < argc))
+            dumpPath = argv[++i];
+        else if ((argv[i][0] != '-') && (modulePath == NULL))
+            modulePath = argv[i];
+        else
+            break;
+    }
+
+    if (i < argc)
+    {
+        fprintf(stderr, "Usage: protracker --benchmark [--script <file>] [--dump <folder>] [module]\n");
+        return (false);
+    }
+
+    active = true;
+    return (true);
+}
+
+void benchLap(int8_t section)
+{
+    uint64_t time64;
+
+    if (!active)
+        return;
+
+    time64 = SDL_GetPerformanceCounter();
+    frameTicks[section] += time64 - lapTime64;
+    lapTime64 = time64;
+}
+
+static int8_t storeFrameTimes(void)
+{
+    int8_t i;
+    float *newTimes;
+
+    if (numFrames == maxFrames)
+    {
+        maxFrames = (maxFrames == 0) ? 4096 : (maxFrames * 2);
+
+        for (i = 0; i < BENCH_SECTIONS; ++i)
+        {
+            newTimes = (float *)(realloc(frameTimes[i], maxFrames * sizeof (float)));
+            if (newTimes == NULL)
+                return (false);
+
+            frameTimes[i] = newTimes;
+        }
+    }
+
+    for (i = 0; i < BENCH_SECTIONS; ++i)
+        frameTimes[i][numFrames] = (float)(frameTicks[i] / perfFreqMs);
+
+    numFrames++;
+    return (true);
+}
+
+// mixes one frame's worth of audio and runs the 50Hz timer, on the benchmark's own clock
+static void advanceClock(void)
+{
+    int32_t numSamples;
+
+    audioFrac += editor.outputFreq;
+    numSamples = audioFrac / VBLANK_HZ;
+    audioFrac -= numSamples * VBLANK_HZ;
+
+    audioMixOffline(numSamples);
+
+    ticksFrac += TICKS_50HZ;
+    while (ticksFrac >= VBLANK_HZ)
+    {
+        ticksFrac -= VBLANK_HZ;
+        _50HzCallBack(0, NULL);
+    }
+}
+
+// one iteration of the main loop, minus the input polling and the frame pacing
+static int8_t runFrame(void)
+{
+    uint64_t frameStart64;
+
+    advanceClock();
+    runInputTick(); // frames are 1/60th of a second here, so one tick each
+    runLogicTick();
+
+    memset(frameTicks, 0, sizeof (frameTicks));
+    frameStart64 = SDL_GetPerformanceCounter();
+    lapTime64 = frameStart64;
+
+    sampleBatchUpdate();
+    updateBackgroundTasks();
+    benchLap(BENCH_OTHER);
+
+    updateScopes();
+    benchLap(BENCH_SCOPES);
+
+    renderFrame(); // laps for the rest are in there
+
+    flipFrame();
+    benchLap(BENCH_PRESENT);
+
+    frameTicks[BENCH_FRAME] = lapTime64 - frameStart64;
+
+    return (storeFrameTimes());
+}
+
+static uint32_t crc32Table[256];
+
+static uint32_t updateCRC32(uint32_t crc, const uint8_t *data, uint32_t len)
+{
+    uint32_t i, j, c;
+
+    if (crc32Table[1] == 0)
+    {
+        for (i = 0; i < 256; ++i)
+        {
+            c = i;
+            for (j = 0; j < 8; ++j)
+                c = (c & 1) ? (0xEDB88320 ^ (c >> 1)) : (c >> 1);
+
+            crc32Table[i] = c;
+        }
+    }
+
+    crc = ~crc;
+    for (i = 0; i < len; ++i)
+        crc = crc32Table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+
+    return (~crc);
+}
+
+static void putBE32(uint8_t *dst, uint32_t x)
+{
+    dst[0] = (uint8_t)(x >> 24);
+    dst[1] = (uint8_t)(x >> 16);
+    dst[2] = (uint8_t)(x >>  8);
+    dst[3] = (uint8_t)(x);
+}
+
+static int8_t writeChunk(FILE *f, const char *type, const uint8_t *data, uint32_t len)
+{
+    uint8_t header[8], crc[4];
+
+    putBE32(header, len);
+    memcpy(&header[4], type, 4);
+    putBE32(crc, updateCRC32(updateCRC32(0, &header[4], 4), data, len));
+
+    return ((fwrite(header, 1, 8, f) == 8) && (fwrite(data, 1, len, f) == len) && (fwrite(crc, 1, 4, f) == 4));
+}
+
+/* Saves an ARGB frame as a 24-bit PNG. The image data is put in stored
+** (uncompressed) deflate blocks, which is plenty for pixel comparisons and
+** doesn't need zlib.
+*/
+static int8_t savePNG(const char *path, const uint32_t *frame)
+{
+    const uint8_t pngSignature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    int8_t result;
+    uint8_t ihdr[13], *raw, *idat, *dst;
+    uint32_t x, y, rowLen, rawLen, idatLen, blockLen, pos, adlerA, adlerB, pixel;
+    FILE *f;
+
+    rowLen = 1 + (SCREEN_W * 3); // filter type + RGB
+    rawLen = rowLen * SCREEN_H;
+    idatLen = 2 + rawLen + (((rawLen + 65534) / 65535) * 5) + 4;
+
+    raw  = (uint8_t *)(malloc(rawLen));
+    idat = (uint8_t *)(malloc(idatLen));
+
+    if ((raw == NULL) || (idat == NULL))
+    {
+        if (raw  != NULL) free(raw);
+        if (idat != NULL) free(idat);
+
+        return (false);
+    }
+
+    dst = raw;
+    for (y = 0; y < SCREEN_H; ++y)
+    {
+        *dst++ = 0;
+        for (x = 0; x < SCREEN_W; ++x)
+        {
+            pixel = *frame++;
+
+            *dst++ = (uint8_t)(pixel >> 16);
+            *dst++ = (uint8_t)(pixel >>  8);
+            *dst++ = (uint8_t)(pixel);
+        }
+    }
+
+    // zlib stream: header, stored blocks, Adler-32
+    dst = idat;
+    *dst++ = 0x78;
+    *dst++ = 0x01;
+
+    for (pos = 0; pos < rawLen; pos += blockLen)
+    {
+        blockLen = MIN(rawLen - pos, 65535);
+
+        *dst++ = ((pos + blockLen) == rawLen) ? 1 : 0; // last block flag
+        *dst++ = (uint8_t)(blockLen);
+        *dst++ = (uint8_t)(blockLen >> 8);
+        *dst++ = (uint8_t)(~blockLen);
+        *dst++ = (uint8_t)(~blockLen >> 8);
+
+        memcpy(dst, &raw[pos], blockLen);
+        dst += blockLen;
+    }
+
+    adlerA = 1;
+    adlerB = 0;
+
+    for (pos = 0; pos < rawLen; ++pos)
+    {
+        adlerA = (adlerA + raw[pos]) % 65521;
+        adlerB = (adlerB + adlerA) % 65521;
+    }
+
+    putBE32(dst, (adlerB << 16) | adlerA);
+
+    putBE32(&ihdr[0], SCREEN_W);
+    putBE32(&ihdr[4], SCREEN_H);
+    ihdr[8]  = 8; // bits per channel
+    ihdr[9]  = 2; // RGB
+    ihdr[10] = 0;
+    ihdr[11] = 0;
+    ihdr[12] = 0;
+
+    result = false;
+
+    f = fopen(path, "wb");
+    if (f != NULL)
+    {
+        result = (fwrite(pngSignature, 1, 8, f) == 8) &&
+            writeChunk(f, "IHDR", ihdr, 13) &&
+            writeChunk(f, "IDAT", idat, idatLen) &&
+            writeChunk(f, "IEND", NULL, 0);
+
+        if (fclose(f) != 0)
+            result = false;
+    }
+
+    free(raw);
+    free(idat);
+
+    return (result);
+}
+
+static int8_t dumpFrame(const char *name)
+{
+    char *path;
+    int8_t result;
+
+    if (dumpPath == NULL)
+        return (true); // not asked for
+
+    path = (char *)(malloc(strlen(dumpPath) + 1 + strlen(name) + 5));
+    if (path == NULL)
+        return (false);
+
+    sprintf(path, "%s/%s.png", dumpPath, name);
+
+    result = savePNG(path, getPresentedFrame());
+    if (!result)
+        fprintf(stderr, "Couldn't write \"%s\"\n", path);
+
+    free(path);
+    return (result);
+}
+
+static int8_t pressKey(const char *keyName)
+{
+    const char *plus;
+    int8_t ctrl, alt, shift, amiga, result;
+    SDL_Scancode scancode;
+
+    ctrl  = false;
+    alt   = false;
+    shift = false;
+    amiga = false;
+
+    // modifier prefixes
+    while ((plus = strchr(keyName, '+')) != NULL)
+    {
+             if (((plus - keyName) == 4) && !SDL_strncasecmp(keyName, "CTRL",  4)) ctrl  = true;
+        else if (((plus - keyName) == 3) && !SDL_strncasecmp(keyName, "ALT",   3)) alt   = true;
+        else if (((plus - keyName) == 5) && !SDL_strncasecmp(keyName, "SHIFT", 5)) shift = true;
+        else if (((plus - keyName) == 5) && !SDL_strncasecmp(keyName, "AMIGA", 5)) amiga = true;
+        else break; // part of the key name ("Keypad +")
+
+        keyName = plus + 1;
+    }
+
+    scancode = SDL_GetScancodeFromName(keyName);
+    if (scancode == SDL_SCANCODE_UNKNOWN)
+        return (false);
+
+    input.keyb.leftCtrlKeyDown  = ctrl;
+    input.keyb.leftAltKeyDown   = alt;
+    input.keyb.shiftKeyDown     = shift;
+    input.keyb.leftAmigaKeyDown = amiga;
+
+    keyDownHandler(scancode, SDL_GetKeyFromScancode(scancode));
+    result = runFrame();
+    keyUpHandler(scancode);
+
+    input.keyb.leftCtrlKeyDown  = false;
+    input.keyb.leftAltKeyDown   = false;
+    input.keyb.shiftKeyDown     = false;
+    input.keyb.leftAmigaKeyDown = false;
+
+    return (result);
+}
+
+static int8_t clickMouse(int32_t x, int32_t y, uint8_t button)
+{
+    int8_t result;
+
+    input.mouse.x = (int16_t)(CLAMP(x, 0, SCREEN_W - 1));
+    input.mouse.y = (int16_t)(CLAMP(y, 0, SCREEN_H - 1));
+    setSpritePos(SPRITE_MOUSE_POINTER, input.mouse.x, input.mouse.y);
+
+    mouseButtonDownHandler(button);
+    result = runFrame();
+    mouseButtonUpHandler(button);
+
+    return (result);
+}
+
+static void playModule(int8_t pattern)
+{
+    editor.playMode = pattern ? PLAY_MODE_PATTERN : PLAY_MODE_NORMAL;
+
+    if (pattern)
+        modPlay(modEntry->currPattern, DONT_SET_ORDER, DONT_SET_ROW);
+    else
+        modPlay(DONT_SET_PATTERN, modEntry->currOrder, DONT_SET_ROW);
+
+    editor.currMode = MODE_PLAY;
+    pointerSetMode(POINTER_MODE_PLAY, DO_CARRY);
+    setStatusMessage(editor.allRightText, DO_CARRY);
+}
+
+static void stopModule(void)
+{
+    modStop();
+
+    editor.currMode = MODE_IDLE;
+    pointerSetMode(POINTER_MODE_IDLE, DO_CARRY);
+    setStatusMessage(editor.allRightText, DO_CARRY);
+}
+
+// returns false on errors, which are printed with the line number
+static int8_t runCommand(char *line, uint32_t lineNum)
+{
+    char *cmd, *arg;
+    int32_t n, x, y;
+    uint32_t len;
+
+    // trim
+    while (isspace((uint8_t)(*line)))
+        line++;
+
+    len = (uint32_t)(strlen(line));
+    while ((len > 0) && isspace((uint8_t)(line[len - 1])))
+        line[--len] = '\0';
+
+    if ((line[0] == '\0') || (line[0] == '#'))
+        return (true);
+
+    cmd = line;
+    arg = line;
+
+    while ((*arg != '\0') && !isspace((uint8_t)(*arg)))
+        arg++;
+
+    if (*arg != '\0')
+    {
+        *arg++ = '\0';
+        while (isspace((uint8_t)(*arg)))
+            arg++;
+    }
+
+    if (strcmp(cmd, "load") == 0)
+    {
+        if (!loadModFromArg(arg))
+        {
+            fprintf(stderr, "line %u: couldn't load \"%s\"\n", lineNum, arg);
+            return (false);
+        }
+
+        displayMainScreen();
+        return (true);
+    }
+    else if (strcmp(cmd, "play") == 0)
+    {
+        playModule(strcmp(arg, "pattern") == 0);
+        return (true);
+    }
+    else if (strcmp(cmd, "stop") == 0)
+    {
+        stopModule();
+        return (true);
+    }
+    else if (strcmp(cmd, "frames") == 0)
+    {
+        n = atoi(arg);
+        while (n-- > 0)
+        {
+            if (!runFrame())
+                return (false);
+        }
+
+        return (true);
+    }
+    else if (strcmp(cmd, "key") == 0)
+    {
+        if (pressKey(arg))
+            return (true);
+
+        fprintf(stderr, "line %u: unknown key \"%s\"\n", lineNum, arg);
+        return (false);
+    }
+    else if (strcmp(cmd, "click") == 0)
+    {
+        if (sscanf(arg, "%d %d", &x, &y) == 2)
+            return (clickMouse(x, y, (strstr(arg, "right") != NULL) ? SDL_BUTTON_RIGHT : SDL_BUTTON_LEFT));
+    }
+    else if (strcmp(cmd, "dump") == 0)
+    {
+        if (arg[0] != '\0')
+            return (dumpFrame(arg));
+    }
+
+    fprintf(stderr, "line %u: bad command \"%s\"\n", lineNum, cmd);
+    return (false);
+}
+
+static int8_t runScript(void)
+{
+    char line[SCRIPT_LINE_LEN];
+    uint32_t lineNum;
+    FILE *f;
+
+    lineNum = 0;
+
+    if (scriptPath == NULL)
+    {
+        while (defaultScript[lineNum] != NULL)
+        {
+            strcpy(line, defaultScript[lineNum]);
+            if (!runCommand(line, ++lineNum))
+                return (false);
+        }
+
+        return (true);
+    }
+
+    f = fopen(scriptPath, "r");
+    if (f == NULL)
+    {
+        fprintf(stderr, "Couldn't open script \"%s\"\n", scriptPath);
+        return (false);
+    }
+
+    while (fgets(line, sizeof (line), f) != NULL)
+    {
+        if (!runCommand(line, ++lineNum))
+        {
+            fclose(f);
+            return (false);
+        }
+    }
+
+    fclose(f);
+    return (true);
+}
+
+static int compareFloats(const void *a, const void *b)
+{
+    float x, y;
+
+    x = *(const float *)(a);
+    y = *(const float *)(b);
+
+    return ((x > y) - (x < y));
+}
+
+static float percentile(const float *sorted, uint32_t num, uint32_t p)
+{
+    return (sorted[((num - 1) * p) / 100]);
+}
+
+static void printReport(double wallTimeMs)
+{
+    int8_t i;
+    uint32_t j;
+    double sum;
+    float *sorted;
+
+    printf("%u frames in %.1fms (%.1f frames/s)\n\n", numFrames, wallTimeMs, (wallTimeMs > 0.0) ? (numFrames / (wallTimeMs / 1000.0)) : 0.0);
+    printf("%-10s %9s %9s %9s %9s %9s %9s\n", "section", "mean", "p50", "p90", "p99", "p99.9", "max");
+
+    sorted = (float *)(malloc(numFrames * sizeof (float)));
+    if (sorted == NULL)
+        return;
+
+    for (i = 0; i < BENCH_SECTIONS; ++i)
+    {
+        memcpy(sorted, frameTimes[i], numFrames * sizeof (float));
+        qsort(sorted, numFrames, sizeof (float), compareFloats);
+
+        sum = 0.0;
+        for (j = 0; j < numFrames; ++j)
+            sum += sorted[j];
+
+        printf("%-10s %8.4fms %8.4fms %8.4fms %8.4fms %8.4fms %8.4fms\n", sectionNames[i], sum / numFrames,
+            percentile(sorted, numFrames, 50), percentile(sorted, numFrames, 90), percentile(sorted, numFrames, 99),
+            sorted[((numFrames - 1) * 999) / 1000], sorted[numFrames - 1]);
+    }
+
+    free(sorted);
+}
+
+int32_t benchRun(void)
+{
+    int8_t i, result;
+    uint64_t timeStart;
+
+    perfFreqMs = (double)(SDL_GetPerformanceFrequency()) / 1000.0;
+
+    if (modulePath != NULL)
+    {
+        if (!loadModFromArg(modulePath))
+        {
+            fprintf(stderr, "Couldn't load \"%s\"\n", modulePath);
+            return (1);
+        }
+
+        displayMainScreen();
+    }
+
+    timeStart = SDL_GetPerformanceCounter();
+    result = runScript();
+
+    if (result && (numFrames > 0))
+        printReport((double)(SDL_GetPerformanceCounter() - timeStart) / perfFreqMs);
+
+    for (i = 0; i < BENCH_SECTIONS; ++i)
+    {
+        if (frameTimes[i] != NULL)
+        {
+            free(frameTimes[i]);
+            frameTimes[i] = NULL;
+        }
+    }
+
+    // let the background threads finish before cleanUp() frees what they use
+    if (editor.diskop.isFilling)
+    {
+        editor.diskop.isFilling = false;
+
+        editor.diskop.forceStopReading = true;
+        SDL_WaitThread(editor.diskop.fillThread, NULL);
+    }
+
+    waitForModSave();
+    sampleBatchWait();
+
+    return (result ? 0 : 1);
+}
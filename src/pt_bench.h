@@ -0,0 +1,26 @@
+#ifndef __PT_BENCH_H
+#define __PT_BENCH_H
+
+#include <stdint.h>
+
+// frame time sections, in the order renderFrame() draws them
+enum
+{
+    BENCH_SONG_INFO  = 0,
+    BENCH_PATTERN    = 1,
+    BENCH_DISK_OP    = 2,
+    BENCH_SAMPLER    = 3,
+    BENCH_SCOPES     = 4, // scopes/spectrum analyzer
+    BENCH_TERMINAL   = 5,
+    BENCH_OTHER      = 6, // dialogs, edit op., pos. ed. and the rest
+    BENCH_PRESENT    = 7, // sprites, VU meters and the dirty region search
+    BENCH_FRAME      = 8, // all of the above
+
+    BENCH_SECTIONS
+};
+
+int8_t benchParseArgs(int32_t argc, char **argv); // prints the usage and returns false on errors
+void benchLap(int8_t section); // adds the time since the last lap to a section, does nothing outside of the benchmark
+int32_t benchRun(void); // returns the exit code
+
+#endif
@@ -12,6 +12,7 @@
 #include "pt_audio.h"
 #include "pt_diskop.h"
 #include "pt_config.h"
+#include "pt_powerpacker.h"
 #include "pt_textout.h"
 
 FILE *loadPTDotConfig(void)
@@ -55,6 +56,9 @@ int8_t loadConfig(void)
     ptConfig.soundFrequency    = 48000;
     ptConfig.stereoSeparation  = 15;
     ptConfig.videoScaleFactor  = 2;
+    ptConfig.softwareVideo     = false;
+    ptConfig.vsync             = true;
+    ptConfig.frameRate         = 0; // display's refresh rate
     ptConfig.blepSynthesis     = true;
     ptConfig.realVuMeters      = false;
     ptConfig.modDot            = false;
@@ -64,8 +68,10 @@ int8_t loadConfig(void)
     ptConfig.blankZeroFlag     = false;
     ptConfig.compoMode         = false;
     ptConfig.soundBufferSize   = 1024;
-    ptConfig.vblankScopes      = false;
     ptConfig.autoCloseDiskOp   = true;
+    ptConfig.modPackEfficiency = PP_EFFICIENCY_BEST;
+    ptConfig.wavImportPeriod   = 0; // off
+    ptConfig.sampleUndoMem     = 16; // megabytes
 
     memset(ptConfig.defaultDiskOpDir, 0, PATH_MAX_LEN + 1);
 
@@ -134,13 +140,6 @@ int8_t loadConfig(void)
                 else if (strncmp(&configBuffer[16], "FALSE", 5) == 0) ptConfig.autoCloseDiskOp = false;
             }
 
-            // VBLANKSCOPES
-            else if (strncmp(configBuffer, "VBLANKSCOPES=", 13) == 0)
-            {
-                     if (strncmp(&configBuffer[13], "TRUE",  4) == 0) ptConfig.vblankScopes = true;
-                else if (strncmp(&configBuffer[13], "FALSE", 5) == 0) ptConfig.vblankScopes = false;
-            }
-
             // COMPOMODE
             else if (strncmp(configBuffer, "COMPOMODE=", 10) == 0)
             {
@@ -204,6 +203,47 @@ int8_t loadConfig(void)
                 else if (strncmp(&configBuffer[7], "FALSE", 5) == 0) ptConfig.modDot = false;
             }
 
+            // PACKEFFICIENCY
+            else if (strncmp(configBuffer, "PACKEFFICIENCY=", 15) == 0)
+            {
+                     if (strncmp(&configBuffer[15], "FAST",     4) == 0) ptConfig.modPackEfficiency = PP_EFFICIENCY_FAST;
+                else if (strncmp(&configBuffer[15], "MEDIOCRE", 8) == 0) ptConfig.modPackEfficiency = PP_EFFICIENCY_MEDIOCRE;
+                else if (strncmp(&configBuffer[15], "GOOD",     4) == 0) ptConfig.modPackEfficiency = PP_EFFICIENCY_GOOD;
+                else if (strncmp(&configBuffer[15], "VERYGOOD", 8) == 0) ptConfig.modPackEfficiency = PP_EFFICIENCY_VERYGOOD;
+                else if (strncmp(&configBuffer[15], "BEST",     4) == 0) ptConfig.modPackEfficiency = PP_EFFICIENCY_BEST;
+            }
+
+            // WAVIMPORTTARGET
+            else if (strncmp(configBuffer, "WAVIMPORTTARGET=", 16) == 0)
+            {
+                if (strncmp(&configBuffer[16], "OFF", 3) == 0)
+                {
+                    ptConfig.wavImportPeriod = 0;
+                }
+                else if ((configBuffer[16] >= '0') && (configBuffer[16] <= '9'))
+                {
+                    ptConfig.wavImportPeriod = (int16_t)(CLAMP(atoi(&configBuffer[16]), 113, 856));
+                }
+                else
+                {
+                    for (i = 0; i < 36; ++i)
+                    {
+                        if (strncmp(&configBuffer[16], noteNames1[i], 3) == 0)
+                        {
+                            ptConfig.wavImportPeriod = periodTable[i];
+                            break;
+                        }
+                    }
+                }
+            }
+
+            // SAMPLEUNDOMEM
+            else if (strncmp(configBuffer, "SAMPLEUNDOMEM=", 14) == 0)
+            {
+                if (configBuffer[14] != '\0')
+                    ptConfig.sampleUndoMem = (uint32_t)(CLAMP(atoi(&configBuffer[14]), 1, 256));
+            }
+
             // SCALE3X (deprecated)
             else if (strncmp(configBuffer, "SCALE3X=", 8) == 0)
             {
@@ -225,6 +265,27 @@ int8_t loadConfig(void)
                 else if (strncmp(&configBuffer[11], "9X", 2) == 0) ptConfig.videoScaleFactor = 9;
             }
 
+            // SOFTWAREVIDEO
+            else if (strncmp(configBuffer, "SOFTWAREVIDEO=", 14) == 0)
+            {
+                     if (strncmp(&configBuffer[14], "TRUE",  4) == 0) ptConfig.softwareVideo = true;
+                else if (strncmp(&configBuffer[14], "FALSE", 5) == 0) ptConfig.softwareVideo = false;
+            }
+
+            // VSYNC
+            else if (strncmp(configBuffer, "VSYNC=", 6) == 0)
+            {
+                     if (strncmp(&configBuffer[6], "TRUE",  4) == 0) ptConfig.vsync = true;
+                else if (strncmp(&configBuffer[6], "FALSE", 5) == 0) ptConfig.vsync = false;
+            }
+
+            // FRAMERATE
+            else if (strncmp(configBuffer, "FRAMERATE=", 10) == 0)
+            {
+                if (configBuffer[10] != '\0')
+                    ptConfig.frameRate = (int16_t)(CLAMP(atoi(&configBuffer[10]), 0, 500));
+            }
+
             // BLEP
             else if (strncmp(configBuffer, "BLEP=", 5) == 0)
             {
@@ -286,18 +347,21 @@ int8_t loadConfig(void)
         free(configBuffer);
     }
 
-    editor.ui.pattDots         = ptConfig.pattDots;
-    editor.ui.dottedCenterFlag = ptConfig.dottedCenterFlag;
-    editor.ui.videoScaleFactor = ptConfig.videoScaleFactor;
-    editor.ui.realVuMeters     = ptConfig.realVuMeters;
-    editor.diskop.modDot       = ptConfig.modDot;
-    editor.blepSynthesis       = ptConfig.blepSynthesis;
-    editor.ui.blankZeroFlag    = ptConfig.blankZeroFlag;
-    editor.accidental          = ptConfig.accidental;
-    editor.quantizeValue       = ptConfig.quantizeValue;
-    editor.transDelFlag        = ptConfig.transDel;
-    editor.compoMode           = ptConfig.compoMode;
-    editor.oldTempo            = editor.initialTempo;
+    editor.ui.pattDots              = ptConfig.pattDots;
+    editor.ui.dottedCenterFlag      = ptConfig.dottedCenterFlag;
+    editor.ui.videoScaleFactor      = ptConfig.videoScaleFactor;
+    editor.ui.realVuMeters          = ptConfig.realVuMeters;
+    editor.diskop.modDot            = ptConfig.modDot;
+    editor.diskop.modPackEfficiency = ptConfig.modPackEfficiency;
+    editor.wavImportPeriod          = ptConfig.wavImportPeriod;
+    editor.sampleUndoMemLimit       = ptConfig.sampleUndoMem * (1024 * 1024);
+    editor.blepSynthesis            = ptConfig.blepSynthesis;
+    editor.ui.blankZeroFlag         = ptConfig.blankZeroFlag;
+    editor.accidental               = ptConfig.accidental;
+    editor.quantizeValue            = ptConfig.quantizeValue;
+    editor.transDelFlag             = ptConfig.transDel;
+    editor.compoMode                = ptConfig.compoMode;
+    editor.oldTempo                 = editor.initialTempo;
 
     // Load PT.Config (if available)
     ptConfigFound = false;
@@ -7,10 +7,11 @@ struct ptConfig_t
 {
     char *defaultDiskOpDir;
     int8_t dottedCenterFlag, pattDots, a500LowPassFilter, compoMode, autoCloseDiskOp;
-    int8_t stereoSeparation, videoScaleFactor, blepSynthesis, transDel;
-    int8_t modDot, accidental, blankZeroFlag, realVuMeters, vblankScopes;
-    int16_t quantizeValue;
-    uint32_t soundFrequency, soundBufferSize;
+    int8_t stereoSeparation, videoScaleFactor, softwareVideo, blepSynthesis, transDel;
+    int8_t modDot, accidental, blankZeroFlag, realVuMeters, modPackEfficiency;
+    int8_t vsync;
+    int16_t quantizeValue, wavImportPeriod, frameRate;
+    uint32_t soundFrequency, soundBufferSize, sampleUndoMem;
 } ptConfig;
 
 int8_t loadConfig();
@@ -1,5 +1,6 @@
 #include <SDL2/SDL.h>
 #include <stdint.h>
+#include <string.h>
 #include <ctype.h> // tolower()
 #include <fcntl.h>
 #include <sys/types.h>
@@ -19,16 +20,17 @@
 #include "pt_diskop.h"
 #include "pt_mouse.h"
 #include "pt_sampler.h"
+#include "pt_sampleundo.h"
 #include "pt_visuals.h"
 #include "pt_keyboard.h"
 #include "pt_scopes.h"
+#include "pt_modloader.h"
+#include "pt_edit.h"
 
 void setPattern(int16_t pattern); // pt_modplayer.c
 
 void jamAndPlaceSample(SDL_Keycode keyEntry, int8_t normalModes);
 uint8_t quantizeCheck(uint8_t row);
-uint8_t handleSpecialKeys(SDL_Scancode keyEntry);
-int8_t keyToNote(SDL_Keycode keyEntry);
 
 // used for re-rendering text object while editing it
 void updateTextObject(int16_t editObject)
@@ -320,6 +322,9 @@ void exitGetTextLine(uint8_t updateValue)
                     if (editor.ui.tmpDisp16 > (MAX_PATTERNS - 1))
                         editor.ui.tmpDisp16 =  MAX_PATTERNS - 1;
 
+                    if (!modAllocPattern(editor.ui.tmpDisp16))
+                        break;
+
                     modEntry->head.order[posEdPos] = editor.ui.tmpDisp16;
 
                     updateWindowTitle(MOD_IS_MODIFIED);
@@ -368,7 +373,7 @@ void exitGetTextLine(uint8_t updateValue)
                     if (tmp16 > (MAX_PATTERNS - 1))
                         tmp16 =  MAX_PATTERNS - 1;
 
-                    if (modEntry->head.order[modEntry->currOrder] != tmp16)
+                    if ((modEntry->head.order[modEntry->currOrder] != tmp16) && modAllocPattern(tmp16))
                     {
                         modEntry->head.order[modEntry->currOrder] = tmp16;
 
@@ -703,6 +708,7 @@ void handleEditKeys(SDL_Scancode keyEntry, int8_t normalMode)
                 key += hexKey;
             }
 
+            saveUndo();
             note = &modEntry->patterns[modEntry->currPattern][(modEntry->currRow * AMIGA_VOICES) + editor.cursor.channel];
 
             switch (editor.cursor.mode)
@@ -787,6 +793,7 @@ void handleEditKeys(SDL_Scancode keyEntry, int8_t normalMode)
         {
             if ((editor.currMode == MODE_EDIT) || (editor.currMode == MODE_RECORD))
             {
+                saveUndo();
                 note = &modEntry->patterns[modEntry->currPattern][(modEntry->currRow * AMIGA_VOICES) + editor.cursor.channel];
 
                 if (!input.keyb.leftAltKeyDown)
@@ -820,6 +827,8 @@ uint8_t handleSpecialKeys(SDL_Scancode keyEntry)
 
     if (input.keyb.leftAltKeyDown)
     {
+        saveUndo();
+
         note     = &modEntry->patterns[modEntry->currPattern][(modEntry->currRow * AMIGA_VOICES) + editor.cursor.channel];
         prevNote = &modEntry->patterns[modEntry->currPattern][(((modEntry->currRow - 1) & 0x3F) * AMIGA_VOICES) + editor.cursor.channel];
 
@@ -922,15 +931,8 @@ void jamAndPlaceSample(SDL_Keycode keyEntry, int8_t normalMode)
                     if (chn->n_length == 0)
                         chn->n_length = 2;
 
-                    paulaSetVolume(ch, chn->n_volume);
-                    paulaSetPeriod(ch, chn->n_period);
-                    paulaSetData(ch,   chn->n_start);
-                    paulaSetLength(ch, chn->n_length);
-                    paulaRestartDMA(ch);
-
-                    // these take effect after the current DMA cycle is done
-                    paulaSetData(ch,   chn->n_loopstart);
-                    paulaSetLength(ch, chn->n_replen);
+                    // the mixer starts it at a fixed delay from the key press
+                    paulaScheduleNote(ch, input.eventTime64);
                 }
             }
         }
@@ -943,6 +945,8 @@ void jamAndPlaceSample(SDL_Keycode keyEntry, int8_t normalMode)
                 // insert note and sample number
                 if (!editor.ui.samplerScreenShown && ((editor.currMode == MODE_EDIT) || (editor.currMode == MODE_RECORD)))
                 {
+                    saveUndo();
+
                     note->sample = editor.sampleZero ? 0 : (editor.currSample + 1);
                     note->period = cleanPeriod;
 
@@ -966,8 +970,6 @@ void jamAndPlaceSample(SDL_Keycode keyEntry, int8_t normalMode)
                 updateCursorPos();
             }
         }
-
-        updateSpectrumAnalyzer(editor.cursor.channel, s->volume, tempPeriod);
     }
     else if (noteVal == -2)
     {
@@ -977,6 +979,8 @@ void jamAndPlaceSample(SDL_Keycode keyEntry, int8_t normalMode)
         {
             if (!editor.ui.samplerScreenShown && ((editor.currMode == MODE_EDIT) || (editor.currMode == MODE_RECORD)))
             {
+                saveUndo();
+
                 note->period = 0;
                 note->sample = 0;
 
@@ -1024,28 +1028,203 @@ uint8_t quantizeCheck(uint8_t row)
     return (row);
 }
 
+/* Pattern undo history.
+**
+** saveUndo() is called right before the current pattern is changed. It only
+** takes a snapshot (editor.undoBuffer), the snapshot is compared against the
+** pattern when the next snapshot is taken or undo/redo is used, and the changed
+** cells (before and after values) are stored as one undo step. Cells and step
+** headers live in two fixed rings, the oldest steps are dropped when either of
+** them runs full. Everything done during one record mode take in a pattern
+** becomes one step.
+*/
+
+#define UNDO_MAX_STEPS 256   // must be a power of two
+#define UNDO_MAX_CELLS 16384 // must be a power of two
+
+typedef struct undoCell_t
+{
+    uint16_t pos;
+    note_t before, after;
+} undoCell_t;
+
+typedef struct undoStep_t
+{
+    uint32_t firstCell;
+    uint16_t numCells;
+    uint8_t pattern;
+} undoStep_t;
+
+static undoCell_t undoCells[UNDO_MAX_CELLS];
+static undoStep_t undoSteps[UNDO_MAX_STEPS];
+
+// running counters, step n is in undoSteps[n & (UNDO_MAX_STEPS - 1)]. Steps below undoCurrStep can be undone, the rest redone
+static uint32_t undoFirstStep, undoCurrStep, undoEndStep, undoFirstCell, undoEndCell;
+static int16_t undoPattern = -1; // pattern of the pending snapshot, -1 = none
+static int8_t undoRecordTake;
+
+static inline int8_t noteChanged(const note_t *a, const note_t *b)
+{
+    return (memcmp(a, b, sizeof (note_t)) != 0);
+}
+
+static void dropOldestUndoStep(void)
+{
+    undoFirstStep++;
+    undoFirstCell = (undoFirstStep != undoEndStep) ? undoSteps[undoFirstStep & (UNDO_MAX_STEPS - 1)].firstCell : undoEndCell;
+}
+
+// turns the pending snapshot into an undo step
+static void commitUndo(void)
+{
+    uint8_t pattern;
+    uint16_t i, numCells;
+    note_t *patt;
+    undoStep_t *step;
+    undoCell_t *cell;
+
+    if (undoPattern < 0)
+        return;
+
+    pattern = (uint8_t)(undoPattern);
+    patt = modEntry->patterns[pattern];
+    undoPattern = -1;
+
+    numCells = 0;
+    for (i = 0; i < (MOD_ROWS * AMIGA_VOICES); ++i)
+    {
+        if (noteChanged(&patt[i], &editor.undoBuffer[i]))
+            numCells++;
+    }
+
+    if (numCells == 0)
+        return;
+
+    // a new change drops everything that could have been redone
+    if (undoCurrStep != undoEndStep)
+    {
+        undoEndCell = undoSteps[undoCurrStep & (UNDO_MAX_STEPS - 1)].firstCell;
+        undoEndStep = undoCurrStep;
+    }
+
+    while ((undoFirstStep != undoEndStep) && (((undoEndStep - undoFirstStep) >= UNDO_MAX_STEPS) ||
+           ((undoEndCell - undoFirstCell) + numCells) > UNDO_MAX_CELLS))
+    {
+        dropOldestUndoStep();
+    }
+
+    step = &undoSteps[undoEndStep & (UNDO_MAX_STEPS - 1)];
+    step->firstCell = undoEndCell;
+    step->numCells  = numCells;
+    step->pattern   = pattern;
+
+    for (i = 0; i < (MOD_ROWS * AMIGA_VOICES); ++i)
+    {
+        if (noteChanged(&patt[i], &editor.undoBuffer[i]))
+        {
+            cell = &undoCells[undoEndCell++ & (UNDO_MAX_CELLS - 1)];
+            cell->pos    = i;
+            cell->before = editor.undoBuffer[i];
+            cell->after  = patt[i];
+        }
+    }
+
+    undoEndStep++;
+    undoCurrStep = undoEndStep;
+}
+
 void saveUndo(void)
 {
+    // keep the snapshot from the start of the take while recording into the same pattern
+    if ((editor.currMode == MODE_RECORD) && undoRecordTake && (undoPattern == modEntry->currPattern))
+        return;
+
+    commitUndo();
+
     memcpy(editor.undoBuffer, modEntry->patterns[modEntry->currPattern], sizeof (note_t) * (AMIGA_VOICES * MOD_ROWS));
+
+    undoPattern    = modEntry->currPattern;
+    undoRecordTake = (editor.currMode == MODE_RECORD);
 }
 
-void undoLastChange(void)
+// Recording stopped or playback was (re)started, so the take is over. Its
+// edits become one undo step and the next take gets its own.
+void endUndoTake(void)
+{
+    if (undoRecordTake)
+    {
+        commitUndo();
+        undoRecordTake = false;
+    }
+}
+
+void resetUndo(void)
+{
+    undoFirstStep  = 0;
+    undoCurrStep   = 0;
+    undoEndStep    = 0;
+    undoFirstCell  = 0;
+    undoEndCell    = 0;
+    undoPattern    = -1;
+    undoRecordTake = false;
+}
+
+static void applyUndoStep(const undoStep_t *step, int8_t redo)
 {
     uint16_t i;
-    note_t data;
+    note_t *patt;
+    const undoCell_t *cell;
 
-    for (i = 0; i < (MOD_ROWS * AMIGA_VOICES); ++i)
-    {
-        data = editor.undoBuffer[i];
-        editor.undoBuffer[i] = modEntry->patterns[modEntry->currPattern][i];
+    if (!modAllocPattern(step->pattern))
+        return;
 
-        modEntry->patterns[modEntry->currPattern][i] = data;
+    patt = modEntry->patterns[step->pattern];
+    for (i = 0; i < step->numCells; ++i)
+    {
+        cell = &undoCells[(step->firstCell + i) & (UNDO_MAX_CELLS - 1)];
+        patt[cell->pos] = redo ? cell->after : cell->before;
     }
 
+    // show the pattern that was changed
+    if ((step->pattern != modEntry->currPattern) && !editor.songPlaying)
+        modSetPattern(step->pattern);
+
     updateWindowTitle(MOD_IS_MODIFIED);
     editor.ui.updatePatternData = true;
 }
 
+void undoLastChange(void)
+{
+    commitUndo();
+
+    if (undoCurrStep == undoFirstStep)
+    {
+        displayErrorMsg("NOTHING TO UNDO");
+        return;
+    }
+
+    undoCurrStep--;
+    applyUndoStep(&undoSteps[undoCurrStep & (UNDO_MAX_STEPS - 1)], false);
+
+    displayMsg("UNDO DONE !");
+}
+
+void redoLastChange(void)
+{
+    commitUndo();
+
+    if (undoCurrStep == undoEndStep)
+    {
+        displayErrorMsg("NOTHING TO REDO");
+        return;
+    }
+
+    applyUndoStep(&undoSteps[undoCurrStep & (UNDO_MAX_STEPS - 1)], true);
+    undoCurrStep++;
+
+    displayMsg("REDO DONE !");
+}
+
 void copySampleTrack(void)
 {
     uint8_t i, j;
@@ -1083,6 +1262,8 @@ void copySampleTrack(void)
         // copy sample data
         memcpy(&modEntry->sampleData[smpTo->offset], &modEntry->sampleData[smpFrom->offset], MAX_SAMPLE_LEN);
 
+        sampleUndoReset(editor.sampleTo - 1);
+
         updateCurrSample();
 
         editor.ui.updateSongSize = true;
@@ -1090,6 +1271,8 @@ void copySampleTrack(void)
     else
     {
         // copy sample number in track/pattern
+        saveUndo();
+
         if (editor.trackPattFlag == 0)
         {
             for (i = 0; i < MOD_ROWS; ++i)
@@ -1174,6 +1357,9 @@ void exchSampleTrack(void)
             modEntry->sampleData[smpTo->offset   + k] = smp;
         }
 
+        sampleUndoReset(editor.sampleFrom - 1);
+        sampleUndoReset(editor.sampleTo   - 1);
+
         editor.sampleZero = false;
 
         updateCurrSample();
@@ -1181,6 +1367,8 @@ void exchSampleTrack(void)
     else
     {
         // exchange sample number in track/pattern
+        saveUndo();
+
         if (editor.trackPattFlag == 0)
         {
             for (i = 0; i < MOD_ROWS; ++i)
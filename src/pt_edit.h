@@ -6,6 +6,9 @@
 
 void saveUndo(void);
 void undoLastChange(void);
+void redoLastChange(void);
+void endUndoTake(void);
+void resetUndo(void);
 void copySampleTrack(void);
 void delSampleTrack(void);
 void exchSampleTrack(void);
@@ -189,6 +189,9 @@ enum
     ASK_SAVE_ALL_SAMPLES      = 16,
     ASK_PAT2SMP               = 17,
     ASK_RESTORE_SAMPLE        = 18,
+    ASK_NORMALIZE_ALL_SAMPLES = 19,
+    ASK_DC_ALL_SAMPLES        = 20,
+    ASK_RESAMPLE_ALL_SAMPLES  = 21,
 
     TEMPO_MODE_CIA    = 0,
     TEMPO_MODE_VBLANK = 1,
@@ -221,10 +224,10 @@ typedef struct samplerChunk_t
     sampleLoop_t loop;
 } samplerChunk_t;
 
+// packed 4-byte pattern cell, same size as a cell in a .MOD file (see modCellsToNotes())
 typedef struct note_t
 {
-    uint8_t param, sample, command;
-    uint16_t period;
+    uint32_t param : 8, command : 4, period : 12, sample : 8;
 } note_t;
 
 typedef struct moduleHeader_t
@@ -268,9 +271,12 @@ typedef struct module_t
     uint16_t currBPM;
     uint32_t rowsCounter, rowsInTotal;
     moduleHeader_t head;
+    int16_t allocatedPatterns;
     moduleSample_t samples[MOD_SAMPLES];
-    note_t *patterns[MAX_PATTERNS];
+    note_t *patternStore; // one contiguous block holding patterns 0..allocatedPatterns-1
+    note_t *patterns[MAX_PATTERNS]; // pointers into patternStore (or a shared blank pattern)
     moduleChannel_t channels[AMIGA_VOICES];
+    uint32_t serial; // unique per module, see modFileNewSerial()
 } module_t;
 
 struct input_t
@@ -290,21 +296,25 @@ struct input_t
         uint8_t repeatCounter, repeatCounter_2, buttonWaitCounter;
         int32_t lastGUIButton, lastGUIButton_2, prevX, prevY;
         int16_t x, y, lastMouseX;
+        int32_t offsetX, offsetY;
         float scaleX_f, scaleY_f;
     } mouse;
+
+    uint64_t eventTime64; // when the event being handled happened, on the performance counter clock
 } input;
 
 // this is massive...
 struct editor_t
 {
     volatile int8_t vuMeterVolumes[AMIGA_VOICES];
-    volatile float realVuMeterVolumes[AMIGA_VOICES];
+    float realVuMeterVolumes[AMIGA_VOICES];
     volatile int8_t spectrumVolumes[SPECTRUM_BAR_NUM];
     volatile int8_t *sampleFromDisp;
     volatile int8_t *sampleToDisp;
     volatile int8_t *currSampleDisp;
     volatile uint8_t isWAVRendering;
     volatile uint8_t isSMPRendering;
+    volatile uint8_t isModSaving;
     volatile uint8_t smpRenderingDone;
     volatile uint8_t modTick;
     volatile uint8_t modSpeed;
@@ -331,8 +341,7 @@ struct editor_t
     char allRightText[10], *entryNameTmp, *currPath, *dropTempFileName;
     UNICHAR *fileNameTmp, *currPathU;
 
-    int8_t smpRedoFinetunes[MOD_SAMPLES], smpRedoVolumes[MOD_SAMPLES], multiModeNext[4];
-    int8_t *smpRedoBuffer[MOD_SAMPLES], *tempSample, errorMsgActive, errorMsgBlock, currSample;
+    int8_t multiModeNext[4], errorMsgActive, errorMsgBlock, currSample;
     int8_t metroFlag, recordMode, sampleFrom, multiFlag, sampleTo, keypadSampleOffset;
     int8_t keypadToggle8CFlag, normalizeFiltersFlag, sampleAllFlag, trackPattFlag, halfClipFlag;
     int8_t newOldFlag, pat2SmpHQ, note1, note2, note3, note4, oldNote1, oldNote2, oldNote3, oldNote4;
@@ -345,27 +354,26 @@ struct editor_t
     uint8_t resampleNote, initialTempo, initialSpeed, editMoveAdd, configFound, abortMod2Wav, blepSynthesis;
 
     int16_t *mod2WavBuffer, *pat2SmpBuf, vol1, vol2, quantizeValue;
-    int16_t metroSpeed, metroChannel, sampleVol, modulateSpeed;
+    int16_t metroSpeed, metroChannel, sampleVol, modulateSpeed, wavImportPeriod;
     uint16_t effectMacros[10], oldTempo, currPlayNote, ticks50Hz;
 
-    int32_t smpRedoLoopStarts[MOD_SAMPLES], smpRedoLoopLengths[MOD_SAMPLES], smpRedoLengths[MOD_SAMPLES];
     int32_t markStartOfs, markEndOfs, samplePos, modulatePos, modulateOffset, chordLength, playTime;
     int32_t lpCutOff, hpCutOff;
-    uint32_t *scopeBuffer, pat2SmpPos, outputFreq, audioBufferSize;
+    uint32_t *scopeBuffer, pat2SmpPos, outputFreq, audioBufferSize, sampleUndoMemLimit, modEditCount;
 
     float outputFreq_f;
 
     note_t trackBuffer[MOD_ROWS], cmdsBuffer[MOD_ROWS], blockBuffer[MOD_ROWS];
     note_t patternBuffer[MOD_ROWS * AMIGA_VOICES], undoBuffer[MOD_ROWS * AMIGA_VOICES];
 
-    SDL_Thread *mod2WavThread, *pat2SmpThread;
+    SDL_Thread *mod2WavThread, *pat2SmpThread, *modSaveThread;
 
     struct diskop_t
     {
         volatile uint8_t cached;
         volatile uint8_t isFilling;
         volatile uint8_t forceStopReading;
-        int8_t modDot, mode, modPackFlg, smpSaveType;
+        int8_t modDot, mode, modPackFlg, modPackEfficiency, smpSaveType;
         int32_t numFiles;
         int32_t scrollOffset;
         SDL_Thread *fillThread;
@@ -403,6 +411,7 @@ struct editor_t
         // render/update flags
         uint8_t refreshMousePointer, updateStatusText, updatePatternData, updateSongTime;
         uint8_t updateSongName, updateMod2WavDialog ,mod2WavFinished;
+        volatile uint8_t modSaveFinished;
 
         // edit op. #2
         uint8_t updateRecordText, updateQuantizeText, updateMetro1Text, updateMetro2Text;
@@ -107,7 +107,10 @@ void updateWindowTitle(int8_t modified)
     char titleTemp[128];
 
     if (modified)
+    {
         modEntry->modified = true;
+        editor.modEditCount++; // see reportModSave()
+    }
 
     if (modEntry->head.moduleTitle[0] != '\0')
     {
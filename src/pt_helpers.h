@@ -15,6 +15,17 @@
 #define PT_ASSERT(X)
 #endif
 
+// SIMD code paths (scalar fallbacks are always present)
+#if defined (__SSE2__) || defined (_M_X64) || (defined (_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define PT_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined (PT_USE_SSE2) && (defined (__SSSE3__) || defined (__AVX__))
+#define PT_USE_SSSE3
+#include <tmmintrin.h>
+#endif
+
 #ifndef true
 #define true 1
 #define false 0
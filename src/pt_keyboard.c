@@ -18,6 +18,7 @@
 #include "pt_modloader.h"
 #include "pt_mouse.h"
 #include "pt_terminal.h"
+#include "pt_samplebatch.h"
 
 void sampleUpButton(void);   // pt_mouse.c
 void sampleDownButton(void); // pt_mouse.c
@@ -2396,7 +2397,16 @@ void keyDownHandler(SDL_Scancode keyEntry, SDL_Keycode keyCode)
 
         case SDL_SCANCODE_G:
         {
-            if (input.keyb.leftCtrlKeyDown)
+            if (input.keyb.leftCtrlKeyDown && input.keyb.shiftKeyDown)
+            {
+                editor.ui.askScreenShown = true;
+                editor.ui.askScreenType  = ASK_NORMALIZE_ALL_SAMPLES;
+
+                pointerSetMode(POINTER_MODE_MSG1, NO_CARRY);
+                setStatusMessage("NORMALIZE ALL ?", NO_CARRY);
+                renderAskDialog();
+            }
+            else if (input.keyb.leftCtrlKeyDown)
             {
                 editor.ui.askScreenShown = true;
                 editor.ui.askScreenType  = ASK_BOOST_ALL_SAMPLES;
@@ -2441,6 +2451,8 @@ void keyDownHandler(SDL_Scancode keyEntry, SDL_Keycode keyCode)
                     return;
                 }
 
+                saveUndo();
+
                 if (modEntry->currRow < 63)
                 {
                     for (i = 0; i <= (editor.buffToPos - editor.buffFromPos); ++i)
@@ -2453,8 +2465,6 @@ void keyDownHandler(SDL_Scancode keyEntry, SDL_Keycode keyCode)
                     }
                 }
 
-                saveUndo();
-
                 for (i = 0; i <= (editor.buffToPos - editor.buffFromPos); ++i)
                 {
                     if ((modEntry->currRow + i) > 63)
@@ -2540,6 +2550,8 @@ void keyDownHandler(SDL_Scancode keyEntry, SDL_Keycode keyCode)
         {
             if (input.keyb.leftAltKeyDown)
             {
+                saveUndo();
+
                 for (i = 0; i < MOD_ROWS; ++i)
                 {
                     noteSrc = &modEntry->patterns[modEntry->currPattern][(i * AMIGA_VOICES) + editor.cursor.channel];
@@ -2791,6 +2803,15 @@ void keyDownHandler(SDL_Scancode keyEntry, SDL_Keycode keyCode)
 
                 displayMsg("POS RESTORED !");
             }
+            else if (input.keyb.leftAltKeyDown && input.keyb.shiftKeyDown)
+            {
+                editor.ui.askScreenShown = true;
+                editor.ui.askScreenType  = ASK_RESAMPLE_ALL_SAMPLES;
+
+                pointerSetMode(POINTER_MODE_MSG1, NO_CARRY);
+                setStatusMessage("RESAMPLE ALL ?", NO_CARRY);
+                renderAskDialog();
+            }
             else if (input.keyb.leftAltKeyDown)
             {
                 editor.ui.askScreenShown = true;
@@ -2843,7 +2864,14 @@ void keyDownHandler(SDL_Scancode keyEntry, SDL_Keycode keyCode)
         case SDL_SCANCODE_U:
         {
             if (input.keyb.leftCtrlKeyDown)
-                undoLastChange();
+            {
+                if (editor.ui.samplerScreenShown)
+                    undoSampleData(editor.currSample);
+                else if (input.keyb.shiftKeyDown)
+                    redoLastChange();
+                else
+                    undoLastChange();
+            }
             else
                 handleEditKeys(keyEntry, EDIT_NORMAL);
         }
@@ -2855,6 +2883,15 @@ void keyDownHandler(SDL_Scancode keyEntry, SDL_Keycode keyCode)
             {
                 pattOctaDown(TRANSPOSE_ALL);
             }
+            else if (input.keyb.leftCtrlKeyDown && input.keyb.shiftKeyDown)
+            {
+                editor.ui.askScreenShown = true;
+                editor.ui.askScreenType  = ASK_DC_ALL_SAMPLES;
+
+                pointerSetMode(POINTER_MODE_MSG1, NO_CARRY);
+                setStatusMessage("REMOVE DC ALL ?", NO_CARRY);
+                renderAskDialog();
+            }
             else if (input.keyb.leftCtrlKeyDown)
             {
                 if (editor.ui.samplerScreenShown)
@@ -3750,6 +3787,10 @@ int8_t handleGeneralModes(SDL_Scancode keyEntry)
         return (false);
     }
 
+    // an "all samples" batch operation is working on the sample data, wait for it
+    if (sampleBatchRunning())
+        return (false);
+
     // SWAP CHANNEL (CTRL+T)
     if (editor.swapChannelFlag)
     {
@@ -3766,6 +3807,8 @@ int8_t handleGeneralModes(SDL_Scancode keyEntry)
 
             case SDL_SCANCODE_1:
             {
+                saveUndo();
+
                 for (i = 0; i < MOD_ROWS; ++i)
                 {
                     noteSrc = &modEntry->patterns[modEntry->currPattern][(i * AMIGA_VOICES) + editor.cursor.channel];
@@ -3784,6 +3827,8 @@ int8_t handleGeneralModes(SDL_Scancode keyEntry)
 
             case SDL_SCANCODE_2:
             {
+                saveUndo();
+
                 for (i = 0; i < MOD_ROWS; ++i)
                 {
                     noteSrc = &modEntry->patterns[modEntry->currPattern][(i * AMIGA_VOICES) + editor.cursor.channel];
@@ -3802,6 +3847,8 @@ int8_t handleGeneralModes(SDL_Scancode keyEntry)
 
             case SDL_SCANCODE_3:
             {
+                saveUndo();
+
                 for (i = 0; i < MOD_ROWS; ++i)
                 {
                     noteSrc = &modEntry->patterns[modEntry->currPattern][(i * AMIGA_VOICES) + editor.cursor.channel];
@@ -3820,6 +3867,8 @@ int8_t handleGeneralModes(SDL_Scancode keyEntry)
 
             case SDL_SCANCODE_4:
             {
+                saveUndo();
+
                 for (i = 0; i < MOD_ROWS; ++i)
                 {
                     noteSrc = &modEntry->patterns[modEntry->currPattern][(i * AMIGA_VOICES) + editor.cursor.channel];
@@ -19,15 +19,19 @@
 #include "pt_mouse.h"
 #include "pt_diskop.h"
 #include "pt_sampler.h"
+#include "pt_samplebatch.h"
 #include "pt_config.h"
 #include "pt_visuals.h"
 #include "pt_edit.h"
 #include "pt_modloader.h"
+#include "pt_modfile.h"
 #include "pt_sampleloader.h"
 #include "pt_terminal.h"
 #include "pt_unicode.h"
 #include "pt_scopes.h"
 #include "pt_audio.h"
+#include "pt_bench.h"
+#include "pt_pacer.h"
 
 extern int8_t forceMixerOff; // pt_audio.c
 extern uint32_t palette[PALETTE_NUM]; // pt_palette.c
@@ -40,9 +44,11 @@ uint32_t *pixelBuffer  = NULL;
 SDL_Window *window     = NULL;
 SDL_Renderer *renderer = NULL;
 SDL_Texture  *texture  = NULL;
-uint8_t fullscreen = false, vsync60HzPresent = false;
+uint8_t fullscreen = false, vsyncPresent = false;
 // -----------------------------
 
+#define IDLE_WAIT_MS 100 // longest sleep in the main loop while idle, it wakes up on any event
+
 #ifdef _WIN32
 #define SYSMSG_FILE_ARG (WM_USER + 1)
 #define ARGV_SHARED_MEM_MAX_LEN ((PATH_MAX_LEN * 2) + 2)
@@ -61,9 +67,8 @@ static LONG WINAPI exceptionHandler(EXCEPTION_POINTERS *ptr);
 static uint8_t backupMadeAfterCrash;
 #endif
 
-static uint64_t timeNext64;
-static SDL_TimerID timer50Hz;
 static module_t *tempMod;
+static int8_t benchMode;
 
 #ifdef __APPLE__
 static void osxSetDirToProgramDirFromArgs(char **argv);
@@ -72,16 +77,22 @@ static int8_t checkIfAppWasTranslocated(int argc, char **argv);
 
 static void handleInput(void);
 static int8_t initializeVars(void);
-static void loadModFromArg(char *arg);
+int8_t loadModFromArg(char *arg);
+void runInputTick(void);
+void runLogicTick(void);
+static int8_t isWindowVisible(void);
+static int8_t canIdle(void);
 static void handleSigTerm(void);
 static void loadDroppedFile(char *fullPath, uint32_t fullPathLen, uint8_t autoPlay);
 static void cleanUp(void);
-static void setupWaitVBL(void);
-static void waitVBL(void);
 static void readMouseXY(void);
+static void setMouseXY(int32_t mx, int32_t my);
 
 int main(int argc, char *argv[])
 {
+    int32_t i;
+    int8_t visible;
+    uint32_t numTicks;
     SDL_version sdlVer;
 
     // very first thing to do is to set a big endian flag using a well-known hack
@@ -125,6 +136,17 @@ int main(int argc, char *argv[])
     SDL_setenv("SDL_AUDIODRIVER", "directsound", true);
 #endif
 
+    // offscreen GUI benchmark, no window and no sound card (see pt_bench.c)
+    benchMode = (argc >= 2) && (strcmp(argv[1], "--benchmark") == 0);
+    if (benchMode)
+    {
+        if (!benchParseArgs(argc, argv))
+            return (1);
+
+        SDL_setenv("SDL_VIDEODRIVER", "dummy", true);
+        SDL_setenv("SDL_AUDIODRIVER", "dummy", true);
+    }
+
     if (SDL_Init(SDL_INIT_AUDIO | SDL_INIT_VIDEO | SDL_INIT_TIMER) < 0)
     {
         showErrorMsgBox("Couldn't initialize SDL: %s", SDL_GetError());
@@ -162,6 +184,15 @@ int main(int argc, char *argv[])
     osxSetDirToProgramDirFromArgs(argv);
 #endif
 
+    if (!modFileCheckNoteLayout())
+    {
+        showErrorMsgBox("This build has an unexpected note_t bitfield layout, patterns would get corrupted.\n" \
+                        "Please report this (with the compiler used), or build without SSE2.");
+
+        SDL_Quit();
+        return (1);
+    }
+
     if (!initializeVars())
     {
         cleanUp();
@@ -178,7 +209,7 @@ int main(int argc, char *argv[])
         return (1);
     }
 
-    if (!setupVideo())
+    if (!(benchMode ? setupOffscreenVideo() : setupVideo()))
     {
         cleanUp();
         SDL_Quit();
@@ -188,7 +219,7 @@ int main(int argc, char *argv[])
 
     // allow only one instance, and send arguments to it (song to play)
 #ifdef _WIN32
-    if (handleSingleInstancing(argc, argv))
+    if (!benchMode && handleSingleInstancing(argc, argv))
     {
         cleanUp();
         SDL_Quit();
@@ -206,6 +237,9 @@ int main(int argc, char *argv[])
         return (1);
     }
 
+    if (benchMode)
+        audioSetOffline(); // the benchmark runs the mixer itself
+
     if (!terminalInit())
     {
         cleanUp();
@@ -222,29 +256,10 @@ int main(int argc, char *argv[])
         return (1);
     }
 
-    timer50Hz = SDL_AddTimer(1000 / 50, _50HzCallBack, NULL);
-    if (timer50Hz == 0)
-    {
-        showErrorMsgBox("Couldn't create 50Hz timer:\n%s", SDL_GetError());
-
-        cleanUp();
-        SDL_Quit();
-
-        return (1);
-    }
-
     setupSprites();
     diskOpSetInitPath();
 
-    editor.programRunning = true; // set this before initScopes()
-
-    if (!ptConfig.vblankScopes && !initScopes())
-    {
-        cleanUp();
-        SDL_Quit();
-
-        return (1);
-    }
+    editor.programRunning = true;
 
     modEntry = createNewMod();
     if (modEntry == NULL)
@@ -272,7 +287,9 @@ int main(int argc, char *argv[])
 
     terminalPrintf("Configuration:\n");
     terminalPrintf("- Video upscaling factor: %dx\n", ptConfig.videoScaleFactor);
-    terminalPrintf("- Video 60Hz vsync: %s\n", vsync60HzPresent ? "yes" : "no");
+    terminalPrintf("- Video vsync: %s\n", vsyncPresent ? "yes" : "no");
+    terminalPrintf("- Video frame rate: %dHz\n", (int32_t)(pacerGetFrameRate() + 0.5));
+    terminalPrintf("- Video output: %s\n", (renderer == NULL) ? "software scaler" : "GPU renderer");
     terminalPrintf("- \"MOD.\" filenames: %s\n", ptConfig.modDot ? "yes" : "no");
     terminalPrintf("- Stereo separation: %d%%\n", ptConfig.stereoSeparation);
     terminalPrintf("- Audio BLEP synthesis: %s\n", ptConfig.blepSynthesis ? "yes" : "no");
@@ -282,7 +299,7 @@ int main(int argc, char *argv[])
     terminalPrintf("\nEverything is up and running.\n\n");
 
     // load a .MOD from the command arguments if passed (also ignore OS X < 10.9 -psn argument on double-click launch)
-    if (((argc >= 2) && (strlen(argv[1]) > 0)) && !((argc == 2) && (!strncmp(argv[1], "-psn_", 5))))
+    if (!benchMode && ((argc >= 2) && (strlen(argv[1]) > 0)) && !((argc == 2) && (!strncmp(argv[1], "-psn_", 5))))
     {
         loadModFromArg(argv[1]);
 
@@ -306,34 +323,57 @@ int main(int argc, char *argv[])
     fillToVuMetersBgBuffer();
     updateCursorPos();
 
+    if (benchMode)
+    {
+        i = benchRun();
+
+        cleanUp();
+        SDL_Quit();
+
+        return (i);
+    }
+
     SDL_ShowWindow(window);
 
-    setupWaitVBL();
     while (editor.programRunning)
     {
+        // nothing to draw (or nobody to see it), sleep until there's input
+        visible = isWindowVisible();
+        if (!visible || canIdle())
+            SDL_WaitEventTimeout(NULL, IDLE_WAIT_MS);
+
         readMouseXY();
         updateKeyModifiers(); // set/clear CTRL/ALT/SHIFT/AMIGA key states
         handleInput();
-        updateMouseCounters();
-        handleKeyRepeat(input.keyb.lastRepKey);
 
-        if (!input.mouse.buttonWaiting && (editor.ui.sampleMarkingPos == -1) &&
-            !editor.ui.forceSampleDrag && !editor.ui.forceVolDrag &&
-            !editor.ui.forceSampleEdit && !editor.ui.forceTermBarDrag)
-        {
-            handleMouseButtons();
-            handleSamplerFiltersBoxRepeats();
-        }
+        // key/mouse repeats and the 60Hz logic run on their own clocks, the frames below are drawn at the display's rate
+        numTicks = pacerGetInputTicks();
+        while (numTicks--)
+            runInputTick();
 
-        renderFrame();
-        flipFrame();
+        numTicks = pacerGetLogicTicks();
+        while (numTicks--)
+            runLogicTick();
 
-        if (ptConfig.vblankScopes)
-            updateScopes();
+        numTicks = pacerGetTimerTicks();
+        while (numTicks--)
+            _50HzCallBack(1000 / TIMER_HZ, NULL);
+
+        sampleBatchUpdate();
+        updateBackgroundTasks();
 
-        sinkVisualizerBars();
+        if (visible)
+        {
+            updateScopes();
+            renderFrame();
+            flipFrame();
 
-        waitVBL(); // if our display rate is higher than 60Hz, make sure we still sync to 60Hz (or if we disabled vblank)
+            pacerWait(); // times the frame if vsync doesn't
+        }
+        else
+        {
+            pacerSkipFrame(); // a restore event redraws the whole screen
+        }
     }
 
     cleanUp();
@@ -352,6 +392,8 @@ static void handleInput(void)
 #ifdef _WIN32
         handleSysMsg(inputEvent);
 #endif
+        input.eventTime64 = pacerEventTime(inputEvent.common.timestamp);
+
         if (editor.ui.editTextFlag && (inputEvent.type == SDL_TEXTINPUT))
         {
             // text input when editing texts/numbers
@@ -380,17 +422,31 @@ static void handleInput(void)
         {
             handleSigTerm();
         }
+        else if ((inputEvent.type == SDL_RENDER_TARGETS_RESET) || (inputEvent.type == SDL_RENDER_DEVICE_RESET) ||
+                 ((inputEvent.type == SDL_WINDOWEVENT) && ((inputEvent.window.event == SDL_WINDOWEVENT_EXPOSED) ||
+                  (inputEvent.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) || (inputEvent.window.event == SDL_WINDOWEVENT_RESTORED))))
+        {
+            invalidateFrame(); // the window needs a full redraw
+        }
         else if (inputEvent.type == SDL_KEYUP)
         {
             keyUpHandler(inputEvent.key.keysym.scancode);
         }
         else if (inputEvent.type == SDL_KEYDOWN)
         {
+            if (!inputEvent.key.repeat)
+                pacerSyncInputClock(input.eventTime64); // the repeat delay counts from the press
+
             if (editor.repeatKeyFlag || (input.keyb.lastRepKey != inputEvent.key.keysym.scancode))
                 keyDownHandler(inputEvent.key.keysym.scancode, inputEvent.key.keysym.sym);
         }
+        else if (inputEvent.type == SDL_MOUSEMOTION)
+        {
+            setMouseXY(inputEvent.motion.x, inputEvent.motion.y);
+        }
         else if (inputEvent.type == SDL_MOUSEBUTTONUP)
         {
+            setMouseXY(inputEvent.button.x, inputEvent.button.y); // where it happened, not where the mouse is now
             mouseButtonUpHandler(inputEvent.button.button);
 
             if (!editor.ui.askScreenShown && !editor.ui.terminalShown && editor.ui.introScreenShown)
@@ -411,6 +467,9 @@ static void handleInput(void)
         }
         else if (inputEvent.type == SDL_MOUSEBUTTONDOWN)
         {
+            setMouseXY(inputEvent.button.x, inputEvent.button.y);
+            pacerSyncInputClock(input.eventTime64);
+
             if ((editor.ui.sampleMarkingPos == -1) &&
                 !editor.ui.forceSampleDrag && !editor.ui.forceVolDrag &&
                 !editor.ui.forceSampleEdit && !editor.ui.forceTermBarDrag)
@@ -437,10 +496,48 @@ static void handleInput(void)
                 editor.abortMod2Wav   = true;
                 SDL_WaitThread(editor.mod2WavThread, NULL);
             }
+
+            waitForModSave(); // don't quit in the middle of writing a module
+            sampleBatchWait();
         }
     }
 }
 
+// what used to run once per frame at 60Hz, part 1: key/mouse repeat and the other counters
+void runInputTick(void)
+{
+    updateMouseCounters();
+    handleKeyRepeat(input.keyb.lastRepKey);
+
+    if (!input.mouse.buttonWaiting && (editor.ui.sampleMarkingPos == -1) &&
+        !editor.ui.forceSampleDrag && !editor.ui.forceVolDrag &&
+        !editor.ui.forceSampleEdit && !editor.ui.forceTermBarDrag)
+    {
+        handleMouseButtons();
+        handleSamplerFiltersBoxRepeats();
+    }
+}
+
+// ...and part 2, VU meter decay
+void runLogicTick(void)
+{
+    sinkVisualizerBars();
+}
+
+static int8_t isWindowVisible(void)
+{
+    return (!(SDL_GetWindowFlags(window) & (SDL_WINDOW_HIDDEN | SDL_WINDOW_MINIMIZED)));
+}
+
+// nothing moves on screen and no button/key is held down (those repeat)
+static int8_t canIdle(void)
+{
+    if (input.mouse.leftButtonPressed || input.mouse.rightButtonPressed || input.keyb.repeatKey)
+        return (false);
+
+    return (!isScreenAnimating());
+}
+
 static int8_t initializeVars(void)
 {
     clearPaulaAndScopes();
@@ -500,13 +597,6 @@ static int8_t initializeVars(void)
         return (false);
     }
 
-    editor.tempSample = (int8_t *)(calloc(MAX_SAMPLE_LEN, 1));
-    if (editor.tempSample == NULL)
-    {
-        showErrorMsgBox("Out of memory!");
-        return (false);
-    }
-
     // setup initial mouse coordinates
     input.mouse.x = SCREEN_W / 2;
     input.mouse.y = SCREEN_H / 2;
@@ -575,7 +665,7 @@ static int8_t initializeVars(void)
     return (true);
 }
 
-static void loadModFromArg(char *arg)
+int8_t loadModFromArg(char *arg) // also used by pt_bench.c
 {
     uint32_t filenameLen;
     UNICHAR *filenameU;
@@ -591,7 +681,7 @@ static void loadModFromArg(char *arg)
         displayErrorMsg(editor.outOfMemoryText);
         terminalPrintf(editor.modLoadOoMText);
 
-        return;
+        return (false);
     }
 
 #ifdef _WIN32
@@ -620,6 +710,7 @@ static void loadModFromArg(char *arg)
     }
 
     free(filenameU);
+    return (tempMod != NULL);
 }
 
 void resetAllScreens(void)
@@ -921,7 +1012,7 @@ static void loadDroppedFile(char *fullPath, uint32_t fullPathLen, uint8_t autoPl
     uint8_t isMod, songWasPlaying;
     UNICHAR *fullPathU;
 
-    if (editor.diskop.isFilling || editor.isWAVRendering)
+    if (editor.diskop.isFilling || editor.isWAVRendering || sampleBatchRunning())
         return;
 
     ansiName = (char *)(calloc(fullPathLen + 10, sizeof (char)));
@@ -1033,8 +1124,6 @@ static void cleanUp(void) // never call this inside the main loop!
 {
     audioClose();
 
-    if (timer50Hz != 0) SDL_RemoveTimer(timer50Hz);
-
     modFree();
     deAllocSamplerVars();
     deAllocDiskOpVars();
@@ -1042,12 +1131,12 @@ static void cleanUp(void) // never call this inside the main loop!
     freeBMPs();
     terminalFree();
     videoClose();
+    pacerFree();
     freeSprites();
 
     if (ptConfig.defaultDiskOpDir != NULL) free(ptConfig.defaultDiskOpDir);
     if (editor.rowVisitTable      != NULL) free(editor.rowVisitTable);
     if (editor.ui.pattNames       != NULL) free(editor.ui.pattNames);
-    if (editor.tempSample         != NULL) free(editor.tempSample);
     if (editor.scopeBuffer        != NULL) free(editor.scopeBuffer);
 
 #ifdef _WIN32
@@ -1056,58 +1145,24 @@ static void cleanUp(void) // never call this inside the main loop!
 #endif
 }
 
-static void setupWaitVBL(void)
-{
-    int32_t time32;
-    double time_f;
-
-    // setup next frame time
-    time_f     = ((double)(SDL_GetPerformanceFrequency()) / VBLANK_HZ) + 0.5;
-    time32     = (int32_t)(time_f);
-    timeNext64 = SDL_GetPerformanceCounter() + time32;
-}
-
-static void waitVBL(void)
+static void readMouseXY(void)
 {
-    // this routine almost never delays if we have 60Hz vsync, but it's still needed for safety
-
-    int32_t time32;
-    uint64_t time64;
-    double time_f, perfFreq_f;
-
-    perfFreq_f = (double)(SDL_GetPerformanceFrequency()); // should be safe for double
-    if (perfFreq_f <= 0.0)
-        return; // panic!
-
-    time64 = SDL_GetPerformanceCounter();
-    if (time64 < timeNext64)
-    {
-        // calculate time remaining until next frame
-        time64 = timeNext64 - time64;
-
-        // convert to milliseconds
-        time_f = ((1000.0 * (double)(time64)) / perfFreq_f) + 0.5;
-        time32 = (int32_t)(time_f);
+    int32_t mx, my;
 
-        // delay until we reach next frame
-        if (time32 > 0)
-            SDL_Delay(time32);
-    }
+    SDL_PumpEvents();
+    SDL_GetMouseState(&mx, &my);
 
-    // setup next frame time
-    time_f      = (perfFreq_f / VBLANK_HZ) + 0.5;
-    time32      = (int32_t)(time_f);
-    timeNext64 += time32;
+    setMouseXY(mx, my);
 }
 
-static void readMouseXY(void)
+// window coordinates -> screen coordinates
+static void setMouseXY(int32_t mx, int32_t my)
 {
     int16_t x, y;
-    int32_t mx, my;
     float mx_f, my_f;
 
-    SDL_PumpEvents();
-    SDL_GetMouseState(&mx, &my);
+    mx -= input.mouse.offsetX;
+    my -= input.mouse.offsetY;
 
     if (input.mouse.scaleX_f != 1.0f)
     {
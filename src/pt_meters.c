@@ -0,0 +1,371 @@
+/*
+** Level metering for the mixer output. The mixer hands over each voice's
+** block and the final (filtered) master block, peak/RMS are taken over the
+** whole block with SSE2, and the master also gets a true-peak estimate (4x
+** oversampled with a windowed sinc) and a clip counter.
+**
+** The audio thread accumulates everything since the last meterRead() and
+** publishes it once per block through a sequence lock, so a reader never
+** sees half a block and never stalls the audio thread.
+*/
+
+#include <SDL2/SDL.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "pt_header.h"
+#include "pt_helpers.h"
+#include "pt_meters.h"
+
+#define READ_TRIES 8
+
+typedef struct meterAccum_t
+{
+    float voicePeak[AMIGA_VOICES], peak[2], truePeak[2];
+    double voiceSumSq[AMIGA_VOICES], sumSq[2];
+    uint32_t voiceSamples, samples, clips;
+} meterAccum_t;
+
+#define TP_TAPS 8 // interpolation taps for the true-peak points
+#define TP_PHASES 3 // points at 1/4, 2/4 and 3/4 between two sample points
+#define M_PI_D 3.14159265358979323846
+
+// audio thread only
+static meterAccum_t block, accum;
+static float truePeakCoeffs[TP_PHASES][TP_TAPS], truePeakHistory[2][TP_TAPS - 1], totalPeak, totalTruePeak;
+static int8_t truePeakCoeffsReady;
+static uint32_t totalClips;
+static int32_t lastReadGen, lastResetGen;
+
+// shared
+static audioMeters_t published;
+static SDL_atomic_t publishSeq, readGen, resetGen;
+
+static void peakAndSumSq(const float *data, int32_t numSamples, float *peak, double *sumSq)
+{
+    int32_t i;
+    float p, s, a;
+
+    p = 0.0f;
+    s = 0.0f;
+    i = 0;
+
+#ifdef PT_USE_SSE2
+    {
+        const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+        __m128 x, vPeak, vSum;
+        float tmp[4];
+
+        vPeak = _mm_setzero_ps();
+        vSum  = _mm_setzero_ps();
+
+        for (; i + 4 <= numSamples; i += 4)
+        {
+            x     = _mm_loadu_ps(&data[i]);
+            vPeak = _mm_max_ps(vPeak, _mm_and_ps(x, absMask));
+            vSum  = _mm_add_ps(vSum, _mm_mul_ps(x, x));
+        }
+
+        _mm_storeu_ps(tmp, vPeak);
+        p = MAX(MAX(tmp[0], tmp[1]), MAX(tmp[2], tmp[3]));
+
+        _mm_storeu_ps(tmp, vSum);
+        s = (tmp[0] + tmp[1]) + (tmp[2] + tmp[3]);
+    }
+#endif
+
+    for (; i < numSamples; ++i)
+    {
+        a = ABS(data[i]);
+        if (a > p)
+            p = a;
+
+        s += data[i] * data[i];
+    }
+
+    if (p > *peak)
+        *peak = p;
+
+    *sumSq += s;
+}
+
+// Hann-windowed sinc, normalized to unity gain per phase
+static void makeTruePeakCoeffs(void)
+{
+    int32_t i, j;
+    double x, w, c, sum;
+
+    for (i = 0; i < TP_PHASES; ++i)
+    {
+        sum = 0.0;
+        for (j = 0; j < TP_TAPS; ++j)
+        {
+            x = (j - ((TP_TAPS / 2) - 1)) - ((i + 1) / (double)(TP_PHASES + 1)); // distance from the point to this tap
+            w = 0.5 + (0.5 * cos((M_PI_D * x) / (TP_TAPS / 2)));
+            c = (fabs(x) < 1e-9) ? 1.0 : (sin(M_PI_D * x) / (M_PI_D * x));
+
+            truePeakCoeffs[i][j] = (float)(c * w);
+            sum += truePeakCoeffs[i][j];
+        }
+
+        for (j = 0; j < TP_TAPS; ++j)
+            truePeakCoeffs[i][j] = (float)(truePeakCoeffs[i][j] / sum);
+    }
+
+    truePeakCoeffsReady = true;
+}
+
+static inline float historyOrData(const float *history, const float *data, int32_t i)
+{
+    return ((i < 0) ? history[(TP_TAPS - 1) + i] : data[i]);
+}
+
+/* Peak of the points interpolated between data[k] and data[k + 1], for k from
+** -TP_TAPS/2 to numSamples-1-TP_TAPS/2. The history holds the previous
+** block's last points, so no interval is skipped or measured twice.
+*/
+static float truePeakBlock(float *history, const float *data, int32_t numSamples)
+{
+    const int32_t first = -(TP_TAPS / 2), last = (numSamples - 1) - (TP_TAPS / 2);
+    int32_t k, i, j;
+    float p, y, a;
+
+    if (!truePeakCoeffsReady)
+        makeTruePeakCoeffs();
+
+    p = 0.0f;
+
+    // intervals that reach into the history
+    for (k = first; (k < ((TP_TAPS / 2) - 1)) && (k <= last); ++k)
+    {
+        for (i = 0; i < TP_PHASES; ++i)
+        {
+            y = 0.0f;
+            for (j = 0; j < TP_TAPS; ++j)
+                y += truePeakCoeffs[i][j] * historyOrData(history, data, (k - ((TP_TAPS / 2) - 1)) + j);
+
+            a = ABS(y);
+            if (a > p)
+                p = a;
+        }
+    }
+
+#ifdef PT_USE_SSE2
+    {
+        const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+        __m128 x[TP_TAPS], vy, vPeak;
+        float tmp[4];
+
+        vPeak = _mm_setzero_ps();
+
+        // four intervals at a time
+        for (; (k + 3) <= last; k += 4)
+        {
+            for (j = 0; j < TP_TAPS; ++j)
+                x[j] = _mm_loadu_ps(&data[(k - ((TP_TAPS / 2) - 1)) + j]);
+
+            for (i = 0; i < TP_PHASES; ++i)
+            {
+                vy = _mm_mul_ps(x[0], _mm_set1_ps(truePeakCoeffs[i][0]));
+                for (j = 1; j < TP_TAPS; ++j)
+                    vy = _mm_add_ps(vy, _mm_mul_ps(x[j], _mm_set1_ps(truePeakCoeffs[i][j])));
+
+                vPeak = _mm_max_ps(vPeak, _mm_and_ps(vy, absMask));
+            }
+        }
+
+        _mm_storeu_ps(tmp, vPeak);
+        p = MAX(p, MAX(MAX(tmp[0], tmp[1]), MAX(tmp[2], tmp[3])));
+    }
+#endif
+
+    for (; k <= last; ++k)
+    {
+        for (i = 0; i < TP_PHASES; ++i)
+        {
+            y = 0.0f;
+            for (j = 0; j < TP_TAPS; ++j)
+                y += truePeakCoeffs[i][j] * data[(k - ((TP_TAPS / 2) - 1)) + j];
+
+            a = ABS(y);
+            if (a > p)
+                p = a;
+        }
+    }
+
+    // keep the last points for the next block
+    for (i = 0; i < (TP_TAPS - 1); ++i)
+        history[i] = historyOrData(history, data, (numSamples - (TP_TAPS - 1)) + i);
+
+    return (p);
+}
+
+static uint32_t countClips(const float *data, int32_t numSamples, float fullScale)
+{
+    int32_t i;
+    uint32_t clips;
+
+    clips = 0;
+    i = 0;
+
+#ifdef PT_USE_SSE2
+    {
+        const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+        const __m128 limit = _mm_set1_ps(fullScale);
+        int32_t mask;
+
+        for (; i + 4 <= numSamples; i += 4)
+        {
+            mask = _mm_movemask_ps(_mm_cmpgt_ps(_mm_and_ps(_mm_loadu_ps(&data[i]), absMask), limit));
+            clips += (mask & 1) + ((mask >> 1) & 1) + ((mask >> 2) & 1) + ((mask >> 3) & 1);
+        }
+    }
+#endif
+
+    for (; i < numSamples; ++i)
+    {
+        if (ABS(data[i]) > fullScale)
+            clips++;
+    }
+
+    return (clips);
+}
+
+void meterVoiceBlock(uint8_t voice, const float *data, int32_t numSamples)
+{
+    peakAndSumSq(data, numSamples, &block.voicePeak[voice], &block.voiceSumSq[voice]);
+
+    if (voice == 0)
+        block.voiceSamples += numSamples;
+}
+
+void meterMasterBlock(const float *left, const float *right, int32_t numSamples, float fullScale)
+{
+    uint8_t i;
+    float scale, peak, tp;
+    double sumSq;
+    const float *data;
+
+    scale = 1.0f / fullScale;
+
+    for (i = 0; i < 2; ++i)
+    {
+        data = (i == 0) ? left : right;
+
+        peak  = 0.0f;
+        sumSq = 0.0;
+        peakAndSumSq(data, numSamples, &peak, &sumSq);
+
+        tp = truePeakBlock(truePeakHistory[i], data, numSamples);
+
+        block.peak[i]      = MAX(block.peak[i], peak * scale);
+        block.truePeak[i]  = MAX(block.truePeak[i], tp * scale);
+        block.sumSq[i]    += sumSq * (scale * scale);
+
+        block.clips += countClips(data, numSamples, fullScale);
+    }
+
+    block.samples += numSamples;
+}
+
+void meterPublish(void)
+{
+    uint8_t i;
+    int32_t gen;
+    audioMeters_t m;
+
+    gen = SDL_AtomicGet(&resetGen);
+    if (gen != lastResetGen)
+    {
+        lastResetGen  = gen;
+        totalPeak     = 0.0f;
+        totalTruePeak = 0.0f;
+        totalClips    = 0;
+    }
+
+    // a reader took the last values, start a new interval
+    gen = SDL_AtomicGet(&readGen);
+    if (gen != lastReadGen)
+    {
+        lastReadGen = gen;
+        memset(&accum, 0, sizeof (accum));
+    }
+
+    for (i = 0; i < AMIGA_VOICES; ++i)
+    {
+        accum.voicePeak[i]   = MAX(accum.voicePeak[i], block.voicePeak[i]);
+        accum.voiceSumSq[i] += block.voiceSumSq[i];
+    }
+
+    for (i = 0; i < 2; ++i)
+    {
+        accum.peak[i]      = MAX(accum.peak[i], block.peak[i]);
+        accum.truePeak[i]  = MAX(accum.truePeak[i], MAX(block.truePeak[i], block.peak[i]));
+        accum.sumSq[i]    += block.sumSq[i];
+
+        totalPeak     = MAX(totalPeak, block.peak[i]);
+        totalTruePeak = MAX(totalTruePeak, accum.truePeak[i]);
+    }
+
+    totalClips += block.clips; // after the reset above, so this block's clips count
+
+    accum.voiceSamples += block.voiceSamples;
+    accum.samples      += block.samples;
+
+    memset(&block, 0, sizeof (block));
+
+    for (i = 0; i < AMIGA_VOICES; ++i)
+    {
+        m.voicePeak[i] = accum.voicePeak[i];
+        m.voiceRms[i]  = (accum.voiceSamples > 0) ? (float)(sqrt(accum.voiceSumSq[i] / accum.voiceSamples)) : 0.0f;
+    }
+
+    for (i = 0; i < 2; ++i)
+    {
+        m.peak[i]     = accum.peak[i];
+        m.truePeak[i] = accum.truePeak[i];
+        m.rms[i]      = (accum.samples > 0) ? (float)(sqrt(accum.sumSq[i] / accum.samples)) : 0.0f;
+    }
+
+    m.maxPeak     = totalPeak;
+    m.maxTruePeak = totalTruePeak;
+    m.clipCount   = totalClips;
+
+    // odd sequence = write in progress
+    SDL_AtomicAdd(&publishSeq, 1);
+    SDL_MemoryBarrierRelease();
+    memcpy(&published, &m, sizeof (audioMeters_t));
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicAdd(&publishSeq, 1);
+}
+
+int8_t meterRead(audioMeters_t *m)
+{
+    uint8_t i;
+    int32_t seq1, seq2;
+
+    for (i = 0; i < READ_TRIES; ++i)
+    {
+        seq1 = SDL_AtomicGet(&publishSeq);
+        if (seq1 & 1)
+            continue;
+
+        SDL_MemoryBarrierAcquire();
+        memcpy(m, &published, sizeof (audioMeters_t));
+        SDL_MemoryBarrierAcquire();
+
+        seq2 = SDL_AtomicGet(&publishSeq);
+        if (seq1 == seq2)
+        {
+            SDL_AtomicAdd(&readGen, 1);
+            return (true);
+        }
+    }
+
+    return (false);
+}
+
+void meterReset(void)
+{
+    SDL_AtomicAdd(&resetGen, 1);
+}
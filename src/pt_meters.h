@@ -0,0 +1,24 @@
+#ifndef __PT_METERS_H
+#define __PT_METERS_H
+
+#include <stdint.h>
+#include "pt_header.h"
+
+typedef struct audioMeters_t
+{
+    float voicePeak[AMIGA_VOICES], voiceRms[AMIGA_VOICES]; // since the last read, 1.0 = voice at full volume
+    float peak[2], rms[2], truePeak[2]; // master output since the last read, 1.0 = 0dBFS
+    float maxPeak, maxTruePeak; // master output since meterReset()
+    uint32_t clipCount; // clipped output sample points since meterReset()
+} audioMeters_t;
+
+// audio thread, once per mixed block: all voices, then the master, then publish
+void meterVoiceBlock(uint8_t voice, const float *data, int32_t numSamples);
+void meterMasterBlock(const float *left, const float *right, int32_t numSamples, float fullScale);
+void meterPublish(void);
+
+// any other thread
+int8_t meterRead(audioMeters_t *m); // false if the audio thread kept us out, try again later
+void meterReset(void); // clears the totals, done by the audio thread at its next block
+
+#endif
@@ -0,0 +1,873 @@
+/* .MOD file parsing and pattern storage. Nothing in here touches the UI or the
+** replayer, so it can be used from any thread and from the modcheck tool.
+** Errors are returned in a modLoadInfo_t, the caller decides how to show them.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h> // tolower()
+#include "pt_header.h"
+#include "pt_helpers.h"
+#include "pt_unicode.h"
+#include "pt_modfile.h"
+#include "pt_powerpacker.h"
+
+typedef struct mem_t
+{
+    int8_t _eof;
+    uint8_t *_ptr, *_base;
+    uint32_t _cnt, _bufsiz;
+} mem_t;
+
+static mem_t *mopen(const uint8_t *src, uint32_t length);
+static void mclose(mem_t **buf);
+static int32_t mgetc(mem_t *buf);
+static size_t mread(void *buffer, size_t size, size_t count, mem_t *buf);
+static void mseek(mem_t *buf, int32_t offset, int32_t whence);
+
+// the SIMD cell converters below depend on this exact layout
+typedef char noteSizeCheck_t[(sizeof (note_t) == 4) ? 1 : -1];
+
+/* The bitfield order inside the word is up to the compiler, so it can't be
+** checked at compile time. The SIMD converters need it LSB-first (param in
+** bits 0..7, sample in bits 24..31), call this once at startup.
+*/
+int8_t modFileCheckNoteLayout(void)
+{
+#ifdef PT_USE_SSE2
+    uint32_t word;
+    note_t note;
+
+    memset(&note, 0, sizeof (note));
+
+    note.param   = 0x12;
+    note.command = 0x3;
+    note.period  = 0x456;
+    note.sample  = 0x78;
+
+    memcpy(&word, &note, 4);
+    return (word == 0x78456312);
+#else
+    return (true); // the scalar code only accesses the fields by name
+#endif
+}
+
+// patterns that are not allocated yet point to this one (read-only in practice, see modAllocPattern() in pt_modloader.c)
+static note_t blankPattern[MOD_ROWS * AMIGA_VOICES];
+
+#ifdef PT_USE_SSE2
+static inline __m128i byteSwap32x4(__m128i x)
+{
+#ifdef PT_USE_SSSE3
+    return (_mm_shuffle_epi8(x, _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3)));
+#else
+    x = _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+    return (_mm_or_si128(_mm_slli_epi32(x, 16), _mm_srli_epi32(x, 16)));
+#endif
+}
+#endif
+
+// unpacks .MOD pattern cells (4 bytes each) to note_t, in place
+static void modCellsToNotes(note_t *notes, uint32_t numCells)
+{
+    uint8_t b[4];
+    uint32_t i;
+    note_t note;
+
+    i = 0;
+
+#ifdef PT_USE_SSE2
+    {
+        const __m128i mask12  = _mm_set1_epi32(0x00000FFF);
+        const __m128i maskPer = _mm_set1_epi32(0x00FFF000);
+        const __m128i maskSHi = _mm_set1_epi32((int32_t)(0xF0000000));
+        const __m128i maskSLo = _mm_set1_epi32(0x0F000000);
+        __m128i w, out;
+
+        // big-endian cell: ssss pppp pppp pppp | ssss cccc xxxx xxxx
+        for (; (i + 4) <= numCells; i += 4)
+        {
+            w = byteSwap32x4(_mm_loadu_si128((__m128i *)(&notes[i])));
+
+            out = _mm_and_si128(w, mask12);                                        // command + param
+            out = _mm_or_si128(out, _mm_and_si128(_mm_srli_epi32(w,  4), maskPer)); // period
+            out = _mm_or_si128(out, _mm_and_si128(w, maskSHi));                     // sample (high nybble)
+            out = _mm_or_si128(out, _mm_and_si128(_mm_slli_epi32(w, 12), maskSLo)); // sample (low nybble)
+
+            _mm_storeu_si128((__m128i *)(&notes[i]), out);
+        }
+    }
+#endif
+
+    for (; i < numCells; ++i)
+    {
+        memcpy(b, &notes[i], 4);
+
+        note.period  = ((b[0] & 0x0F) << 8) | b[1];
+        note.sample  =  (b[0] & 0xF0) | (b[2] >> 4); // don't (!) clamp, the player checks for invalid samples
+        note.command =   b[2] & 0x0F;
+        note.param   =   b[3];
+
+        notes[i] = note;
+    }
+}
+
+// packs note_t to .MOD pattern cells (4 bytes each)
+void notesToModCells(const note_t *notes, uint8_t *cells, uint32_t numCells)
+{
+    uint32_t i;
+    const note_t *note;
+
+    i = 0;
+
+#ifdef PT_USE_SSE2
+    {
+        const __m128i mask12  = _mm_set1_epi32(0x00000FFF);
+        const __m128i maskPer = _mm_set1_epi32(0x0FFF0000);
+        const __m128i maskSHi = _mm_set1_epi32((int32_t)(0xF0000000));
+        const __m128i maskSLo = _mm_set1_epi32(0x0000F000);
+        __m128i n, w;
+
+        for (; (i + 4) <= numCells; i += 4)
+        {
+            n = _mm_loadu_si128((const __m128i *)(&notes[i]));
+
+            w = _mm_and_si128(n, mask12);
+            w = _mm_or_si128(w, _mm_and_si128(_mm_slli_epi32(n,  4), maskPer));
+            w = _mm_or_si128(w, _mm_and_si128(n, maskSHi));
+            w = _mm_or_si128(w, _mm_and_si128(_mm_srli_epi32(n, 12), maskSLo));
+
+            _mm_storeu_si128((__m128i *)(&cells[i * 4]), byteSwap32x4(w));
+        }
+    }
+#endif
+
+    for (; i < numCells; ++i)
+    {
+        note = &notes[i];
+
+        cells[(i * 4) + 0] = (note->sample & 0xF0) | ((note->period >> 8) & 0x0F);
+        cells[(i * 4) + 1] = note->period & 0x00FF;
+        cells[(i * 4) + 2] = ((note->sample << 4) & 0xF0) | (note->command & 0x0F);
+        cells[(i * 4) + 3] = note->param;
+    }
+}
+
+int8_t resizePatternStore(module_t *module, int16_t numPatterns)
+{
+    int16_t i;
+    note_t *newStore;
+
+    numPatterns = CLAMP(numPatterns, 1, MAX_PATTERNS);
+    if ((module->patternStore != NULL) && (numPatterns == module->allocatedPatterns))
+        return (true);
+
+    newStore = (note_t *)(realloc(module->patternStore, (numPatterns * (MOD_ROWS * AMIGA_VOICES)) * sizeof (note_t)));
+    if (newStore == NULL)
+        return (false);
+
+    if (numPatterns > module->allocatedPatterns)
+    {
+        memset(&newStore[module->allocatedPatterns * (MOD_ROWS * AMIGA_VOICES)], 0,
+            ((numPatterns - module->allocatedPatterns) * (MOD_ROWS * AMIGA_VOICES)) * sizeof (note_t));
+    }
+
+    module->patternStore = newStore;
+    module->allocatedPatterns = numPatterns;
+
+    for (i = 0; i < MAX_PATTERNS; ++i)
+        module->patterns[i] = (i < numPatterns) ? &newStore[i * (MOD_ROWS * AMIGA_VOICES)] : blankPattern;
+
+    return (true);
+}
+
+void freePatternStore(module_t *module)
+{
+    uint8_t i;
+
+    if (module->patternStore != NULL)
+    {
+        free(module->patternStore);
+        module->patternStore = NULL;
+    }
+
+    for (i = 0; i < MAX_PATTERNS; ++i)
+        module->patterns[i] = NULL;
+
+    module->allocatedPatterns = 0;
+}
+
+// Modules are told apart by this, not by their address (a freed module's
+// address can be handed out again). Only used from the main thread.
+uint32_t modFileNewSerial(void)
+{
+    static uint32_t serial;
+
+    return (++serial);
+}
+
+static void setLoadError(modLoadInfo_t *info, int8_t error, const char *errorText, const char *errorDetails)
+{
+    info->error        = error;
+    info->errorText    = errorText;
+    info->errorDetails = errorDetails;
+}
+
+void modFileFree(module_t *module)
+{
+    if (module != NULL)
+    {
+        freePatternStore(module);
+
+        if (module->sampleData != NULL)
+            free(module->sampleData);
+
+        free(module);
+    }
+}
+
+static int8_t checkModType(const char *buf)
+{
+         if (!strncmp(buf, "M.K.", 4)) return (FORMAT_MK);   // ProTracker v1.x, handled as ProTracker v2.x
+    else if (!strncmp(buf, "M!K!", 4)) return (FORMAT_MK2);  // ProTracker v2.x (if >64 patterns)
+    else if (!strncmp(buf, "FLT4", 4)) return (FORMAT_FLT4); // StarTrekker (4ch), handled as ProTracker v2.x
+    else if (!strncmp(buf, "4CHN", 4)) return (FORMAT_4CHN); // FastTracker II (4ch), handled as ProTracker v2.x
+    else if (!strncmp(buf, "N.T.", 4)) return (FORMAT_MK);   // NoiseTracker 1.0, handled as ProTracker v2.x
+    else if (!strncmp(buf, "M&K!", 4)) return (FORMAT_FEST); // Special NoiseTracker format (used in music disks?)
+    else if (!strncmp(buf, "FEST", 4)) return (FORMAT_FEST); // Special NoiseTracker format (used in music disks?)
+
+    return (FORMAT_UNKNOWN); // may be The Ultimate SoundTracker, 15 samples
+}
+
+module_t *modFileLoad(UNICHAR *fileName, modLoadInfo_t *info)
+{
+    char modSig[4], tmpChar;
+    int8_t mightBeSTK, numSamples, lateVerSTKFlag;
+    uint8_t ppCrunchData[4], *ppBuffer, *modBuffer;
+    int32_t i, tmp, loopOverflow;
+    char ppMagic[4];
+    uint32_t j, ppPackLen, ppUnpackLen, numCells;
+    FILE *fmodule;
+    module_t *newModule;
+    moduleSample_t *s;
+    note_t *note;
+    mem_t *mod;
+
+    lateVerSTKFlag = false;
+    mightBeSTK     = false;
+
+    memset(info, 0, sizeof (modLoadInfo_t));
+    info->format = FORMAT_UNKNOWN;
+
+    newModule = (module_t *)(calloc(1, sizeof (module_t)));
+    if (newModule == NULL)
+    {
+        setLoadError(info, MOD_LOAD_OUT_OF_MEMORY, "OUT OF MEMORY !!!", "out of memory!");
+
+        return (NULL);
+    }
+
+    newModule->serial = modFileNewSerial();
+
+    fmodule = UNICHAR_FOPEN(fileName, "rb");
+    if (fmodule == NULL)
+    {
+        free(newModule);
+        newModule = NULL;
+
+        setLoadError(info, MOD_LOAD_IO_ERROR, "FILE I/O ERROR !", "file input/output error!");
+
+        return (NULL);
+    }
+
+    fseek(fmodule, 0, SEEK_END);
+    newModule->head.moduleSize = ftell(fmodule);
+    fseek(fmodule, 0, SEEK_SET);
+
+    info->fileSize = newModule->head.moduleSize;
+
+    // check if mod is a powerpacker mod
+    memset(ppMagic, 0, sizeof (ppMagic));
+    fread(ppMagic, 1, 4, fmodule);
+
+    if (memcmp(ppMagic, "PX20", 4) == 0)
+    {
+        free(newModule);
+        fclose(fmodule);
+
+        setLoadError(info, MOD_LOAD_PP_ENCRYPTED, "ENCRYPTED PPACK !", ".MOD is PowerPacker encrypted!");
+
+        return (NULL);
+    }
+    else if (memcmp(ppMagic, "PP20", 4) == 0)
+    {
+        info->powerPacked = true;
+
+        ppPackLen = newModule->head.moduleSize;
+        if ((ppPackLen & 3) || (ppPackLen < 12)) // magic + efficiency table + length/skip bits, at least
+        {
+            free(newModule);
+            fclose(fmodule);
+
+            setLoadError(info, MOD_LOAD_PP_ERROR, "POWERPACKER ERROR", "unknown PowerPacker error");
+
+            return (NULL);
+        }
+
+        fseek(fmodule, ppPackLen - 4, SEEK_SET);
+
+        ppCrunchData[0] = (uint8_t)(fgetc(fmodule));
+        ppCrunchData[1] = (uint8_t)(fgetc(fmodule));
+        ppCrunchData[2] = (uint8_t)(fgetc(fmodule));
+        ppCrunchData[3] = (uint8_t)(fgetc(fmodule));
+
+        ppUnpackLen = (ppCrunchData[0] << 16) | (ppCrunchData[1] << 8) | ppCrunchData[2];
+
+        // smallest and biggest possible .MOD
+        if ((ppUnpackLen < 2108) || (ppUnpackLen > 4195326))
+        {
+            free(newModule);
+            fclose(fmodule);
+
+            setLoadError(info, MOD_LOAD_NOT_A_MOD, "NOT A MOD FILE !", "not a valid .MOD file (incorrect unpacked file size)");
+
+            return (NULL);
+        }
+
+        ppBuffer = (uint8_t *)(malloc(ppPackLen));
+        if (ppBuffer == NULL)
+        {
+            free(newModule);
+            fclose(fmodule);
+
+            setLoadError(info, MOD_LOAD_OUT_OF_MEMORY, "OUT OF MEMORY !!!", "out of memory!");
+
+            return (NULL);
+        }
+
+        modBuffer = (uint8_t *)(malloc(ppUnpackLen));
+        if (modBuffer == NULL)
+        {
+            free(newModule);
+            free(ppBuffer);
+
+            fclose(fmodule);
+
+            setLoadError(info, MOD_LOAD_OUT_OF_MEMORY, "OUT OF MEMORY !!!", "out of memory!");
+
+            return (NULL);
+        }
+
+        fseek(fmodule, 0, SEEK_SET);
+        fread(ppBuffer, 1, ppPackLen, fmodule);
+        fclose(fmodule);
+
+        if (!ppdecrunch(ppBuffer + 8, modBuffer, ppBuffer + 4, ppPackLen - 12, ppUnpackLen, ppCrunchData[3]))
+        {
+            free(newModule);
+            free(ppBuffer);
+            free(modBuffer);
+
+            setLoadError(info, MOD_LOAD_PP_ERROR, "POWERPACKER ERROR", "corrupt PowerPacker data");
+
+            return (NULL);
+        }
+
+        free(ppBuffer);
+
+        newModule->head.moduleSize = ppUnpackLen;
+    }
+    else
+    {
+        // smallest and biggest possible .MOD
+        if ((newModule->head.moduleSize < 2108) || (newModule->head.moduleSize > 4195326))
+        {
+            free(newModule);
+            fclose(fmodule);
+
+            setLoadError(info, MOD_LOAD_NOT_A_MOD, "NOT A MOD FILE !", "not a valid .MOD file (invalid file size)");
+
+            return (NULL);
+        }
+
+        modBuffer = (uint8_t *)(malloc(newModule->head.moduleSize));
+        if (modBuffer == NULL)
+        {
+            free(newModule);
+            fclose(fmodule);
+
+            setLoadError(info, MOD_LOAD_OUT_OF_MEMORY, "OUT OF MEMORY !!!", "out of memory!");
+
+            return (NULL);
+        }
+
+        fseek(fmodule, 0, SEEK_SET);
+        fread(modBuffer, 1, newModule->head.moduleSize, fmodule);
+        fclose(fmodule);
+    }
+
+    mod = mopen(modBuffer, newModule->head.moduleSize);
+    if (mod == NULL)
+    {
+        free(modBuffer);
+        free(newModule);
+
+        setLoadError(info, MOD_LOAD_IO_ERROR, "FILE I/O ERROR !", "file input/output error");
+
+        return (NULL);
+    }
+
+    // check module tag
+    mseek(mod, 0x0438, SEEK_SET);
+    mread(modSig, 1, 4, mod);
+
+    newModule->head.format = checkModType(modSig);
+    if (newModule->head.format == FORMAT_UNKNOWN)
+        mightBeSTK = true;
+
+    mseek(mod, 0, SEEK_SET);
+
+    mread(newModule->head.moduleTitle, 1, 20, mod);
+    // index 21 of newModule->head.moduleTitle is already zeroed
+
+    for (i = 0; i < 20; ++i)
+    {
+        tmpChar = newModule->head.moduleTitle[i];
+        if (((tmpChar < ' ') || (tmpChar > '~')) && (tmpChar != '\0'))
+            tmpChar = ' ';
+
+        newModule->head.moduleTitle[i] = (char)(tolower(tmpChar));
+    }
+
+    // read sample information
+    for (i = 0; i < MOD_SAMPLES; ++i)
+    {
+        s = &newModule->samples[i];
+
+        if (mightBeSTK && (i > 14))
+        {
+            s->loopLength = 2;
+        }
+        else
+        {
+            mread(s->text, 1, 22, mod);
+            // index 23 of s->text is already zeroed
+
+            for (j = 0; j < 22; ++j)
+            {
+                tmpChar = s->text[j];
+                if (((tmpChar < ' ') || (tmpChar > '~')) && (tmpChar != '\0'))
+                    tmpChar = ' ';
+
+                s->text[j] = (char)(tolower(tmpChar));
+            }
+
+            s->length = ((mgetc(mod) << 8) | mgetc(mod)) * 2;
+            if (s->length > 9999)
+                lateVerSTKFlag = true; // Only used if mightBeSTK is set
+
+            if (newModule->head.format == FORMAT_FEST)
+                s->fineTune = (uint8_t)((-mgetc(mod) & 0x1F) / 2); // One more bit of precision, + inverted
+            else
+                s->fineTune = (uint8_t)(mgetc(mod)) & 0x0F;
+
+            s->volume = (uint8_t)(mgetc(mod));
+            if (s->volume > 64)
+                s->volume = 64;
+
+            s->loopStart = ((mgetc(mod) << 8) | mgetc(mod)) * 2;
+            if (mightBeSTK)
+                s->loopStart /= 2;
+
+            s->loopLength = ((mgetc(mod) << 8) | mgetc(mod)) * 2;
+            if (s->loopLength < 2)
+                s->loopLength = 2;
+
+            // fix for poorly converted STK->PTMOD modules.
+            if (!mightBeSTK && (s->loopLength > 2) && ((s->loopStart + s->loopLength) > s->length))
+            {
+                if (((s->loopStart / 2) + s->loopLength) <= s->length)
+                    s->loopStart /= 2;
+            }
+
+            if (mightBeSTK)
+            {
+                if (s->loopLength > 2)
+                {
+                    tmp = s->loopStart;
+
+                    s->length      -= s->loopStart;
+                    s->loopStart    = 0;
+                    s->tmpLoopStart = tmp;
+                }
+
+                // no finetune in STK/UST
+                s->fineTune = 0;
+            }
+
+            // some modules are broken like this, adjust sample length if possible (this is ok if we have room)
+            if ((s->loopLength > 2) && ((s->loopStart + s->loopLength) > s->length))
+            {
+                loopOverflow = (s->loopStart + s->loopLength) - s->length;
+                if ((s->length + loopOverflow) <= 131070)
+                {
+                    s->length += loopOverflow; // this is safe, we're calloc()'ing 131070*(31+1) bytes
+                }
+                else
+                {
+                    s->loopStart  = 0;
+                    s->loopLength = 2;
+                }
+            }
+        }
+    }
+
+    // STK 2.5 had loopStart in words, not bytes. Convert if late version STK.
+    for (i = 0; i < 15; ++i)
+    {
+        if (mightBeSTK && lateVerSTKFlag)
+        {
+            s = &newModule->samples[i];
+            if (s->loopStart > 2)
+            {
+                s->length -= s->tmpLoopStart;
+                s->tmpLoopStart *= 2;
+            }
+        }
+    }
+
+    newModule->head.orderCount = (uint8_t)(mgetc(mod));
+
+    // fixes beatwave.mod (129 orders) and other weird MODs
+    if (newModule->head.orderCount > 127)
+    {
+        if (newModule->head.orderCount > 129)
+        {
+            mclose(&mod);
+
+            free(modBuffer);
+            free(newModule);
+
+            setLoadError(info, MOD_LOAD_NOT_A_MOD, "NOT A MOD FILE !", "not a valid .MOD file (NumOrders > 127)");
+
+            return (NULL);
+        }
+
+        newModule->head.orderCount = 127;
+    }
+
+    if (newModule->head.orderCount == 0)
+    {
+        mclose(&mod);
+
+        free(modBuffer);
+        free(newModule);
+
+        setLoadError(info, MOD_LOAD_NOT_A_MOD, "NOT A MOD FILE !", "not a valid .MOD file (NumOrders = 0)");
+
+        return (NULL);
+    }
+
+    newModule->head.restartPos = (uint8_t)(mgetc(mod));
+    if (mightBeSTK && ((newModule->head.restartPos == 0) || (newModule->head.restartPos > 220)))
+    {
+        mclose(&mod);
+
+        free(modBuffer);
+        free(newModule);
+
+        setLoadError(info, MOD_LOAD_NOT_A_MOD, "NOT A MOD FILE !", "not a valid .MOD file");
+
+        return (NULL);
+    }
+
+    if (mightBeSTK)
+    {
+        // If we're still here at this point and the mightBeSTK flag is set,
+        // then it's definitely a proper The Ultimate SoundTracker (STK) module.
+
+        newModule->head.format = FORMAT_STK;
+
+        if (newModule->head.restartPos != 120) // 120 = 125 (?)
+        {
+            if (newModule->head.restartPos > 239)
+                newModule->head.restartPos = 239;
+
+            // max BPM: 14536 (there was no clamping originally, sick!)
+            newModule->head.initBPM = (uint16_t)(1773447 / ((240 - newModule->head.restartPos) * 122));
+        }
+    }
+
+    for (i = 0; i < MOD_ORDERS; ++i)
+    {
+        newModule->head.order[i] = (int16_t)(mgetc(mod));
+        if (newModule->head.order[i] > newModule->head.patternCount)
+            newModule->head.patternCount = newModule->head.order[i];
+    }
+
+    if (++newModule->head.patternCount > MAX_PATTERNS)
+    {
+        mclose(&mod);
+
+        free(modBuffer);
+        free(newModule);
+
+        setLoadError(info, MOD_LOAD_NOT_A_MOD, "NOT A MOD FILE !", "not a valid .MOD file (NumPatterns > 100)");
+
+        return (NULL);
+    }
+
+    if (newModule->head.format != FORMAT_STK) // The Ultimate SoundTracker MODs doesn't have this tag
+        mseek(mod, 4, SEEK_CUR); // We already read/tested the tag earlier, skip it
+
+    // allocate only the patterns that are in use, the rest are allocated on demand
+    if (!resizePatternStore(newModule, newModule->head.patternCount))
+    {
+        mclose(&mod);
+
+        free(modBuffer);
+        freePatternStore(newModule);
+        free(newModule);
+
+        setLoadError(info, MOD_LOAD_OUT_OF_MEMORY, "OUT OF MEMORY !!!", "out of memory!");
+
+        return (NULL);
+    }
+
+    // note_t has the same size as a .MOD cell, so read all cells straight into the store and unpack them there
+    numCells = newModule->head.patternCount * (MOD_ROWS * AMIGA_VOICES);
+    mread(newModule->patternStore, 4, numCells, mod);
+    modCellsToNotes(newModule->patternStore, numCells);
+
+    if ((newModule->head.format == FORMAT_NT) || (newModule->head.format == FORMAT_FEST) ||
+        (newModule->head.format == FORMAT_4CHN) || mightBeSTK)
+    {
+        note = newModule->patternStore;
+        for (j = 0; j < numCells; ++j, ++note)
+        {
+            if ((newModule->head.format == FORMAT_NT) || (newModule->head.format == FORMAT_FEST))
+            {
+                // Any Dxx == D00 in N.T./FEST modules
+                if (note->command == 0x0D)
+                    note->param = 0x00;
+            }
+            else if (mightBeSTK)
+            {
+                // Convert STK effects to PT effects
+                if (!lateVerSTKFlag)
+                {
+                    if (note->command == 0x01)
+                    {
+                        // Arpeggio
+                        note->command = 0x00;
+                    }
+                    else if (note->command == 0x02)
+                    {
+                        // Pitch slide
+                        if (note->param & 0xF0)
+                        {
+                            note->command = 0x02;
+                            note->param >>= 4;
+                        }
+                        else if (note->param & 0x0F)
+                        {
+                            note->command = 0x01;
+                        }
+                    }
+                }
+
+                // Volume slide/pattern break
+                if (note->command == 0x0D)
+                {
+                    if (note->param == 0)
+                        note->command = 0x0D;
+                    else
+                        note->command = 0x0A;
+                }
+            }
+            else if (newModule->head.format == FORMAT_4CHN) // 4CHN != PT MOD
+            {
+                // Remove FastTracker II 8xx/E8x panning commands if present
+                if (note->command == 0x08)
+                {
+                    // 8xx
+                    note->command = 0;
+                    note->param   = 0;
+                }
+                else if ((note->command == 0x0E) && ((note->param >> 4) == 0x08))
+                {
+                    // E8x
+                    note->command = 0;
+                    note->param   = 0;
+                }
+
+                // Remove F00, FastTracker II didn't use F00 as STOP in .MOD
+                if ((note->command == 0x0F) && (note->param == 0x00))
+                {
+                    note->command = 0;
+                    note->param   = 0;
+                }
+            }
+        }
+    }
+
+    numSamples = (newModule->head.format == FORMAT_STK) ? 15 : 31;
+    for (i = 0; i < numSamples; ++i)
+        newModule->samples[i].offset = MAX_SAMPLE_LEN * i;
+
+    newModule->sampleData = (int8_t *)(calloc(MOD_SAMPLES + 1, MAX_SAMPLE_LEN)); // +1 sample slot for overflow safety (scopes etc)
+    if (newModule->sampleData == NULL)
+    {
+        mclose(&mod);
+
+        free(modBuffer);
+        freePatternStore(newModule);
+        free(newModule);
+
+        setLoadError(info, MOD_LOAD_OUT_OF_MEMORY, "OUT OF MEMORY !!!", "out of memory!");
+
+        return (NULL);
+    }
+
+    // load sample data
+    numSamples = (newModule->head.format == FORMAT_STK) ? 15 : 31;
+    for (i = 0; i < numSamples; ++i)
+    {
+        s = &newModule->samples[i];
+
+        if (mightBeSTK && (s->loopLength > 2))
+        {
+            for (j = 0; j < (uint32_t)(s->tmpLoopStart); ++j)
+                mgetc(mod); // skip
+
+            mread(&newModule->sampleData[s->offset], 1, s->length - s->loopStart, mod);
+        }
+        else
+        {
+            mread(&newModule->sampleData[s->offset], 1, s->length, mod);
+        }
+
+        // fix beeping samples
+        if ((s->length >= 2) && ((s->loopStart + s->loopLength) <= 2))
+        {
+            newModule->sampleData[s->offset + 0] = 0;
+            newModule->sampleData[s->offset + 1] = 0;
+        }
+    }
+
+    mclose(&mod);
+    free(modBuffer);
+
+    for (i = 0; i < AMIGA_VOICES; ++i)
+        newModule->channels[i].n_chanindex = i;
+
+    info->format = newModule->head.format;
+    return (newModule);
+}
+
+static mem_t *mopen(const uint8_t *src, uint32_t length)
+{
+    mem_t *b;
+
+    if ((src == NULL) || (length == 0))
+        return (NULL);
+
+    b = (mem_t *)(malloc(sizeof (mem_t)));
+    if (b == NULL)
+        return (NULL);
+
+    b->_base   = (uint8_t *)(src);
+    b->_ptr    = (uint8_t *)(src);
+    b->_cnt    = length;
+    b->_bufsiz = length;
+    b->_eof    = false;
+
+    return (b);
+}
+
+static void mclose(mem_t **buf)
+{
+    if (*buf != NULL)
+    {
+        free(*buf);
+        *buf = NULL;
+    }
+}
+
+static int32_t mgetc(mem_t *buf)
+{
+    int32_t b;
+
+    if ((buf == NULL) || (buf->_ptr == NULL) || (buf->_cnt <= 0))
+        return (0);
+
+    b = *buf->_ptr;
+
+    buf->_cnt--;
+    buf->_ptr++;
+
+    if (buf->_cnt <= 0)
+    {
+        buf->_ptr = buf->_base + buf->_bufsiz;
+        buf->_cnt = 0;
+        buf->_eof = true;
+    }
+
+    return (int32_t)(b);
+}
+
+static size_t mread(void *buffer, size_t size, size_t count, mem_t *buf)
+{
+    int32_t pcnt;
+    size_t wrcnt;
+
+    if ((buf == NULL) || (buf->_ptr == NULL))
+        return (0);
+
+    wrcnt = size * count;
+    if ((size == 0) || buf->_eof)
+        return (0);
+
+    pcnt = (buf->_cnt > wrcnt) ? wrcnt : buf->_cnt;
+    memcpy(buffer, buf->_ptr, pcnt);
+
+    buf->_cnt -= pcnt;
+    buf->_ptr += pcnt;
+
+    if (buf->_cnt <= 0)
+    {
+        buf->_ptr = buf->_base + buf->_bufsiz;
+        buf->_cnt = 0;
+        buf->_eof = true;
+    }
+
+    return (pcnt / size);
+}
+
+static void mseek(mem_t *buf, int32_t offset, int32_t whence)
+{
+    if (buf == NULL)
+        return;
+
+    if (buf->_base)
+    {
+        switch (whence)
+        {
+            case SEEK_SET: buf->_ptr  = buf->_base + offset;                break;
+            case SEEK_CUR: buf->_ptr += offset;                             break;
+            case SEEK_END: buf->_ptr  = buf->_base + buf->_bufsiz + offset; break;
+            default: break;
+        }
+
+        buf->_eof = false;
+        if (buf->_ptr >= (buf->_base + buf->_bufsiz))
+        {
+            buf->_ptr = buf->_base + buf->_bufsiz;
+            buf->_eof = true;
+        }
+
+        buf->_cnt = (buf->_base + buf->_bufsiz) - buf->_ptr;
+    }
+}
@@ -0,0 +1,34 @@
+#ifndef __PT_MODFILE_H
+#define __PT_MODFILE_H
+
+#include <stdint.h>
+#include "pt_header.h"
+#include "pt_unicode.h"
+
+enum
+{
+    MOD_LOAD_OK            = 0,
+    MOD_LOAD_IO_ERROR      = 1,
+    MOD_LOAD_OUT_OF_MEMORY = 2,
+    MOD_LOAD_NOT_A_MOD     = 3,
+    MOD_LOAD_PP_ENCRYPTED  = 4,
+    MOD_LOAD_PP_ERROR      = 5
+};
+
+typedef struct modLoadInfo_t
+{
+    int8_t error, format, powerPacked;
+    uint32_t fileSize;
+    const char *errorText;    // short, for the status bar
+    const char *errorDetails; // for the terminal
+} modLoadInfo_t;
+
+module_t *modFileLoad(UNICHAR *fileName, modLoadInfo_t *info);
+void modFileFree(module_t *module);
+uint32_t modFileNewSerial(void);
+int8_t resizePatternStore(module_t *module, int16_t numPatterns);
+void freePatternStore(module_t *module);
+void notesToModCells(const note_t *notes, uint8_t *cells, uint32_t numCells);
+int8_t modFileCheckNoteLayout(void);
+
+#endif
@@ -3,7 +3,10 @@
 #include <string.h>
 #include <stdint.h>
 #include <ctype.h> // tolower()
+#include <errno.h>
 #ifdef _WIN32
+#define WIN32_MEAN_AND_LEAN
+#include <windows.h>
 #include <io.h>
 #else
 #include <unistd.h>
@@ -14,27 +17,53 @@
 #include "pt_palette.h"
 #include "pt_header.h"
 #include "pt_sampler.h"
+#include "pt_sampleundo.h"
+#include "pt_edit.h"
 #include "pt_textout.h"
 #include "pt_audio.h"
 #include "pt_helpers.h"
 #include "pt_terminal.h"
 #include "pt_visuals.h"
 #include "pt_unicode.h"
+#include "pt_modfile.h"
+#include "pt_modloader.h"
+#include "pt_powerpacker.h"
 
-typedef struct mem_t
+#ifdef _WIN32
+#define openTmpFile(name) _open(name, _O_WRONLY | _O_CREAT | _O_EXCL | _O_BINARY, _S_IREAD | _S_IWRITE)
+#define fdopen _fdopen
+#define fileno _fileno
+#define fsync  _commit
+#else
+#define openTmpFile(name) open(name, O_WRONLY | O_CREAT | O_EXCL, 0666)
+#endif
+
+// Makes sure that a pattern is backed by the pattern store before it can be
+// edited or referenced in the order list. All patterns below the highest
+// allocated one are allocated too, so order list entries always hit real data.
+int8_t modAllocPattern(int16_t pattern)
 {
-    int8_t _eof;
-    uint8_t *_ptr, *_base;
-    uint32_t _cnt, _bufsiz;
-} mem_t;
+    int8_t result;
+
+    if ((pattern < 0) || (pattern > (MAX_PATTERNS - 1)))
+        return (false);
+
+    if (pattern < modEntry->allocatedPatterns)
+        return (true);
 
-static mem_t *mopen(const uint8_t *src, uint32_t length);
-static void mclose(mem_t **buf);
-static int32_t mgetc(mem_t *buf);
-static size_t mread(void *buffer, size_t size, size_t count, mem_t *buf);
-static void mseek(mem_t *buf, int32_t offset, int32_t whence);
+    // the replayer reads patterns from the audio thread, don't move the store under its feet
+    lockAudio();
+    result = resizePatternStore(modEntry, pattern + 1);
+    unlockAudio();
 
-uint8_t ppdecrunch(uint8_t *src, uint8_t *dst, uint8_t *offsetLens, uint32_t srcLen, uint32_t dstLen, uint8_t skipBits);
+    if (!result)
+    {
+        displayErrorMsg(editor.outOfMemoryText);
+        terminalPrintf("Couldn't allocate pattern %02d: out of memory\n", pattern);
+    }
+
+    return (result);
+}
 
 module_t *createNewMod(void)
 {
@@ -48,14 +77,12 @@ module_t *createNewMod(void)
         return (false);
     }
 
-    for (i = 0; i < MAX_PATTERNS; ++i)
+    newMod->serial = modFileNewSerial();
+
+    if (!resizePatternStore(newMod, 1))
     {
-        newMod->patterns[i] = (note_t *)(calloc(MOD_ROWS * AMIGA_VOICES, sizeof (note_t)));
-        if (newMod->patterns[i] == NULL)
-        {
-            showErrorMsgBox("Out of memory!");
-            return (false);
-        }
+        showErrorMsgBox("Out of memory!");
+        return (false);
     }
 
     newMod->sampleData = (int8_t *)(calloc(MOD_SAMPLES + 1, MAX_SAMPLE_LEN)); // +1 sample slot for overflow safety (scopes etc)
@@ -95,37 +122,65 @@ module_t *createNewMod(void)
     return (newMod);
 }
 
-int8_t modSave(char *fileName)
+typedef struct modSaveJob_t
+{
+    char *fileName, moduleTitle[20];
+    uint8_t *data;
+    uint32_t dataLen, editCount;
+    int8_t pack, packEfficiency, storedRaw, result;
+    uint32_t moduleSerial;
+} modSaveJob_t;
+
+static modSaveJob_t *modSaveJob;
+
+enum
 {
+    MOD_SAVE_OK         = 0,
+    MOD_SAVE_OUT_OF_MEM = 1,
+    MOD_SAVE_IO_ERROR   = 2
+};
+
+// Serializes the current module into one buffer. This is also the snapshot the
+// save thread works on, so the module can be edited while it's being written.
+static uint8_t *modSaveSnapshot(uint32_t *length)
+{
+    uint8_t *modBuffer, *ptr;
     int16_t tempPatternCount;
-    int32_t i, nameTextLen;
-    uint32_t tempLoopLength, tempLoopStart, j, k;
-    note_t tmp;
-    FILE *fmodule;
+    int32_t i;
+    uint32_t tempLoopLength, tempLoopStart, modLength, j;
 
     tempPatternCount = 0;
-
-    fmodule = fopen(fileName, "wb");
-    if (fmodule == NULL)
+    for (i = 0; i < MOD_ORDERS; ++i)
     {
-        displayErrorMsg("FILE I/O ERROR !");
-        terminalPrintf("Module saving failed: file input/output error\n");
-
-        return (false);
+        if (tempPatternCount < modEntry->head.order[i])
+            tempPatternCount = modEntry->head.order[i];
     }
 
+    if (++tempPatternCount > MAX_PATTERNS)
+          tempPatternCount = MAX_PATTERNS;
+
+    modLength = 1084 + (tempPatternCount * (MOD_ROWS * AMIGA_VOICES * 4));
+    for (i = 0; i < MOD_SAMPLES; ++i)
+        modLength += modEntry->samples[i].length;
+
+    modBuffer = (uint8_t *)(malloc(modLength));
+    if (modBuffer == NULL)
+        return (NULL);
+
+    ptr = modBuffer;
+
     for (i = 0; i < 20; ++i)
-        fputc(tolower(modEntry->head.moduleTitle[i]), fmodule);
+        *ptr++ = (uint8_t)(tolower(modEntry->head.moduleTitle[i]));
 
     for (i = 0; i < MOD_SAMPLES; ++i)
     {
         for (j = 0; j < 22; ++j)
-            fputc(tolower(modEntry->samples[i].text[j]), fmodule);
+            *ptr++ = (uint8_t)(tolower(modEntry->samples[i].text[j]));
 
-        fputc(modEntry->samples[i].length >> 9, fmodule);
-        fputc(modEntry->samples[i].length >> 1, fmodule);
-        fputc(modEntry->samples[i].fineTune & 0x0F, fmodule);
-        fputc((modEntry->samples[i].volume > 64) ? 64 : modEntry->samples[i].volume, fmodule);
+        *ptr++ = (uint8_t)(modEntry->samples[i].length >> 9);
+        *ptr++ = (uint8_t)(modEntry->samples[i].length >> 1);
+        *ptr++ = (uint8_t)(modEntry->samples[i].fineTune & 0x0F);
+        *ptr++ = (uint8_t)((modEntry->samples[i].volume > 64) ? 64 : modEntry->samples[i].volume);
 
         tempLoopLength = modEntry->samples[i].loopLength;
         if (tempLoopLength < 2)
@@ -135,658 +190,375 @@ int8_t modSave(char *fileName)
         if (tempLoopLength == 2)
             tempLoopStart = 0;
 
-        fputc(tempLoopStart  >> 9, fmodule);
-        fputc(tempLoopStart  >> 1, fmodule);
-        fputc(tempLoopLength >> 9, fmodule);
-        fputc(tempLoopLength >> 1, fmodule);
+        *ptr++ = (uint8_t)(tempLoopStart  >> 9);
+        *ptr++ = (uint8_t)(tempLoopStart  >> 1);
+        *ptr++ = (uint8_t)(tempLoopLength >> 9);
+        *ptr++ = (uint8_t)(tempLoopLength >> 1);
     }
 
-    fputc(modEntry->head.orderCount & 0x00FF, fmodule);
-    fputc(0x7F, fmodule); // ProTracker puts 0x7F at this place (restart pos)
+    *ptr++ = (uint8_t)(modEntry->head.orderCount & 0x00FF);
+    *ptr++ = 0x7F; // ProTracker puts 0x7F at this place (restart pos)
 
     for (i = 0; i < MOD_ORDERS; ++i)
-        fputc(modEntry->head.order[i] & 0x00FF, fmodule);
+        *ptr++ = (uint8_t)(modEntry->head.order[i] & 0x00FF);
 
-    tempPatternCount = 0;
-    for (i = 0; i < MOD_ORDERS; ++i)
-    {
-        if (tempPatternCount < modEntry->head.order[i])
-            tempPatternCount = modEntry->head.order[i];
-    }
-
-    if (++tempPatternCount > MAX_PATTERNS)
-          tempPatternCount = MAX_PATTERNS;
-
-    fwrite((tempPatternCount <= 64) ? "M.K." : "M!K!", 1, 4, fmodule);
+    memcpy(ptr, (tempPatternCount <= 64) ? "M.K." : "M!K!", 4);
+    ptr += 4;
 
     for (i = 0; i < tempPatternCount; ++i)
     {
-        for (j = 0; j < MOD_ROWS; ++j)
-        {
-            for (k = 0; k < AMIGA_VOICES; ++k)
-            {
-                tmp = modEntry->patterns[i][(j * AMIGA_VOICES) + k];
-
-                fputc((tmp.sample & 0xF0) | ((tmp.period >> 8) & 0x0F), fmodule);
-                fputc(tmp.period & 0x00FF, fmodule);
-                fputc(((tmp.sample << 4) & 0xF0) | (tmp.command & 0x0F), fmodule);
-                fputc(tmp.param, fmodule);
-            }
-        }
+        notesToModCells(modEntry->patterns[i], ptr, MOD_ROWS * AMIGA_VOICES);
+        ptr += (MOD_ROWS * AMIGA_VOICES * 4);
     }
 
     for (i = 0; i < MOD_SAMPLES; ++i)
     {
+        if (modEntry->samples[i].length == 0)
+            continue;
+
+        memcpy(ptr, &modEntry->sampleData[modEntry->samples[i].offset], modEntry->samples[i].length);
+
         // Amiga ProTracker "BEEEEEEEEP" sample fix
         if ((modEntry->samples[i].length >= 2) && ((modEntry->samples[i].loopStart + modEntry->samples[i].loopLength) == 2))
         {
-            fputc(0, fmodule);
-            fputc(0, fmodule);
-
-            k = modEntry->samples[i].length;
-            for (j = 2; j < k; ++j)
-                fputc(modEntry->sampleData[modEntry->samples[i].offset + j], fmodule);
-        }
-        else
-        {
-            fwrite(&modEntry->sampleData[MAX_SAMPLE_LEN * i], 1, modEntry->samples[i].length, fmodule);
+            ptr[0] = 0;
+            ptr[1] = 0;
         }
-    }
 
-    fclose(fmodule);
-
-    displayMsg("MODULE SAVED !");
-    setMsgPointer();
+        ptr += modEntry->samples[i].length;
+    }
 
-    editor.diskop.cached = false;
-    if (editor.ui.diskOpScreenShown)
-        editor.ui.updateDiskOpFileList = true;
+    *length = modLength;
+    return (modBuffer);
+}
 
-    updateWindowTitle(MOD_NOT_MODIFIED);
+/* Crunches (if wanted) and writes the image. It's written to a new temp file
+** next to the real one with one fwrite() (unbuffered, so one write call),
+** flushed to disk and then renamed over the real file, so a failed save or a
+** crash never leaves a half-written module behind. Doesn't touch the UI, this
+** runs on the save thread.
+**
+** On POSIX systems a symlink is followed and the file it points to gets
+** replaced, with its permission bits kept (not its owner). On Windows the
+** link itself is replaced.
+*/
+static int8_t modSaveWrite(modSaveJob_t *job)
+{
+    char *tmpFileName, *fileName, *realFileName;
+    int8_t result;
+    uint8_t *ppBuffer;
+    int32_t i, fd;
+    uint32_t ppPackLen;
+    size_t written;
+    FILE *fmodule;
+#ifndef _WIN32
+    struct stat st;
+#endif
 
-    if (moduleNameIsEmpty(modEntry->head.moduleTitle))
-    {
-        terminalPrintf("Module \"untitled\" saved\n");
-    }
-    else
+    if (job->pack)
     {
-        terminalPrintf("Module \"");
+        ppBuffer = ppcrunch(job->data, job->dataLen, job->packEfficiency, &ppPackLen);
+        if (ppBuffer == NULL)
+            return (MOD_SAVE_OUT_OF_MEM);
 
-        nameTextLen = 20;
-        for (i = 19; i >= 0; --i)
+        if (ppPackLen < job->dataLen)
         {
-            if (modEntry->head.moduleTitle[i] == '\0')
-                nameTextLen--;
-            else
-                break;
-        }
+            free(job->data);
 
-        for (i = 0; i < nameTextLen; ++i)
+            job->data    = ppBuffer;
+            job->dataLen = ppPackLen;
+        }
+        else
         {
-            if (modEntry->head.moduleTitle[i] != '\0')
-                teriminalPutChar(tolower(modEntry->head.moduleTitle[i]));
-            else
-                teriminalPutChar(' ');
+            // didn't get any smaller (random sample data etc.), store it unpacked
+            free(ppBuffer);
+            job->storedRaw = true;
         }
-
-        terminalPrintf("\" saved\n");
     }
 
-    return (true);
-}
-
-static int8_t checkModType(const char *buf)
-{
-         if (!strncmp(buf, "M.K.", 4)) return (FORMAT_MK);   // ProTracker v1.x, handled as ProTracker v2.x
-    else if (!strncmp(buf, "M!K!", 4)) return (FORMAT_MK2);  // ProTracker v2.x (if >64 patterns)
-    else if (!strncmp(buf, "FLT4", 4)) return (FORMAT_FLT4); // StarTrekker (4ch), handled as ProTracker v2.x
-    else if (!strncmp(buf, "4CHN", 4)) return (FORMAT_4CHN); // FastTracker II (4ch), handled as ProTracker v2.x
-    else if (!strncmp(buf, "N.T.", 4)) return (FORMAT_MK);   // NoiseTracker 1.0, handled as ProTracker v2.x
-    else if (!strncmp(buf, "M&K!", 4)) return (FORMAT_FEST); // Special NoiseTracker format (used in music disks?)
-    else if (!strncmp(buf, "FEST", 4)) return (FORMAT_FEST); // Special NoiseTracker format (used in music disks?)
-
-    return (FORMAT_UNKNOWN); // may be The Ultimate SoundTracker, 15 samples
-}
-
-module_t *modLoad(UNICHAR *fileName)
-{
-    char modSig[4], tmpChar;
-    int8_t mightBeSTK, numSamples, lateVerSTKFlag;
-    uint8_t ppCrunchData[4], bytes[4], *ppBuffer;
-    uint8_t *modBuffer, ch, row, pattern;
-    int32_t i, tmp, loopOverflow;
-    uint32_t j, PP20, ppPackLen, ppUnpackLen;
-    FILE *fmodule;
-    module_t *newModule;
-    moduleSample_t *s;
-    note_t *note;
-    mem_t *mod;
-
-    lateVerSTKFlag = false;
-    mightBeSTK     = false;
+#ifdef _WIN32
+    realFileName = NULL;
+#else
+    realFileName = realpath(job->fileName, NULL); // NULL if the file doesn't exist yet
+#endif
+    fileName = (realFileName != NULL) ? realFileName : job->fileName;
 
-    newModule = (module_t *)(calloc(1, sizeof (module_t)));
-    if (newModule == NULL)
+    tmpFileName = (char *)(malloc(strlen(fileName) + 8));
+    if (tmpFileName == NULL)
     {
-        displayErrorMsg(editor.outOfMemoryText);
-        terminalPrintf(editor.modLoadOoMText);
-
-        return (NULL);
+        free(realFileName);
+        return (MOD_SAVE_OUT_OF_MEM);
     }
 
-    fmodule = UNICHAR_FOPEN(fileName, "rb");
-    if (fmodule == NULL)
-    {
-        free(newModule);
-        newModule = NULL;
+    result = MOD_SAVE_IO_ERROR;
 
-        displayErrorMsg("FILE I/O ERROR !");
-        terminalPrintf("Module loading failed: file input/output error!\n");
+    // pick a name that isn't taken, an existing file is never overwritten
+    fd = -1;
+    for (i = 0; i < 100; ++i)
+    {
+        sprintf(tmpFileName, "%s.%02d.tmp", fileName, i);
 
-        return (NULL);
+        fd = openTmpFile(tmpFileName);
+        if ((fd != -1) || (errno != EEXIST))
+            break;
     }
 
-    fseek(fmodule, 0, SEEK_END);
-    newModule->head.moduleSize = ftell(fmodule);
-    fseek(fmodule, 0, SEEK_SET);
+    fmodule = (fd != -1) ? fdopen(fd, "wb") : NULL;
+    if ((fmodule == NULL) && (fd != -1))
+        close(fd);
 
-    // check if mod is a powerpacker mod
-    fread(&PP20, 4, 1, fmodule); if (bigEndian) PP20 = SWAP32(PP20);
-    if (PP20 == 0x30325850) // "PX20"
+    if (fmodule != NULL)
     {
-        free(newModule);
-        fclose(fmodule);
+        setvbuf(fmodule, NULL, _IONBF, 0);
+        written = fwrite(job->data, 1, job->dataLen, fmodule);
 
-        displayErrorMsg("ENCRYPTED PPACK !");
-        terminalPrintf("Module loading failed: .MOD is PowerPacker encrypted!\n");
+        // make sure the data is on disk before the rename makes it the real file
+        if ((fflush(fmodule) != 0) || (fsync(fileno(fmodule)) != 0))
+            written = 0;
 
-        return (NULL);
-    }
-    else if (PP20 == 0x30325050) // "PP20"
-    {
-        ppPackLen = newModule->head.moduleSize;
-        if (ppPackLen & 3)
+        if ((fclose(fmodule) == 0) && (written == job->dataLen))
         {
-            free(newModule);
-            fclose(fmodule);
-
-            displayErrorMsg("POWERPACKER ERROR");
-            terminalPrintf("Module loading failed: unknown PowerPacker error\n");
+#ifdef _WIN32
+            if (MoveFileExA(tmpFileName, fileName, MOVEFILE_REPLACE_EXISTING))
+                result = MOD_SAVE_OK;
+#else
+            // keep the permissions of the file we replace
+            if (stat(fileName, &st) == 0)
+                chmod(tmpFileName, st.st_mode & 07777);
 
-            return (NULL);
+            if (rename(tmpFileName, fileName) == 0)
+                result = MOD_SAVE_OK;
+#endif
         }
 
-        fseek(fmodule, ppPackLen - 4, SEEK_SET);
-
-        ppCrunchData[0] = (uint8_t)(fgetc(fmodule));
-        ppCrunchData[1] = (uint8_t)(fgetc(fmodule));
-        ppCrunchData[2] = (uint8_t)(fgetc(fmodule));
-        ppCrunchData[3] = (uint8_t)(fgetc(fmodule));
-
-        ppUnpackLen = (ppCrunchData[0] << 16) | (ppCrunchData[1] << 8) | ppCrunchData[2];
-
-        // smallest and biggest possible .MOD
-        if ((ppUnpackLen < 2108) || (ppUnpackLen > 4195326))
-        {
-            free(newModule);
-            fclose(fmodule);
-
-            displayErrorMsg("NOT A MOD FILE !");
-            terminalPrintf("Module loading failed: not a valid .MOD file (incorrect unpacked file size)\n");
-
-            return (NULL);
-        }
+        if (result != MOD_SAVE_OK)
+            remove(tmpFileName);
+    }
 
-        ppBuffer = (uint8_t *)(malloc(ppPackLen));
-        if (ppBuffer == NULL)
-        {
-            free(newModule);
-            fclose(fmodule);
+    free(tmpFileName);
+    free(realFileName);
 
-            displayErrorMsg(editor.outOfMemoryText);
-            terminalPrintf(editor.modLoadOoMText);
+    return (result);
+}
 
-            return (NULL);
-        }
+static void freeModSaveJob(modSaveJob_t *job)
+{
+    if (job != NULL)
+    {
+        free(job->fileName);
+        free(job->data);
+        free(job);
+    }
+}
 
-        modBuffer = (uint8_t *)(malloc(ppUnpackLen));
-        if (modBuffer == NULL)
-        {
-            free(newModule);
-            free(ppBuffer);
+static modSaveJob_t *createModSaveJob(const char *fileName)
+{
+    modSaveJob_t *job;
 
-            fclose(fmodule);
+    job = (modSaveJob_t *)(calloc(1, sizeof (modSaveJob_t)));
+    if (job == NULL)
+        return (NULL);
 
-            displayErrorMsg(editor.outOfMemoryText);
-            terminalPrintf(editor.modLoadOoMText);
+    job->fileName = (char *)(malloc(strlen(fileName) + 1));
+    if (job->fileName == NULL)
+    {
+        free(job);
+        return (NULL);
+    }
 
-            return (NULL);
-        }
+    strcpy(job->fileName, fileName);
+    memcpy(job->moduleTitle, modEntry->head.moduleTitle, 20);
 
-        fseek(fmodule, 0, SEEK_SET);
-        fread(ppBuffer, 1, ppPackLen, fmodule);
-        fclose(fmodule);
+    // to tell if the module was edited while it was being written
+    job->moduleSerial = modEntry->serial;
+    job->editCount    = editor.modEditCount;
 
-        ppdecrunch(ppBuffer + 8, modBuffer, ppBuffer + 4, ppPackLen - 12, ppUnpackLen, ppCrunchData[3]);
-        free(ppBuffer);
+    job->pack           = editor.diskop.modPackFlg;
+    job->packEfficiency = editor.diskop.modPackEfficiency;
 
-        newModule->head.moduleSize = ppUnpackLen;
-    }
-    else
+    job->data = modSaveSnapshot(&job->dataLen);
+    if (job->data == NULL)
     {
-        // smallest and biggest possible .MOD
-        if ((newModule->head.moduleSize < 2108) || (newModule->head.moduleSize > 4195326))
-        {
-            free(newModule);
-            fclose(fmodule);
-
-            displayErrorMsg("NOT A MOD FILE !");
-            terminalPrintf("Module loading failed: not a valid .MOD file (invalid file size)");
-
-            return (NULL);
-        }
+        freeModSaveJob(job);
+        return (NULL);
+    }
 
-        modBuffer = (uint8_t *)(malloc(newModule->head.moduleSize));
-        if (modBuffer == NULL)
-        {
-            free(newModule);
-            fclose(fmodule);
+    return (job);
+}
 
-            displayErrorMsg(editor.outOfMemoryText);
-            terminalPrintf(editor.modLoadOoMText);
+static void reportModSave(modSaveJob_t *job)
+{
+    int32_t i, nameTextLen;
 
-            return (NULL);
-        }
+    if (job->result == MOD_SAVE_OUT_OF_MEM)
+    {
+        displayErrorMsg(editor.outOfMemoryText);
+        terminalPrintf("Module saving failed: out of memory\n");
 
-        fseek(fmodule, 0, SEEK_SET);
-        fread(modBuffer, 1, newModule->head.moduleSize, fmodule);
-        fclose(fmodule);
+        return;
     }
 
-    mod = mopen(modBuffer, newModule->head.moduleSize);
-    if (mod == NULL)
+    if (job->result == MOD_SAVE_IO_ERROR)
     {
-        free(modBuffer);
-        free(newModule);
-
         displayErrorMsg("FILE I/O ERROR !");
-        terminalPrintf("Module loading failed: file input/output error\n");
+        terminalPrintf("Module saving failed: file input/output error\n");
 
-        return (NULL);
+        return;
     }
 
-    // check module tag
-    mseek(mod, 0x0438, SEEK_SET);
-    mread(modSig, 1, 4, mod);
-
-    newModule->head.format = checkModType(modSig);
-    if (newModule->head.format == FORMAT_UNKNOWN)
-        mightBeSTK = true;
-
-    mseek(mod, 0, SEEK_SET);
+    displayMsg("MODULE SAVED !");
+    setMsgPointer();
 
-    mread(newModule->head.moduleTitle, 1, 20, mod);
-    // index 21 of newModule->head.moduleTitle is already zeroed
+    editor.diskop.cached = false;
+    if (editor.ui.diskOpScreenShown)
+        editor.ui.updateDiskOpFileList = true;
 
-    for (i = 0; i < 20; ++i)
+    // edits made after the snapshot aren't in the file
+    if ((job->moduleSerial == modEntry->serial) && (job->editCount == editor.modEditCount))
     {
-        tmpChar = newModule->head.moduleTitle[i];
-        if (((tmpChar < ' ') || (tmpChar > '~')) && (tmpChar != '\0'))
-            tmpChar = ' ';
-
-        newModule->head.moduleTitle[i] = (char)(tolower(tmpChar));
+        modEntry->modified = false;
+        updateWindowTitle(MOD_NOT_MODIFIED);
     }
 
-    // read sample information
-    for (i = 0; i < MOD_SAMPLES; ++i)
+    if (moduleNameIsEmpty(job->moduleTitle))
     {
-        s = &newModule->samples[i];
-
-        if (mightBeSTK && (i > 14))
-        {
-            s->loopLength = 2;
-        }
-        else
-        {
-            mread(s->text, 1, 22, mod);
-            // index 23 of s->text is already zeroed
-
-            for (j = 0; j < 22; ++j)
-            {
-                tmpChar = s->text[j];
-                if (((tmpChar < ' ') || (tmpChar > '~')) && (tmpChar != '\0'))
-                    tmpChar = ' ';
-
-                s->text[j] = (char)(tolower(tmpChar));
-            }
-
-            s->length = ((mgetc(mod) << 8) | mgetc(mod)) * 2;
-            if (s->length > 9999)
-                lateVerSTKFlag = true; // Only used if mightBeSTK is set
-
-            if (newModule->head.format == FORMAT_FEST)
-                s->fineTune = (uint8_t)((-mgetc(mod) & 0x1F) / 2); // One more bit of precision, + inverted
-            else
-                s->fineTune = (uint8_t)(mgetc(mod)) & 0x0F;
-
-            s->volume = (uint8_t)(mgetc(mod));
-            if (s->volume > 64)
-                s->volume = 64;
-
-            s->loopStart = ((mgetc(mod) << 8) | mgetc(mod)) * 2;
-            if (mightBeSTK)
-                s->loopStart /= 2;
-
-            s->loopLength = ((mgetc(mod) << 8) | mgetc(mod)) * 2;
-            if (s->loopLength < 2)
-                s->loopLength = 2;
-
-            // fix for poorly converted STK->PTMOD modules.
-            if (!mightBeSTK && (s->loopLength > 2) && ((s->loopStart + s->loopLength) > s->length))
-            {
-                if (((s->loopStart / 2) + s->loopLength) <= s->length)
-                    s->loopStart /= 2;
-            }
-
-            if (mightBeSTK)
-            {
-                if (s->loopLength > 2)
-                {
-                    tmp = s->loopStart;
-
-                    s->length      -= s->loopStart;
-                    s->loopStart    = 0;
-                    s->tmpLoopStart = tmp;
-                }
-
-                // no finetune in STK/UST
-                s->fineTune = 0;
-            }
-
-            // some modules are broken like this, adjust sample length if possible (this is ok if we have room)
-            if ((s->loopLength > 2) && ((s->loopStart + s->loopLength) > s->length))
-            {
-                loopOverflow = (s->loopStart + s->loopLength) - s->length;
-                if ((s->length + loopOverflow) <= 131070)
-                {
-                    s->length += loopOverflow; // this is safe, we're calloc()'ing 131070*(31+1) bytes
-                }
-                else
-                {
-                    s->loopStart  = 0;
-                    s->loopLength = 2;
-                }
-            }
-        }
+        terminalPrintf("Module \"untitled\" saved\n");
     }
-
-    // STK 2.5 had loopStart in words, not bytes. Convert if late version STK.
-    for (i = 0; i < 15; ++i)
+    else
     {
-        if (mightBeSTK && lateVerSTKFlag)
+        terminalPrintf("Module \"");
+
+        nameTextLen = 20;
+        for (i = 19; i >= 0; --i)
         {
-            s = &newModule->samples[i];
-            if (s->loopStart > 2)
-            {
-                s->length -= s->tmpLoopStart;
-                s->tmpLoopStart *= 2;
-            }
+            if (job->moduleTitle[i] == '\0')
+                nameTextLen--;
+            else
+                break;
         }
-    }
-
-    newModule->head.orderCount = (uint8_t)(mgetc(mod));
 
-    // fixes beatwave.mod (129 orders) and other weird MODs
-    if (newModule->head.orderCount > 127)
-    {
-        if (newModule->head.orderCount > 129)
+        for (i = 0; i < nameTextLen; ++i)
         {
-            mclose(&mod);
-
-            free(modBuffer);
-            free(newModule);
-
-            displayErrorMsg("NOT A MOD FILE !");
-            terminalPrintf("Module loading failed: not a valid .MOD file (NumOrders > 127)\n");
-
-            return (NULL);
+            if (job->moduleTitle[i] != '\0')
+                teriminalPutChar(tolower(job->moduleTitle[i]));
+            else
+                teriminalPutChar(' ');
         }
 
-        newModule->head.orderCount = 127;
+        terminalPrintf("\" saved\n");
     }
 
-    if (newModule->head.orderCount == 0)
-    {
-        mclose(&mod);
-
-        free(modBuffer);
-        free(newModule);
-
-        displayErrorMsg("NOT A MOD FILE !");
-        terminalPrintf("Module loading failed: not a valid .MOD file (NumOrders = 0)\n");
+    if (job->storedRaw)
+        terminalPrintf("Packing didn't make the module smaller, it was saved unpacked\n");
+}
 
-        return (NULL);
-    }
+static int32_t modSaveThreadFunc(void *ptr)
+{
+    modSaveJob_t *job;
 
-    newModule->head.restartPos = (uint8_t)(mgetc(mod));
-    if (mightBeSTK && ((newModule->head.restartPos == 0) || (newModule->head.restartPos > 220)))
-    {
-        mclose(&mod);
+    job = (modSaveJob_t *)(ptr);
+    job->result = modSaveWrite(job);
 
-        free(modBuffer);
-        free(newModule);
+    editor.ui.modSaveFinished = true;
+    return (0);
+}
 
-        displayErrorMsg("NOT A MOD FILE !");
-        terminalPrintf("Module loading failed: not a valid .MOD file\n");
+static void finishModSave(void)
+{
+    SDL_WaitThread(editor.modSaveThread, NULL);
 
-        return (NULL);
-    }
+    editor.ui.modSaveFinished = false;
+    editor.isModSaving        = false;
 
-    if (mightBeSTK)
-    {
-        // If we're still here at this point and the mightBeSTK flag is set,
-        // then it's definitely a proper The Ultimate SoundTracker (STK) module.
+    reportModSave(modSaveJob);
 
-        newModule->head.format = FORMAT_STK;
+    freeModSaveJob(modSaveJob);
+    modSaveJob = NULL;
+}
 
-        if (newModule->head.restartPos != 120) // 120 = 125 (?)
-        {
-            if (newModule->head.restartPos > 239)
-                newModule->head.restartPos = 239;
+// called every frame from the main thread, picks up the result of a background save
+void updateModSave(void)
+{
+    if (editor.isModSaving && editor.ui.modSaveFinished)
+        finishModSave();
+}
 
-            // max BPM: 14536 (there was no clamping originally, sick!)
-            newModule->head.initBPM = (uint16_t)(1773447 / ((240 - newModule->head.restartPos) * 122));
-        }
-    }
+// blocks until a background save is done (before starting a new one, or on exit)
+void waitForModSave(void)
+{
+    if (editor.isModSaving)
+        finishModSave();
+}
 
-    for (i = 0; i < MOD_ORDERS; ++i)
-    {
-        newModule->head.order[i] = (int16_t)(mgetc(mod));
-        if (newModule->head.order[i] > newModule->head.patternCount)
-            newModule->head.patternCount = newModule->head.order[i];
-    }
+// Synchronous save, used where we can't rely on the main loop (e.g. the crash handler)
+int8_t modSave(char *fileName)
+{
+    int8_t result;
+    modSaveJob_t *job;
 
-    if (++newModule->head.patternCount > MAX_PATTERNS)
+    job = createModSaveJob(fileName);
+    if (job == NULL)
     {
-        mclose(&mod);
-
-        free(modBuffer);
-        free(newModule);
-
-        displayErrorMsg("NOT A MOD FILE !");
-        terminalPrintf("Module loading failed: not a valid .MOD file (NumPatterns > 100)\n");
+        displayErrorMsg(editor.outOfMemoryText);
+        terminalPrintf("Module saving failed: out of memory\n");
 
-        return (NULL);
+        return (false);
     }
 
-    if (newModule->head.format != FORMAT_STK) // The Ultimate SoundTracker MODs doesn't have this tag
-        mseek(mod, 4, SEEK_CUR); // We already read/tested the tag earlier, skip it
-
-    // init 100 patterns and load patternCount of patterns
-    for (pattern = 0; pattern < MAX_PATTERNS; ++pattern)
-    {
-        newModule->patterns[pattern] = (note_t *)(calloc(MOD_ROWS * AMIGA_VOICES, sizeof (note_t)));
-        if (newModule->patterns[pattern] == NULL)
-        {
-            mclose(&mod);
-
-            free(modBuffer);
-
-            for (i = 0; i < pattern; ++i)
-                free(newModule->patterns[i]);
+    job->result = modSaveWrite(job);
+    reportModSave(job);
 
-            free(newModule);
+    result = (job->result == MOD_SAVE_OK);
+    freeModSaveJob(job);
 
-            displayErrorMsg(editor.outOfMemoryText);
-            terminalPrintf(editor.modLoadOoMText);
+    return (result);
+}
 
-            return (NULL);
-        }
-    }
+// Snapshots the module on this thread and lets a thread crunch and write it
+int8_t modSaveInBackground(char *fileName)
+{
+    waitForModSave();
 
-    for (pattern = 0; pattern < newModule->head.patternCount; ++pattern)
+    modSaveJob = createModSaveJob(fileName);
+    if (modSaveJob == NULL)
     {
-        note = newModule->patterns[pattern];
-        for (row = 0; row < MOD_ROWS; ++row)
-        {
-            for (ch = 0; ch < AMIGA_VOICES; ++ch)
-            {
-                bytes[0] = (uint8_t)(mgetc(mod));
-                bytes[1] = (uint8_t)(mgetc(mod));
-                bytes[2] = (uint8_t)(mgetc(mod));
-                bytes[3] = (uint8_t)(mgetc(mod));
-
-                note->period  = ((bytes[0] & 0x0F) << 8) | bytes[1];
-                note->sample  =  (bytes[0] & 0xF0) | (bytes[2] >> 4); // Don't (!) clamp, the player checks for invalid samples
-                note->command = bytes[2] & 0x0F;
-                note->param   = bytes[3];
-
-                if ((newModule->head.format == FORMAT_NT) || (newModule->head.format == FORMAT_FEST))
-                {
-                    // Any Dxx == D00 in N.T./FEST modules
-                    if (note->command == 0x0D)
-                        note->param = 0x00;
-                }
-                else if (mightBeSTK)
-                {
-                    // Convert STK effects to PT effects
-                    if (!lateVerSTKFlag)
-                    {
-                        if (note->command == 0x01)
-                        {
-                            // Arpeggio
-                            note->command = 0x00;
-                        }
-                        else if (note->command == 0x02)
-                        {
-                            // Pitch slide
-                            if (note->param & 0xF0)
-                            {
-                                note->command = 0x02;
-                                note->param >>= 4;
-                            }
-                            else if (note->param & 0x0F)
-                            {
-                                note->command = 0x01;
-                            }
-                        }
-                    }
-
-                    // Volume slide/pattern break
-                    if (note->command == 0x0D)
-                    {
-                        if (note->param == 0)
-                            note->command = 0x0D;
-                        else
-                            note->command = 0x0A;
-                    }
-                }
-                else if (newModule->head.format == FORMAT_4CHN) // 4CHN != PT MOD
-                {
-                    // Remove FastTracker II 8xx/E8x panning commands if present
-                    if (note->command == 0x08)
-                    {
-                        // 8xx
-                        note->command = 0;
-                        note->param   = 0;
-                    }
-                    else if ((note->command == 0x0E) && ((note->param >> 4) == 0x08))
-                    {
-                        // E8x
-                        note->command = 0;
-                        note->param   = 0;
-                    }
-
-                    // Remove F00, FastTracker II didn't use F00 as STOP in .MOD
-                    if ((note->command == 0x0F) && (note->param == 0x00))
-                    {
-                        note->command = 0;
-                        note->param   = 0;
-                    }
-                }
+        displayErrorMsg(editor.outOfMemoryText);
+        terminalPrintf("Module saving failed: out of memory\n");
 
-                note++;
-            }
-        }
+        return (false);
     }
 
-    numSamples = (newModule->head.format == FORMAT_STK) ? 15 : 31;
-    for (i = 0; i < numSamples; ++i)
-        newModule->samples[i].offset = MAX_SAMPLE_LEN * i;
+    editor.ui.modSaveFinished = false;
+    editor.isModSaving        = true;
 
-    newModule->sampleData = (int8_t *)(calloc(MOD_SAMPLES + 1, MAX_SAMPLE_LEN)); // +1 sample slot for overflow safety (scopes etc)
-    if (newModule->sampleData == NULL)
+    editor.modSaveThread = SDL_CreateThread(modSaveThreadFunc, "ProTracker module save thread", modSaveJob);
+    if (editor.modSaveThread == NULL)
     {
-        mclose(&mod);
-
-        free(modBuffer);
-
-        for (i = 0; i < MAX_PATTERNS; ++i)
-        {
-            if (newModule->patterns[i] != NULL)
-                free(newModule->patterns[i]);
-        }
+        // no thread, save right here instead
+        editor.isModSaving = false;
 
-        free(newModule);
+        modSaveJob->result = modSaveWrite(modSaveJob);
+        reportModSave(modSaveJob);
 
-        displayErrorMsg(editor.outOfMemoryText);
-        terminalPrintf(editor.modLoadOoMText);
-
-        return (NULL);
+        freeModSaveJob(modSaveJob);
+        modSaveJob = NULL;
     }
 
-    // load sample data
-    numSamples = (newModule->head.format == FORMAT_STK) ? 15 : 31;
-    for (i = 0; i < numSamples; ++i)
-    {
-        s = &newModule->samples[i];
-
-        if (mightBeSTK && (s->loopLength > 2))
-        {
-            for (j = 0; j < (uint32_t)(s->tmpLoopStart); ++j)
-                mgetc(mod); // skip
+    return (true);
+}
 
-            mread(&newModule->sampleData[s->offset], 1, s->length - s->loopStart, mod);
-        }
-        else
-        {
-            mread(&newModule->sampleData[s->offset], 1, s->length, mod);
-        }
+module_t *modLoad(UNICHAR *fileName)
+{
+    module_t *newModule;
+    modLoadInfo_t info;
 
-        // fix beeping samples
-        if ((s->length >= 2) && ((s->loopStart + s->loopLength) <= 2))
-        {
-            newModule->sampleData[s->offset + 0] = 0;
-            newModule->sampleData[s->offset + 1] = 0;
-        }
+    newModule = modFileLoad(fileName, &info);
+    if (newModule == NULL)
+    {
+        displayErrorMsg((info.error == MOD_LOAD_OUT_OF_MEMORY) ? editor.outOfMemoryText : info.errorText);
+        terminalPrintf("Module loading failed: %s\n", info.errorDetails);
     }
 
-    mclose(&mod);
-    free(modBuffer);
-
-    for (i = 0; i < AMIGA_VOICES; ++i)
-        newModule->channels[i].n_chanindex = i;
-
     return (newModule);
 }
 
@@ -963,220 +735,7 @@ int8_t saveModule(int8_t checkIfFileExist, int8_t giveNewFreeFilename)
         editor.ui.askScreenShown = false;
     }
 
-    return (modSave(fileName));
-}
-
-static mem_t *mopen(const uint8_t *src, uint32_t length)
-{
-    mem_t *b;
-
-    if ((src == NULL) || (length == 0))
-        return (NULL);
-
-    b = (mem_t *)(malloc(sizeof (mem_t)));
-    if (b == NULL)
-        return (NULL);
-
-    b->_base   = (uint8_t *)(src);
-    b->_ptr    = (uint8_t *)(src);
-    b->_cnt    = length;
-    b->_bufsiz = length;
-    b->_eof    = false;
-
-    return (b);
-}
-
-static void mclose(mem_t **buf)
-{
-    if (*buf != NULL)
-    {
-        free(*buf);
-        *buf = NULL;
-    }
-}
-
-static int32_t mgetc(mem_t *buf)
-{
-    int32_t b;
-
-    if ((buf == NULL) || (buf->_ptr == NULL) || (buf->_cnt <= 0))
-        return (0);
-
-    b = *buf->_ptr;
-
-    buf->_cnt--;
-    buf->_ptr++;
-
-    if (buf->_cnt <= 0)
-    {
-        buf->_ptr = buf->_base + buf->_bufsiz;
-        buf->_cnt = 0;
-        buf->_eof = true;
-    }
-
-    return (int32_t)(b);
-}
-
-static size_t mread(void *buffer, size_t size, size_t count, mem_t *buf)
-{
-    int32_t pcnt;
-    size_t wrcnt;
-
-    if ((buf == NULL) || (buf->_ptr == NULL))
-        return (0);
-
-    wrcnt = size * count;
-    if ((size == 0) || buf->_eof)
-        return (0);
-
-    pcnt = (buf->_cnt > wrcnt) ? wrcnt : buf->_cnt;
-    memcpy(buffer, buf->_ptr, pcnt);
-
-    buf->_cnt -= pcnt;
-    buf->_ptr += pcnt;
-
-    if (buf->_cnt <= 0)
-    {
-        buf->_ptr = buf->_base + buf->_bufsiz;
-        buf->_cnt = 0;
-        buf->_eof = true;
-    }
-
-    return (pcnt / size);
-}
-
-static void mseek(mem_t *buf, int32_t offset, int32_t whence)
-{
-    if (buf == NULL)
-        return;
-
-    if (buf->_base)
-    {
-        switch (whence)
-        {
-            case SEEK_SET: buf->_ptr  = buf->_base + offset;                break;
-            case SEEK_CUR: buf->_ptr += offset;                             break;
-            case SEEK_END: buf->_ptr  = buf->_base + buf->_bufsiz + offset; break;
-            default: break;
-        }
-
-        buf->_eof = false;
-        if (buf->_ptr >= (buf->_base + buf->_bufsiz))
-        {
-            buf->_ptr = buf->_base + buf->_bufsiz;
-            buf->_eof = true;
-        }
-
-        buf->_cnt = (buf->_base + buf->_bufsiz) - buf->_ptr;
-    }
-}
-
-/*
-** Code taken from Heikki Orsila's amigadepack. Seems to have no license,
-** so I'll assume it fits into wtfpl (wtfpl.net). Heikki should contact me
-** if it shall not.
-** Modified by 8bitbubsy
-**/
-
-#define PP_READ_BITS(nbits, var) do {       \
-  bitCnt = (nbits);                         \
-  while (bitsLeft < bitCnt) {               \
-    if (bufSrc < src) return (false);       \
-    bitBuffer |= (*--bufSrc << bitsLeft);   \
-    bitsLeft += 8;                          \
-  }                                         \
-  (var) = 0;                                \
-  bitsLeft -= bitCnt;                       \
-  while (bitCnt--) {                        \
-    (var) = ((var) << 1) | (bitBuffer & 1); \
-    bitBuffer >>= 1;                        \
-  }                                         \
-} while (0);
-
-uint8_t ppdecrunch(uint8_t *src, uint8_t *dst, uint8_t *offsetLens, uint32_t srcLen, uint32_t dstLen, uint8_t skipBits)
-{
-    uint8_t *bufSrc, *dstEnd, *out, bitsLeft, bitCnt;
-    uint32_t x, todo, offBits, offset, written, bitBuffer;
-
-    if ((src == NULL) || (dst == NULL) || (offsetLens == NULL))
-        return (false);
-
-    bitsLeft  = 0;
-    bitBuffer = 0;
-    written   = 0;
-    bufSrc    = src + srcLen;
-    out       = dst + dstLen;
-    dstEnd    = out;
-
-    PP_READ_BITS(skipBits, x);
-    while (written < dstLen)
-    {
-        PP_READ_BITS(1, x);
-        if (x == 0)
-        {
-            todo = 1;
-
-            do
-            {
-                PP_READ_BITS(2, x);
-                todo += x;
-            }
-            while (x == 3);
-
-            while (todo--)
-            {
-                PP_READ_BITS(8, x);
-
-                if (out <= dst)
-                    return (false);
-
-                *--out = (uint8_t)(x);
-                written++;
-            }
-
-            if (written == dstLen)
-                break;
-        }
-
-        PP_READ_BITS(2, x);
-
-        offBits = offsetLens[x];
-        todo    = x + 2;
-
-        if (x == 3)
-        {
-            PP_READ_BITS(1, x);
-            if (x == 0) offBits = 7;
-
-            PP_READ_BITS((uint8_t)(offBits), offset);
-            do
-            {
-                PP_READ_BITS(3, x);
-                todo += x;
-            }
-            while (x == 7);
-        }
-        else
-        {
-            PP_READ_BITS((uint8_t)(offBits), offset);
-        }
-
-        if ((out + offset) >= dstEnd)
-            return (false);
-
-        while (todo--)
-        {
-            x = out[offset];
-
-            if (out <= dst)
-                return (false);
-
-            *--out = (uint8_t)(x);
-            written++;
-        }
-    }
-
-    return (true);
+    return (modSaveInBackground(fileName));
 }
 
 void setupNewMod(void)
@@ -1192,9 +751,11 @@ void setupNewMod(void)
         modEntry->samples[i].loopStartDisp  = &modEntry->samples[i].loopStart;
         modEntry->samples[i].loopLengthDisp = &modEntry->samples[i].loopLength;
 
-        fillSampleRedoBuffer(i);
+        sampleUndoReset(i);
     }
 
+    resetUndo();
+
     modSetPos(0, 0);
     modSetPattern(0); // set pattern to 00 instead of first order's pattern
 
@@ -4,12 +4,17 @@
 #include <stdint.h>
 #include "pt_header.h"
 #include "pt_unicode.h"
+#include "pt_modfile.h"
 
 module_t *createNewMod(void);
 int8_t saveModule(int8_t checkIfFileExist, int8_t giveNewFreeFilename);
 int8_t modSave(char *fileName);
+int8_t modSaveInBackground(char *fileName);
+void updateModSave(void);
+void waitForModSave(void);
 module_t *modLoad(UNICHAR *fileName);
 void setupNewMod(void);
+int8_t modAllocPattern(int16_t pattern);
 
 void diskOpLoadFile(uint32_t fileEntryRow); // pt_mouse.c
 
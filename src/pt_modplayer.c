@@ -14,6 +14,8 @@
 #include "pt_modloader.h"
 #include "pt_config.h"
 #include "pt_sampler.h"
+#include "pt_sampleundo.h"
+#include "pt_edit.h"
 #include "pt_visuals.h"
 #include "pt_textout.h"
 #include "pt_terminal.h"
@@ -60,10 +62,13 @@ void doStopIt(void)
 
 void setPattern(int16_t pattern)
 {
-    modPattern = pattern;
-    if (modPattern > (MAX_PATTERNS - 1))
-        modPattern =  MAX_PATTERNS - 1;
+    if (pattern > (MAX_PATTERNS - 1))
+        pattern =  MAX_PATTERNS - 1;
+
+    if (!modAllocPattern(pattern))
+        return;
 
+    modPattern = (int8_t)(pattern);
     modEntry->currPattern = modPattern;
 }
 
@@ -185,7 +190,6 @@ static void doRetrg(moduleChannel_t *ch)
     paulaSetData(ch->n_chanindex,   ch->n_loopstart);
     paulaSetLength(ch->n_chanindex, ch->n_replen);
 
-    updateSpectrumAnalyzer(ch->n_chanindex, ch->n_volume, ch->n_period);
     setVUMeterHeight(ch);
 }
 
@@ -739,7 +743,6 @@ static void setPeriod(moduleChannel_t *ch)
         paulaSetPeriod(ch->n_chanindex, ch->n_period);
         paulaRestartDMA(ch->n_chanindex);
 
-        updateSpectrumAnalyzer(ch->n_chanindex, ch->n_volume, ch->n_period);
         setVUMeterHeight(ch);
     }
 
@@ -1044,6 +1047,9 @@ int8_t intMusic(void)
 
 void modSetPattern(uint8_t pattern)
 {
+    if (!modAllocPattern(pattern))
+        return;
+
     modPattern = pattern;
     modEntry->currPattern = modPattern;
     editor.ui.updateCurrPattText = true;
@@ -1132,6 +1138,8 @@ void modStop(void)
     uint8_t i;
     moduleChannel_t *ch;
 
+    endUndoTake();
+
     editor.songPlaying = false;
     turnOffVoices();
 
@@ -1171,9 +1179,16 @@ void playPattern(int8_t startRow)
 
 void incPatt(void)
 {
-    if (++modPattern > (MAX_PATTERNS - 1))
-          modPattern = 0;
+    int8_t newPattern;
 
+    newPattern = modPattern + 1;
+    if (newPattern > (MAX_PATTERNS - 1))
+        newPattern = 0;
+
+    if (!modAllocPattern(newPattern))
+        return;
+
+    modPattern = newPattern;
     modEntry->currPattern = modPattern;
 
     editor.ui.updatePatternData  = true;
@@ -1182,9 +1197,16 @@ void incPatt(void)
 
 void decPatt(void)
 {
-    if (--modPattern < 0)
-          modPattern = MAX_PATTERNS - 1;
+    int8_t newPattern;
+
+    newPattern = modPattern - 1;
+    if (newPattern < 0)
+        newPattern = MAX_PATTERNS - 1;
 
+    if (!modAllocPattern(newPattern))
+        return;
+
+    modPattern = newPattern;
     modEntry->currPattern = modPattern;
 
     editor.ui.updatePatternData  = true;
@@ -1195,6 +1217,8 @@ void modPlay(int16_t patt, int16_t order, int8_t row)
 {
     uint8_t oldPlayMode, oldMode;
 
+    endUndoTake();
+
     if (row != -1)
     {
         if ((row >= 0) && (row <= 63))
@@ -1230,7 +1254,7 @@ void modPlay(int16_t patt, int16_t order, int8_t row)
         }
     }
 
-    if ((patt >= 0) && (patt <= (MAX_PATTERNS - 1)))
+    if ((patt >= 0) && (patt <= (MAX_PATTERNS - 1)) && modAllocPattern(patt))
     {
         modPattern = patt;
         modEntry->currPattern = patt;
@@ -1309,8 +1333,8 @@ void clearSong(void)
         modEntry->head.orderCount   = 1;
         modEntry->head.patternCount = 1;
 
-        for (i = 0; i < MAX_PATTERNS; ++i)
-            memset(modEntry->patterns[i], 0, (MOD_ROWS * AMIGA_VOICES) * sizeof (note_t));
+        memset(modEntry->patternStore, 0, (modEntry->allocatedPatterns * (MOD_ROWS * AMIGA_VOICES)) * sizeof (note_t));
+        resetUndo();
 
         for (i = 0; i < AMIGA_VOICES; ++i)
         {
@@ -1358,6 +1382,8 @@ void clearSamples(void)
             s->volume     = 0;
 
             memset(s->text, 0, sizeof (s->text));
+
+            sampleUndoReset(i);
         }
 
         memset(modEntry->sampleData, 0, (MOD_SAMPLES + 1) * MAX_SAMPLE_LEN);
@@ -1387,15 +1413,9 @@ void clearAll(void)
 
 void modFree(void)
 {
-    uint8_t i;
-
     if (modEntry != NULL)
     {
-        for (i = 0; i < MAX_PATTERNS; ++i)
-        {
-            if (modEntry->patterns[i] != NULL)
-                free(modEntry->patterns[i]);
-        }
+        freePatternStore(modEntry);
 
         if (modEntry->sampleData != NULL)
             free(modEntry->sampleData);
@@ -11,6 +11,9 @@
 #include "pt_palette.h"
 #include "pt_diskop.h"
 #include "pt_sampler.h"
+#include "pt_sampleundo.h"
+#include "pt_sampledsp.h"
+#include "pt_samplebatch.h"
 #include "pt_modloader.h"
 #include "pt_edit.h"
 #include "pt_sampleloader.h"
@@ -396,9 +399,24 @@ int8_t handleLeftMouseButton(void);
 
 void updateMouseScaling(void)
 {
+    int32_t scale;
     float scaleX_f, scaleY_f;
 
-    SDL_RenderGetScale(renderer, &scaleX_f, &scaleY_f);
+    if (renderer == NULL)
+    {
+        // built-in software scaler, the picture is centered in the window
+        getSoftwareVideoLayout(&scale, &input.mouse.offsetX, &input.mouse.offsetY);
+
+        scaleX_f = (float)(scale);
+        scaleY_f = (float)(scale);
+    }
+    else
+    {
+        SDL_RenderGetScale(renderer, &scaleX_f, &scaleY_f);
+
+        input.mouse.offsetX = 0;
+        input.mouse.offsetY = 0;
+    }
 
     if (scaleX_f == 0.0f) scaleX_f = 1.0f;
     if (scaleY_f == 0.0f) scaleY_f = 1.0f;
@@ -1703,6 +1721,9 @@ void patternUpButton(void)
     if (val > (MAX_PATTERNS - 1))
         val =  MAX_PATTERNS - 1;
 
+    if (!modAllocPattern(val))
+        return;
+
     modEntry->head.order[modEntry->currOrder] = (uint8_t)(val);
 
     if (editor.ui.posEdScreenShown)
@@ -1829,9 +1850,7 @@ void handleSamplerVolumeBox(void)
 {
     int8_t *sampleData;
     uint8_t i;
-    int16_t sample, sampleVol;
-    int32_t sampleIndex, sampleLength;
-    float smp_f;
+    int32_t sampleVol, sampleLength;
     moduleSample_t *s;
 
     if (input.mouse.rightButtonPressed)
@@ -2011,19 +2030,7 @@ void handleSamplerVolumeBox(void)
                 sampleLength = s->length;
             }
 
-            sampleVol   = 0;
-            sampleIndex = 0;
-
-            while (sampleIndex < sampleLength)
-            {
-                sample = *sampleData++;
-                sample = ABS(sample);
-
-                if (sampleVol < sample)
-                    sampleVol = sample;
-
-                sampleIndex++;
-            }
+            sampleVol = sample8Peak(sampleData, sampleLength);
 
             if ((sampleVol <= 0) || (sampleVol > 127))
             {
@@ -2133,26 +2140,20 @@ void handleSamplerVolumeBox(void)
             {
                 sampleData  += editor.markStartOfs;
                 sampleLength = editor.markEndOfs - editor.markStartOfs;
+
+                sampleUndoSave(editor.currSample, editor.markStartOfs, editor.markEndOfs);
+                invalidateSampleWaveform(editor.currSample, editor.markStartOfs, editor.markEndOfs);
             }
             else
             {
                 sampleLength = s->length;
-            }
-
-            sampleIndex = 0;
-            while (sampleIndex < sampleLength)
-            {
-                smp_f  = (sampleIndex * editor.vol2) / (float)(sampleLength);
-                smp_f += ((sampleLength - sampleIndex) * editor.vol1) / (float)(sampleLength);
-                smp_f *= (float)(*sampleData);
-                smp_f /= 100.0f;
-                smp_f  = roundf(smp_f);
 
-                *sampleData++ = (int8_t)(CLAMP(smp_f, -128.0f, 127.0f));
-
-                sampleIndex++;
+                sampleUndoSave(editor.currSample, 0, s->length);
+                invalidateSampleWaveform(editor.currSample, 0, s->length);
             }
 
+            sample8Ramp(sampleData, sampleLength, editor.vol1, editor.vol2);
+
             fixSampleBeep(s);
 
             editor.ui.samplerVolBoxShown = false;
@@ -2248,7 +2249,6 @@ void handleSamplerFiltersBoxRepeats(void)
 void handleSamplerFiltersBox(void)
 {
     uint8_t i;
-    moduleSample_t *s;
 
     if (input.mouse.rightButtonPressed && editor.ui.editTextFlag)
     {
@@ -2358,20 +2358,7 @@ void handleSamplerFiltersBox(void)
         if ((input.mouse.x >=  65) && (input.mouse.x <=  75) &&
             (input.mouse.y >= 154) && (input.mouse.y <= 184))
         {
-            s = &modEntry->samples[editor.currSample];
-
-            if (s->length == 0)
-            {
-                displayErrorMsg("SAMPLE IS EMPTY");
-            }
-            else
-            {
-                memcpy(&modEntry->sampleData[s->offset], editor.tempSample, 131070);
-
-                redrawSample();
-                updateWindowTitle(MOD_IS_MODIFIED);
-                renderSamplerFiltersBox();
-            }
+            undoSampleData(editor.currSample);
 
             return;
         }
@@ -2914,6 +2901,9 @@ int8_t handleRightMouseButton(void)
     if (!input.mouse.rightButtonPressed)
         return (false);
 
+    if (sampleBatchRunning())
+        return (true);
+
     // exit sample swap mode with right mouse button (if present)
     if (editor.swapChannelFlag)
     {
@@ -3121,6 +3111,10 @@ int8_t handleLeftMouseButton(void)
             return (true);
         }
 
+        // an "all samples" batch operation is working on the sample data, wait for it
+        if (sampleBatchRunning())
+            return (true);
+
         guiButton = checkGUIButtons();
         if (guiButton != -1)
         {
@@ -3442,6 +3436,8 @@ int8_t handleLeftMouseButton(void)
 
                         memcpy(ptr8_1, &modEntry->sampleData[s->offset], MAX_SAMPLE_LEN);
 
+                        sampleUndoSave(editor.currSample, editor.samplePos, s->length);
+
                         ptr8_2 = &modEntry->sampleData[s->offset + editor.samplePos];
                         ptr8_3 = &modEntry->sampleData[s->offset + (s->length - 1)];
                         ptr8_4 = ptr8_1;
@@ -3486,6 +3482,7 @@ int8_t handleLeftMouseButton(void)
 
                         free(ptr8_4);
 
+                        invalidateSampleWaveform(editor.currSample, 0, s->length);
                         fixSampleBeep(s);
                         if (editor.ui.samplerScreenShown)
                             displaySample();
@@ -3517,6 +3514,9 @@ int8_t handleLeftMouseButton(void)
                         break;
                     }
 
+                    // the echo is written from the sample position on, for a whole sample length
+                    sampleUndoSave(editor.currSample, 0, editor.samplePos + s->length);
+
                     ptr8_1 = &modEntry->sampleData[s->offset + editor.samplePos];
                     ptr8_2 = &modEntry->sampleData[s->offset];
                     ptr8_3 = ptr8_2;
@@ -3555,6 +3555,7 @@ int8_t handleLeftMouseButton(void)
                             ptr8_3[j] = (int8_t)(CLAMP(ptr8_3[j] * 2, -128, 127));
                     }
 
+                    invalidateSampleWaveform(editor.currSample, 0, editor.samplePos + s->length);
                     fixSampleBeep(s);
                     if (editor.ui.samplerScreenShown)
                         displaySample();
@@ -3672,6 +3673,8 @@ int8_t handleLeftMouseButton(void)
                         return (true);
                     }
 
+                    sampleUndoSave(editor.currSample, 0, s->length);
+
                     ptr8_2 = ptr8_3;
 
                     memcpy(ptr8_2, ptr8_1, MAX_SAMPLE_LEN);
@@ -3703,6 +3706,7 @@ int8_t handleLeftMouseButton(void)
 
                     free(ptr8_3);
 
+                    invalidateSampleWaveform(editor.currSample, 0, s->length);
                     fixSampleBeep(s);
                     if (editor.ui.samplerScreenShown)
                         displaySample();
@@ -3735,6 +3739,8 @@ int8_t handleLeftMouseButton(void)
                         break;
                     }
 
+                    sampleUndoSave(editor.currSample, 0, s->length);
+
                     ptr8_1 = &modEntry->sampleData[s->offset];
                     ptr8_2 = &modEntry->sampleData[s->offset + (s->length - 1)];
 
@@ -3760,6 +3766,7 @@ int8_t handleLeftMouseButton(void)
                     }
                     while (ptr8_1 < ptr8_2);
 
+                    invalidateSampleWaveform(editor.currSample, 0, s->length);
                     fixSampleBeep(s);
                     if (editor.ui.samplerScreenShown)
                         displaySample();
@@ -3780,11 +3787,15 @@ int8_t handleLeftMouseButton(void)
 
                     if ((editor.markEndOfs - editor.markStartOfs) > 0)
                     {
+                        sampleUndoSave(editor.currSample, editor.markStartOfs, editor.markEndOfs);
+
                         ptr8_1 = &modEntry->sampleData[s->offset + editor.markStartOfs];
                         ptr8_2 = &modEntry->sampleData[s->offset + editor.markEndOfs - 1];
                     }
                     else
                     {
+                        sampleUndoSave(editor.currSample, 0, s->length);
+
                         ptr8_1 = &modEntry->sampleData[s->offset];
                         ptr8_2 = &modEntry->sampleData[s->offset + (s->length - 1)];
                     }
@@ -3797,6 +3808,7 @@ int8_t handleLeftMouseButton(void)
                     }
                     while (ptr8_1 < ptr8_2);
 
+                    invalidateSampleWaveform(editor.currSample, 0, s->length);
                     fixSampleBeep(s);
                     if (editor.ui.samplerScreenShown)
                         displaySample();
@@ -3829,6 +3841,8 @@ int8_t handleLeftMouseButton(void)
 
                     turnOffVoices();
 
+                    sampleUndoSave(editor.currSample, 0, s->length);
+
                     memcpy(&modEntry->sampleData[s->offset], &modEntry->sampleData[s->offset + editor.samplePos], MAX_SAMPLE_LEN - editor.samplePos);
                     memset(&modEntry->sampleData[s->offset + (MAX_SAMPLE_LEN - editor.samplePos)], 0, editor.samplePos);
 
@@ -3875,6 +3889,8 @@ int8_t handleLeftMouseButton(void)
                         break;
                     }
 
+                    sampleUndoSave(editor.currSample, 0, editor.samplePos);
+
                     ptr8_1 = &modEntry->sampleData[s->offset];
                     for (j = 0; j < editor.samplePos; ++j)
                     {
@@ -3885,6 +3901,7 @@ int8_t handleLeftMouseButton(void)
                         ptr8_1++;
                     }
 
+                    invalidateSampleWaveform(editor.currSample, 0, editor.samplePos);
                     fixSampleBeep(s);
                     if (editor.ui.samplerScreenShown)
                         displaySample();
@@ -3909,6 +3926,8 @@ int8_t handleLeftMouseButton(void)
                         break;
                     }
 
+                    sampleUndoSave(editor.currSample, editor.samplePos, s->length);
+
                     ptr8_1 = &modEntry->sampleData[s->offset + (s->length - 1)];
                     for (j = editor.samplePos; j < s->length; ++j)
                     {
@@ -3919,6 +3938,7 @@ int8_t handleLeftMouseButton(void)
                         ptr8_1--;
                     }
 
+                    invalidateSampleWaveform(editor.currSample, editor.samplePos, s->length);
                     fixSampleBeep(s);
                     if (editor.ui.samplerScreenShown)
                         displaySample();
@@ -3998,6 +4018,8 @@ int8_t handleLeftMouseButton(void)
 
                     if (editor.sampleVol != 100)
                     {
+                        sampleUndoSave(editor.currSample, 0, s->length);
+
                         ptr8_1 = &modEntry->sampleData[modEntry->samples[editor.currSample].offset];
                         for (j = 0; j < s->length; ++j)
                         {
@@ -4007,6 +4029,7 @@ int8_t handleLeftMouseButton(void)
                             *ptr8_1++ = (int8_t)(CLAMP(smp_f, -128.0f, 127.0f));
                         }
 
+                        invalidateSampleWaveform(editor.currSample, 0, s->length);
                         fixSampleBeep(s);
                         if (editor.ui.samplerScreenShown)
                             displaySample();
@@ -4958,7 +4981,6 @@ int8_t handleLeftMouseButton(void)
                 {
                     editor.ui.samplerFiltersBoxShown = true;
                     renderSamplerFiltersBox();
-                    fillSampleFilterUndoBuffer();
                 }
                 break;
 
@@ -4977,8 +4999,12 @@ int8_t handleLeftMouseButton(void)
                 }
                 break;
 
-                // TODO: Find a PowerPacker packer and enable this
-                // case PTB_DO_PACKMOD: editor.diskop.modPackFlg ^= 1; break;
+                case PTB_DO_PACKMOD:
+                {
+                    editor.diskop.modPackFlg ^= 1;
+                    editor.ui.updatePackText = true;
+                }
+                break;
 
                 case PTB_DO_SAMPLEFORMAT:
                 {
@@ -0,0 +1,300 @@
+/*
+** Frame pacing.
+**
+** With vsync, the present waits for the vertical blank and we don't have to
+** do anything. The time each present takes is measured: if it returned right
+** away (nothing was presented, or the driver/compositor ignores vsync), the
+** frame is timed here instead.
+**
+** Frames are timed by sleeping with the OS timer until a bit before the
+** deadline, and spinning for the rest. The spin time follows the measured
+** oversleep of the OS timer, so it's short on systems with precise timers.
+**
+** The emulation logic (repeat counters, VU meter decay) doesn't run per frame
+** but from its own LOGIC_HZ clock, so the screen can be redrawn at whatever
+** rate the display runs at (120Hz, 144Hz, variable refresh rate...).
+**
+** Key and mouse button repeats run from yet another LOGIC_HZ clock, which
+** is restarted at the time of each press (taken from the SDL event), and
+** catches up on ticks the frames didn't get to. So repeats don't depend on
+** the frame rate or on when in the frame the key went down.
+**
+** The play time counter has a TIMER_HZ clock of its own. Its ticks are never
+** dropped, so the counter stays right even if the main loop sleeps or stalls.
+*/
+
+#ifdef _WIN32
+#if !defined (_WIN32_WINNT) || (_WIN32_WINNT < 0x0600)
+#undef _WIN32_WINNT
+#define _WIN32_WINNT 0x0600 // for CreateWaitableTimerExW()
+#endif
+#define WIN32_MEAN_AND_LEAN
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+#include <SDL2/SDL.h>
+#include <stdint.h>
+#include <math.h>
+#include "pt_header.h"
+#include "pt_helpers.h"
+#include "pt_pacer.h"
+
+#ifdef _WIN32
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+static HANDLE sleepTimer;
+#endif
+
+static int8_t vsyncEnabled, vsyncPacing, presented, logicLockStep;
+static uint64_t framePeriod64, logicPeriod64, nextFrame64, nextLogic64, spinTime64, minSpinTime64, maxSpinTime64;
+static uint64_t timerPeriod64, nextTimer64, nextInput64;
+static double perfFreq_d, frameRate_d;
+
+void pacerInit(double frameRate, int8_t vsync)
+{
+    uint64_t time64;
+
+    perfFreq_d = (double)(SDL_GetPerformanceFrequency());
+    if (perfFreq_d <= 0.0)
+        perfFreq_d = 1000.0; // panic!
+
+    frameRate_d  = CLAMP(frameRate, 30.0, 500.0);
+    vsyncEnabled = vsync;
+
+    framePeriod64 = (uint64_t)((perfFreq_d / frameRate_d) + 0.5);
+    logicPeriod64 = (uint64_t)((perfFreq_d / LOGIC_HZ) + 0.5);
+    timerPeriod64 = (uint64_t)((perfFreq_d / TIMER_HZ) + 0.5);
+
+    // a ~60Hz display is kept in lockstep with the logic, like on the Amiga (one tick per frame)
+    logicLockStep = vsync && (fabs(frameRate_d - LOGIC_HZ) < 1.0);
+
+    // start out cautious, the spin time adapts to the timer's real precision
+    minSpinTime64 = (uint64_t)(perfFreq_d * 0.00005); // 50us
+    maxSpinTime64 = (uint64_t)(perfFreq_d * 0.004);   // 4ms
+    spinTime64    = (uint64_t)(perfFreq_d * 0.002);
+
+    vsyncPacing = false;
+    presented   = false;
+
+#ifdef _WIN32
+    if (sleepTimer == NULL)
+    {
+        sleepTimer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+        if (sleepTimer == NULL) // older than Windows 10 1803
+            sleepTimer = CreateWaitableTimerExW(NULL, NULL, 0, TIMER_ALL_ACCESS);
+    }
+#endif
+
+    time64 = SDL_GetPerformanceCounter();
+    nextFrame64 = time64 + framePeriod64;
+    nextLogic64 = time64 + logicPeriod64;
+    nextTimer64 = time64 + timerPeriod64;
+    nextInput64 = time64 + logicPeriod64;
+}
+
+void pacerFree(void)
+{
+#ifdef _WIN32
+    if (sleepTimer != NULL)
+    {
+        CloseHandle(sleepTimer);
+        sleepTimer = NULL;
+    }
+#endif
+}
+
+double pacerGetFrameRate(void)
+{
+    return (frameRate_d);
+}
+
+void pacerPresentDone(uint64_t presentTime64)
+{
+    presented = true;
+
+    // a present that waited for the vblank takes a good part of a frame, one that didn't returns in well under 1/8th
+    vsyncPacing = vsyncEnabled && (presentTime64 >= (framePeriod64 / 8));
+}
+
+uint32_t pacerGetLogicTicks(void)
+{
+    uint32_t ticks;
+    uint64_t time64;
+
+    time64 = SDL_GetPerformanceCounter();
+
+    if (logicLockStep && vsyncPacing)
+    {
+        nextLogic64 = time64 + logicPeriod64; // for when the lockstep ends
+        return (1);
+    }
+
+    ticks = 0;
+    while ((time64 >= nextLogic64) && (ticks < MAX_LOGIC_TICKS))
+    {
+        nextLogic64 += logicPeriod64;
+        ticks++;
+    }
+
+    if (time64 >= nextLogic64)
+        nextLogic64 = time64 + logicPeriod64; // stalled (window dragging, breakpoint...), don't try to catch up
+
+    return (ticks);
+}
+
+uint32_t pacerGetTimerTicks(void)
+{
+    uint32_t ticks;
+    uint64_t time64;
+
+    time64 = SDL_GetPerformanceCounter();
+    if (time64 < nextTimer64)
+        return (0);
+
+    ticks = (uint32_t)(((time64 - nextTimer64) / timerPeriod64) + 1);
+    nextTimer64 += ticks * timerPeriod64;
+
+    return (ticks);
+}
+
+uint32_t pacerGetInputTicks(void)
+{
+    uint32_t ticks;
+    uint64_t time64;
+
+    time64 = SDL_GetPerformanceCounter();
+    if (time64 < nextInput64)
+        return (0);
+
+    ticks = (uint32_t)(((time64 - nextInput64) / logicPeriod64) + 1);
+    if (ticks > MAX_INPUT_TICKS)
+    {
+        nextInput64 = time64 + logicPeriod64; // stalled, don't fire a burst of repeats
+        return (1);
+    }
+
+    nextInput64 += ticks * logicPeriod64;
+    return (ticks);
+}
+
+void pacerSyncInputClock(uint64_t eventTime64)
+{
+    nextInput64 = eventTime64 + logicPeriod64;
+}
+
+uint64_t pacerEventTime(uint32_t eventTicks)
+{
+    uint32_t age;
+    uint64_t time64, age64;
+
+    time64 = SDL_GetPerformanceCounter();
+
+    age = SDL_GetTicks() - eventTicks; // wraps around correctly
+    if (age > 1000)
+        return (time64); // no (sane) timestamp, say it happened now
+
+    age64 = (uint64_t)(age * (perfFreq_d / 1000.0));
+    return ((age64 < time64) ? (time64 - age64) : time64);
+}
+
+// coarse sleep with the OS timer
+static void osSleep(uint64_t time64)
+{
+    double seconds;
+#ifdef _WIN32
+    LARGE_INTEGER dueTime;
+#else
+    struct timespec ts;
+#endif
+
+    seconds = time64 / perfFreq_d;
+
+#ifdef _WIN32
+    if (sleepTimer != NULL)
+    {
+        dueTime.QuadPart = -(LONGLONG)(seconds * 10000000.0); // relative, in 100ns units
+        if (SetWaitableTimer(sleepTimer, &dueTime, 0, NULL, NULL, FALSE))
+        {
+            WaitForSingleObject(sleepTimer, INFINITE);
+            return;
+        }
+    }
+
+    SDL_Delay((uint32_t)(seconds * 1000.0));
+#elif defined (__APPLE__)
+    ts.tv_sec  = (time_t)(seconds);
+    ts.tv_nsec = (long)((seconds - ts.tv_sec) * 1000000000.0);
+    nanosleep(&ts, NULL);
+#else
+    ts.tv_sec  = (time_t)(seconds);
+    ts.tv_nsec = (long)((seconds - ts.tv_sec) * 1000000000.0);
+    clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, NULL);
+#endif
+}
+
+static void sleepUntil(uint64_t deadline64)
+{
+    uint64_t time64, wakeUp64, overshoot64;
+
+    time64 = SDL_GetPerformanceCounter();
+    if ((time64 + spinTime64) < deadline64)
+    {
+        wakeUp64 = deadline64 - spinTime64;
+
+        osSleep(wakeUp64 - time64);
+        time64 = SDL_GetPerformanceCounter();
+
+        // follow the timer's oversleep: up right away, back down slowly
+        overshoot64 = (time64 > wakeUp64) ? (time64 - wakeUp64) : 0;
+        overshoot64 += overshoot64 / 4;
+
+        if (overshoot64 > spinTime64)
+            spinTime64 = overshoot64;
+        else
+            spinTime64 -= (spinTime64 - overshoot64) / 64;
+
+        spinTime64 = CLAMP(spinTime64, minSpinTime64, maxSpinTime64);
+    }
+
+    while (time64 < deadline64)
+    {
+#ifdef PT_USE_SSE2
+        _mm_pause();
+#endif
+        time64 = SDL_GetPerformanceCounter();
+    }
+}
+
+void pacerWait(void)
+{
+    uint64_t time64;
+
+    if (presented && vsyncPacing)
+    {
+        // the present waited for the vblank, time the next frame from there in case it isn't presented
+        presented = false;
+        nextFrame64 = SDL_GetPerformanceCounter() + framePeriod64;
+
+        return;
+    }
+
+    presented = false;
+
+    sleepUntil(nextFrame64);
+    nextFrame64 += framePeriod64;
+
+    time64 = SDL_GetPerformanceCounter();
+    if (time64 >= nextFrame64)
+        nextFrame64 = time64 + framePeriod64; // the frame took too long, don't try to catch up
+}
+
+void pacerSkipFrame(void)
+{
+    // nothing was presented, so the logic can't be in lockstep with the vblank
+    presented   = false;
+    vsyncPacing = false;
+
+    nextFrame64 = SDL_GetPerformanceCounter() + framePeriod64;
+}
@@ -0,0 +1,24 @@
+#ifndef __PT_PACER_H
+#define __PT_PACER_H
+
+#include <stdint.h>
+#include "pt_header.h"
+
+#define LOGIC_HZ VBLANK_HZ // key/mouse repeat counters, VU meter decay etc. run at this rate
+#define MAX_LOGIC_TICKS 4  // per frame, after a stall the rest is dropped
+#define TIMER_HZ 50        // play time counter, see _50HzCallBack()
+#define MAX_INPUT_TICKS (LOGIC_HZ / 2) // per frame, held keys/buttons repeat on time unless the program stalls
+
+void pacerInit(double frameRate, int8_t vsync);
+void pacerFree(void);
+double pacerGetFrameRate(void);
+void pacerPresentDone(uint64_t presentTime64); // how long the present took, in performance counter ticks
+uint32_t pacerGetLogicTicks(void); // number of LOGIC_HZ ticks to run this frame
+uint32_t pacerGetTimerTicks(void); // number of TIMER_HZ ticks since the last call, never dropped
+uint32_t pacerGetInputTicks(void); // number of LOGIC_HZ key/mouse repeat ticks to run this frame
+void pacerSyncInputClock(uint64_t eventTime64); // start the repeat ticks from a key/button press
+uint64_t pacerEventTime(uint32_t eventTicks); // SDL event timestamp -> performance counter time
+void pacerWait(void); // call once per frame, after presenting
+void pacerSkipFrame(void); // call instead of pacerWait() when the frame wasn't drawn
+
+#endif
@@ -1,4 +1,5 @@
 #include <stdint.h>
+#include <string.h>
 #include "pt_header.h"
 #include "pt_palette.h"
 #include "pt_tables.h"
@@ -25,261 +26,181 @@ static uint8_t periodToNote(int16_t period)
     return (255); // illegal period
 }
 
-void drawPatternNormal(uint32_t *frameBuffer);
-void drawPatternDotted(uint32_t *frameBuffer);
+#define PATT_ROWS_SHOWN 15
+#define EMPTY_DOT ((char)(128)) // glyph 128, the "empty" dot of the dotted pattern mode
 
-void redrawPattern(uint32_t *frameBuffer)
+// one run for the row number and one per channel, for every visible row
+static textRun_t rowNumRuns[PATT_ROWS_SHOWN], noteRuns[PATT_ROWS_SHOWN][AMIGA_VOICES];
+static int16_t lastPattern = -1, lastRow = -1;
+
+static uint16_t getRowY(uint8_t i)
 {
-    if (editor.ui.pattDots)
-        drawPatternDotted(frameBuffer);
+    if (i < 7)
+        return (140 + (i * 7));
+    else if (i == 7)
+        return (140 + (7 * 7) + 1); // align font to play row (middle)
     else
-        drawPatternNormal(frameBuffer);
+        return (140 + (i * 7) + 7); // beyond play row, jump some pixels out of the row (middle)
 }
 
-void drawPatternNormal(uint32_t *frameBuffer)
+static void resetRowRuns(uint8_t i)
 {
-    int8_t rowMiddlePos;
-    uint8_t i, j, tempNote, rowDispCheck;
-    uint16_t y, y2, putXOffset, putYOffset, rowData;
-    note_t note;
+    uint8_t j;
 
-    for (i = 0; i < 15; ++i)
+    resetTextRun(&rowNumRuns[i]);
+    for (j = 0; j < AMIGA_VOICES; ++j)
+        resetTextRun(&noteRuns[i][j]);
+}
+
+static void moveRowRuns(uint8_t dst, uint8_t src)
+{
+    uint8_t j;
+
+    moveTextRun(&rowNumRuns[dst], &rowNumRuns[src], getRowY(dst));
+    for (j = 0; j < AMIGA_VOICES; ++j)
+        moveTextRun(&noteRuns[dst][j], &noteRuns[src][j], getRowY(dst));
+}
+
+/* When the view moves by one row, shift the already drawn rows (pixels and
+** run shadows) instead of redrawing them. Only the rows around the play row
+** (which use another font) and the row scrolled in need to be drawn after
+** that. Rows with changed data are still caught by the run shadows.
+*/
+static void scrollPatternRows(int8_t dir)
+{
+    int8_t i;
+
+    if (dir > 0)
     {
-        rowMiddlePos = i - 7;
-        rowDispCheck = modEntry->currRow + rowMiddlePos;
+        for (i = 0; i < 6; ++i)
+            moveRowRuns(i, i + 1);
 
-        if (rowDispCheck < MOD_ROWS)
-        {
-            rowData    = rowDispCheck * 4;
-            putYOffset = 140 + (i * 7);
-
-            if (i == 7) // are we on the play row (middle)?
-            {
-                putYOffset++; // align font to play row (middle)
-
-                // put current row number
-                printTwoDecimalsBigBg(frameBuffer, 8, putYOffset, rowMiddlePos + modEntry->currRow, palette[PAL_GENTXT], palette[PAL_GENBKG]);
-
-                // pattern data
-                for (j = 0; j < AMIGA_VOICES; ++j)
-                {
-                    note = modEntry->patterns[modEntry->currPattern][rowData + j];
-                    putXOffset = 26 + (j * 72);
-
-                    if (note.period == 0)
-                    {
-                        textOutBigBg(frameBuffer, putXOffset + 6, putYOffset, "---", palette[PAL_GENTXT], palette[PAL_GENBKG]);
-                    }
-                    else
-                    {
-                        tempNote = periodToNote(note.period);
-                        if (tempNote == 255)
-                            textOutBigBg(frameBuffer, putXOffset + 6, putYOffset, "???", palette[PAL_GENTXT], palette[PAL_GENBKG]);
-                        else
-                            textOutBigBg(frameBuffer, putXOffset + 6, putYOffset, editor.accidental ? noteNames2[tempNote] : noteNames1[tempNote], palette[PAL_GENTXT], palette[PAL_GENBKG]);
-                    }
-
-                    if (editor.ui.blankZeroFlag)
-                    {
-                        if (note.sample & 0xF0)
-                            printOneHexBigBg(frameBuffer, putXOffset + 30, putYOffset, note.sample >> 4, palette[PAL_GENTXT], palette[PAL_GENBKG]);
-                        else
-                            printOneHexBigBg(frameBuffer, putXOffset + 30, putYOffset, ' ', palette[PAL_GENBKG], palette[PAL_GENBKG]);
-                    }
-                    else
-                    {
-                        printOneHexBigBg(frameBuffer, putXOffset + 30, putYOffset, note.sample >> 4, palette[PAL_GENTXT], palette[PAL_GENBKG]);
-                    }
-
-                    printOneHexBigBg(frameBuffer, putXOffset + 38, putYOffset, note.sample & 0x0F, palette[PAL_GENTXT], palette[PAL_GENBKG]);
-                    printOneHexBigBg(frameBuffer, putXOffset + 46, putYOffset, note.command, palette[PAL_GENTXT], palette[PAL_GENBKG]);
-                    printTwoHexBigBg(frameBuffer, putXOffset + 54, putYOffset, note.param,  palette[PAL_GENTXT], palette[PAL_GENBKG]);
-                }
-            }
-            else
-            {
-                if (i > 7)
-                    putYOffset += 7; // beyond play row, jump some pixels out of the row (middle)
-
-                // put current row number
-                printTwoDecimalsBg(frameBuffer, 8, putYOffset, rowMiddlePos + modEntry->currRow, palette[PAL_PATTXT], palette[PAL_BACKGRD]);
-
-                // pattern data
-                for (j = 0; j < AMIGA_VOICES; ++j)
-                {
-                    note = modEntry->patterns[modEntry->currPattern][rowData + j];
-                    putXOffset = 26 + (j * 72);
-
-                    if (note.period == 0)
-                    {
-                        textOutBg(frameBuffer, putXOffset + 6, putYOffset, "---", palette[PAL_PATTXT], palette[PAL_BACKGRD]);
-                    }
-                    else
-                    {
-                        tempNote = periodToNote(note.period);
-                        if (tempNote == 255)
-                            textOutBg(frameBuffer, putXOffset + 6, putYOffset, "???", palette[PAL_PATTXT], palette[PAL_BACKGRD]);
-                        else
-                            textOutBg(frameBuffer, putXOffset + 6, putYOffset, editor.accidental ? noteNames2[tempNote] : noteNames1[tempNote], palette[PAL_PATTXT], palette[PAL_BACKGRD]);
-                    }
-
-                    if (editor.ui.blankZeroFlag)
-                    {
-                        if (note.sample & 0xF0)
-                            printOneHexBg(frameBuffer, putXOffset + 30, putYOffset, note.sample >> 4, palette[PAL_PATTXT], palette[PAL_BACKGRD]);
-                        else
-                            printOneHexBg(frameBuffer, putXOffset + 30, putYOffset, ' ', palette[PAL_BACKGRD], palette[PAL_BACKGRD]);
-                    }
-                    else
-                    {
-                        printOneHexBg(frameBuffer, putXOffset + 30, putYOffset, note.sample >> 4, palette[PAL_PATTXT], palette[PAL_BACKGRD]);
-                    }
-
-                    printOneHexBg(frameBuffer, putXOffset + 38, putYOffset, note.sample & 0x0F, palette[PAL_PATTXT], palette[PAL_BACKGRD]);
-                    printOneHexBg(frameBuffer, putXOffset + 46, putYOffset, note.command, palette[PAL_PATTXT], palette[PAL_BACKGRD]);
-                    printTwoHexBg(frameBuffer, putXOffset + 54, putYOffset, note.param, palette[PAL_PATTXT], palette[PAL_BACKGRD]);
-                }
-            }
-        }
+        for (i = 8; i < (PATT_ROWS_SHOWN - 1); ++i)
+            moveRowRuns(i, i + 1);
+
+        resetRowRuns(6);
+        resetRowRuns(PATT_ROWS_SHOWN - 1);
     }
+    else
+    {
+        for (i = 6; i > 0; --i)
+            moveRowRuns(i, i - 1);
 
-    // fill margin
-    if (modEntry->currRow <= 6)
+        for (i = PATT_ROWS_SHOWN - 1; i > 8; --i)
+            moveRowRuns(i, i - 1);
+
+        resetRowRuns(0);
+        resetRowRuns(8);
+    }
+}
+
+// note, sample, command and parameter of a cell as the eight chars drawn on screen
+static void getNoteText(char *text, const note_t *note, uint8_t dotted)
+{
+    uint8_t tempNote;
+
+    if (note->period == 0)
     {
-        y2 = 140 + ((7 -  modEntry->currRow) * 7);
-        for (y = 140; y < y2; y += 7)
-            textOutBgNoSpace(frameBuffer, 9, y, "00 --000000 --000000 --000000 --000000", palette[PAL_BACKGRD], palette[PAL_BACKGRD]);
+        if (dotted)
+            text[0] = text[1] = text[2] = EMPTY_DOT;
+        else
+            text[0] = text[1] = text[2] = '-';
     }
-    else if (modEntry->currRow >= 57)
+    else
     {
-        y2 = 245 - ((modEntry->currRow - 56) * 7);
-        for (y = 245; y > y2; y -= 7)
-            textOutBgNoSpace(frameBuffer, 9, y, "00 --000000 --000000 --000000 --000000", palette[PAL_BACKGRD], palette[PAL_BACKGRD]);
+        tempNote = periodToNote(note->period);
+        if (tempNote == 255)
+            memcpy(text, "???", 3);
+        else
+            memcpy(text, editor.accidental ? noteNames2[tempNote] : noteNames1[tempNote], 3);
+    }
+
+    if (dotted && (note->sample == 0))
+    {
+        text[3] = text[4] = EMPTY_DOT;
+    }
+    else
+    {
+        text[3] = (!dotted && editor.ui.blankZeroFlag && !(note->sample & 0xF0)) ? ' ' : hexTable[note->sample >> 4];
+        text[4] = hexTable[note->sample & 0x0F];
     }
+
+    if (dotted && ((note->command | note->param) == 0))
+    {
+        text[5] = text[6] = text[7] = EMPTY_DOT;
+    }
+    else
+    {
+        text[5] = hexTable[note->command & 0x0F];
+        text[6] = hexTable[note->param >> 4];
+        text[7] = hexTable[note->param & 0x0F];
+    }
+
+    text[8] = '\0';
 }
 
-void drawPatternDotted(uint32_t *frameBuffer)
+void redrawPattern(uint32_t *frameBuffer)
 {
     int8_t rowMiddlePos;
-    uint8_t i, j, tempNote, rowDispCheck;
+    char rowText[3], noteText[9];
+    uint8_t i, j, rowDispCheck;
     uint16_t y, y2, putXOffset, putYOffset, rowData;
-    note_t note;
+    uint32_t fontColor, backColor;
 
-    for (i = 0; i < 15; ++i)
+    if (modEntry->currPattern == lastPattern)
+    {
+             if (modEntry->currRow == (lastRow + 1)) scrollPatternRows(1);
+        else if (modEntry->currRow == (lastRow - 1)) scrollPatternRows(-1);
+    }
+
+    lastPattern = modEntry->currPattern;
+    lastRow     = modEntry->currRow;
+
+    for (i = 0; i < PATT_ROWS_SHOWN; ++i)
     {
         rowMiddlePos = i - 7;
         rowDispCheck = modEntry->currRow + rowMiddlePos;
 
-        if (rowDispCheck < MOD_ROWS)
+        if (rowDispCheck >= MOD_ROWS)
+        {
+            resetRowRuns(i); // this row's area gets filled as margin below
+            continue;
+        }
+
+        rowData    = rowDispCheck * 4;
+        putYOffset = getRowY(i);
+
+        if (i == 7) // are we on the play row (middle)?
         {
-            rowData    = rowDispCheck * 4;
-            putYOffset = 140 + (i * 7);
-
-            if (i == 7) // are we on the play row (middle)?
-            {
-                putYOffset++; // align font to play row (middle)
-
-                // put current row number
-                printTwoDecimalsBigBg(frameBuffer, 8, putYOffset, rowMiddlePos + modEntry->currRow, palette[PAL_GENTXT], palette[PAL_GENBKG]);
-
-                // pattern data
-                for (j = 0; j < AMIGA_VOICES; ++j)
-                {
-                    note = modEntry->patterns[modEntry->currPattern][rowData + j];
-                    putXOffset = 26 + (j * 72);
-
-                    if (note.period == 0)
-                    {
-                        charOutBigBg(frameBuffer, putXOffset +  6, putYOffset, 128, palette[PAL_GENTXT], palette[PAL_GENBKG]);
-                        charOutBigBg(frameBuffer, putXOffset + 14, putYOffset, 128, palette[PAL_GENTXT], palette[PAL_GENBKG]);
-                        charOutBigBg(frameBuffer, putXOffset + 22, putYOffset, 128, palette[PAL_GENTXT], palette[PAL_GENBKG]);
-                    }
-                    else
-                    {
-                        tempNote = periodToNote(note.period);
-                        if (tempNote == 255)
-                            textOutBigBg(frameBuffer, putXOffset + 6, putYOffset, "???", palette[PAL_GENTXT], palette[PAL_GENBKG]);
-                        else
-                            textOutBigBg(frameBuffer, putXOffset + 6, putYOffset, editor.accidental ? noteNames2[tempNote] : noteNames1[tempNote], palette[PAL_GENTXT], palette[PAL_GENBKG]);
-                    }
-
-                    if (note.sample)
-                    {
-                        printOneHexBigBg(frameBuffer, putXOffset + 30, putYOffset, note.sample >> 4, palette[PAL_GENTXT], palette[PAL_GENBKG]);
-                        printOneHexBigBg(frameBuffer, putXOffset + 38, putYOffset, note.sample & 0x0F, palette[PAL_GENTXT], palette[PAL_GENBKG]);
-                    }
-                    else
-                    {
-                        charOutBigBg(frameBuffer, putXOffset + 30, putYOffset, 128, palette[PAL_GENTXT], palette[PAL_GENBKG]);
-                        charOutBigBg(frameBuffer, putXOffset + 38, putYOffset, 128, palette[PAL_GENTXT], palette[PAL_GENBKG]);
-                    }
-
-                    if ((note.command | note.param) == 0)
-                    {
-                        charOutBigBg(frameBuffer, putXOffset + 46, putYOffset, 128, palette[PAL_GENTXT], palette[PAL_GENBKG]);
-                        charOutBigBg(frameBuffer, putXOffset + 54, putYOffset, 128, palette[PAL_GENTXT], palette[PAL_GENBKG]);
-                        charOutBigBg(frameBuffer, putXOffset + 62, putYOffset, 128, palette[PAL_GENTXT], palette[PAL_GENBKG]);
-                    }
-                    else
-                    {
-                        printOneHexBigBg(frameBuffer, putXOffset + 46, putYOffset, note.command, palette[PAL_GENTXT], palette[PAL_GENBKG]);
-                        printTwoHexBigBg(frameBuffer, putXOffset + 54, putYOffset, note.param,   palette[PAL_GENTXT], palette[PAL_GENBKG]);
-                    }
-                }
-            }
+            fontColor = palette[PAL_GENTXT];
+            backColor = palette[PAL_GENBKG];
+        }
+        else
+        {
+            fontColor = palette[PAL_PATTXT];
+            backColor = palette[PAL_BACKGRD];
+        }
+
+        // put current row number
+        rowText[0] = '0' + (rowDispCheck / 10);
+        rowText[1] = '0' + (rowDispCheck % 10);
+        rowText[2] = '\0';
+
+        if (i == 7)
+            textRunOutBigBg(&rowNumRuns[i], frameBuffer, 8, putYOffset, rowText, fontColor, backColor);
+        else
+            textRunOutBg(&rowNumRuns[i], frameBuffer, 8, putYOffset, rowText, fontColor, backColor);
+
+        // pattern data
+        for (j = 0; j < AMIGA_VOICES; ++j)
+        {
+            getNoteText(noteText, &modEntry->patterns[modEntry->currPattern][rowData + j], editor.ui.pattDots);
+            putXOffset = 26 + (j * 72);
+
+            if (i == 7)
+                textRunOutBigBg(&noteRuns[i][j], frameBuffer, putXOffset + 6, putYOffset, noteText, fontColor, backColor);
             else
-            {
-                if (i > 7)
-                    putYOffset += 7; // beyond play row, jump some pixels out of the row (middle)
-
-                // put current row number
-                printTwoDecimalsBg(frameBuffer, 8, putYOffset, rowMiddlePos + modEntry->currRow, palette[PAL_PATTXT], palette[PAL_BACKGRD]);
-
-                // pattern data
-                for (j = 0; j < AMIGA_VOICES; ++j)
-                {
-                    note = modEntry->patterns[modEntry->currPattern][rowData + j];
-                    putXOffset = 26 + (j * 72);
-
-                    if (note.period == 0)
-                    {
-                        charOutBg(frameBuffer, putXOffset + 6,  putYOffset, 128, palette[PAL_PATTXT], palette[PAL_BACKGRD]);
-                        charOutBg(frameBuffer, putXOffset + 14, putYOffset, 128, palette[PAL_PATTXT], palette[PAL_BACKGRD]);
-                        charOutBg(frameBuffer, putXOffset + 22, putYOffset, 128, palette[PAL_PATTXT], palette[PAL_BACKGRD]);
-                    }
-                    else
-                    {
-                        tempNote = periodToNote(note.period);
-                        if (tempNote == 255)
-                            textOutBg(frameBuffer, putXOffset + 6, putYOffset, "???", palette[PAL_PATTXT], palette[PAL_BACKGRD]);
-                        else
-                            textOutBg(frameBuffer, putXOffset + 6, putYOffset, editor.accidental ? noteNames2[tempNote] : noteNames1[tempNote], palette[PAL_PATTXT], palette[PAL_BACKGRD]);
-                    }
-
-                    if (note.sample)
-                    {
-                        printOneHexBg(frameBuffer, putXOffset + 30, putYOffset, note.sample >> 4,   palette[PAL_PATTXT], palette[PAL_BACKGRD]);
-                        printOneHexBg(frameBuffer, putXOffset + 38, putYOffset, note.sample & 0x0F, palette[PAL_PATTXT], palette[PAL_BACKGRD]);
-                    }
-                    else
-                    {
-                        charOutBg(frameBuffer, putXOffset + 30, putYOffset, 128, palette[PAL_PATTXT], palette[PAL_BACKGRD]);
-                        charOutBg(frameBuffer, putXOffset + 38, putYOffset, 128, palette[PAL_PATTXT], palette[PAL_BACKGRD]);
-                    }
-
-                    if ((note.command | note.param) == 0)
-                    {
-                        charOutBg(frameBuffer, putXOffset + 46, putYOffset, 128, palette[PAL_PATTXT], palette[PAL_BACKGRD]);
-                        charOutBg(frameBuffer, putXOffset + 54, putYOffset, 128, palette[PAL_PATTXT], palette[PAL_BACKGRD]);
-                        charOutBg(frameBuffer, putXOffset + 62, putYOffset, 128, palette[PAL_PATTXT], palette[PAL_BACKGRD]);
-                    }
-                    else
-                    {
-                        printOneHexBg(frameBuffer, putXOffset + 46, putYOffset, note.command, palette[PAL_PATTXT], palette[PAL_BACKGRD]);
-                        printTwoHexBg(frameBuffer, putXOffset + 54, putYOffset, note.param,   palette[PAL_PATTXT], palette[PAL_BACKGRD]);
-                    }
-                }
-            }
+                textRunOutBg(&noteRuns[i][j], frameBuffer, putXOffset + 6, putYOffset, noteText, fontColor, backColor);
         }
     }
 
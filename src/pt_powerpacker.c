@@ -0,0 +1,587 @@
+/*
+** PowerPacker (PP20) decruncher.
+**
+** Based on the decruncher from Heikki Orsila's amigadepack. Seems to have no
+** license, so I'll assume it fits into wtfpl (wtfpl.net). Heikki should contact
+** me if it shall not.
+** Modified by 8bitbubsy
+**
+** The crunched stream is read backwards. Instead of fetching one byte per
+** refill and pulling bits out one by one, this one refills a 64-bit bit buffer
+** with whole big-endian 32-bit words, reverses bits through a table and copies
+** match runs in bulk. All the bounds checks against malformed input are kept.
+**
+** The cruncher is new code, it writes the exact stream the decruncher above
+** (and the Amiga one) reads. Matches are found with hash chains on the
+** reversed input, the efficiency level decides the offset sizes, the window
+** and how hard we look.
+**/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pt_helpers.h"
+#include "pt_powerpacker.h"
+
+typedef struct ppBitReader_t
+{
+    const uint8_t *start, *ptr; // ptr walks backwards towards start
+    uint64_t bitBuffer;
+    int32_t bitsLeft;
+} ppBitReader_t;
+
+static const uint8_t bitReverseTable[256] =
+{
+    0x00, 0x80, 0x40, 0xC0, 0x20, 0xA0, 0x60, 0xE0, 0x10, 0x90, 0x50, 0xD0, 0x30, 0xB0, 0x70, 0xF0,
+    0x08, 0x88, 0x48, 0xC8, 0x28, 0xA8, 0x68, 0xE8, 0x18, 0x98, 0x58, 0xD8, 0x38, 0xB8, 0x78, 0xF8,
+    0x04, 0x84, 0x44, 0xC4, 0x24, 0xA4, 0x64, 0xE4, 0x14, 0x94, 0x54, 0xD4, 0x34, 0xB4, 0x74, 0xF4,
+    0x0C, 0x8C, 0x4C, 0xCC, 0x2C, 0xAC, 0x6C, 0xEC, 0x1C, 0x9C, 0x5C, 0xDC, 0x3C, 0xBC, 0x7C, 0xFC,
+    0x02, 0x82, 0x42, 0xC2, 0x22, 0xA2, 0x62, 0xE2, 0x12, 0x92, 0x52, 0xD2, 0x32, 0xB2, 0x72, 0xF2,
+    0x0A, 0x8A, 0x4A, 0xCA, 0x2A, 0xAA, 0x6A, 0xEA, 0x1A, 0x9A, 0x5A, 0xDA, 0x3A, 0xBA, 0x7A, 0xFA,
+    0x06, 0x86, 0x46, 0xC6, 0x26, 0xA6, 0x66, 0xE6, 0x16, 0x96, 0x56, 0xD6, 0x36, 0xB6, 0x76, 0xF6,
+    0x0E, 0x8E, 0x4E, 0xCE, 0x2E, 0xAE, 0x6E, 0xEE, 0x1E, 0x9E, 0x5E, 0xDE, 0x3E, 0xBE, 0x7E, 0xFE,
+    0x01, 0x81, 0x41, 0xC1, 0x21, 0xA1, 0x61, 0xE1, 0x11, 0x91, 0x51, 0xD1, 0x31, 0xB1, 0x71, 0xF1,
+    0x09, 0x89, 0x49, 0xC9, 0x29, 0xA9, 0x69, 0xE9, 0x19, 0x99, 0x59, 0xD9, 0x39, 0xB9, 0x79, 0xF9,
+    0x05, 0x85, 0x45, 0xC5, 0x25, 0xA5, 0x65, 0xE5, 0x15, 0x95, 0x55, 0xD5, 0x35, 0xB5, 0x75, 0xF5,
+    0x0D, 0x8D, 0x4D, 0xCD, 0x2D, 0xAD, 0x6D, 0xED, 0x1D, 0x9D, 0x5D, 0xDD, 0x3D, 0xBD, 0x7D, 0xFD,
+    0x03, 0x83, 0x43, 0xC3, 0x23, 0xA3, 0x63, 0xE3, 0x13, 0x93, 0x53, 0xD3, 0x33, 0xB3, 0x73, 0xF3,
+    0x0B, 0x8B, 0x4B, 0xCB, 0x2B, 0xAB, 0x6B, 0xEB, 0x1B, 0x9B, 0x5B, 0xDB, 0x3B, 0xBB, 0x7B, 0xFB,
+    0x07, 0x87, 0x47, 0xC7, 0x27, 0xA7, 0x67, 0xE7, 0x17, 0x97, 0x57, 0xD7, 0x37, 0xB7, 0x77, 0xF7,
+    0x0F, 0x8F, 0x4F, 0xCF, 0x2F, 0xAF, 0x6F, 0xEF, 0x1F, 0x9F, 0x5F, 0xDF, 0x3F, 0xBF, 0x7F, 0xFF
+};
+
+static inline void ppRefillBits(ppBitReader_t *br)
+{
+    uint32_t word;
+
+    while (br->bitsLeft <= 32)
+    {
+        if ((br->ptr - br->start) >= 4)
+        {
+            br->ptr -= 4;
+
+            // PP20 data is made of big-endian longwords, the last byte is consumed first
+            word = ((uint32_t)(br->ptr[0]) << 24) | ((uint32_t)(br->ptr[1]) << 16) | ((uint32_t)(br->ptr[2]) << 8) | br->ptr[3];
+
+            br->bitBuffer |= (uint64_t)(word) << br->bitsLeft;
+            br->bitsLeft  += 32;
+        }
+        else if (br->ptr > br->start)
+        {
+            br->bitBuffer |= (uint64_t)(*--br->ptr) << br->bitsLeft;
+            br->bitsLeft  += 8;
+        }
+        else
+        {
+            break; // no more input
+        }
+    }
+}
+
+// reads up to 24 bits, first bit read ends up as the MSB of the result
+static inline int8_t ppReadBits(ppBitReader_t *br, uint8_t numBits, uint32_t *out)
+{
+    uint32_t x;
+
+    if (numBits > 24)
+        return (false);
+
+    if (br->bitsLeft < numBits)
+    {
+        ppRefillBits(br);
+        if (br->bitsLeft < numBits)
+            return (false); // ran out of crunched data
+    }
+
+    x = (uint32_t)(br->bitBuffer) & ((1UL << numBits) - 1);
+    br->bitBuffer >>= numBits;
+    br->bitsLeft   -= numBits;
+
+    *out = (((uint32_t)(bitReverseTable[x & 0xFF]) << 16) |
+            ((uint32_t)(bitReverseTable[(x >> 8) & 0xFF]) << 8) |
+             (uint32_t)(bitReverseTable[x >> 16])) >> (24 - numBits);
+
+    return (true);
+}
+
+#define PP_READ_BITS(nbits, var) \
+    if (!ppReadBits(&br, (uint8_t)(nbits), &(var))) \
+        return (false);
+
+uint8_t ppdecrunch(const uint8_t *src, uint8_t *dst, const uint8_t *offsetLens, uint32_t srcLen, uint32_t dstLen, uint8_t skipBits)
+{
+    uint8_t *dstEnd, *out;
+    uint32_t x, i, todo, offBits, offset, dist;
+    ppBitReader_t br;
+
+    if ((src == NULL) || (dst == NULL) || (offsetLens == NULL))
+        return (false);
+
+    br.start     = src;
+    br.ptr       = src + srcLen;
+    br.bitBuffer = 0;
+    br.bitsLeft  = 0;
+
+    out    = dst + dstLen;
+    dstEnd = out;
+
+    while (skipBits > 0)
+    {
+        todo = (skipBits > 24) ? 24 : skipBits;
+        PP_READ_BITS(todo, x);
+        skipBits -= (uint8_t)(todo);
+    }
+
+    while (out > dst)
+    {
+        PP_READ_BITS(1, x);
+        if (x == 0)
+        {
+            // literal run
+            todo = 1;
+
+            do
+            {
+                PP_READ_BITS(2, x);
+                todo += x;
+            }
+            while (x == 3);
+
+            if (todo > (uint32_t)(out - dst))
+                return (false);
+
+            while (todo--)
+            {
+                PP_READ_BITS(8, x);
+                *--out = (uint8_t)(x);
+            }
+
+            if (out == dst)
+                break;
+        }
+
+        // match
+        PP_READ_BITS(2, x);
+
+        offBits = offsetLens[x];
+        todo    = x + 2;
+
+        if (x == 3)
+        {
+            PP_READ_BITS(1, x);
+            if (x == 0) offBits = 7;
+
+            PP_READ_BITS(offBits, offset);
+            do
+            {
+                PP_READ_BITS(3, x);
+                todo += x;
+            }
+            while (x == 7);
+        }
+        else
+        {
+            PP_READ_BITS(offBits, offset);
+        }
+
+        if ((out + offset) >= dstEnd)
+            return (false);
+
+        if (todo > (uint32_t)(out - dst))
+            return (false);
+
+        // every match byte is copied from (offset + 1) bytes above it
+        dist = offset + 1;
+        out -= todo;
+
+        if (dist == 1)
+        {
+            memset(out, out[todo], todo);
+        }
+        else if (dist >= todo)
+        {
+            memcpy(out, out + dist, todo); // no overlap
+        }
+        else
+        {
+            for (i = todo; i-- > 0;)
+                out[i] = out[i + dist];
+        }
+    }
+
+    return (true);
+}
+
+#define PP_HASH_SIZE   65536 // 2-byte hash, no collisions
+#define PP_WINDOW_SIZE 8192  // longest possible match distance (13 offset bits)
+#define PP_WINDOW_MASK (PP_WINDOW_SIZE - 1)
+#define PP_NO_POS      0xFFFFFFFF
+
+typedef struct ppLevel_t
+{
+    uint8_t offsetLens[4];
+    uint16_t chainDepth, niceLen;
+    uint8_t lazy;
+} ppLevel_t;
+
+static const ppLevel_t ppLevels[PP_EFFICIENCY_NUM] =
+{
+    { { 9,  9,  9,  9 },  16,  32, false }, // fast
+    { { 9, 10, 10, 10 },  32,  64, false }, // mediocre
+    { { 9, 10, 11, 11 },  64, 128, true  }, // good
+    { { 9, 10, 12, 12 },  64, 128, true  }, // very good
+    { { 9, 10, 12, 13 }, 128, 256, true  }  // best
+};
+
+typedef struct ppBitWriter_t
+{
+    uint32_t *words, numWords, maxWords;
+    uint64_t bitBuffer;
+    int32_t bitsUsed;
+} ppBitWriter_t;
+
+typedef struct ppCruncher_t
+{
+    const ppLevel_t *level;
+    const uint8_t *data; // input, reversed
+    uint32_t dataLen, nextInsert, maxDist[4];
+    uint32_t *head, *prev;
+    ppBitWriter_t bw;
+} ppCruncher_t;
+
+// writes up to 24 bits, MSB first (the first bit written is the first bit the decruncher reads)
+static inline void ppWriteBits(ppBitWriter_t *bw, uint32_t value, uint8_t numBits)
+{
+    uint32_t x;
+
+    x = (((uint32_t)(bitReverseTable[value & 0xFF]) << 16) |
+         ((uint32_t)(bitReverseTable[(value >> 8) & 0xFF]) << 8) |
+          (uint32_t)(bitReverseTable[(value >> 16) & 0xFF])) >> (24 - numBits);
+
+    bw->bitBuffer |= (uint64_t)(x) << bw->bitsUsed;
+    bw->bitsUsed  += numBits;
+
+    if (bw->bitsUsed >= 32)
+    {
+        if (bw->numWords < bw->maxWords)
+            bw->words[bw->numWords] = (uint32_t)(bw->bitBuffer);
+
+        bw->numWords++;
+        bw->bitBuffer >>= 32;
+        bw->bitsUsed   -= 32;
+    }
+}
+
+static inline void ppInsertUpTo(ppCruncher_t *c, uint32_t pos)
+{
+    uint16_t hash;
+
+    while (c->nextInsert < pos)
+    {
+        if ((c->nextInsert + 1) < c->dataLen)
+        {
+            hash = (uint16_t)(c->data[c->nextInsert] | (c->data[c->nextInsert + 1] << 8));
+
+            c->prev[c->nextInsert & PP_WINDOW_MASK] = c->head[hash];
+            c->head[hash] = c->nextInsert;
+        }
+
+        c->nextInsert++;
+    }
+}
+
+// bits a match takes in the stream (without the match flag)
+static inline int32_t ppMatchBits(const ppLevel_t *level, uint32_t len, uint32_t dist)
+{
+    if (len < 5)
+        return (2 + level->offsetLens[len - 2]);
+
+    return (2 + 1 + ((dist <= 128) ? 7 : level->offsetLens[3]) + ((((len - 5) / 7) + 1) * 3));
+}
+
+// bits saved by coding len bytes as this match instead of as literals
+static inline int32_t ppMatchGain(const ppLevel_t *level, uint32_t len, uint32_t dist)
+{
+    return ((int32_t)(len * 8) - ppMatchBits(level, len, dist));
+}
+
+/* Returns the match at pos that saves the most bits, or 0. A longer match
+** isn't always better, a far one can cost more offset bits than it saves. */
+static uint32_t ppFindMatch(ppCruncher_t *c, uint32_t pos, uint32_t *matchDist)
+{
+    const uint8_t *data;
+    uint16_t depth;
+    int32_t gain, bestGain;
+    uint32_t cand, next, dist, len, maxLen, bestLen, bestDist;
+
+    ppInsertUpTo(c, pos);
+
+    maxLen = c->dataLen - pos;
+    if (maxLen < 2)
+        return (0);
+
+    data     = c->data;
+    bestLen  = 0;
+    bestDist = 0;
+    bestGain = 0;
+    depth    = c->level->chainDepth;
+    cand     = c->head[data[pos] | (data[pos + 1] << 8)];
+
+    while ((cand != PP_NO_POS) && (depth-- > 0))
+    {
+        dist = pos - cand;
+        if (dist > c->maxDist[3])
+            break; // chain is sorted by distance, the rest is out of reach
+
+        /* The chain goes from near to far, and a match can't get cheaper with
+        ** a longer distance. So it can only win if it matches one byte further
+        ** than the best so far. */
+        if ((bestLen == 0) || (data[cand + bestLen] == data[pos + bestLen]))
+        {
+            len = 2;
+            while ((len < maxLen) && (data[cand + len] == data[pos + len]))
+                len++;
+
+            // short matches have shorter offset fields
+            while ((len >= 2) && (len < 5) && (dist > c->maxDist[len - 2]))
+                len--;
+
+            gain = (len >= 2) ? ppMatchGain(c->level, len, dist) : 0;
+            if ((len > bestLen) && (gain > bestGain))
+            {
+                bestLen  = len;
+                bestDist = dist;
+                bestGain = gain;
+
+                if ((len >= c->level->niceLen) || (len == maxLen))
+                    break;
+            }
+        }
+
+        next = c->prev[cand & PP_WINDOW_MASK];
+        if (next >= cand)
+            break; // slot was reused by a newer position
+
+        cand = next;
+    }
+
+    *matchDist = bestDist;
+    return (bestLen);
+}
+
+static void ppWriteLiterals(ppCruncher_t *c, uint32_t start, uint32_t count)
+{
+    uint32_t x;
+
+    ppWriteBits(&c->bw, 0, 1);
+
+    x = count - 1;
+    while (x >= 3)
+    {
+        ppWriteBits(&c->bw, 3, 2);
+        x -= 3;
+    }
+    ppWriteBits(&c->bw, x, 2);
+
+    while (count--)
+        ppWriteBits(&c->bw, c->data[start++], 8);
+}
+
+static void ppWriteMatch(ppCruncher_t *c, uint32_t len, uint32_t dist)
+{
+    uint32_t x;
+
+    if (len < 5)
+    {
+        ppWriteBits(&c->bw, len - 2, 2);
+        ppWriteBits(&c->bw, dist - 1, c->level->offsetLens[len - 2]);
+    }
+    else
+    {
+        ppWriteBits(&c->bw, 3, 2);
+
+        if (dist <= 128)
+        {
+            ppWriteBits(&c->bw, 0, 1);
+            ppWriteBits(&c->bw, dist - 1, 7);
+        }
+        else
+        {
+            ppWriteBits(&c->bw, 1, 1);
+            ppWriteBits(&c->bw, dist - 1, c->level->offsetLens[3]);
+        }
+
+        x = len - 5;
+        while (x >= 7)
+        {
+            ppWriteBits(&c->bw, 7, 3);
+            x -= 7;
+        }
+        ppWriteBits(&c->bw, x, 3);
+    }
+}
+
+/* Returns a complete PP20 file image (malloc'd) and its length, or NULL if
+** out of memory. The decruncher writes backwards, so we crunch a reversed
+** copy of the input and the bit stream comes out in the order it's read. */
+uint8_t *ppcrunch(const uint8_t *src, uint32_t srcLen, uint8_t efficiency, uint32_t *packedLen)
+{
+    uint8_t *data, *packed, *ptr, skipBits;
+    uint32_t i, pos, len, len2, dist, dist2, litStart, litCount, totalBits, word;
+    ppCruncher_t c;
+
+    if ((src == NULL) || (srcLen == 0) || (srcLen > 0xFFFFFF) || (efficiency >= PP_EFFICIENCY_NUM))
+        return (NULL);
+
+    memset(&c, 0, sizeof (c));
+
+    c.level   = &ppLevels[efficiency];
+    c.dataLen = srcLen;
+
+    for (i = 0; i < 4; ++i)
+        c.maxDist[i] = 1UL << c.level->offsetLens[i];
+
+    data = (uint8_t *)(malloc(srcLen));
+
+    // all literals is ~8.67 bits per byte, anything with matches is less
+    c.bw.maxWords = ((srcLen / 32) + 1) * 9 + 16;
+    c.bw.words    = (uint32_t *)(malloc(c.bw.maxWords * sizeof (uint32_t)));
+    c.head        = (uint32_t *)(malloc(PP_HASH_SIZE * sizeof (uint32_t)));
+    c.prev        = (uint32_t *)(malloc(PP_WINDOW_SIZE * sizeof (uint32_t)));
+
+    if ((data == NULL) || (c.bw.words == NULL) || (c.head == NULL) || (c.prev == NULL))
+    {
+        free(data);
+        free(c.bw.words);
+        free(c.head);
+        free(c.prev);
+
+        return (NULL);
+    }
+
+    for (i = 0; i < srcLen; ++i)
+        data[i] = src[srcLen - 1 - i];
+
+    memset(c.head, 0xFF, PP_HASH_SIZE * sizeof (uint32_t));
+    c.data = data;
+
+    pos      = 0;
+    litStart = 0;
+    litCount = 0;
+
+    while (pos < srcLen)
+    {
+        len = ppFindMatch(&c, pos, &dist);
+
+        // lazy matching: take a literal if the next position has a match that saves more bits
+        if (c.level->lazy)
+        {
+            while ((len >= 2) && (len < c.level->niceLen) && ((pos + 1) < srcLen))
+            {
+                len2 = ppFindMatch(&c, pos + 1, &dist2);
+                if ((len2 < 2) || (ppMatchGain(c.level, len2, dist2) <= ppMatchGain(c.level, len, dist)))
+                    break;
+
+                if (litCount == 0)
+                    litStart = pos;
+
+                litCount++;
+                pos++;
+
+                len  = len2;
+                dist = dist2;
+            }
+        }
+
+        if (len < 2)
+        {
+            if (litCount == 0)
+                litStart = pos;
+
+            litCount++;
+            pos++;
+
+            continue;
+        }
+
+        // a literal run is always followed by a match, so the match flag is only needed without one
+        if (litCount > 0)
+        {
+            ppWriteLiterals(&c, litStart, litCount);
+            litCount = 0;
+        }
+        else
+        {
+            ppWriteBits(&c.bw, 1, 1);
+        }
+
+        ppWriteMatch(&c, len, dist);
+        pos += len;
+    }
+
+    if (litCount > 0)
+        ppWriteLiterals(&c, litStart, litCount);
+
+    free(data);
+    free(c.head);
+    free(c.prev);
+
+    // flush, then pad the start of the stream to a whole longword (skipped by the decruncher)
+    totalBits = (c.bw.numWords * 32) + c.bw.bitsUsed;
+    if (c.bw.bitsUsed > 0)
+    {
+        if (c.bw.numWords < c.bw.maxWords)
+            c.bw.words[c.bw.numWords] = (uint32_t)(c.bw.bitBuffer);
+
+        c.bw.numWords++;
+    }
+
+    if (c.bw.numWords > c.bw.maxWords)
+    {
+        free(c.bw.words);
+        return (NULL); // can't happen
+    }
+
+    skipBits = (uint8_t)((32 - (totalBits & 31)) & 31);
+    if (skipBits > 0)
+    {
+        for (i = c.bw.numWords - 1; i > 0; --i)
+            c.bw.words[i] = (c.bw.words[i] << skipBits) | (c.bw.words[i - 1] >> (32 - skipBits));
+
+        c.bw.words[0] <<= skipBits;
+    }
+
+    *packedLen = 4 + 4 + (c.bw.numWords * 4) + 4;
+
+    packed = (uint8_t *)(malloc(*packedLen));
+    if (packed == NULL)
+    {
+        free(c.bw.words);
+        return (NULL);
+    }
+
+    ptr = packed;
+
+    memcpy(ptr, "PP20", 4);
+    memcpy(ptr + 4, c.level->offsetLens, 4);
+    ptr += 8;
+
+    // the decruncher reads longwords from the end of the file
+    for (i = c.bw.numWords; i-- > 0;)
+    {
+        word = c.bw.words[i];
+
+        *ptr++ = (uint8_t)(word >> 24);
+        *ptr++ = (uint8_t)(word >> 16);
+        *ptr++ = (uint8_t)(word >>  8);
+        *ptr++ = (uint8_t)(word);
+    }
+
+    *ptr++ = (uint8_t)(srcLen >> 16);
+    *ptr++ = (uint8_t)(srcLen >>  8);
+    *ptr++ = (uint8_t)(srcLen);
+    *ptr++ = skipBits;
+
+    free(c.bw.words);
+    return (packed);
+}
@@ -0,0 +1,21 @@
+#ifndef __PT_POWERPACKER_H
+#define __PT_POWERPACKER_H
+
+#include <stdint.h>
+
+// same efficiency presets as the Amiga PowerPacker
+enum
+{
+    PP_EFFICIENCY_FAST     = 0,
+    PP_EFFICIENCY_MEDIOCRE = 1,
+    PP_EFFICIENCY_GOOD     = 2,
+    PP_EFFICIENCY_VERYGOOD = 3,
+    PP_EFFICIENCY_BEST     = 4,
+
+    PP_EFFICIENCY_NUM
+};
+
+uint8_t ppdecrunch(const uint8_t *src, uint8_t *dst, const uint8_t *offsetLens, uint32_t srcLen, uint32_t dstLen, uint8_t skipBits);
+uint8_t *ppcrunch(const uint8_t *src, uint32_t srcLen, uint8_t efficiency, uint32_t *packedLen);
+
+#endif
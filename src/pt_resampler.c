@@ -0,0 +1,270 @@
+/*
+** Windowed-sinc polyphase resampler, used for sample importing, the sampler's
+** "Resample" and chord mixing.
+**
+** The kernel is a Kaiser-windowed sinc, tabulated for RESAMPLER_PHASES + 1
+** fractional positions. Output points are the dot product of the input with
+** the two nearest kernel phases, linearly interpolated. When downsampling, the
+** cutoff is lowered and the kernel is widened by the same ratio, so the
+** result doesn't alias.
+**
+** Input is pushed in blocks of any size up to maxInput, the resampler keeps
+** the history it needs between calls. The input is treated as preceded and
+** followed by silence, call resamplerFlush() after the last block to get the
+** tail out.
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "pt_helpers.h"
+#include "pt_resampler.h"
+#include "pt_sampledsp.h"
+
+#define M_PI_D 3.14159265358979323846
+#define KAISER_BETA 8.0
+#define CUTOFF_SCALE 0.92 // leave room for the transition band below Nyquist
+
+static double besselI0(double x)
+{
+    double sum, term, k;
+
+    sum  = 1.0;
+    term = 1.0;
+
+    for (k = 1.0; k < 64.0; k += 1.0)
+    {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum  += term;
+
+        if (term < (sum * 1e-12))
+            break;
+    }
+
+    return (sum);
+}
+
+static void makeKernel(resampler_t *r, double cutoff)
+{
+    int32_t phase, i, half;
+    double x, w, t, sum, besselBeta;
+    float *c;
+
+    half = r->numTaps / 2;
+    besselBeta = besselI0(KAISER_BETA);
+
+    for (phase = 0; phase <= RESAMPLER_PHASES; ++phase)
+    {
+        c = &r->coeffs[phase * r->numTaps];
+
+        sum = 0.0;
+        for (i = 0; i < r->numTaps; ++i)
+        {
+            // distance (in input points) from the output point to this tap
+            x = (i - (half - 1)) - (phase / (double)(RESAMPLER_PHASES));
+
+            t = x / half;
+            if (fabs(t) >= 1.0)
+            {
+                c[i] = 0.0f;
+                continue;
+            }
+
+            w = besselI0(KAISER_BETA * sqrt(1.0 - (t * t))) / besselBeta;
+
+            if (fabs(x) < 1e-9)
+                c[i] = (float)(cutoff * w);
+            else
+                c[i] = (float)((sin(M_PI_D * cutoff * x) / (M_PI_D * x)) * w);
+
+            sum += c[i];
+        }
+
+        // unity gain at DC for every phase
+        if (sum != 0.0)
+        {
+            for (i = 0; i < r->numTaps; ++i)
+                c[i] = (float)(c[i] / sum);
+        }
+    }
+}
+
+int8_t resamplerInit(resampler_t *r, double step, int32_t maxInput)
+{
+    double cutoff, width;
+
+    memset(r, 0, sizeof (resampler_t));
+
+    if ((step <= 0.0) || (maxInput <= 0))
+        return (false);
+
+    cutoff = CUTOFF_SCALE;
+    width  = RESAMPLER_TAPS;
+
+    if (step > 1.0)
+    {
+        cutoff /= step;
+        width  *= step;
+    }
+
+    r->numTaps = ((int32_t)(ceil(width)) + 3) & ~3; // SIMD loops work on four taps at a time
+    if (r->numTaps > RESAMPLER_MAX_TAPS)
+        r->numTaps = RESAMPLER_MAX_TAPS;
+
+    r->step       = step;
+    r->maxInput   = maxInput;
+    r->bufferSize = (r->numTaps * 2) + maxInput;
+
+    r->coeffs = (float *)(malloc((RESAMPLER_PHASES + 1) * r->numTaps * sizeof (float)));
+    r->buffer = (float *)(malloc(r->bufferSize * sizeof (float)));
+
+    if ((r->coeffs == NULL) || (r->buffer == NULL))
+    {
+        resamplerFree(r);
+        return (false);
+    }
+
+    makeKernel(r, cutoff);
+    resamplerReset(r);
+
+    return (true);
+}
+
+void resamplerFree(resampler_t *r)
+{
+    if (r->coeffs != NULL)
+    {
+        free(r->coeffs);
+        r->coeffs = NULL;
+    }
+
+    if (r->buffer != NULL)
+    {
+        free(r->buffer);
+        r->buffer = NULL;
+    }
+}
+
+void resamplerReset(resampler_t *r)
+{
+    // silence before the first input point, so that output point 0 lines up with input point 0
+    r->bufferLen = (r->numTaps / 2) - 1;
+    r->pos = 0.0;
+
+    memset(r->buffer, 0, r->bufferLen * sizeof (float));
+}
+
+uint32_t resamplerMaxOutput(const resampler_t *r, uint32_t inputLen)
+{
+    // the flush is worth numTaps/2 input points
+    inputLen = MAX(inputLen, (uint32_t)(r->numTaps / 2));
+    return ((uint32_t)(ceil(inputLen / r->step)) + 2);
+}
+
+static inline float interpolatedDotProduct(const float *x, const float *c0, const float *c1, int32_t numTaps, float frac)
+{
+    int32_t i;
+    float sum0, sum1;
+
+    sum0 = 0.0f;
+    sum1 = 0.0f;
+    i = 0;
+
+#ifdef PT_USE_SSE2
+    {
+        __m128 acc0, acc1, in;
+        float sums0[4], sums1[4];
+
+        acc0 = _mm_setzero_ps();
+        acc1 = _mm_setzero_ps();
+
+        for (; i < numTaps; i += 4)
+        {
+            in   = _mm_loadu_ps(&x[i]);
+            acc0 = _mm_add_ps(acc0, _mm_mul_ps(in, _mm_loadu_ps(&c0[i])));
+            acc1 = _mm_add_ps(acc1, _mm_mul_ps(in, _mm_loadu_ps(&c1[i])));
+        }
+
+        _mm_storeu_ps(sums0, acc0);
+        _mm_storeu_ps(sums1, acc1);
+
+        sum0 = (sums0[0] + sums0[1]) + (sums0[2] + sums0[3]);
+        sum1 = (sums1[0] + sums1[1]) + (sums1[2] + sums1[3]);
+    }
+#endif
+
+    for (; i < numTaps; ++i)
+    {
+        sum0 += x[i] * c0[i];
+        sum1 += x[i] * c1[i];
+    }
+
+    return (LERP(sum0, sum1, frac));
+}
+
+// makes as many output points as the buffered input allows, then drops the input we're done with
+static uint32_t resamplerRun(resampler_t *r, float *out)
+{
+    int32_t pos_i;
+    uint32_t numOut;
+    double phase;
+    const float *c0;
+
+    numOut = 0;
+    while (((int32_t)(r->pos) + r->numTaps) <= r->bufferLen)
+    {
+        pos_i = (int32_t)(r->pos);
+        phase = (r->pos - pos_i) * RESAMPLER_PHASES;
+
+        c0 = &r->coeffs[(int32_t)(phase) * r->numTaps];
+        out[numOut++] = interpolatedDotProduct(&r->buffer[pos_i], c0, c0 + r->numTaps, r->numTaps, (float)(phase - (int32_t)(phase)));
+
+        r->pos += r->step;
+    }
+
+    pos_i = MIN((int32_t)(r->pos), r->bufferLen);
+    if (pos_i > 0)
+    {
+        memmove(r->buffer, &r->buffer[pos_i], (r->bufferLen - pos_i) * sizeof (float));
+
+        r->bufferLen -= pos_i;
+        r->pos       -= pos_i;
+    }
+
+    return (numOut);
+}
+
+// inputLen must not exceed maxInput. Returns number of output points written
+uint32_t resamplerProcess(resampler_t *r, const float *in, uint32_t inputLen, float *out)
+{
+    PT_ASSERT(inputLen <= (uint32_t)(r->maxInput));
+
+    memcpy(&r->buffer[r->bufferLen], in, inputLen * sizeof (float));
+    r->bufferLen += inputLen;
+
+    return (resamplerRun(r, out));
+}
+
+uint32_t resamplerProcess8bit(resampler_t *r, const int8_t *in, uint32_t inputLen, float *out)
+{
+    PT_ASSERT(inputLen <= (uint32_t)(r->maxInput));
+
+    sample8ToFloat(in, &r->buffer[r->bufferLen], inputLen);
+    r->bufferLen += inputLen;
+
+    return (resamplerRun(r, out));
+}
+
+// pushes the silence needed to get the output points up to the end of the input
+uint32_t resamplerFlush(resampler_t *r, float *out)
+{
+    int32_t tailLen;
+
+    tailLen = r->numTaps / 2;
+
+    memset(&r->buffer[r->bufferLen], 0, tailLen * sizeof (float));
+    r->bufferLen += tailLen;
+
+    return (resamplerRun(r, out));
+}
@@ -0,0 +1,29 @@
+#ifndef __PT_RESAMPLER_H
+#define __PT_RESAMPLER_H
+
+#include <stdint.h>
+
+// RESAMPLER_TAPS = kernel length when upsampling (widened by the ratio when downsampling)
+// RESAMPLER_PHASES = number of fractional positions in the kernel table (linearly interpolated)
+
+#define RESAMPLER_TAPS 32
+#define RESAMPLER_MAX_TAPS 512
+#define RESAMPLER_PHASES 256
+
+typedef struct resampler_t
+{
+    float *coeffs, *buffer;
+    double step, pos;
+    int32_t numTaps, bufferLen, bufferSize, maxInput;
+} resampler_t;
+
+// step = input sample points per output sample point, maxInput = max input length per process call
+int8_t resamplerInit(resampler_t *r, double step, int32_t maxInput);
+void resamplerFree(resampler_t *r);
+void resamplerReset(resampler_t *r);
+uint32_t resamplerMaxOutput(const resampler_t *r, uint32_t inputLen);
+uint32_t resamplerProcess(resampler_t *r, const float *in, uint32_t inputLen, float *out);
+uint32_t resamplerProcess8bit(resampler_t *r, const int8_t *in, uint32_t inputLen, float *out);
+uint32_t resamplerFlush(resampler_t *r, float *out);
+
+#endif
@@ -0,0 +1,242 @@
+/*
+** "All samples" batch operations (boost, filter, normalize, DC removal and
+** resampling of every sample), run on a pool of worker threads with one
+** sample per task.
+**
+** Everything that isn't thread safe happens on the GUI thread: the undo steps
+** for all samples are saved (as one undo group) before the workers start, and
+** the "beep" fix, waveform and GUI updates are done by sampleBatchUpdate()
+** when all samples are done. The workers only touch the sample data and
+** attributes of the sample they're working on. Input is ignored while a batch
+** is running.
+*/
+
+#include <SDL2/SDL.h>
+#include <stdio.h>
+#include <stdint.h>
+#include "pt_header.h"
+#include "pt_helpers.h"
+#include "pt_audio.h"
+#include "pt_palette.h"
+#include "pt_textout.h"
+#include "pt_terminal.h"
+#include "pt_visuals.h"
+#include "pt_sampler.h"
+#include "pt_sampleundo.h"
+#include "pt_sampledsp.h"
+#include "pt_samplebatch.h"
+
+#define MAX_BATCH_THREADS 16
+
+static const char *opNames[SAMPLE_BATCH_NUM_OPS] =
+{
+    "BOOSTING", "FILTERING", "NORMALIZING", "REMOVING DC", "RESAMPLING"
+};
+
+static const char *opTermNames[SAMPLE_BATCH_NUM_OPS] =
+{
+    "Treble boost", "Treble decrease", "Normalize", "DC offset removal", "Resample"
+};
+
+static volatile int8_t batchRunning;
+static int8_t batchOp, batchSamples[MOD_SAMPLES], batchResults[MOD_SAMPLES];
+static int32_t numBatchSamples, numThreads, lastProgress;
+static uint64_t batchStartTime;
+static SDL_atomic_t nextTask, tasksDone;
+static SDL_Thread *threads[MAX_BATCH_THREADS];
+
+static int8_t processSample(int8_t op, int8_t sample)
+{
+    int8_t *smpDat;
+    int32_t length, peak, vol;
+    moduleSample_t *s;
+
+    s = &modEntry->samples[sample];
+    smpDat = &modEntry->sampleData[s->offset];
+    length = s->length;
+
+    switch (op)
+    {
+        case SAMPLE_BATCH_BOOST: sample8TrebleBoost(smpDat, length); break;
+
+        // average of each point and the next one, like filterSample()
+        case SAMPLE_BATCH_FILTER: sample8Mix(smpDat, smpDat, smpDat + 1, length - 1, false); break;
+
+        case SAMPLE_BATCH_NORMALIZE:
+        {
+            // same gain as the volume box's "normalize", but without its 200% limit
+            peak = sample8Peak(smpDat, length);
+            if ((peak > 0) && (peak < 127))
+            {
+                vol = (int32_t)((12700.0f / peak) + 0.5f);
+                sample8Ramp(smpDat, length, (int16_t)(vol), (int16_t)(vol));
+            }
+        }
+        break;
+
+        case SAMPLE_BATCH_DC_REMOVE: sample8SubtractSat(smpDat, length, (int8_t)(sample8Sum(smpDat, length) / length)); break;
+
+        case SAMPLE_BATCH_RESAMPLE: return (resampleSampleData(sample, false) == RESAMPLE_OK);
+
+        default: break;
+    }
+
+    return (true);
+}
+
+static int32_t batchThreadFunc(void *ptr)
+{
+    int32_t i;
+
+    (void)(ptr);
+
+    while ((i = SDL_AtomicAdd(&nextTask, 1)) < numBatchSamples)
+    {
+        batchResults[i] = processSample(batchOp, batchSamples[i]);
+        SDL_AtomicIncRef(&tasksDone);
+    }
+
+    return (0);
+}
+
+int8_t sampleBatchRunning(void)
+{
+    return (batchRunning);
+}
+
+void sampleBatchStart(int8_t op)
+{
+    char threadName[48];
+    int8_t i;
+    int32_t numStarted;
+
+    if (batchRunning || (op < 0) || (op >= SAMPLE_BATCH_NUM_OPS))
+        return;
+
+    numBatchSamples = 0;
+    for (i = 0; i < MOD_SAMPLES; ++i)
+    {
+        if (modEntry->samples[i].length > 1)
+            batchSamples[numBatchSamples++] = i;
+    }
+
+    if (numBatchSamples == 0)
+    {
+        displayErrorMsg("SAMPLES ARE EMPTY");
+        return;
+    }
+
+    turnOffVoices();
+
+    // all the undo steps in one group, undoing any of the samples undoes the whole batch
+    sampleUndoBeginGroup();
+    for (i = 0; i < numBatchSamples; ++i)
+        sampleUndoSave(batchSamples[i], 0, modEntry->samples[batchSamples[i]].length);
+    sampleUndoEndGroup();
+
+    batchOp      = op;
+    lastProgress = -1;
+
+    SDL_AtomicSet(&nextTask, 0);
+    SDL_AtomicSet(&tasksDone, 0);
+
+    batchStartTime = SDL_GetPerformanceCounter();
+    batchRunning   = true;
+
+    numThreads = CLAMP(SDL_GetCPUCount(), 1, MAX_BATCH_THREADS);
+    numThreads = MIN(numThreads, numBatchSamples);
+
+    numStarted = 0;
+    for (i = 0; i < numThreads; ++i)
+    {
+        sprintf(threadName, "ProTracker sample batch thread %d", i);
+
+        threads[i] = SDL_CreateThread(batchThreadFunc, threadName, NULL);
+        if (threads[i] != NULL)
+            numStarted++;
+    }
+
+    // no threads? do it here then
+    if (numStarted == 0)
+        batchThreadFunc(NULL);
+
+    pointerSetMode(POINTER_MODE_READ_DIR, NO_CARRY);
+    sampleBatchUpdate();
+}
+
+void sampleBatchWait(void)
+{
+    int32_t i;
+
+    if (!batchRunning)
+        return;
+
+    for (i = 0; i < numThreads; ++i)
+    {
+        if (threads[i] != NULL)
+        {
+            SDL_WaitThread(threads[i], NULL);
+            threads[i] = NULL;
+        }
+    }
+}
+
+void sampleBatchUpdate(void)
+{
+    char statusText[32];
+    int8_t sample;
+    int32_t i, done, numFailed;
+    double timeMs;
+
+    if (!batchRunning)
+        return;
+
+    done = SDL_AtomicGet(&tasksDone);
+    if (done < numBatchSamples)
+    {
+        if (done != lastProgress)
+        {
+            lastProgress = done;
+
+            sprintf(statusText, "%s %02d/%02d", opNames[batchOp], done, numBatchSamples);
+            setStatusMessage(statusText, NO_CARRY);
+        }
+
+        return;
+    }
+
+    sampleBatchWait();
+    batchRunning = false;
+
+    timeMs = (double)(SDL_GetPerformanceCounter() - batchStartTime) / (SDL_GetPerformanceFrequency() / 1000.0);
+
+    numFailed = 0;
+    for (i = 0; i < numBatchSamples; ++i)
+    {
+        sample = batchSamples[i];
+
+        if (!batchResults[i])
+            numFailed++;
+
+        invalidateSampleWaveform(sample, 0, MAX_SAMPLE_LEN);
+        fixSampleBeep(&modEntry->samples[sample]);
+    }
+
+    terminalPrintf("%s of %d samples took %.1fms (%d thread(s))\n", opTermNames[batchOp], numBatchSamples, timeMs, numThreads);
+    if (numFailed > 0)
+        terminalPrintf("%d sample(s) couldn't be processed (out of memory or bad tuning)\n", numFailed);
+
+    pointerSetPreviousMode();
+    setPrevStatusMessage();
+
+    if (numFailed > 0)
+        displayErrorMsg("SAMPLE(S) FAILED!");
+    else
+        displayMsg("ALL SAMPLES DONE");
+
+    editor.samplePos = 0;
+    updateCurrSample();
+
+    editor.ui.updateSongSize = true;
+    updateWindowTitle(MOD_IS_MODIFIED);
+}
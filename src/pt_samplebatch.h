@@ -0,0 +1,22 @@
+#ifndef __PT_SAMPLEBATCH_H
+#define __PT_SAMPLEBATCH_H
+
+#include <stdint.h>
+
+enum
+{
+    SAMPLE_BATCH_BOOST     = 0,
+    SAMPLE_BATCH_FILTER    = 1,
+    SAMPLE_BATCH_NORMALIZE = 2,
+    SAMPLE_BATCH_DC_REMOVE = 3,
+    SAMPLE_BATCH_RESAMPLE  = 4,
+
+    SAMPLE_BATCH_NUM_OPS
+};
+
+void sampleBatchStart(int8_t op);
+void sampleBatchUpdate(void); // call once per frame, shows progress and finishes the batch when all samples are done
+int8_t sampleBatchRunning(void);
+void sampleBatchWait(void);
+
+#endif
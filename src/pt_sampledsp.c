@@ -0,0 +1,408 @@
+/*
+** Whole-sample DSP kernels for the sampler's destructive operations (filters,
+** boost, DC removal, mixing, volume ramp). The 8-bit kernels work in place,
+** SSE2 paths do 16 sample points per iteration and the scalar loops handle
+** the rest (and give identical results).
+*/
+
+#include <stdint.h>
+#include <math.h>
+#include "pt_helpers.h"
+#include "pt_sampledsp.h"
+
+#ifdef PT_USE_SSE2
+// sign extends the low/high 8 bytes to 16-bit lanes
+#define UNPACK_LO_S8(x) _mm_srai_epi16(_mm_unpacklo_epi8(x, x), 8)
+#define UNPACK_HI_S8(x) _mm_srai_epi16(_mm_unpackhi_epi8(x, x), 8)
+
+// roundf() for four floats: round half away from zero
+static inline __m128i roundPs(__m128 x)
+{
+    const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32((int32_t)(0x80000000)));
+    __m128i r, sign;
+
+    r    = _mm_cvttps_epi32(_mm_add_ps(_mm_andnot_ps(signMask, x), _mm_set1_ps(0.5f)));
+    sign = _mm_srai_epi32(_mm_castps_si128(x), 31);
+
+    return (_mm_sub_epi32(_mm_xor_si128(r, sign), sign));
+}
+
+// roundf(x / 2^shift) for 16-bit lanes
+static inline __m128i divRound16(__m128i x, int32_t shift)
+{
+    __m128i sign, r;
+
+    sign = _mm_srai_epi16(x, 15);
+    r = _mm_sub_epi16(_mm_xor_si128(x, sign), sign); // abs
+    r = _mm_srli_epi16(_mm_add_epi16(r, _mm_set1_epi16((int16_t)(1 << (shift - 1)))), shift);
+
+    return (_mm_sub_epi16(_mm_xor_si128(r, sign), sign));
+}
+#endif
+
+static inline int32_t divRound(int32_t x, int32_t shift)
+{
+    return ((x < 0) ? -((-x + (1 << (shift - 1))) >> shift) : ((x + (1 << (shift - 1))) >> shift));
+}
+
+void sample8ToFloat(const int8_t *src, float *dst, uint32_t numSamples)
+{
+    uint32_t i;
+
+    i = 0;
+
+#ifdef PT_USE_SSE2
+    {
+        __m128i x, lo, hi;
+
+        for (; (i + 16) <= numSamples; i += 16)
+        {
+            x  = _mm_loadu_si128((const __m128i *)(&src[i]));
+            lo = UNPACK_LO_S8(x);
+            hi = UNPACK_HI_S8(x);
+
+            _mm_storeu_ps(&dst[i +  0], _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(lo, lo), 16)));
+            _mm_storeu_ps(&dst[i +  4], _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(lo, lo), 16)));
+            _mm_storeu_ps(&dst[i +  8], _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(hi, hi), 16)));
+            _mm_storeu_ps(&dst[i + 12], _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(hi, hi), 16)));
+        }
+    }
+#endif
+
+    for (; i < numSamples; ++i)
+        dst[i] = src[i];
+}
+
+void quantizeFloatBlockTo8bit(const float *src, int8_t *dst, uint32_t numSamples, float gain)
+{
+    uint32_t i;
+    float smp_f;
+
+    i = 0;
+
+#ifdef PT_USE_SSE2
+    {
+        const __m128 gain4 = _mm_set1_ps(gain);
+        __m128i a, b, c, d;
+
+        // the pack instructions saturate to -128..127
+        for (; (i + 16) <= numSamples; i += 16)
+        {
+            a = roundPs(_mm_mul_ps(_mm_loadu_ps(&src[i +  0]), gain4));
+            b = roundPs(_mm_mul_ps(_mm_loadu_ps(&src[i +  4]), gain4));
+            c = roundPs(_mm_mul_ps(_mm_loadu_ps(&src[i +  8]), gain4));
+            d = roundPs(_mm_mul_ps(_mm_loadu_ps(&src[i + 12]), gain4));
+
+            _mm_storeu_si128((__m128i *)(&dst[i]), _mm_packs_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d)));
+        }
+    }
+#endif
+
+    for (; i < numSamples; ++i)
+    {
+        smp_f = roundf(src[i] * gain);
+        dst[i] = (int8_t)(CLAMP(smp_f, -128.0f, 127.0f));
+    }
+}
+
+float getFloatPeak(const float *data, uint32_t numSamples)
+{
+    uint32_t i;
+    float peak, smp_f;
+
+    peak = 0.0f;
+    i = 0;
+
+#ifdef PT_USE_SSE2
+    {
+        const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+        __m128 peak4;
+        float peaks[4];
+
+        peak4 = _mm_setzero_ps();
+        for (; (i + 4) <= numSamples; i += 4)
+            peak4 = _mm_max_ps(peak4, _mm_and_ps(_mm_loadu_ps(&data[i]), absMask));
+
+        _mm_storeu_ps(peaks, peak4);
+        peak = MAX(MAX(peaks[0], peaks[1]), MAX(peaks[2], peaks[3]));
+    }
+#endif
+
+    for (; i < numSamples; ++i)
+    {
+        smp_f = fabsf(data[i]);
+        if (peak < smp_f)
+            peak = smp_f;
+    }
+
+    return (peak);
+}
+
+// same math as lossyIntegrator()/lossyIntegratorHighPass() in pt_audio.c, for one channel
+void lossyIntegratorBlock(float *data, uint32_t numSamples, float coeff0, float coeff1, int8_t highPass, int8_t backwards)
+{
+    uint32_t i;
+    int32_t step;
+    float *ptr, in, out, buffer;
+
+    if (numSamples == 0)
+        return;
+
+    ptr  = backwards ? &data[numSamples - 1] : data;
+    step = backwards ? -1 : 1;
+
+    buffer = 0.0f;
+    for (i = 0; i < numSamples; ++i, ptr += step)
+    {
+        in  = *ptr;
+        out = (coeff0 * in + buffer) * coeff1;
+        buffer = coeff0 * (in - out) + out + 1e-10f;
+
+        *ptr = highPass ? (in - out) : out;
+    }
+}
+
+int32_t sample8Sum(const int8_t *data, uint32_t numSamples)
+{
+    uint32_t i;
+    int32_t sum;
+
+    sum = 0;
+    i = 0;
+
+#ifdef PT_USE_SSE2
+    {
+        const __m128i signFlip = _mm_set1_epi8((int8_t)(0x80));
+        __m128i acc;
+        int64_t sums[2];
+
+        // sum of the unsigned (x + 128) values, then take the bias back out
+        acc = _mm_setzero_si128();
+        for (; (i + 16) <= numSamples; i += 16)
+            acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_xor_si128(_mm_loadu_si128((const __m128i *)(&data[i])), signFlip), _mm_setzero_si128()));
+
+        _mm_storeu_si128((__m128i *)(sums), acc);
+        sum = (int32_t)((sums[0] + sums[1]) - ((int64_t)(i) * 128));
+    }
+#endif
+
+    for (; i < numSamples; ++i)
+        sum += data[i];
+
+    return (sum);
+}
+
+int32_t sample8Peak(const int8_t *data, uint32_t numSamples)
+{
+    uint32_t i;
+    int32_t smpMin, smpMax;
+
+    smpMin = 0;
+    smpMax = 0;
+    i = 0;
+
+#ifdef PT_USE_SSE2
+    {
+        const __m128i signFlip = _mm_set1_epi8((int8_t)(0x80));
+        __m128i x, min16, max16;
+        uint8_t mins[16], maxs[16];
+        uint32_t j;
+
+        if (numSamples >= 16)
+        {
+            // SSE2 only has unsigned byte min/max, flip the sign bit to keep the order
+            min16 = _mm_set1_epi8((int8_t)(0x80));
+            max16 = _mm_set1_epi8((int8_t)(0x80));
+
+            for (; (i + 16) <= numSamples; i += 16)
+            {
+                x = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(&data[i])), signFlip);
+                min16 = _mm_min_epu8(min16, x);
+                max16 = _mm_max_epu8(max16, x);
+            }
+
+            _mm_storeu_si128((__m128i *)(mins), min16);
+            _mm_storeu_si128((__m128i *)(maxs), max16);
+
+            for (j = 0; j < 16; ++j)
+            {
+                smpMin = MIN(smpMin, (int32_t)(mins[j]) - 128);
+                smpMax = MAX(smpMax, (int32_t)(maxs[j]) - 128);
+            }
+        }
+    }
+#endif
+
+    for (; i < numSamples; ++i)
+    {
+        smpMin = MIN(smpMin, data[i]);
+        smpMax = MAX(smpMax, data[i]);
+    }
+
+    return (MAX(-smpMin, smpMax));
+}
+
+void sample8SubtractSat(int8_t *data, uint32_t numSamples, int8_t value)
+{
+    uint32_t i;
+    int32_t smp32;
+
+    i = 0;
+
+#ifdef PT_USE_SSE2
+    {
+        const __m128i value16 = _mm_set1_epi8(value);
+
+        for (; (i + 16) <= numSamples; i += 16)
+            _mm_storeu_si128((__m128i *)(&data[i]), _mm_subs_epi8(_mm_loadu_si128((const __m128i *)(&data[i])), value16));
+    }
+#endif
+
+    for (; i < numSamples; ++i)
+    {
+        smp32 = data[i] - value;
+        data[i] = (int8_t)(CLAMP(smp32, -128, 127));
+    }
+}
+
+/* dst = src1 + src2, either clipped (halfClip) or halved and rounded. src2 can
+** be NULL (silence). dst may be the same as src1, or trail it by any number
+** of points (dst == src2 - 1 averages neighbouring points in place). */
+void sample8Mix(int8_t *dst, const int8_t *src1, const int8_t *src2, uint32_t numSamples, int8_t halfClip)
+{
+    uint32_t i;
+    int32_t smp32;
+
+    i = 0;
+
+#ifdef PT_USE_SSE2
+    {
+        __m128i a, b, lo, hi;
+
+        for (; (i + 16) <= numSamples; i += 16)
+        {
+            a = _mm_loadu_si128((const __m128i *)(&src1[i]));
+            b = (src2 != NULL) ? _mm_loadu_si128((const __m128i *)(&src2[i])) : _mm_setzero_si128();
+
+            if (halfClip)
+            {
+                _mm_storeu_si128((__m128i *)(&dst[i]), _mm_adds_epi8(a, b));
+            }
+            else
+            {
+                lo = divRound16(_mm_add_epi16(UNPACK_LO_S8(a), UNPACK_LO_S8(b)), 1);
+                hi = divRound16(_mm_add_epi16(UNPACK_HI_S8(a), UNPACK_HI_S8(b)), 1);
+
+                _mm_storeu_si128((__m128i *)(&dst[i]), _mm_packs_epi16(lo, hi));
+            }
+        }
+    }
+#endif
+
+    for (; i < numSamples; ++i)
+    {
+        smp32 = src1[i];
+        if (src2 != NULL)
+            smp32 += src2[i];
+
+        if (!halfClip)
+            smp32 = divRound(smp32, 1);
+
+        dst[i] = (int8_t)(CLAMP(smp32, -128, 127));
+    }
+}
+
+// x + (x - previous x) / 4 (rounded), the point before the first one counts as 0
+void sample8TrebleBoost(int8_t *data, uint32_t numSamples)
+{
+    uint32_t i;
+    int32_t prev, smp32;
+
+    prev = 0;
+    i = 0;
+
+#ifdef PT_USE_SSE2
+    {
+        __m128i x, xPrev, carry, lo, hi;
+
+        carry = _mm_setzero_si128();
+        for (; (i + 16) <= numSamples; i += 16)
+        {
+            x     = _mm_loadu_si128((const __m128i *)(&data[i]));
+            xPrev = _mm_or_si128(_mm_slli_si128(x, 1), carry);
+            carry = _mm_srli_si128(x, 15);
+
+            lo = UNPACK_LO_S8(x);
+            hi = UNPACK_HI_S8(x);
+            lo = _mm_add_epi16(lo, divRound16(_mm_sub_epi16(lo, UNPACK_LO_S8(xPrev)), 2));
+            hi = _mm_add_epi16(hi, divRound16(_mm_sub_epi16(hi, UNPACK_HI_S8(xPrev)), 2));
+
+            _mm_storeu_si128((__m128i *)(&data[i]), _mm_packs_epi16(lo, hi));
+        }
+
+        prev = (int8_t)(_mm_cvtsi128_si32(carry));
+    }
+#endif
+
+    for (; i < numSamples; ++i)
+    {
+        smp32 = data[i];
+        data[i] = (int8_t)(CLAMP(smp32 + divRound(smp32 - prev, 2), -128, 127));
+        prev = smp32;
+    }
+}
+
+// scales the data by a gain going linearly from vol1% (first point) towards vol2% (one past the last point)
+void sample8Ramp(int8_t *data, uint32_t numSamples, int16_t vol1, int16_t vol2)
+{
+    uint32_t i;
+    float len_f, smp_f;
+
+    if (numSamples == 0)
+        return;
+
+    len_f = (float)(numSamples);
+    i = 0;
+
+#ifdef PT_USE_SSE2
+    {
+        const __m128 len4 = _mm_set1_ps(len_f), vol1_4 = _mm_set1_ps(vol1), vol2_4 = _mm_set1_ps(vol2);
+        const __m128 hundred4 = _mm_set1_ps(100.0f);
+        __m128 idx4, gain4;
+        __m128i x, lo, hi, r[4];
+        int32_t j;
+
+        idx4 = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+        for (; (i + 16) <= numSamples; i += 16)
+        {
+            x  = _mm_loadu_si128((const __m128i *)(&data[i]));
+            lo = UNPACK_LO_S8(x);
+            hi = UNPACK_HI_S8(x);
+
+            for (j = 0; j < 4; ++j)
+            {
+                gain4 = _mm_add_ps(_mm_div_ps(_mm_mul_ps(idx4, vol2_4), len4), _mm_div_ps(_mm_mul_ps(_mm_sub_ps(len4, idx4), vol1_4), len4));
+
+                x = (j < 2) ? lo : hi;
+                x = (j & 1) ? _mm_unpackhi_epi16(x, x) : _mm_unpacklo_epi16(x, x);
+
+                r[j] = roundPs(_mm_div_ps(_mm_mul_ps(gain4, _mm_cvtepi32_ps(_mm_srai_epi32(x, 16))), hundred4));
+                idx4 = _mm_add_ps(idx4, _mm_set1_ps(4.0f));
+            }
+
+            _mm_storeu_si128((__m128i *)(&data[i]), _mm_packs_epi16(_mm_packs_epi32(r[0], r[1]), _mm_packs_epi32(r[2], r[3])));
+        }
+    }
+#endif
+
+    for (; i < numSamples; ++i)
+    {
+        smp_f  = (i * vol2) / len_f;
+        smp_f += ((numSamples - i) * vol1) / len_f;
+        smp_f *= (float)(data[i]);
+        smp_f /= 100.0f;
+        smp_f  = roundf(smp_f);
+
+        data[i] = (int8_t)(CLAMP(smp_f, -128.0f, 127.0f));
+    }
+}
@@ -0,0 +1,22 @@
+#ifndef __PT_SAMPLEDSP_H
+#define __PT_SAMPLEDSP_H
+
+#include <stdint.h>
+
+// float <-> 8-bit conversion, quantizing rounds half away from zero and saturates to -128..127
+void sample8ToFloat(const int8_t *src, float *dst, uint32_t numSamples);
+void quantizeFloatBlockTo8bit(const float *src, int8_t *dst, uint32_t numSamples, float gain);
+float getFloatPeak(const float *data, uint32_t numSamples);
+
+// one pass of the one-pole lossy integrator (low-pass, or high-pass as input minus low-pass) over the data, in place
+void lossyIntegratorBlock(float *data, uint32_t numSamples, float coeff0, float coeff1, int8_t highPass, int8_t backwards);
+
+// in place 8-bit kernels
+int32_t sample8Sum(const int8_t *data, uint32_t numSamples);
+int32_t sample8Peak(const int8_t *data, uint32_t numSamples); // highest absolute value (0..128)
+void sample8SubtractSat(int8_t *data, uint32_t numSamples, int8_t value);
+void sample8Mix(int8_t *dst, const int8_t *src1, const int8_t *src2, uint32_t numSamples, int8_t halfClip);
+void sample8TrebleBoost(int8_t *data, uint32_t numSamples);
+void sample8Ramp(int8_t *data, uint32_t numSamples, int16_t vol1, int16_t vol2); // vol1/vol2 in percent
+
+#endif
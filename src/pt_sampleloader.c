@@ -23,6 +23,9 @@
 #include "pt_helpers.h"
 #include "pt_terminal.h"
 #include "pt_unicode.h"
+#include "pt_resampler.h"
+#include "pt_sampleundo.h"
+#include "pt_sampledsp.h"
 
 enum
 {
@@ -30,6 +33,9 @@ enum
     WAV_FORMAT_IEEE_FLOAT = 0x0003
 };
 
+#define WAV_BLOCK_FRAMES 4096 // sample frames read and converted per block when importing .WAVs
+#define WAV_BLOCK_SLACK 16 // the SSSE3 24-bit converter loads 16 bytes for every 12 used
+
 static int8_t loadWAVSample(UNICHAR *fileName, char *entryName, int8_t forceDownSampling);
 static int8_t loadIFFSample(UNICHAR *fileName, char *entryName);
 static int8_t loadRAWSample(UNICHAR *fileName, char *entryName);
@@ -39,25 +45,324 @@ void extLoadWAVSampleCallback(int8_t downsample)
     loadWAVSample(editor.fileNameTmp, editor.entryNameTmp, downsample);
 }
 
+/*
+** .WAV block conversion kernels. Sample points are converted to float without
+** any scaling (8-bit = -128..127, 16-bit = -32768..32767, 24-bit and 32-bit
+** integer = -2^31..2^31-1, float = as stored), the normalization gain takes
+** care of the rest.
+*/
+
+static void convertPCM8ToFloat(const uint8_t *src, float *dst, uint32_t numSamples)
+{
+    uint32_t i;
+
+    i = 0;
+
+#ifdef PT_USE_SSE2
+    {
+        const __m128i signFlip = _mm_set1_epi8((int8_t)(0x80));
+        __m128i x, lo, hi;
+
+        for (; (i + 16) <= numSamples; i += 16)
+        {
+            x  = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(&src[i])), signFlip);
+            lo = _mm_srai_epi16(_mm_unpacklo_epi8(x, x), 8);
+            hi = _mm_srai_epi16(_mm_unpackhi_epi8(x, x), 8);
+
+            _mm_storeu_ps(&dst[i +  0], _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(lo, lo), 16)));
+            _mm_storeu_ps(&dst[i +  4], _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(lo, lo), 16)));
+            _mm_storeu_ps(&dst[i +  8], _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(hi, hi), 16)));
+            _mm_storeu_ps(&dst[i + 12], _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(hi, hi), 16)));
+        }
+    }
+#endif
+
+    for (; i < numSamples; ++i)
+        dst[i] = (float)(src[i] - 128);
+}
+
+static void convertPCM16ToFloat(const uint8_t *src, float *dst, uint32_t numSamples)
+{
+    uint32_t i;
+
+    i = 0;
+
+#ifdef PT_USE_SSE2
+    {
+        __m128i x;
+
+        for (; (i + 8) <= numSamples; i += 8)
+        {
+            x = _mm_loadu_si128((const __m128i *)(&src[i * 2]));
+
+            _mm_storeu_ps(&dst[i + 0], _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16)));
+            _mm_storeu_ps(&dst[i + 4], _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16)));
+        }
+    }
+#endif
+
+    for (; i < numSamples; ++i)
+        dst[i] = (float)((int16_t)(src[(i * 2) + 0] | (src[(i * 2) + 1] << 8)));
+}
+
+static void convertPCM24ToFloat(const uint8_t *src, float *dst, uint32_t numSamples)
+{
+    uint32_t i;
+
+    i = 0;
+
+#ifdef PT_USE_SSSE3
+    {
+        // put the three bytes of each point in the upper 24 bits of a 32-bit lane
+        const __m128i unpack24 = _mm_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+
+        for (; (i + 4) <= numSamples; i += 4)
+            _mm_storeu_ps(&dst[i], _mm_cvtepi32_ps(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(&src[i * 3])), unpack24)));
+    }
+#endif
+
+    for (; i < numSamples; ++i)
+    {
+        dst[i] = (float)((int32_t)(((uint32_t)(src[(i * 3) + 0]) <<  8) |
+                                   ((uint32_t)(src[(i * 3) + 1]) << 16) |
+                                   ((uint32_t)(src[(i * 3) + 2]) << 24)));
+    }
+}
+
+static void convertPCM32ToFloat(const uint8_t *src, float *dst, uint32_t numSamples)
+{
+    uint32_t i;
+
+    i = 0;
+
+#ifdef PT_USE_SSE2
+    for (; (i + 4) <= numSamples; i += 4)
+        _mm_storeu_ps(&dst[i], _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)(&src[i * 4]))));
+#endif
+
+    for (; i < numSamples; ++i)
+    {
+        dst[i] = (float)((int32_t)(((uint32_t)(src[(i * 4) + 0]) <<  0) |
+                                   ((uint32_t)(src[(i * 4) + 1]) <<  8) |
+                                   ((uint32_t)(src[(i * 4) + 2]) << 16) |
+                                   ((uint32_t)(src[(i * 4) + 3]) << 24)));
+    }
+}
+
+static void convertFloat32ToFloat(const uint8_t *src, float *dst, uint32_t numSamples)
+{
+    uint32_t i, smp32;
+
+    if (!bigEndian)
+    {
+        memcpy(dst, src, numSamples * sizeof (float));
+        return;
+    }
+
+    for (i = 0; i < numSamples; ++i)
+    {
+        memcpy(&smp32, &src[i * 4], 4);
+        smp32 = SWAP32(smp32);
+        memcpy(&dst[i], &smp32, 4);
+    }
+}
+
+// in place, frame i is written to where sample point i was
+static void downmixStereoToMono(float *data, uint32_t numFrames)
+{
+    uint32_t i;
+
+    i = 0;
+
+#ifdef PT_USE_SSE2
+    {
+        const __m128 half = _mm_set1_ps(0.5f);
+        __m128 a, b;
+
+        for (; (i + 4) <= numFrames; i += 4)
+        {
+            a = _mm_loadu_ps(&data[(i * 2) + 0]);
+            b = _mm_loadu_ps(&data[(i * 2) + 4]);
+
+            a = _mm_add_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+            _mm_storeu_ps(&data[i], _mm_mul_ps(a, half));
+        }
+    }
+#endif
+
+    for (; i < numFrames; ++i)
+        data[i] = (data[(i * 2) + 0] + data[(i * 2) + 1]) * 0.5f;
+}
+
+// reads numFrames frames from the current file position, and converts them to mono float
+static int8_t readWAVBlock(FILE *f, uint8_t *rawBuffer, float *floatBuffer, uint32_t numFrames,
+    uint16_t audioFormat, uint16_t numChannels, uint16_t bitsPerSample)
+{
+    uint32_t numSamples;
+
+    numSamples = numFrames * numChannels;
+    if (fread(rawBuffer, bitsPerSample / 8, numSamples, f) != numSamples)
+        return (false);
+
+    switch (bitsPerSample)
+    {
+        case 8:  convertPCM8ToFloat(rawBuffer,  floatBuffer, numSamples); break;
+        case 16: convertPCM16ToFloat(rawBuffer, floatBuffer, numSamples); break;
+        case 24: convertPCM24ToFloat(rawBuffer, floatBuffer, numSamples); break;
+
+        default:
+        {
+            if (audioFormat == WAV_FORMAT_IEEE_FLOAT)
+                convertFloat32ToFloat(rawBuffer, floatBuffer, numSamples);
+            else
+                convertPCM32ToFloat(rawBuffer, floatBuffer, numSamples);
+        }
+        break;
+    }
+
+    if (numChannels == 2)
+        downmixStereoToMono(floatBuffer, numFrames);
+
+    return (true);
+}
+
+typedef struct wavImport_t
+{
+    FILE *f;
+    uint8_t *rawBuffer, resample;
+    uint16_t audioFormat, numChannels, bitsPerSample;
+    uint32_t dataPtr, numFrames, blockFrames, maxLength;
+    float *floatBuffer, *outBuffer;
+    resampler_t resampler;
+} wavImport_t;
+
+static void freeWAVImport(wavImport_t *w)
+{
+    free(w->rawBuffer);
+    free(w->floatBuffer);
+    free(w->outBuffer);
+
+    resamplerFree(&w->resampler);
+}
+
+/*
+** Finds the peak of the (downmixed) data chunk for normalization, without
+** resampling. This also makes sure that all of the sample data can be read
+** before the sample slot is touched.
+*/
+static int8_t scanWAVPeak(wavImport_t *w, float *peak)
+{
+    uint32_t framePos, blockFrames;
+    float smp_f;
+
+    fseek(w->f, w->dataPtr, SEEK_SET);
+
+    *peak = 0.0f;
+    for (framePos = 0; framePos < w->numFrames; framePos += blockFrames)
+    {
+        blockFrames = MIN(w->numFrames - framePos, w->blockFrames);
+        if (!readWAVBlock(w->f, w->rawBuffer, w->floatBuffer, blockFrames, w->audioFormat, w->numChannels, w->bitsPerSample))
+            return (false);
+
+        smp_f = getFloatPeak(w->floatBuffer, blockFrames);
+        if (*peak < smp_f)
+            *peak = smp_f;
+    }
+
+    return (true);
+}
+
+/*
+** Runs the data chunk through the whole chain (convert, downmix, resample)
+** and writes the quantized output to dst. outLen = number of output points
+** (max. w->maxLength).
+*/
+static int8_t processWAVData(wavImport_t *w, int8_t *dst, float gain, uint32_t *outLen)
+{
+    uint8_t flushed;
+    uint32_t framePos, blockFrames, blockLen, outPos;
+    float *blockOut;
+
+    fseek(w->f, w->dataPtr, SEEK_SET);
+
+    if (w->resample)
+        resamplerReset(&w->resampler);
+
+    flushed  = false;
+    framePos = 0;
+    outPos   = 0;
+
+    while (outPos < w->maxLength)
+    {
+        if (framePos < w->numFrames)
+        {
+            blockFrames = MIN(w->numFrames - framePos, w->blockFrames);
+            if (!readWAVBlock(w->f, w->rawBuffer, w->floatBuffer, blockFrames, w->audioFormat, w->numChannels, w->bitsPerSample))
+            {
+                *outLen = outPos;
+                return (false);
+            }
+
+            framePos += blockFrames;
+
+            if (w->resample)
+            {
+                blockOut = w->outBuffer;
+                blockLen = resamplerProcess(&w->resampler, w->floatBuffer, blockFrames, blockOut);
+            }
+            else
+            {
+                blockOut = w->floatBuffer;
+                blockLen = blockFrames;
+            }
+        }
+        else if (w->resample && !flushed)
+        {
+            // end of data, get the resampler's tail out
+            blockOut = w->outBuffer;
+            blockLen = resamplerFlush(&w->resampler, blockOut);
+
+            flushed = true;
+        }
+        else
+        {
+            break;
+        }
+
+        blockLen = MIN(blockLen, w->maxLength - outPos);
+        quantizeFloatBlockTo8bit(blockOut, &dst[outPos], blockLen, gain);
+
+        outPos += blockLen;
+    }
+
+    *outLen = outPos;
+    return (true);
+}
+
 int8_t loadWAVSample(UNICHAR *fileName, char *entryName, int8_t forceDownSampling)
 {
     /*
     ** - Supports 8-bit, 16-bit, 24-bit, 32-bit, 32-bit float
     ** - Supports additional "INAM", "smpl" and "xtra" chunks
     ** - Stereo is downmixed to mono
-    ** - >8-bit is quantized to 8-bit
-    ** - pre-"2x downsampling" (if wanted by the user)
+    ** - >8-bit is normalized and quantized to 8-bit
+    ** - pre-"2x downsampling" (if wanted by the user), or resampling to the
+    **   rate of editor.wavImportPeriod (WAVIMPORTTARGET in protracker.ini)
+    ** - The data chunk is streamed in blocks of WAV_BLOCK_FRAMES frames (two
+    **   passes: a peak scan of the decoded frames, then conversion and
+    **   resampling straight to the sample slot)
     */
 
-    uint8_t *audioDataU8, wavSampleNameFound;
-    int16_t *audioDataS16, tempVol, smp16;
-    uint16_t audioFormat, numChannels, bitsPerSample;
-    int32_t *audioDataS32, smp32, smp32_l, smp32_r;
-    uint32_t *audioDataU32, i, nameLen, chunkID, chunkSize;
-    uint32_t sampleLength, sampleRate, filesize, loopFlags;
+    int8_t *smpPtr;
+    uint8_t wavSampleNameFound;
+    int16_t tempVol;
+    uint16_t audioFormat, numChannels, bitsPerSample, bytesPerFrame;
+    uint32_t i, nameLen, chunkID, chunkSize, sampleLength, sampleRate, filesize, loopFlags;
     uint32_t loopStart, loopEnd, dataPtr, dataLen, fmtPtr, endOfChunk, bytesRead;
     uint32_t fmtLen, inamPtr, inamLen, smplPtr, smplLen, xtraPtr, xtraLen;
-    float *audioDataFloat, smp_f;
+    float peak, gain;
+    double resampleStep;
+    wavImport_t w;
     FILE *f;
     moduleSample_t *s;
 
@@ -254,389 +559,123 @@ int8_t loadWAVSample(UNICHAR *fileName, char *entryName, int8_t forceDownSamplin
         return (false);
     }
 
-    if (sampleRate > 22050)
+    if (editor.wavImportPeriod > 0)
     {
-        if (forceDownSampling == -1)
-        {
-            editor.ui.askScreenShown = true;
-            editor.ui.askScreenType  = ASK_DOWNSAMPLING;
-
-            pointerSetMode(POINTER_MODE_MSG1, NO_CARRY);
-            setStatusMessage("2X DOWNSAMPLING ?", NO_CARRY);
-            renderAskDialog();
-
-            fclose(f);
-
-            return (true);
-        }
+        // resample to the rate of the wanted period, so that the sample keeps its pitch on that note
+        resampleStep = sampleRate / ((double)(PAULA_PAL_CLK) / editor.wavImportPeriod);
     }
     else
     {
-        forceDownSampling = false;
-    }
-
-    // ---- READ SAMPLE DATA ----
-    fseek(f, dataPtr, SEEK_SET);
-
-    if (bitsPerSample == 8) // 8-BIT INTEGER SAMPLE
-    {
-        if (sampleLength > (MAX_SAMPLE_LEN * 4))
-            sampleLength =  MAX_SAMPLE_LEN * 4;
-
-        audioDataU8 = (uint8_t *)(malloc(sampleLength * sizeof (uint8_t)));
-        if (audioDataU8 == NULL)
-        {
-            fclose(f);
-            displayErrorMsg(editor.outOfMemoryText);
-            terminalPrintf("WAV sample loading failed: out of memory!\n");
-
-            return (false);
-        }
-
-        // read sample data
-        if (fread(audioDataU8, 1, sampleLength, f) != sampleLength)
+        if (sampleRate > 22050)
         {
-            fclose(f);
-            free(audioDataU8);
-            displayErrorMsg("I/O ERROR !");
-            terminalPrintf("WAV sample loading failed: I/O error!\n");
-
-            return (false);
-        }
-
-        // convert from stereo to mono (if needed)
-        if (numChannels == 2)
-        {
-            sampleLength /= 2;
-
-            // add right channel to left channel
-            for (i = 0; i < (sampleLength - 1); i++)
+            if (forceDownSampling == -1)
             {
-                smp16 = (audioDataU8[(i * 2) + 0] - 128) + (audioDataU8[(i * 2) + 1] - 128);
-                smp16 = 128 + SAR16(smp16, 1);
-
-                audioDataU8[i] = (uint8_t)(smp16);
-            }
-        }
-
-        // 2x downsampling - remove every other sample (if needed)
-        if (forceDownSampling)
-        {
-            sampleLength /= 2;
-            for (i = 1; i < sampleLength; i++)
-                audioDataU8[i] = audioDataU8[i * 2];
-        }
-
-        if (sampleLength > MAX_SAMPLE_LEN)
-            sampleLength = MAX_SAMPLE_LEN;
-
-        turnOffVoices();
-        for (i = 0; i < MAX_SAMPLE_LEN; ++i)
-        {
-            if (i <= (sampleLength & 0xFFFFFFFE))
-                modEntry->sampleData[(editor.currSample * MAX_SAMPLE_LEN) + i] = audioDataU8[i] - 128;
-            else
-                modEntry->sampleData[(editor.currSample * MAX_SAMPLE_LEN) + i] = 0;
-        }
-
-        free(audioDataU8);
-    }
-    else if (bitsPerSample == 16) // 16-BIT INTEGER SAMPLE
-    {
-        sampleLength /= 2;
-        if (sampleLength > (MAX_SAMPLE_LEN * 4))
-            sampleLength =  MAX_SAMPLE_LEN * 4;
-
-        audioDataS16 = (int16_t *)(malloc(sampleLength * sizeof (int16_t)));
-        if (audioDataS16 == NULL)
-        {
-            fclose(f);
-            displayErrorMsg(editor.outOfMemoryText);
-            terminalPrintf("WAV sample loading failed: out of memory!\n");
-
-            return (false);
-        }
+                editor.ui.askScreenShown = true;
+                editor.ui.askScreenType  = ASK_DOWNSAMPLING;
 
-        // read sample data
-        if (fread(audioDataS16, 2, sampleLength, f) != sampleLength)
-        {
-            fclose(f);
-            free(audioDataS16);
-            displayErrorMsg("I/O ERROR !");
-            terminalPrintf("WAV sample loading failed: I/O error!\n");
-
-            return (false);
-        }
-
-        // convert endianness (if needed)
-        if (bigEndian)
-        {
-            for (i = 0; i < sampleLength; ++i)
-                audioDataS16[i] = SWAP16(audioDataS16[i]);
-        }
-
-        // convert from stereo to mono (if needed)
-        if (numChannels == 2)
-        {
-            sampleLength /= 2;
+                pointerSetMode(POINTER_MODE_MSG1, NO_CARRY);
+                setStatusMessage("2X DOWNSAMPLING ?", NO_CARRY);
+                renderAskDialog();
 
-            // add right channel to left channel
-            for (i = 0; i < (sampleLength - 1); i++)
-            {
-                smp32 = audioDataS16[(i * 2) + 0] + audioDataS16[(i * 2) + 1];
-                smp32 = SAR32_1(smp32);
+                fclose(f);
 
-                audioDataS16[i] = (int16_t)(smp32);
+                return (true);
             }
         }
-
-        // 2x downsampling - remove every other sample (if needed)
-        if (forceDownSampling)
-        {
-            sampleLength /= 2;
-            for (i = 1; i < sampleLength; i++)
-                audioDataS16[i] = audioDataS16[i * 2];
-        }
-
-        if (sampleLength > MAX_SAMPLE_LEN)
-            sampleLength = MAX_SAMPLE_LEN;
-
-        normalize16bitSigned(audioDataS16, sampleLength);
-
-        turnOffVoices();
-        for (i = 0; i < MAX_SAMPLE_LEN; ++i)
+        else
         {
-            if (i <= (sampleLength & 0xFFFFFFFE))
-                modEntry->sampleData[(editor.currSample * MAX_SAMPLE_LEN) + i] = quantize16bitTo8bit(audioDataS16[i]);
-            else
-                modEntry->sampleData[(editor.currSample * MAX_SAMPLE_LEN) + i] = 0;
+            forceDownSampling = false;
         }
 
-        free(audioDataS16);
+        resampleStep = forceDownSampling ? 2.0 : 1.0;
     }
-    else if (bitsPerSample == 24) // 24-BIT INTEGER SAMPLE
-    {
-        sampleLength /= (4 - 1);
-        if (sampleLength > (MAX_SAMPLE_LEN * 4))
-            sampleLength =  MAX_SAMPLE_LEN * 4;
 
-        audioDataS32 = (int32_t *)(malloc(sampleLength * sizeof (int32_t)));
-        if (audioDataS32 == NULL)
-        {
-            fclose(f);
-            displayErrorMsg(editor.outOfMemoryText);
-            terminalPrintf("WAV sample loading failed: out of memory!\n");
+    // ---- READ SAMPLE DATA ----
+    memset(&w, 0, sizeof (w));
 
-            return (false);
-        }
+    w.f             = f;
+    w.audioFormat   = audioFormat;
+    w.numChannels   = numChannels;
+    w.bitsPerSample = bitsPerSample;
+    w.dataPtr       = dataPtr;
+    w.resample      = (fabs(resampleStep - 1.0) > 1e-6);
 
-        // read sample data
-        audioDataU8 = (uint8_t *)(audioDataS32);
-        for (i = 0; i < sampleLength; i++)
-        {
-            audioDataU8[0] = 0;
-            fread(&audioDataU8[1], 3, 1, f);
-            audioDataU8 += sizeof (int32_t);
-        }
+    bytesPerFrame = (bitsPerSample / 8) * numChannels;
 
-        // convert endianness (if needed)
-        if (bigEndian)
-        {
-            for (i = 0; i < sampleLength; ++i)
-                audioDataS32[i] = SWAP32(audioDataS32[i]);
-        }
+    w.numFrames = dataLen / bytesPerFrame;
+    if (w.numFrames > ((filesize - dataPtr) / bytesPerFrame))
+        w.numFrames =  (filesize - dataPtr) / bytesPerFrame; // truncated file, use what's there
 
-        // convert from stereo to mono (if needed)
-        if (numChannels == 2)
-        {
-            sampleLength /= 2;
+    w.maxLength = (uint32_t)(w.numFrames / resampleStep);
+    if (w.maxLength > MAX_SAMPLE_LEN)
+        w.maxLength = MAX_SAMPLE_LEN;
 
-            // add right channel to left channel
-            for (i = 0; i < (sampleLength - 1); i++)
-            {
-                smp32_l = audioDataS32[(i * 2) + 0];
-                smp32_r = audioDataS32[(i * 2) + 1];
+    // keep the output blocks small when upsampling
+    w.blockFrames = WAV_BLOCK_FRAMES;
+    if (resampleStep < 1.0)
+        w.blockFrames = MAX(1, (uint32_t)(WAV_BLOCK_FRAMES * resampleStep));
 
-                smp32_l = SAR32_1(smp32_l);
-                smp32_r = SAR32_1(smp32_r);
+    w.rawBuffer   = (uint8_t *)(malloc((w.blockFrames * bytesPerFrame) + WAV_BLOCK_SLACK));
+    w.floatBuffer = (float *)(malloc(w.blockFrames * 2 * sizeof (float)));
 
-                audioDataS32[i] = smp32_l + smp32_r;
-            }
-        }
-
-        // 2x downsampling - remove every other sample (if needed)
-        if (forceDownSampling)
-        {
-            sampleLength /= 2;
-            for (i = 1; i < sampleLength; i++)
-                audioDataS32[i] = audioDataS32[i * 2];
-        }
-
-        if (sampleLength > MAX_SAMPLE_LEN)
-            sampleLength = MAX_SAMPLE_LEN;
-
-        normalize24bitSigned(audioDataS32, sampleLength);
-
-        turnOffVoices();
-        for (i = 0; i < MAX_SAMPLE_LEN; ++i)
-        {
-            if (i <= (sampleLength & 0xFFFFFFFE))
-                modEntry->sampleData[(editor.currSample * MAX_SAMPLE_LEN) + i] = quantize24bitTo8bit(audioDataS32[i]);
-            else
-                modEntry->sampleData[(editor.currSample * MAX_SAMPLE_LEN) + i] = 0;
-        }
+    if ((w.rawBuffer == NULL) || (w.floatBuffer == NULL) ||
+        (w.resample && !resamplerInit(&w.resampler, resampleStep, w.blockFrames)))
+    {
+        fclose(f);
+        freeWAVImport(&w);
+        displayErrorMsg(editor.outOfMemoryText);
+        terminalPrintf("WAV sample loading failed: out of memory!\n");
 
-        free(audioDataS32);
+        return (false);
     }
-    else if ((audioFormat == WAV_FORMAT_PCM) && (bitsPerSample == 32)) // 32-BIT INTEGER SAMPLE
+
+    // only read the frames we can actually fit in the sample slot (plus the resampler's lookahead)
+    if (w.resample)
     {
-        sampleLength /= 4;
-        if (sampleLength > (MAX_SAMPLE_LEN * 4))
-            sampleLength =  MAX_SAMPLE_LEN * 4;
+        w.numFrames = MIN(w.numFrames, (uint32_t)(ceil(w.maxLength * resampleStep)) + w.resampler.numTaps);
 
-        audioDataS32 = (int32_t *)(malloc(sampleLength * sizeof (int32_t)));
-        if (audioDataS32 == NULL)
+        w.outBuffer = (float *)(malloc(resamplerMaxOutput(&w.resampler, w.blockFrames) * sizeof (float)));
+        if (w.outBuffer == NULL)
         {
             fclose(f);
+            freeWAVImport(&w);
             displayErrorMsg(editor.outOfMemoryText);
             terminalPrintf("WAV sample loading failed: out of memory!\n");
 
             return (false);
         }
-
-        // read sample data
-        if (fread(audioDataS32, 4, sampleLength, f) != sampleLength)
-        {
-            fclose(f);
-            free(audioDataS32);
-            displayErrorMsg("I/O ERROR !");
-            terminalPrintf("WAV sample loading failed: I/O error!\n");
-
-            return (false);
-        }
-
-        // convert endianness (if needed)
-        if (bigEndian)
-        {
-            for (i = 0; i < sampleLength; ++i)
-                audioDataS32[i] = SWAP32(audioDataS32[i]);
-        }
-
-        // convert from stereo to mono (if needed)
-        if (numChannels == 2)
-        {
-            sampleLength /= 2;
-
-            // add right channel to left channel
-            for (i = 0; i < (sampleLength - 1); i++)
-            {
-                smp32_l = audioDataS32[(i * 2) + 0];
-                smp32_r = audioDataS32[(i * 2) + 1];
-
-                smp32_l = SAR32_1(smp32_l);
-                smp32_r = SAR32_1(smp32_r);
-
-                audioDataS32[i] = smp32_l + smp32_r;
-            }
-        }
-
-        // 2x downsampling - remove every other sample (if needed)
-        if (forceDownSampling)
-        {
-            sampleLength /= 2;
-            for (i = 1; i < sampleLength; i++)
-                audioDataS32[i] = audioDataS32[i * 2];
-        }
-
-        if (sampleLength > MAX_SAMPLE_LEN)
-            sampleLength = MAX_SAMPLE_LEN;
-
-        normalize32bitSigned(audioDataS32, sampleLength);
-
-        turnOffVoices();
-        for (i = 0; i < MAX_SAMPLE_LEN; ++i)
-        {
-            if (i <= (sampleLength & 0xFFFFFFFE))
-                modEntry->sampleData[(editor.currSample * MAX_SAMPLE_LEN) + i] = quantize32bitTo8bit(audioDataS32[i]);
-            else
-                modEntry->sampleData[(editor.currSample * MAX_SAMPLE_LEN) + i] = 0;
-        }
-
-        free(audioDataS32);
     }
-    else if ((audioFormat == WAV_FORMAT_IEEE_FLOAT) && (bitsPerSample == 32)) // 32-BIT FLOAT SAMPLE
+    else
     {
-        sampleLength /= 4;
-        if (sampleLength > (MAX_SAMPLE_LEN * 4))
-            sampleLength =  MAX_SAMPLE_LEN * 4;
-
-        audioDataU32 = (uint32_t *)(malloc(sampleLength * sizeof (uint32_t)));
-        if (audioDataU32 == NULL)
-        {
-            fclose(f);
-            displayErrorMsg(editor.outOfMemoryText);
-            terminalPrintf("WAV sample loading failed: out of memory!\n");
-
-            return (false);
-        }
-
-        // read sample data
-        if (fread(audioDataU32, 4, sampleLength, f) != sampleLength)
-        {
-            fclose(f);
-            free(audioDataU32);
-            displayErrorMsg("I/O ERROR !");
-            terminalPrintf("WAV sample loading failed: I/O error!\n");
-
-            return (false);
-        }
-
-        // convert endianness (if needed)
-        if (bigEndian)
-        {
-            for (i = 0; i < sampleLength; ++i)
-                audioDataU32[i] = SWAP32(audioDataU32[i]);
-        }
-
-        audioDataFloat = (float *)(audioDataU32);
+        w.numFrames = w.maxLength;
+    }
 
-        // convert from stereo to mono (if needed)
-        if (numChannels == 2)
-        {
-            sampleLength /= 2;
+    // pass 1: find the peak for normalization (and make sure the data can be read)
+    if (!scanWAVPeak(&w, &peak))
+    {
+        fclose(f);
+        freeWAVImport(&w);
+        displayErrorMsg("I/O ERROR !");
+        terminalPrintf("WAV sample loading failed: I/O error!\n");
 
-            // add right channel to left channel (this is uncorrect, but Good Enough)
-            for (i = 0; i < (sampleLength - 1); i++)
-            {
-                smp_f = (audioDataFloat[(i * 2) + 0] / 2.0f) + (audioDataFloat[(i * 2) + 1] / 2.0f);
-                audioDataFloat[i] = CLAMP(smp_f, -1.0f, 1.0f);
-            }
-        }
+        return (false);
+    }
 
-        // 2x downsampling - remove every other sample (if needed)
-        if (forceDownSampling)
-        {
-            sampleLength /= 2;
-            for (i = 1; i < sampleLength; i++)
-                audioDataFloat[i] = audioDataFloat[i * 2];
-        }
+    // 8-bit samples are not normalized, >8-bit ones are normalized to full 8-bit range
+    if ((bitsPerSample == 8) || (peak <= 0.0f))
+        gain = 1.0f;
+    else
+        gain = 127.0f / peak;
 
-        if (sampleLength > MAX_SAMPLE_LEN)
-            sampleLength = MAX_SAMPLE_LEN;
+    // pass 2: convert (and resample) again, and write the quantized sample points straight to the sample slot
+    turnOffVoices();
 
-        normalize8bitFloatSigned(audioDataFloat, sampleLength);
+    smpPtr = &modEntry->sampleData[editor.currSample * MAX_SAMPLE_LEN];
 
-        turnOffVoices();
-        for (i = 0; i < MAX_SAMPLE_LEN; ++i)
-        {
-            if (i <= (sampleLength & 0xFFFFFFFE))
-                modEntry->sampleData[(editor.currSample * MAX_SAMPLE_LEN) + i] = quantizeFloatTo8bit(audioDataFloat[i]);
-            else
-                modEntry->sampleData[(editor.currSample * MAX_SAMPLE_LEN) + i] = 0;
-        }
+    processWAVData(&w, smpPtr, gain, &sampleLength); // can only fail if the file changed under our feet, keep what we got
+    memset(&smpPtr[sampleLength], 0, MAX_SAMPLE_LEN - sampleLength);
 
-        free(audioDataU32);
-    }
+    freeWAVImport(&w);
 
     // set sample length
     if (sampleLength & 1)
@@ -662,11 +701,11 @@ int8_t loadWAVSample(UNICHAR *fileName, char *entryName, int8_t forceDownSamplin
         fread(&loopEnd,   4, 1, f); if (bigEndian) loopEnd   = SWAP32(loopEnd);
         loopEnd++;
 
-        if (forceDownSampling)
+        if (w.resample)
         {
-            // we already downsampled 2x, so we're half the original length
-            loopStart /= 2;
-            loopEnd   /= 2;
+            // scale loop points to the new rate
+            loopStart = (uint32_t)(loopStart / resampleStep);
+            loopEnd   = (uint32_t)(loopEnd   / resampleStep);
         }
 
         loopStart &= 0xFFFFFFFE;
@@ -738,7 +777,7 @@ int8_t loadWAVSample(UNICHAR *fileName, char *entryName, int8_t forceDownSamplin
 
     fixSampleBeep(s);
     updateCurrSample();
-    fillSampleRedoBuffer(editor.currSample);
+    sampleUndoReset(editor.currSample);
 
     terminalPrintf("WAV sample \"%s\" loaded to slot %02x\n", s->text, editor.currSample + 1);
 
@@ -1015,7 +1054,7 @@ int8_t loadIFFSample(UNICHAR *fileName, char *entryName)
 
     fixSampleBeep(s);
     updateCurrSample();
-    fillSampleRedoBuffer(editor.currSample);
+    sampleUndoReset(editor.currSample);
 
     terminalPrintf("IFF sample \"%s\" loaded into sample slot %02x\n", s->text, editor.currSample + 1);
 
@@ -1075,7 +1114,7 @@ int8_t loadRAWSample(UNICHAR *fileName, char *entryName)
 
     fixSampleBeep(s);
     updateCurrSample();
-    fillSampleRedoBuffer(editor.currSample);
+    sampleUndoReset(editor.currSample);
 
     terminalPrintf("RAW sample \"%s\" loaded into sample slot %02x\n", s->text, editor.currSample + 1);
 
@@ -15,6 +15,10 @@
 #include "pt_mouse.h"
 #include "pt_terminal.h"
 #include "pt_scopes.h"
+#include "pt_resampler.h"
+#include "pt_sampler.h"
+#include "pt_sampleundo.h"
+#include "pt_sampledsp.h"
 
 // rounded constant to fit in float
 #define M_PI_F 3.1415927f
@@ -22,15 +26,254 @@
 #define SAMPLE_AREA_Y_CENTER 169
 #define SAMPLE_AREA_HEIGHT 64
 
+#define RESAMPLE_BLOCK_LEN 4096 // input points fed to the resampler per call
+
+/* Min/max pyramid for the zoomed out sample view. Level 0 summarizes blocks of
+** 32 sample points, every level above summarizes 4 entries of the level below.
+** Edits only mark a range as dirty, the affected entries are rebuilt the next
+** time the sample is rendered. */
+#define WAVEFORM_BLOCK_SHIFT 5
+#define WAVEFORM_BLOCK_LEN (1 << WAVEFORM_BLOCK_SHIFT)
+#define WAVEFORM_LEVEL_SHIFT 2
+#define WAVEFORM_LEVELS 5
+
 extern uint32_t *pixelBuffer; // pt_main.c
 
 typedef struct sampleMixer_t
 {
-    int32_t length, index;
-    float frac, delta;
+    int32_t length;
+    double delta;
 } sampleMixer_t;
 
-void setLoopSprites(void);
+typedef struct waveformPeak_t
+{
+    int8_t min, max;
+} waveformPeak_t;
+
+typedef struct waveform_t
+{
+    waveformPeak_t *levels[WAVEFORM_LEVELS];
+    int32_t dirtyStart, dirtyEnd; // sample points, dirtyEnd is exclusive
+} waveform_t;
+
+static waveformPeak_t *waveformData;
+static waveform_t waveforms[MOD_SAMPLES];
+static int32_t waveformLevelLen[WAVEFORM_LEVELS];
+static int8_t *waveformSampleData; // the sample data the pyramids were built from
+static int16_t lineClipX1 = 0, lineClipX2 = SCREEN_W - 1;
+static float *filterBuffer; // work buffer for the high-pass/low-pass filters
+
+void invalidateSampleWaveform(int8_t sample, int32_t from, int32_t to)
+{
+    waveform_t *w;
+
+    PT_ASSERT((sample >= 0) && (sample <= 30));
+    if ((sample < 0) || (sample > 30))
+        return;
+
+    from = CLAMP(from, 0, MAX_SAMPLE_LEN);
+    to   = CLAMP(to,   0, MAX_SAMPLE_LEN);
+
+    if (from >= to)
+        return;
+
+    w = &waveforms[sample];
+    if (w->dirtyStart >= w->dirtyEnd)
+    {
+        w->dirtyStart = from;
+        w->dirtyEnd   = to;
+    }
+    else
+    {
+        w->dirtyStart = MIN(w->dirtyStart, from);
+        w->dirtyEnd   = MAX(w->dirtyEnd,   to);
+    }
+}
+
+static void getRawPeak(const int8_t *smpPtr, int32_t numBytes, int8_t *min, int8_t *max)
+{
+    int8_t smp, smpMin, smpMax;
+    int32_t i;
+
+    smpMin = *min;
+    smpMax = *max;
+    i = 0;
+
+#ifdef PT_USE_SSE2
+    if (numBytes >= 16)
+    {
+        __m128i vSign, vMin, vMax, x;
+        uint8_t mins[16], maxs[16];
+
+        // offset binary, so that the unsigned SSE2 min/max can be used
+        vSign = _mm_set1_epi8(-128);
+        vMin  = _mm_set1_epi8(-1);
+        vMax  = _mm_setzero_si128();
+
+        for (; (i + 16) <= numBytes; i += 16)
+        {
+            x    = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(&smpPtr[i])), vSign);
+            vMin = _mm_min_epu8(vMin, x);
+            vMax = _mm_max_epu8(vMax, x);
+        }
+
+        vMin = _mm_min_epu8(vMin, _mm_srli_si128(vMin, 8));
+        vMin = _mm_min_epu8(vMin, _mm_srli_si128(vMin, 4));
+        vMin = _mm_min_epu8(vMin, _mm_srli_si128(vMin, 2));
+        vMin = _mm_min_epu8(vMin, _mm_srli_si128(vMin, 1));
+        vMax = _mm_max_epu8(vMax, _mm_srli_si128(vMax, 8));
+        vMax = _mm_max_epu8(vMax, _mm_srli_si128(vMax, 4));
+        vMax = _mm_max_epu8(vMax, _mm_srli_si128(vMax, 2));
+        vMax = _mm_max_epu8(vMax, _mm_srli_si128(vMax, 1));
+
+        _mm_storeu_si128((__m128i *)(mins), vMin);
+        _mm_storeu_si128((__m128i *)(maxs), vMax);
+
+        smp = (int8_t)(mins[0] ^ 0x80); if (smp < smpMin) smpMin = smp;
+        smp = (int8_t)(maxs[0] ^ 0x80); if (smp > smpMax) smpMax = smp;
+    }
+#endif
+
+    for (; i < numBytes; ++i)
+    {
+        smp = smpPtr[i];
+        if (smp < smpMin) smpMin = smp;
+        if (smp > smpMax) smpMax = smp;
+    }
+
+    *min = smpMin;
+    *max = smpMax;
+}
+
+static void rebuildWaveform(int8_t sample)
+{
+    int8_t *smpPtr, min, max;
+    int32_t i, j, start, end, len;
+    waveform_t *w;
+    waveformPeak_t *src, *dst;
+
+    w = &waveforms[sample];
+    if (w->dirtyStart >= w->dirtyEnd)
+        return;
+
+    smpPtr = &modEntry->sampleData[sample * MAX_SAMPLE_LEN];
+
+    // level 0 from the sample data
+    start = w->dirtyStart >> WAVEFORM_BLOCK_SHIFT;
+    end   = (w->dirtyEnd + (WAVEFORM_BLOCK_LEN - 1)) >> WAVEFORM_BLOCK_SHIFT;
+
+    dst = w->levels[0];
+    for (i = start; i < end; ++i)
+    {
+        len = MIN(WAVEFORM_BLOCK_LEN, MAX_SAMPLE_LEN - (i << WAVEFORM_BLOCK_SHIFT));
+
+        min =  127;
+        max = -128;
+        getRawPeak(&smpPtr[i << WAVEFORM_BLOCK_SHIFT], len, &min, &max);
+
+        dst[i].min = min;
+        dst[i].max = max;
+    }
+
+    // the levels above from the entries below
+    for (j = 1; j < WAVEFORM_LEVELS; ++j)
+    {
+        start >>= WAVEFORM_LEVEL_SHIFT;
+        end = (end + ((1 << WAVEFORM_LEVEL_SHIFT) - 1)) >> WAVEFORM_LEVEL_SHIFT;
+
+        src = w->levels[j - 1];
+        dst = w->levels[j];
+
+        for (i = start; i < end; ++i)
+        {
+            min =  127;
+            max = -128;
+
+            for (len = i << WAVEFORM_LEVEL_SHIFT; len < MIN((i + 1) << WAVEFORM_LEVEL_SHIFT, waveformLevelLen[j - 1]); ++len)
+            {
+                if (src[len].min < min) min = src[len].min;
+                if (src[len].max > max) max = src[len].max;
+            }
+
+            dst[i].min = min;
+            dst[i].max = max;
+        }
+    }
+
+    w->dirtyStart = 0;
+    w->dirtyEnd   = 0;
+}
+
+static void getWaveformPeak(int8_t sample, int32_t from, int32_t numBytes, int16_t *outMin, int16_t *outMax)
+{
+    int8_t *smpPtr, min, max;
+    int32_t i, lo, hi, to, alignedLo, alignedHi, level;
+    waveformPeak_t *entries;
+
+    smpPtr = &modEntry->sampleData[sample * MAX_SAMPLE_LEN];
+
+    min =  127;
+    max = -128;
+
+    from = CLAMP(from, 0, MAX_SAMPLE_LEN);
+    to   = CLAMP(from + numBytes, from, MAX_SAMPLE_LEN);
+
+    lo = (from + (WAVEFORM_BLOCK_LEN - 1)) >> WAVEFORM_BLOCK_SHIFT;
+    hi = to >> WAVEFORM_BLOCK_SHIFT;
+
+    if (lo >= hi)
+    {
+        // too short to cover a whole block
+        getRawPeak(&smpPtr[from], to - from, &min, &max);
+    }
+    else
+    {
+        // unaligned edges from the sample data...
+        getRawPeak(&smpPtr[from], (lo << WAVEFORM_BLOCK_SHIFT) - from, &min, &max);
+        getRawPeak(&smpPtr[hi << WAVEFORM_BLOCK_SHIFT], to - (hi << WAVEFORM_BLOCK_SHIFT), &min, &max);
+
+        // ...the rest from the highest levels that fit
+        for (level = 0; lo < hi; ++level)
+        {
+            entries = waveforms[sample].levels[level];
+
+            alignedLo = (lo + ((1 << WAVEFORM_LEVEL_SHIFT) - 1)) >> WAVEFORM_LEVEL_SHIFT;
+            alignedHi = hi >> WAVEFORM_LEVEL_SHIFT;
+
+            if ((level == (WAVEFORM_LEVELS - 1)) || (alignedLo >= alignedHi))
+            {
+                for (i = lo; i < hi; ++i)
+                {
+                    if (entries[i].min < min) min = entries[i].min;
+                    if (entries[i].max > max) max = entries[i].max;
+                }
+
+                break;
+            }
+
+            for (i = lo; i < (alignedLo << WAVEFORM_LEVEL_SHIFT); ++i)
+            {
+                if (entries[i].min < min) min = entries[i].min;
+                if (entries[i].max > max) max = entries[i].max;
+            }
+
+            for (i = alignedHi << WAVEFORM_LEVEL_SHIFT; i < hi; ++i)
+            {
+                if (entries[i].min < min) min = entries[i].min;
+                if (entries[i].max > max) max = entries[i].max;
+            }
+
+            lo = alignedLo;
+            hi = alignedHi;
+        }
+    }
+
+    if (min > max)
+        min = max = 0; // empty range
+
+    *outMin = SAMPLE_AREA_Y_CENTER - SAR8(min, 2);
+    *outMax = SAMPLE_AREA_Y_CENTER - SAR8(max, 2);
+}
 
 void fixSampleBeep(moduleSample_t *s)
 {
@@ -38,6 +281,8 @@ void fixSampleBeep(moduleSample_t *s)
     {
         modEntry->sampleData[s->offset + 0] = 0;
         modEntry->sampleData[s->offset + 1] = 0;
+
+        invalidateSampleWaveform((int8_t)(s - modEntry->samples), 0, 2);
     }
 }
 
@@ -59,18 +304,6 @@ void updateSamplePos(void)
     }
 }
 
-void fillSampleFilterUndoBuffer(void)
-{
-    moduleSample_t *s;
-
-    PT_ASSERT((editor.currSample >= 0) && (editor.currSample <= 30));
-    if ((editor.currSample >= 0) && (editor.currSample <= 30))
-    {
-        s = &modEntry->samples[editor.currSample];
-        memcpy(editor.tempSample, &modEntry->sampleData[s->offset], s->length);
-    }
-}
-
 static void line(uint32_t *frameBuffer, int16_t line_x1, int16_t line_x2, int16_t line_y1, int16_t line_y2)
 {
     int16_t d, x, y, ax, ay, sx, sy, dx, dy;
@@ -96,7 +329,8 @@ static void line(uint32_t *frameBuffer, int16_t line_x1, int16_t line_x2, int16_
             if ((y < 0) || (x < 0) || (y >= SCREEN_H) || (x >= SCREEN_W))
                 break;
 
-            frameBuffer[(y * SCREEN_W) + x] = palette[PAL_QADSCP];
+            if ((x >= lineClipX1) && (x <= lineClipX2))
+                frameBuffer[(y * SCREEN_W) + x] = palette[PAL_QADSCP];
 
             if (x == line_x2)
                 break;
@@ -120,7 +354,8 @@ static void line(uint32_t *frameBuffer, int16_t line_x1, int16_t line_x2, int16_
             if ((y < 0) || (x < 0) || (y >= SCREEN_H) || (x >= SCREEN_W))
                 break;
 
-            frameBuffer[(y * SCREEN_W) + x] = palette[PAL_QADSCP];
+            if ((x >= lineClipX1) && (x <= lineClipX2))
+                frameBuffer[(y * SCREEN_W) + x] = palette[PAL_QADSCP];
 
             if (y == line_y2)
                 break;
@@ -236,44 +471,27 @@ int32_t scr2SmpPos(int32_t x) // screen x pos -> sample pos
     return (scaledPos);
 }
 
-static void getSampleDataPeak(int8_t *smpPtr, int32_t numBytes, int16_t *outMin, int16_t *outMax)
+// draws the sample view columns x1..x2 (inclusive), the rest of the view is left untouched
+static void drawWaveformColumns(int16_t x1, int16_t x2)
 {
-    int8_t smp, min, max;
-    int32_t i;
-
-    min =  127;
-    max = -128;
-
-    // this compiles into *fast* SSE min/max instructions (at least with Visual Studio 2017)
-
-    for (i = 0; i < numBytes; ++i)
-    {
-        smp = smpPtr[i];
-        if (smp < min) min = smp;
-        if (smp > max) max = smp;
-    }
-
-    *outMin = SAMPLE_AREA_Y_CENTER - SAR8(min, 2);
-    *outMax = SAMPLE_AREA_Y_CENTER - SAR8(max, 2);
-}
-
-static void renderSampleData(void)
-{
-    int8_t *smpPtr;
+    int8_t i;
     int16_t y1, y2, y, x, min, max, oldMin, oldMax, numSmpsPerPixel;
     const uint32_t *ptr32Src;
     uint32_t *ptr32Dst;
-    moduleSample_t *s;
 
-    s = &modEntry->samples[editor.currSample];
+    x1 = CLAMP(x1, 0, SAMPLE_AREA_WIDTH - 1);
+    x2 = CLAMP(x2, 0, SAMPLE_AREA_WIDTH - 1);
+
+    if (x1 > x2)
+        return;
 
     // clear sample data
-    ptr32Src = samplerScreenBMP + (17 * 320);
-    ptr32Dst = pixelBuffer + (138 * SCREEN_W);
+    ptr32Src = samplerScreenBMP + ((17 * 320) + 3 + x1);
+    ptr32Dst = pixelBuffer + ((138 * SCREEN_W) + 3 + x1);
     y = SAMPLE_VIEW_HEIGHT;
     while (y--)
     {
-        memcpy(ptr32Dst, ptr32Src, 320 * sizeof (int32_t));
+        memcpy(ptr32Dst, ptr32Src, ((x2 + 1) - x1) * sizeof (int32_t));
 
         ptr32Src += 320;
         ptr32Dst += SCREEN_W;
@@ -281,19 +499,24 @@ static void renderSampleData(void)
 
     // display center line
     if (editor.ui.dottedCenterFlag)
-        memset(pixelBuffer + ((SAMPLE_AREA_Y_CENTER * SCREEN_W) + 3), 0x00373737, SAMPLE_AREA_WIDTH * sizeof (int32_t));
+        memset(pixelBuffer + ((SAMPLE_AREA_Y_CENTER * SCREEN_W) + 3 + x1), 0x00373737, ((x2 + 1) - x1) * sizeof (int32_t));
 
     // render sample data
     if ((editor.sampler.samDisplay >= 0) && (editor.sampler.samDisplay <= MAX_SAMPLE_LEN))
     {
-        y1 = SAMPLE_AREA_Y_CENTER - getScaledSample(scr2SmpPos(0));
+        // lines starting in the column left of the window may reach into it, keep them out of the rest of the view
+        lineClipX1 = 3 + x1;
+        lineClipX2 = 3 + x2;
 
         numSmpsPerPixel = editor.sampler.samDisplay / SAMPLE_AREA_WIDTH;
         if (numSmpsPerPixel <= 1)
         {
             // 1:1 or zoomed in
 
-            for (x = 1; x < SAMPLE_AREA_WIDTH; ++x)
+            x = MAX(x1, 1);
+            y1 = SAMPLE_AREA_Y_CENTER - getScaledSample(scr2SmpPos(x - 1));
+
+            for (; x <= MIN(x2 + 1, SAMPLE_AREA_WIDTH - 1); ++x)
             {
                 y2 = SAMPLE_AREA_Y_CENTER - getScaledSample(scr2SmpPos(x));
                 line(pixelBuffer, 3 + (x - 1), 3 + x, y1, y2);
@@ -304,13 +527,22 @@ static void renderSampleData(void)
         {
             // zoomed out
 
-            oldMin = y1;
-            oldMax = y1;
+            if (modEntry->sampleData != waveformSampleData)
+            {
+                // new module, nothing in the pyramids is valid
+                for (i = 0; i < MOD_SAMPLES; ++i)
+                    invalidateSampleWaveform(i, 0, MAX_SAMPLE_LEN);
+
+                waveformSampleData = modEntry->sampleData;
+            }
+
+            rebuildWaveform(editor.currSample);
 
-            smpPtr = &modEntry->sampleData[s->offset];
-            for (x = 0; x < SAMPLE_AREA_WIDTH; x++)
+            oldMin = oldMax = SAMPLE_AREA_Y_CENTER - getScaledSample(scr2SmpPos(0));
+
+            for (x = MAX(x1 - 1, 0); x <= x2; ++x)
             {
-                getSampleDataPeak(&smpPtr[scr2SmpPos(x)], numSmpsPerPixel, &min, &max);
+                getWaveformPeak(editor.currSample, scr2SmpPos(x), numSmpsPerPixel, &min, &max);
 
                 if (x > 0)
                 {
@@ -324,8 +556,33 @@ static void renderSampleData(void)
                 oldMax = max;
             }
         }
+
+        lineClipX1 = 0;
+        lineClipX2 = SCREEN_W - 1;
+    }
+}
+
+static void renderSampleData(void)
+{
+    const uint32_t *ptr32Src;
+    uint32_t *ptr32Dst;
+    int16_t y;
+
+    // clear the view's borders, drawWaveformColumns() takes care of the rest
+    ptr32Src = samplerScreenBMP + (17 * 320);
+    ptr32Dst = pixelBuffer + (138 * SCREEN_W);
+    y = SAMPLE_VIEW_HEIGHT;
+    while (y--)
+    {
+        memcpy(ptr32Dst, ptr32Src, 3 * sizeof (int32_t));
+        memcpy(ptr32Dst + (3 + SAMPLE_AREA_WIDTH), ptr32Src + (3 + SAMPLE_AREA_WIDTH), (320 - (3 + SAMPLE_AREA_WIDTH)) * sizeof (int32_t));
+
+        ptr32Src += 320;
+        ptr32Dst += SCREEN_W;
     }
 
+    drawWaveformColumns(0, SAMPLE_AREA_WIDTH - 1);
+
     // render "sample display" text
     if (editor.sampler.samStart == editor.sampler.blankSample)
         printSixDecimalsBg(pixelBuffer, 264, 214, 0, palette[PAL_GENTXT], palette[PAL_GENBKG]);
@@ -336,7 +593,8 @@ static void renderSampleData(void)
     setLoopSprites();
 }
 
-void invertRange(void)
+// inverts the part of the mark range that lies within the view columns x1..x2
+static void invertRangeColumns(int16_t x1, int16_t x2)
 {
     uint8_t y;
     int16_t x;
@@ -355,6 +613,12 @@ void invertRange(void)
     start = CLAMP(start, 0, SAMPLE_AREA_WIDTH - 1);
     end   = CLAMP(end,   0, SAMPLE_AREA_WIDTH - 1);
 
+    if ((start > x2) || (MAX(end, start) < x1))
+        return;
+
+    start = MAX(start, x1);
+    end   = MIN(end,   x2);
+
     rangeLen = (end + 1) - start;
     if (rangeLen < 1)
         rangeLen = 1;
@@ -384,6 +648,26 @@ void invertRange(void)
     }
 }
 
+void invertRange(void)
+{
+    invertRangeColumns(0, SAMPLE_AREA_WIDTH - 1);
+}
+
+static void displaySampleColumns(int16_t x1, int16_t x2)
+{
+    if (editor.ui.samplerScreenShown)
+    {
+        x1 = CLAMP(x1, 0, SAMPLE_AREA_WIDTH - 1);
+        x2 = CLAMP(x2, 0, SAMPLE_AREA_WIDTH - 1);
+
+        drawWaveformColumns(x1, x2);
+        if (editor.markEndOfs > 0)
+            invertRangeColumns(x1, x2);
+
+        editor.ui.update9xxPos = true;
+    }
+}
+
 void displaySample(void)
 {
     if (editor.ui.samplerScreenShown)
@@ -400,6 +684,10 @@ void redrawSample(void)
 {
     moduleSample_t *s;
 
+    // called when the sample may have changed as a whole (new sample, loading, undo etc.)
+    if ((editor.currSample >= 0) && (editor.currSample <= 30))
+        invalidateSampleWaveform(editor.currSample, 0, MAX_SAMPLE_LEN);
+
     if (editor.ui.samplerScreenShown)
     {
         PT_ASSERT((editor.currSample >= 0) && (editor.currSample <= 30));
@@ -438,12 +726,13 @@ void redrawSample(void)
     }
 }
 
-void highPassSample(int32_t cutOff)
+// forwards+backwards lossy integrator over the marked range (or the whole sample)
+static void lossyFilterSample(int32_t cutOff, int32_t *cutOffVar, int8_t highPass)
 {
-    int32_t i, from, to;
-    float *sampleData, baseFreq_f, cutOff_f, in[2], out[2];
+    int8_t *smpDat;
+    int32_t from, to;
+    float baseFreq_f, cutOff_f, coeff[2], peak, gain;
     moduleSample_t *s;
-    lossyIntegrator_t filterHi;
 
     PT_ASSERT((editor.currSample >= 0) && (editor.currSample <= 30));
     if ((editor.currSample < 0) || (editor.currSample > 30))
@@ -462,6 +751,8 @@ void highPassSample(int32_t cutOff)
         return;
     }
 
+    smpDat = &modEntry->sampleData[s->offset];
+
     from = 0;
     to   = s->length;
 
@@ -474,16 +765,7 @@ void highPassSample(int32_t cutOff)
     if (to > s->length)
         to = s->length;
 
-    sampleData = (float *)(malloc(s->length * sizeof (float)));
-    if (sampleData == NULL)
-    {
-        displayErrorMsg(editor.outOfMemoryText);
-        terminalPrintf("Sample filtering failed: out of memory!\n");
-
-        return;
-    }
-
-    fillSampleFilterUndoBuffer();
+    sampleUndoSave(editor.currSample, from, to);
 
     // setup filter coefficients
 
@@ -493,238 +775,164 @@ void highPassSample(int32_t cutOff)
     if (cutOff_f >= (baseFreq_f / 2.0f))
     {
         cutOff_f = baseFreq_f / 2.0f;
-        editor.hpCutOff = (int32_t)(cutOff_f);
+        *cutOffVar = (int32_t)(cutOff_f);
     }
 
-    filterHi.coeff[0] = tanf(M_PI_F * cutOff_f / baseFreq_f);
-    filterHi.coeff[1] = 1.0f / (1.0f + filterHi.coeff[0]);
+    coeff[0] = tanf(M_PI_F * cutOff_f / baseFreq_f);
+    coeff[1] = 1.0f / (1.0f + coeff[0]);
 
-    // copy over sample data to float buffer
-    for (i = 0; i < s->length; ++i)
-        sampleData[i] = modEntry->sampleData[s->offset + i];
+    // the whole sample is converted, normalization takes the peak of all of it
+    sample8ToFloat(smpDat, filterBuffer, s->length);
 
-    // filter forwards
-    filterHi.buffer[0] = 0.0f;
-    if (to <= s->length)
+    if (from < to)
     {
-        for (i = from; i < to; ++i)
-        {
-            in[0] = sampleData[i];
-            lossyIntegratorHighPass(&filterHi, in, out);
-            sampleData[i] = out[0];
-        }
+        lossyIntegratorBlock(&filterBuffer[from], to - from, coeff[0], coeff[1], highPass, false);
+        lossyIntegratorBlock(&filterBuffer[from], to - from, coeff[0], coeff[1], highPass, true);
     }
 
-    // filter backwards
-    filterHi.buffer[0] = 0.0f;
-    if (to <= s->length)
+    gain = 1.0f;
+    if (editor.normalizeFiltersFlag)
     {
-        for (i = (to - 1); i >= from; --i)
-        {
-            in[0] = sampleData[i];
-            lossyIntegratorHighPass(&filterHi, in, out);
-            sampleData[i] = out[0];
-        }
+        peak = getFloatPeak(filterBuffer, s->length);
+        if (peak > 0.0f)
+            gain = ((256.0f / 2.0f) - 1.0f) / peak;
     }
 
-    if (editor.normalizeFiltersFlag)
-        normalize8bitFloatSigned(sampleData, s->length);
-
-    for (i = from; i < to; ++i)
-        modEntry->sampleData[s->offset + i] = quantizeFloatTo8bit(sampleData[i]);
+    if (from < to)
+        quantizeFloatBlockTo8bit(&filterBuffer[from], &smpDat[from], to - from, gain);
 
-    free(sampleData);
+    invalidateSampleWaveform(editor.currSample, from, to);
 
     fixSampleBeep(s);
     displaySample();
     updateWindowTitle(MOD_IS_MODIFIED);
 }
 
-void lowPassSample(int32_t cutOff)
+void highPassSample(int32_t cutOff)
 {
-    int32_t i, from, to;
-    float *sampleData, baseFreq_f, cutOff_f, in[2], out[2];
-    moduleSample_t *s;
-    lossyIntegrator_t filterLo;
-
-    PT_ASSERT((editor.currSample >= 0) && (editor.currSample <= 30));
-    if ((editor.currSample < 0) || (editor.currSample > 30))
-        return;
-
-    if (cutOff == 0)
-    {
-        displayErrorMsg("CUTOFF CAN'T BE 0");
-        return;
-    }
+    lossyFilterSample(cutOff, &editor.hpCutOff, true);
+}
 
-    s = &modEntry->samples[editor.currSample];
-    if (s->length == 0)
-    {
-        displayErrorMsg("SAMPLE IS EMPTY");
-        return;
-    }
+void lowPassSample(int32_t cutOff)
+{
+    lossyFilterSample(cutOff, &editor.lpCutOff, false);
+}
 
-    from = 0;
-    to   = s->length;
+static void sampleDataRestored(void)
+{
+    editor.samplePos = 0;
+    updateCurrSample();
 
-    if ((editor.markEndOfs - editor.markStartOfs) > 0)
+    // this routine can be called while the sampler toolboxes are open, so redraw them
+    if (editor.ui.samplerScreenShown)
     {
-        from = editor.markStartOfs;
-        to   = editor.markEndOfs;
+             if (editor.ui.samplerVolBoxShown)     renderSamplerVolBox();
+        else if (editor.ui.samplerFiltersBoxShown) renderSamplerFiltersBox();
     }
+}
 
-    if (to > s->length)
-        to = s->length;
-
-    sampleData = (float *)(malloc(s->length * sizeof (float)));
-    if (sampleData == NULL)
-    {
-        displayErrorMsg(editor.outOfMemoryText);
-        terminalPrintf("Sample filtering failed: out of memory!\n");
+void undoSampleData(int8_t sample)
+{
+    int8_t numUndone;
 
+    PT_ASSERT((sample >= 0) && (sample <= 30));
+    if ((sample < 0) || (sample > 30))
         return;
-    }
-
-    fillSampleFilterUndoBuffer();
-
-    // setup filter coefficients
-
-    baseFreq_f = (float)(FILTERS_BASE_FREQ);
-
-    cutOff_f = (float)(cutOff);
-    if (cutOff_f >= (baseFreq_f / 2.0f))
-    {
-        cutOff_f = baseFreq_f / 2.0f;
-        editor.lpCutOff = (int32_t)(cutOff_f);
-    }
-
-    filterLo.coeff[0] = tanf(M_PI_F * cutOff_f / baseFreq_f);
-    filterLo.coeff[1] = 1.0f / (1.0f + filterLo.coeff[0]);
-
-    // copy over sample data to float buffer
-    for (i = 0; i < s->length; ++i)
-        sampleData[i] = modEntry->sampleData[s->offset + i];
-
-    // filter forwards
-    filterLo.buffer[0] = 0.0f;
-    if (to <= s->length)
-    {
-        for (i = from; i < to; ++i)
-        {
-            in[0] = sampleData[i];
-            lossyIntegrator(&filterLo, in, out);
-            sampleData[i] = out[0];
-        }
-    }
 
-    // filter backwards
-    filterLo.buffer[0] = 0.0f;
-    if (to <= s->length)
+    if (sampleUndoSteps(sample) == 0)
     {
-        for (i = (to - 1); i >= from; --i)
-        {
-            in[0] = sampleData[i];
-            lossyIntegrator(&filterLo, in, out);
-            sampleData[i] = out[0];
-        }
+        displayErrorMsg("NOTHING TO UNDO");
+        return;
     }
 
-    if (editor.normalizeFiltersFlag)
-        normalize8bitFloatSigned(sampleData, s->length);
-
-    for (i = from; i < to; ++i)
-        modEntry->sampleData[s->offset + i] = quantizeFloatTo8bit(sampleData[i]);
+    turnOffVoices();
+    numUndone = sampleUndo(sample, true);
 
-    free(sampleData);
+    displayMsg("UNDO DONE !");
+    if (numUndone > 1)
+        terminalPrintf("Sample %02x: undo of a batch operation, %d samples restored\n", sample + 1, numUndone);
+    else
+        terminalPrintf("Sample %02x: undo (%d step(s) left)\n", sample + 1, sampleUndoSteps(sample));
 
-    fixSampleBeep(s);
-    displaySample();
+    sampleDataRestored();
     updateWindowTitle(MOD_IS_MODIFIED);
 }
 
 void redoSampleData(int8_t sample)
 {
-    moduleSample_t *s;
-
     PT_ASSERT((sample >= 0) && (sample <= 30));
     if ((sample < 0) || (sample > 30))
         return;
 
-    s = &modEntry->samples[sample];
-
-    turnOffVoices();
+    // restoring means undoing every edit since the sample was loaded
+    if (!sampleUndoComplete(sample))
+    {
+        displayErrorMsg("CAN'T RESTORE !");
+        terminalPrintf("Sample %02x can't be restored: its oldest undo steps were dropped (memory limit)\n", sample + 1);
 
-    memset(&modEntry->sampleData[s->offset], 0, MAX_SAMPLE_LEN);
-    if ((editor.smpRedoBuffer[sample] != NULL) && (editor.smpRedoLengths[sample] > 0))
-        memcpy(&modEntry->sampleData[s->offset], editor.smpRedoBuffer[sample], editor.smpRedoLengths[sample]);
+        return;
+    }
 
-    s->fineTune   = editor.smpRedoFinetunes[sample];
-    s->volume     = editor.smpRedoVolumes[sample];
-    s->length     = editor.smpRedoLengths[sample];
-    s->loopStart  = editor.smpRedoLoopStarts[sample];
-    s->loopLength = (editor.smpRedoLoopLengths[sample] < 2) ? 2 : editor.smpRedoLoopLengths[sample];
+    turnOffVoices();
+    while (sampleUndo(sample, false));
 
     displayMsg("SAMPLE RESTORED !");
     terminalPrintf("Sample %02x was restored\n", sample + 1);
 
-    editor.samplePos = 0;
-    updateCurrSample();
-
-    // this routine can be called while the sampler toolboxes are open, so redraw them
-    if (editor.ui.samplerScreenShown)
-    {
-             if (editor.ui.samplerVolBoxShown)     renderSamplerVolBox();
-        else if (editor.ui.samplerFiltersBoxShown) renderSamplerFiltersBox();
-    }
+    sampleDataRestored();
 }
 
-void fillSampleRedoBuffer(int8_t sample)
+int8_t allocSamplerVars(void)
 {
-    moduleSample_t *s;
+    uint8_t i, j;
+    int32_t totalLen;
+    waveformPeak_t *ptr;
 
-    PT_ASSERT((sample >= 0) && (sample <= 30));
-    if ((sample < 0) || (sample > 30))
-        return;
+    editor.sampler.copyBuf = (int8_t *)(malloc(MAX_SAMPLE_LEN));
+    if (editor.sampler.copyBuf == NULL)
+        return (false);
 
-    s = &modEntry->samples[sample];
+    editor.sampler.blankSample = (int8_t *)(calloc(MAX_SAMPLE_LEN, 1));
+    if (editor.sampler.blankSample == NULL)
+        return (false);
 
-    if (editor.smpRedoBuffer[sample] != NULL)
+    totalLen = 0;
+    for (j = 0; j < WAVEFORM_LEVELS; ++j)
     {
-        free(editor.smpRedoBuffer[sample]);
-        editor.smpRedoBuffer[sample] = NULL;
-    }
-
-    editor.smpRedoFinetunes[sample]   = s->fineTune;
-    editor.smpRedoVolumes[sample]     = s->volume;
-    editor.smpRedoLengths[sample]     = s->length;
-    editor.smpRedoLoopStarts[sample]  = s->loopStart;
-    editor.smpRedoLoopLengths[sample] = s->loopLength;
+        if (j == 0)
+            waveformLevelLen[j] = (MAX_SAMPLE_LEN + (WAVEFORM_BLOCK_LEN - 1)) >> WAVEFORM_BLOCK_SHIFT;
+        else
+            waveformLevelLen[j] = (waveformLevelLen[j - 1] + ((1 << WAVEFORM_LEVEL_SHIFT) - 1)) >> WAVEFORM_LEVEL_SHIFT;
 
-    if (s->length > 0)
-    {
-        editor.smpRedoBuffer[sample] = (int8_t *)(malloc(s->length));
-        if (editor.smpRedoBuffer[sample] != NULL)
-            memcpy(editor.smpRedoBuffer[sample], &modEntry->sampleData[s->offset], s->length);
+        totalLen += waveformLevelLen[j];
     }
-}
 
-int8_t allocSamplerVars(void)
-{
-    editor.sampler.copyBuf = (int8_t *)(malloc(MAX_SAMPLE_LEN));
-    if (editor.sampler.copyBuf == NULL)
+    waveformData = (waveformPeak_t *)(malloc(MOD_SAMPLES * totalLen * sizeof (waveformPeak_t)));
+    if (waveformData == NULL)
         return (false);
 
-    editor.sampler.blankSample = (int8_t *)(calloc(MAX_SAMPLE_LEN, 1));
-    if (editor.sampler.blankSample == NULL)
+    filterBuffer = (float *)(malloc(MAX_SAMPLE_LEN * sizeof (float)));
+    if (filterBuffer == NULL)
         return (false);
 
+    ptr = waveformData;
+    for (i = 0; i < MOD_SAMPLES; ++i)
+    {
+        for (j = 0; j < WAVEFORM_LEVELS; ++j)
+        {
+            waveforms[i].levels[j] = ptr;
+            ptr += waveformLevelLen[j];
+        }
+
+        waveforms[i].dirtyStart = 0;
+        waveforms[i].dirtyEnd   = MAX_SAMPLE_LEN;
+    }
+
     return (true);
 }
 
 void deAllocSamplerVars(void)
 {
-    uint8_t i;
-
     if (editor.sampler.copyBuf != NULL)
     {
         free(editor.sampler.copyBuf);
@@ -737,20 +945,25 @@ void deAllocSamplerVars(void)
         editor.sampler.blankSample = NULL;
     }
 
-    for (i = 0; i < MOD_SAMPLES; ++i)
+    if (waveformData != NULL)
     {
-        if (editor.smpRedoBuffer[i] != NULL)
-        {
-            free(editor.smpRedoBuffer[i]);
-            editor.smpRedoBuffer[i] = NULL;
-        }
+        free(waveformData);
+        waveformData = NULL;
     }
+
+    if (filterBuffer != NULL)
+    {
+        free(filterBuffer);
+        filterBuffer = NULL;
+    }
+
+    sampleUndoFree();
 }
 
 void samplerRemoveDcOffset(void)
 {
     int8_t *smpDat;
-    int32_t i, from, to, offset;
+    int32_t from, to, offset;
     moduleSample_t *s;
 
     PT_ASSERT((editor.currSample >= 0) && (editor.currSample <= 30));
@@ -778,32 +991,84 @@ void samplerRemoveDcOffset(void)
     if (to > s->length)
         to = s->length;
 
-    // calculate offset value
-    offset = 0;
-    for (i = from; i < to; ++i)
-        offset += smpDat[i];
-
     if (to <= 0)
         return;
 
-    offset /= to;
+    // calculate offset value
+    offset = sample8Sum(&smpDat[from], MAX(to - from, 0)) / to;
+
+    sampleUndoSave(editor.currSample, from, to);
 
     // remove DC offset
-    for (i = from; i < to; ++i)
-        smpDat[i] = (int8_t)(CLAMP(smpDat[i] - offset, -128, 127));
+    if (from < to)
+        sample8SubtractSat(&smpDat[from], to - from, (int8_t)(offset));
+
+    invalidateSampleWaveform(editor.currSample, from, to);
 
     fixSampleBeep(s);
     displaySample();
     updateWindowTitle(MOD_IS_MODIFIED);
 }
 
+// resamples the sample (following its loop, if any) and adds it to mixerData
+static int8_t mixChordVoice(float *mixerData, int32_t mixLength, const int8_t *smpData, int32_t smpLength,
+    int32_t loopStart, int32_t loopEnd, int8_t loopFlag, double delta)
+{
+    int32_t i, readPos, readEnd, readLen, mixPos, numOut;
+    float *outBuffer;
+    resampler_t resampler;
+
+    if (!resamplerInit(&resampler, delta, RESAMPLE_BLOCK_LEN))
+        return (false);
+
+    outBuffer = (float *)(malloc(resamplerMaxOutput(&resampler, RESAMPLE_BLOCK_LEN) * sizeof (float)));
+    if (outBuffer == NULL)
+    {
+        resamplerFree(&resampler);
+        return (false);
+    }
+
+    readPos = 0;
+    readEnd = loopFlag ? loopEnd : smpLength;
+    mixPos  = 0;
+
+    while (mixPos < mixLength)
+    {
+        if (readPos < readEnd)
+        {
+            readLen = MIN(readEnd - readPos, RESAMPLE_BLOCK_LEN);
+            numOut  = resamplerProcess8bit(&resampler, &smpData[readPos], readLen, outBuffer);
+
+            readPos += readLen;
+            if (loopFlag && (readPos >= readEnd))
+                readPos = loopStart;
+        }
+        else
+        {
+            numOut = resamplerFlush(&resampler, outBuffer); // end of sample, get the tail out
+            mixLength = MIN(mixLength, mixPos + numOut); // and we're done mixing this voice
+        }
+
+        numOut = MIN(numOut, mixLength - mixPos);
+        for (i = 0; i < numOut; ++i)
+            mixerData[mixPos + i] += outBuffer[i] * (1.0f / 128.0f);
+
+        mixPos += numOut;
+    }
+
+    free(outBuffer);
+    resamplerFree(&resampler);
+
+    return (true);
+}
+
 void mixChordSample(void)
 {
     char smpText[22 + 1];
     int8_t *smpData, sameNotes, smpVolume, smpLoopFlag;
     uint8_t smpFinetune;
-    int32_t i, j, readFrac_trunc, mixPos2, smpLength, smpLoopStart, smpLoopEnd;
-    float *mixerData, smp1_f, smp2_f, smp_f;
+    int32_t i, smpLength, smpLoopStart, smpLoopEnd;
+    float *mixerData;
     sampleMixer_t mixCh[4];
     moduleSample_t *s;
 
@@ -908,6 +1173,8 @@ void mixChordSample(void)
 
         s = &modEntry->samples[i];
 
+        sampleUndoSave((int8_t)(i), 0, 0);
+
         s->fineTune = smpFinetune;
         s->volume = smpVolume;
 
@@ -919,6 +1186,8 @@ void mixChordSample(void)
     {
         // overwrite current sample
         s = &modEntry->samples[editor.currSample];
+
+        sampleUndoSave(editor.currSample, 0, s->length);
     }
 
     mixerData = (float *)(calloc(MAX_SAMPLE_LEN, sizeof (float)));
@@ -943,25 +1212,25 @@ void mixChordSample(void)
 
     if (editor.note1 < 36)
     {
-        mixCh[0].delta  = periodTable[editor.tuningNote] / (float)(periodTable[(37 * s->fineTune) + editor.note1]);
+        mixCh[0].delta  = periodTable[editor.tuningNote] / (double)(periodTable[(37 * s->fineTune) + editor.note1]);
         mixCh[0].length = (smpLength * periodTable[(37 * s->fineTune) + editor.note1]) / periodTable[editor.tuningNote];
     }
 
     if (editor.note2 < 36)
     {
-        mixCh[1].delta  = periodTable[editor.tuningNote] / (float)(periodTable[(37 * s->fineTune) + editor.note2]);
+        mixCh[1].delta  = periodTable[editor.tuningNote] / (double)(periodTable[(37 * s->fineTune) + editor.note2]);
         mixCh[1].length = (smpLength * periodTable[(37 * s->fineTune) + editor.note2]) / periodTable[editor.tuningNote];
     }
 
     if (editor.note3 < 36)
     {
-        mixCh[2].delta  = periodTable[editor.tuningNote] / (float)(periodTable[(37 * s->fineTune) + editor.note3]);
+        mixCh[2].delta  = periodTable[editor.tuningNote] / (double)(periodTable[(37 * s->fineTune) + editor.note3]);
         mixCh[2].length = (smpLength * periodTable[(37 * s->fineTune) + editor.note3]) / periodTable[editor.tuningNote];
     }
 
     if (editor.note4 < 36)
     {
-        mixCh[3].delta  = periodTable[editor.tuningNote] / (float)(periodTable[(37 * s->fineTune) + editor.note4]);
+        mixCh[3].delta  = periodTable[editor.tuningNote] / (double)(periodTable[(37 * s->fineTune) + editor.note4]);
         mixCh[3].length = (smpLength * periodTable[(37 * s->fineTune) + editor.note4]) / periodTable[editor.tuningNote];
     }
 
@@ -971,45 +1240,14 @@ void mixChordSample(void)
     {
         if (mixCh[i].length > 0) // mix active channels only
         {
-            for (j = 0; j < MAX_SAMPLE_LEN; ++j) // don't mix more than we can handle in a sample slot
+            if (!mixChordVoice(mixerData, s->length, smpData, smpLength, smpLoopStart, smpLoopEnd, smpLoopFlag, mixCh[i].delta))
             {
-                // lookup next (future) sample (for linear interpolation)
-                mixPos2 = mixCh[i].index + 1;
-                if (smpLoopFlag) // and wrap if needed
-                {
-                    if (mixPos2 >= smpLoopEnd)
-                        mixPos2  = smpLoopStart;
-                }
-                else
-                {
-                    if (mixPos2 >= smpLength)
-                        mixPos2  = 0;
-                }
-
-                smp1_f = smpData[mixCh[i].index] / 128.0f;
-                smp2_f = smpData[mixPos2       ] / 128.0f;
-                smp_f  = LERP(smp1_f, smp2_f, mixCh[i].frac);
+                free(mixerData);
 
-                mixerData[j] += smp_f;
+                displayErrorMsg(editor.outOfMemoryText);
+                terminalPrintf("Sample chord making failed: out of memory!\n");
 
-                mixCh[i].frac += mixCh[i].delta;
-                if (mixCh[i].frac >= 1.0f)
-                {
-                    readFrac_trunc = (int32_t)(mixCh[i].frac);
-
-                    mixCh[i].index += readFrac_trunc;
-                    mixCh[i].frac  -= readFrac_trunc;
-
-                    if (smpLoopFlag)
-                    {
-                        while (mixCh[i].index >= smpLoopEnd)
-                               mixCh[i].index  = smpLoopStart + (mixCh[i].index - smpLoopEnd);
-                    }
-                    else if (mixCh[i].index >= smpLength)
-                    {
-                        break; // we're done mixing this channel
-                    }
-                }
+                return;
             }
         }
     }
@@ -1033,41 +1271,33 @@ void mixChordSample(void)
     updateWindowTitle(MOD_IS_MODIFIED);
 }
 
-void samplerResample(void)
+// resamples from the tuning note to the resample note, doesn't touch the GUI or the waveform cache (also used from
+// batch worker threads), so the caller does fixSampleBeep() and the waveform invalidation on the GUI thread
+int8_t resampleSampleData(int8_t sample, int8_t saveUndo)
 {
     int8_t *oldSampleData, *newSampleData;
     int16_t refPeriod, newPeriod;
-    int32_t readFrac_trunc, readPhase, readLength, writePhase, writeLength;
-    float readDelta, readFrac, smp1_f, smp2_f, smd_f;
+    int8_t flushed;
+    int32_t readPhase, readLength, writePhase, writeLength, numOut;
+    float readDelta, *outBuffer;
+    resampler_t resampler;
     moduleSample_t *s;
 
-    PT_ASSERT((editor.currSample >= 0) && (editor.currSample <= 30));
-    if ((editor.currSample < 0) || (editor.currSample > 30))
-        return;
+    PT_ASSERT((sample >= 0) && (sample <= 30));
+    if ((sample < 0) || (sample > 30))
+        return (RESAMPLE_ERR_VARS);
 
-    s = &modEntry->samples[editor.currSample];
+    s = &modEntry->samples[sample];
     if (s->length == 0)
-    {
-        displayErrorMsg("SAMPLE IS EMPTY");
-        return;
-    }
+        return (RESAMPLE_ERR_EMPTY);
 
     if ((editor.tuningNote > 35) || (editor.resampleNote > 35) || (s->fineTune > 15))
-    {
-        displayErrorMsg("RESAMPLE ERROR!");
-        terminalPrintf("Sample resampling failed: overflown variables!\n");
-        return;
-    }
+        return (RESAMPLE_ERR_VARS);
 
     // allocate memory for our temp sample data
     oldSampleData = (int8_t *)(malloc(s->length));
     if (oldSampleData == NULL)
-    {
-        displayErrorMsg(editor.outOfMemoryText);
-        terminalPrintf("Sample resampling failed: out of memory!\n");
-
-        return;
-    }
+        return (RESAMPLE_ERR_MEMORY);
 
     // setup resampling variables
 
@@ -1084,57 +1314,69 @@ void samplerResample(void)
     if (writeLength <= 0)
     {
         free(oldSampleData);
-
-        displayErrorMsg("RESAMPLE ERROR !");
-        terminalPrintf("Sample resampling failed: new sample length == 0!\n");
-
-        return;
+        return (RESAMPLE_ERR_LENGTH);
     }
 
     readDelta = readLength / (float)(writeLength);
-    readFrac  = 0.0f;
 
     writeLength = writeLength & 0xFFFFFFFE;
     if (writeLength > MAX_SAMPLE_LEN)
         writeLength = MAX_SAMPLE_LEN;
 
-    // kill mixer voices and copy old sample data into temp buffer
-    turnOffVoices();
+    outBuffer = NULL;
+    if (resamplerInit(&resampler, readDelta, RESAMPLE_BLOCK_LEN))
+        outBuffer = (float *)(malloc(resamplerMaxOutput(&resampler, RESAMPLE_BLOCK_LEN) * sizeof (float)));
+
+    if (outBuffer == NULL)
+    {
+        free(oldSampleData);
+        resamplerFree(&resampler);
+
+        return (RESAMPLE_ERR_MEMORY);
+    }
+
+    // copy old sample data into temp buffer
     memcpy(oldSampleData, newSampleData, readLength);
 
+    if (saveUndo)
+        sampleUndoSave(sample, 0, readLength);
+
     // resample!
 
     readPhase  = 0;
     writePhase = 0;
+    flushed    = false;
 
-    while (writePhase < writeLength)
+    while ((writePhase < writeLength) && !flushed)
     {
-        smp1_f = oldSampleData[readPhase];
-        smp2_f = oldSampleData[(readPhase + 1) % readLength];
-
-        smd_f = LERP(smp1_f, smp2_f, readFrac);
-        smd_f = roundf(smd_f);
-        smd_f = CLAMP(smd_f, -128.0f, 127.0f);
-
-        newSampleData[writePhase++] = (int8_t)(smd_f);
-
-        readFrac += readDelta;
-        if (readFrac >= 1.0f)
+        if (readPhase < readLength)
         {
-            readFrac_trunc = (int32_t)(readFrac);
-
-            readPhase += readFrac_trunc;
-            readFrac  -= readFrac_trunc;
+            numOut = resamplerProcess8bit(&resampler, &oldSampleData[readPhase], MIN(readLength - readPhase, RESAMPLE_BLOCK_LEN), outBuffer);
+            readPhase += MIN(readLength - readPhase, RESAMPLE_BLOCK_LEN);
+        }
+        else
+        {
+            numOut  = resamplerFlush(&resampler, outBuffer); // end of sample, get the tail out
+            flushed = true;
         }
+
+        numOut = MIN(numOut, writeLength - writePhase);
+
+        quantizeFloatBlockTo8bit(outBuffer, &newSampleData[writePhase], numOut, 1.0f);
+        writePhase += numOut;
     }
 
+    free(outBuffer);
     free(oldSampleData);
+    resamplerFree(&resampler);
 
     // wipe non-used data in new sample
-    if (writeLength < MAX_SAMPLE_LEN)
-        memset(&newSampleData[writePhase], 0, MAX_SAMPLE_LEN - writeLength);
+    if (writePhase < MAX_SAMPLE_LEN)
+        memset(&newSampleData[writePhase], 0, MAX_SAMPLE_LEN - writePhase);
+
+    // update sample attributes (locked, so the replayer never sees them half-way updated)
+    lockAudio();
 
-    // update sample attributes
     s->length   = writeLength;
     s->fineTune = 0;
 
@@ -1154,7 +1396,55 @@ void samplerResample(void)
         }
     }
 
-    fixSampleBeep(s);
+    unlockAudio();
+
+    return (RESAMPLE_OK);
+}
+
+void samplerResample(void)
+{
+    PT_ASSERT((editor.currSample >= 0) && (editor.currSample <= 30));
+    if ((editor.currSample < 0) || (editor.currSample > 30))
+        return;
+
+    // kill mixer voices, the sample data is about to change
+    turnOffVoices();
+
+    switch (resampleSampleData(editor.currSample, true))
+    {
+        case RESAMPLE_ERR_EMPTY:
+        {
+            displayErrorMsg("SAMPLE IS EMPTY");
+            return;
+        }
+
+        case RESAMPLE_ERR_VARS:
+        {
+            displayErrorMsg("RESAMPLE ERROR!");
+            terminalPrintf("Sample resampling failed: overflown variables!\n");
+            return;
+        }
+
+        case RESAMPLE_ERR_LENGTH:
+        {
+            displayErrorMsg("RESAMPLE ERROR !");
+            terminalPrintf("Sample resampling failed: new sample length == 0!\n");
+            return;
+        }
+
+        case RESAMPLE_ERR_MEMORY:
+        {
+            displayErrorMsg(editor.outOfMemoryText);
+            terminalPrintf("Sample resampling failed: out of memory!\n");
+            return;
+        }
+
+        default: break;
+    }
+
+    fixSampleBeep(&modEntry->samples[editor.currSample]);
+    invalidateSampleWaveform(editor.currSample, 0, MAX_SAMPLE_LEN);
+
     updateCurrSample();
     updateWindowTitle(MOD_IS_MODIFIED);
 }
@@ -1163,9 +1453,7 @@ void doMix(void)
 {
     int8_t *fromPtr1, *fromPtr2, *mixPtr;
     uint8_t smpFrom1, smpFrom2, smpTo;
-    int16_t tmpSmp;
-    int32_t i, mixLength;
-    float smp_f;
+    int32_t mixLength, shortLength;
     moduleSample_t *s1, *s2, *s3;
 
     smpFrom1 = hexToInteger2(&editor.mixText[4]);
@@ -1203,40 +1491,22 @@ void doMix(void)
         mixLength = s2->length;
     }
 
-    mixPtr = (int8_t *)(calloc(mixLength, 1));
-    if (mixPtr == NULL)
-    {
-        displayErrorMsg(editor.outOfMemoryText);
-        terminalPrintf("Sample mixing failed: out of memory!\n");
-
-        return;
-    }
-
     turnOffVoices();
 
+    sampleUndoSave((int8_t)(smpTo), 0, s3->length);
+
     if (mixLength <= MAX_SAMPLE_LEN)
     {
-        for (i = 0; i < mixLength; ++i)
-        {
-            tmpSmp = (i < s2->length) ? (fromPtr1[i] + fromPtr2[i]) : fromPtr1[i];
+        // mixed straight into the destination, it can be one of the sources (same offset, so that's safe)
+        mixPtr = &modEntry->sampleData[s3->offset];
+        shortLength = MIN(s1->length, s2->length);
 
-            if (editor.halfClipFlag == 0)
-            {
-                smp_f = roundf(tmpSmp / 2.0f);
-                mixPtr[i] = (int8_t)(CLAMP(smp_f, -128.0f, 127.0f));
-            }
-            else
-            {
-                mixPtr[i] = (int8_t)(CLAMP(tmpSmp, -128, 127));
-            }
-        }
+        sample8Mix(mixPtr, fromPtr1, fromPtr2, shortLength, editor.halfClipFlag);
+        sample8Mix(&mixPtr[shortLength], &fromPtr1[shortLength], NULL, mixLength - shortLength, editor.halfClipFlag);
 
-        memset(&modEntry->sampleData[s3->offset],      0, MAX_SAMPLE_LEN);
-        memcpy(&modEntry->sampleData[s3->offset], mixPtr, mixLength);
+        memset(&mixPtr[mixLength], 0, MAX_SAMPLE_LEN - mixLength);
     }
 
-    free(mixPtr);
-
     s3->length     = mixLength;
     s3->volume     = 64;
     s3->fineTune   = 0;
@@ -1256,9 +1526,7 @@ void doMix(void)
 void boostSample(int8_t sample, int8_t ignoreMark)
 {
     int8_t *smpDat;
-    int16_t tmp16_1, tmp16_2, tmp16_3;
-    int32_t i, from, to;
-    float smp_f;
+    int32_t from, to;
     moduleSample_t *s;
 
     PT_ASSERT((sample >= 0) && (sample <= 30));
@@ -1286,21 +1554,12 @@ void boostSample(int8_t sample, int8_t ignoreMark)
         }
     }
 
-    tmp16_3 = 0;
-    for (i = from; i < to; ++i)
-    {
-        tmp16_1  = smpDat[i];
+    sampleUndoSave(sample, from, to);
 
-        tmp16_2  = tmp16_1;
-        tmp16_1 -= tmp16_3;
-        tmp16_3  = tmp16_2;
-
-        smp_f    = roundf(tmp16_1 / 4.0f);
-        tmp16_2 += (int16_t)(CLAMP(smp_f, -128.0f, 127.0f));
-
-        smpDat[i] = (int8_t)(CLAMP(tmp16_2, -128, 127));
-    }
+    if (from < to)
+        sample8TrebleBoost(&smpDat[from], to - from);
 
+    invalidateSampleWaveform(sample, from, to);
     fixSampleBeep(s);
 
     // don't redraw sample here, it is done elsewhere
@@ -1310,8 +1569,7 @@ void boostSample(int8_t sample, int8_t ignoreMark)
 void filterSample(int8_t sample, int8_t ignoreMark)
 {
     int8_t *smpDat;
-    int32_t i, from, to;
-    float smp_f;
+    int32_t from, to;
     moduleSample_t *s;
 
     PT_ASSERT((sample >= 0) && (sample <= 30));
@@ -1342,16 +1600,14 @@ void filterSample(int8_t sample, int8_t ignoreMark)
     if (to < 1)
         return;
 
-    to--;
-    for (i = from; i < to; ++i)
-    {
-        smp_f = (smpDat[i + 0] + smpDat[i + 1]) / 2.0f;
-        smp_f = roundf(smp_f);
-        smp_f = CLAMP(smp_f, -128.0f, 127.0f);
+    sampleUndoSave(sample, from, to);
 
-        smpDat[i] = (int8_t)(smp_f);
-    }
+    // average of each point and the next one, in place
+    to--;
+    if (from < to)
+        sample8Mix(&smpDat[from], &smpDat[from], &smpDat[from + 1], to - from, false);
 
+    invalidateSampleWaveform(sample, from, to);
     fixSampleBeep(s);
     // don't redraw sample here, it is done elsewhere
 }
@@ -1378,7 +1634,7 @@ void toggleTuningTone(void)
         paulaRestartDMA(editor.tuningChan);
 
         // force loop flag on for scopes
-        scope[editor.tuningChan].newLoopFlag = scope[editor.tuningChan].loopFlag = true;
+        paulaSetScopeLoop(editor.tuningChan, true, 0);
     }
     else
     {
@@ -1537,6 +1793,8 @@ void samplerSamDelete(uint8_t cut)
     // if whole sample is marked, nuke it
     if ((editor.markEndOfs - editor.markStartOfs) >= sampleLength)
     {
+        sampleUndoSave(editor.currSample, 0, sampleLength);
+
         memset(&modEntry->sampleData[s->offset], 0, MAX_SAMPLE_LEN);
 
         invertRange();
@@ -1592,12 +1850,17 @@ void samplerSamDelete(uint8_t cut)
     if ((sampleLength - markEnd) > 0)
         memcpy(&tmpBuf[editor.markStartOfs], &modEntry->sampleData[s->offset + markEnd], sampleLength - markEnd);
 
+    sampleUndoSave(editor.currSample, markStart, sampleLength);
+
     // nuke sample data and copy over the result
     memset(&modEntry->sampleData[s->offset],      0, MAX_SAMPLE_LEN);
     memcpy(&modEntry->sampleData[s->offset], tmpBuf, copyLength);
 
     free(tmpBuf);
 
+    // everything after the cut has moved
+    invalidateSampleWaveform(editor.currSample, markStart, MAX_SAMPLE_LEN);
+
     editor.sampler.samLength = copyLength;
     if ((editor.sampler.samOffset + editor.sampler.samDisplay) >= editor.sampler.samLength)
     {
@@ -1737,6 +2000,8 @@ void samplerSamPaste(void)
 
     turnOffVoices();
 
+    sampleUndoSave(editor.currSample, editor.markStartOfs, s->length);
+
     wasZooming = (editor.sampler.samDisplay != editor.sampler.samLength) ? true : false;
 
     // copy start part
@@ -1798,6 +2063,9 @@ void samplerSamPaste(void)
 
     free(tmpBuf);
 
+    // everything after the paste position has moved
+    invalidateSampleWaveform(editor.currSample, editor.markStartOfs, MAX_SAMPLE_LEN);
+
     invertRange();
     //invertRange(); WTF
     editor.markEndOfs = editor.markStartOfs + editor.sampler.copyBufSize;
@@ -1868,8 +2136,6 @@ void samplerPlayWaveform(void)
         // these take effect after the current DMA cycle is done
         paulaSetData(chn,   ch->n_loopstart);
         paulaSetLength(chn, ch->n_replen);
-
-        updateSpectrumAnalyzer(chn, ch->n_volume, ch->n_period);
     }
 }
 
@@ -1922,8 +2188,6 @@ void samplerPlayDisplay(void)
         // these take effect after the current DMA cycle is done
         paulaSetData(chn,   ch->n_loopstart);
         paulaSetLength(chn, ch->n_replen);
-
-        updateSpectrumAnalyzer(chn, ch->n_volume, ch->n_period);
     }
 }
 
@@ -1988,8 +2252,6 @@ void samplerPlayRange(void)
         // these take effect after the current DMA cycle is done
         paulaSetData(chn,   ch->n_loopstart);
         paulaSetLength(chn, ch->n_replen);
-
-        updateSpectrumAnalyzer(chn, ch->n_volume, ch->n_period);
     }
 }
 
@@ -2348,7 +2610,7 @@ void samplerEditSample(int8_t mouseButtonHeld)
     // EDIT SAMPLE ROUTINE (non-PT feature inspired by FT2)
 
     int8_t y;
-    int32_t mouseY, x, smp_x0, smp_x1, xDistance, smp_y0, smp_y1, yDistance, smp;
+    int32_t mouseY, x, smp_x0, smp_x1, xDistance, smp_y0, smp_y1, yDistance, smp, editStart, editEnd;
     moduleSample_t *s;
 
     PT_ASSERT((editor.currSample >= 0) && (editor.currSample <= 30));
@@ -2373,6 +2635,9 @@ void samplerEditSample(int8_t mouseButtonHeld)
                 editor.sampler.lastMouseX = input.mouse.x;
                 editor.sampler.lastMouseY = input.mouse.y;
 
+                // the whole stroke is one undo step
+                sampleUndoSave(editor.currSample, 0, s->length);
+
                 editor.ui.forceSampleEdit = true;
                 updateWindowTitle(MOD_IS_MODIFIED);
             }
@@ -2388,6 +2653,9 @@ void samplerEditSample(int8_t mouseButtonHeld)
 
     modEntry->sampleData[s->offset + x] = y;
 
+    editStart = x;
+    editEnd   = x;
+
     // interpolate x gaps
     if (input.mouse.x != editor.sampler.lastMouseX)
     {
@@ -2401,6 +2669,8 @@ void samplerEditSample(int8_t mouseButtonHeld)
             smp_x1 = x;
             smp_x0 = xToSmpX(editor.sampler.lastMouseX - 3, s->length);
 
+            editStart = MIN(editStart, smp_x0);
+
             xDistance = smp_x1 - smp_x0;
             if (xDistance > 0)
             {
@@ -2418,6 +2688,8 @@ void samplerEditSample(int8_t mouseButtonHeld)
             smp_x0 = x;
             smp_x1 = xToSmpX(editor.sampler.lastMouseX - 3, s->length);
 
+            editEnd = MAX(editEnd, smp_x1);
+
             xDistance = smp_x1 - smp_x0;
             if (xDistance > 0)
             {
@@ -2437,7 +2709,10 @@ void samplerEditSample(int8_t mouseButtonHeld)
             editor.sampler.lastMouseY = input.mouse.y;
     }
 
-    displaySample();
+    invalidateSampleWaveform(editor.currSample, editStart, editEnd + 1);
+
+    // only redraw the columns showing the edited points (and their neighbours, for the connecting lines)
+    displaySampleColumns(smpPos2Scr(editStart) - 1, smpPos2Scr(editEnd + 1) + 1);
 }
 
 void samplerSamplePressed(int8_t mouseButtonHeld)
@@ -2675,6 +2950,7 @@ void exitFromSam(void)
 {
     editor.ui.samplerScreenShown = false;
     memcpy(&pixelBuffer[121 * SCREEN_W], &trackerFrameBMP[121 * SCREEN_W], 320 * 134 * sizeof (int32_t));
+    invalidateTextRuns();
 
     updateCursorPos();
     setLoopSprites();
@@ -3,14 +3,25 @@
 
 #include <stdint.h>
 
+enum
+{
+    RESAMPLE_OK         = 0,
+    RESAMPLE_ERR_EMPTY  = 1,
+    RESAMPLE_ERR_VARS   = 2,
+    RESAMPLE_ERR_LENGTH = 3,
+    RESAMPLE_ERR_MEMORY = 4
+};
+
 int32_t smpPos2Scr(int32_t pos); // sample pos   -> screen x pos
 int32_t scr2SmpPos(int32_t x);   // screen x pos -> sample pos
 
 void fixSampleBeep(moduleSample_t *s);
+void invalidateSampleWaveform(int8_t sample, int32_t from, int32_t to); // mark sample points from..to-1 as changed
 void highPassSample(int32_t cutOff);
 void lowPassSample(int32_t cutOff);
 void samplerRemoveDcOffset(void);
 void mixChordSample(void);
+int8_t resampleSampleData(int8_t sample, int8_t saveUndo);
 void samplerResample(void);
 void doMix(void);
 void boostSample(int8_t sample, int8_t ignoreMark);
@@ -36,10 +47,9 @@ void samplerPlayRange(void);
 void samplerRangeAll(void);
 void samplerShowRange(void);
 void samplerShowAll(void);
+void undoSampleData(int8_t sample);
 void redoSampleData(int8_t sample);
-void fillSampleRedoBuffer(int8_t sample);
 void updateSamplePos(void);
-void fillSampleFilterUndoBuffer(void);
 void exitFromSam(void);
 void samplerScreen(void);
 void displaySample(void);
@@ -0,0 +1,261 @@
+/*
+** Undo journal for sample edits.
+**
+** Every step stores the sample's length, loop, volume and finetune from before
+** the edit, and a copy of only the sample points that the edit changes. The
+** steps of all samples share one list (oldest first) and one memory limit
+** (editor.sampleUndoMemLimit); when a new step doesn't fit, the oldest steps
+** are dropped.
+**
+** A step only holds the points from before its own edit, so undoing has to go
+** newest first and every change to the sample data must be journaled. Things
+** that replace a sample as a whole call sampleUndoReset() instead.
+**
+** Steps saved between sampleUndoBeginGroup() and sampleUndoEndGroup() (batch
+** operations on all samples) share a group number, and are undone together
+** for every sample where they are still the newest step.
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pt_header.h"
+#include "pt_helpers.h"
+#include "pt_terminal.h"
+#include "pt_sampler.h"
+#include "pt_sampleundo.h"
+
+typedef struct sampleUndoStep_t
+{
+    int8_t sample, volume, firstPoints[2]; // fixSampleBeep() may clear the first two points after any edit
+    uint8_t fineTune;
+    int32_t length, loopStart, loopLength, from, dataLength;
+    uint32_t group; // 0 = not part of a group
+    struct sampleUndoStep_t *prev, *next;
+    // followed by dataLength bytes of sample data
+} sampleUndoStep_t;
+
+static sampleUndoStep_t *oldestStep, *newestStep;
+static uint32_t memUsed, numSteps[MOD_SAMPLES];
+static int8_t stepsDropped[MOD_SAMPLES];
+static uint32_t currGroup, lastGroup;
+
+static uint32_t stepSize(const sampleUndoStep_t *step)
+{
+    return ((uint32_t)(sizeof (sampleUndoStep_t)) + step->dataLength);
+}
+
+static void removeStep(sampleUndoStep_t *step)
+{
+    if (step->prev != NULL) step->prev->next = step->next; else oldestStep = step->next;
+    if (step->next != NULL) step->next->prev = step->prev; else newestStep = step->prev;
+
+    memUsed -= stepSize(step);
+    numSteps[step->sample]--;
+
+    free(step);
+}
+
+static void dropOldestStep(void)
+{
+    PT_ASSERT(oldestStep != NULL);
+
+    stepsDropped[oldestStep->sample] = true;
+    removeStep(oldestStep);
+}
+
+void sampleUndoReset(int8_t sample)
+{
+    sampleUndoStep_t *step, *prev;
+
+    PT_ASSERT((sample >= 0) && (sample <= 30));
+    if ((sample < 0) || (sample > 30))
+        return;
+
+    step = newestStep;
+    while ((step != NULL) && (numSteps[sample] > 0))
+    {
+        prev = step->prev;
+        if (step->sample == sample)
+            removeStep(step);
+
+        step = prev;
+    }
+
+    stepsDropped[sample] = false;
+}
+
+void sampleUndoSave(int8_t sample, int32_t from, int32_t to)
+{
+    uint32_t size;
+    moduleSample_t *s;
+    sampleUndoStep_t *step;
+
+    PT_ASSERT((sample >= 0) && (sample <= 30));
+    if ((sample < 0) || (sample > 30) || (modEntry == NULL))
+        return;
+
+    from = CLAMP(from, 0, MAX_SAMPLE_LEN);
+    to   = CLAMP(to, from, MAX_SAMPLE_LEN);
+
+    size = (uint32_t)(sizeof (sampleUndoStep_t)) + (to - from);
+    if (size > editor.sampleUndoMemLimit)
+    {
+        // this step alone is over the limit, the older steps are useless without it
+        sampleUndoReset(sample);
+        stepsDropped[sample] = true;
+
+        return;
+    }
+
+    while ((memUsed + size) > editor.sampleUndoMemLimit)
+        dropOldestStep();
+
+    step = (sampleUndoStep_t *)(malloc(size));
+    if (step == NULL)
+    {
+        sampleUndoReset(sample);
+        stepsDropped[sample] = true;
+
+        terminalPrintf("Sample %02x undo history dropped: out of memory!\n", sample + 1);
+        return;
+    }
+
+    s = &modEntry->samples[sample];
+
+    step->sample     = sample;
+    step->volume     = s->volume;
+    step->fineTune   = s->fineTune;
+    step->length     = s->length;
+    step->loopStart  = s->loopStart;
+    step->loopLength = s->loopLength;
+    step->from       = from;
+    step->dataLength = to - from;
+    step->group      = currGroup;
+
+    memcpy(step->firstPoints, &modEntry->sampleData[s->offset], 2);
+    memcpy(step + 1, &modEntry->sampleData[s->offset + from], step->dataLength);
+
+    step->next = NULL;
+    step->prev = newestStep;
+
+    if (newestStep != NULL)
+        newestStep->next = step;
+    else
+        oldestStep = step;
+
+    newestStep = step;
+
+    memUsed += size;
+    numSteps[sample]++;
+}
+
+void sampleUndoBeginGroup(void)
+{
+    if (++lastGroup == 0)
+        lastGroup = 1;
+
+    currGroup = lastGroup;
+}
+
+void sampleUndoEndGroup(void)
+{
+    currGroup = 0;
+}
+
+static sampleUndoStep_t *getNewestStep(int8_t sample)
+{
+    sampleUndoStep_t *step;
+
+    if (numSteps[sample] == 0)
+        return (NULL);
+
+    step = newestStep;
+    while (step->sample != sample)
+        step = step->prev;
+
+    return (step);
+}
+
+static void undoStep(sampleUndoStep_t *step)
+{
+    int8_t *smpData;
+    moduleSample_t *s;
+
+    s = &modEntry->samples[step->sample];
+    smpData = &modEntry->sampleData[s->offset];
+
+    // clear what the edit added past the old end, then put the old sample points back
+    if (s->length > step->length)
+        memset(&smpData[step->length], 0, s->length - step->length);
+
+    memcpy(smpData, step->firstPoints, 2);
+    memcpy(&smpData[step->from], step + 1, step->dataLength);
+
+    s->volume     = step->volume;
+    s->fineTune   = step->fineTune;
+    s->length     = step->length;
+    s->loopStart  = step->loopStart;
+    s->loopLength = (step->loopLength < 2) ? 2 : step->loopLength;
+
+    invalidateSampleWaveform(step->sample, 0, MAX_SAMPLE_LEN);
+    removeStep(step);
+}
+
+int8_t sampleUndo(int8_t sample, int8_t wholeGroup)
+{
+    int8_t i, numUndone;
+    uint32_t group;
+    sampleUndoStep_t *step;
+
+    PT_ASSERT((sample >= 0) && (sample <= 30));
+    if ((sample < 0) || (sample > 30) || (numSteps[sample] == 0))
+        return (0);
+
+    step  = getNewestStep(sample);
+    group = step->group;
+
+    undoStep(step);
+    numUndone = 1;
+
+    if (wholeGroup && (group != 0))
+    {
+        for (i = 0; i < MOD_SAMPLES; ++i)
+        {
+            step = getNewestStep(i);
+            if ((step != NULL) && (step->group == group))
+            {
+                undoStep(step);
+                numUndone++;
+            }
+        }
+    }
+
+    return (numUndone);
+}
+
+int8_t sampleUndoComplete(int8_t sample)
+{
+    PT_ASSERT((sample >= 0) && (sample <= 30));
+    if ((sample < 0) || (sample > 30))
+        return (false);
+
+    return (!stepsDropped[sample]);
+}
+
+uint32_t sampleUndoSteps(int8_t sample)
+{
+    PT_ASSERT((sample >= 0) && (sample <= 30));
+    if ((sample < 0) || (sample > 30))
+        return (0);
+
+    return (numSteps[sample]);
+}
+
+void sampleUndoFree(void)
+{
+    while (oldestStep != NULL)
+        removeStep(oldestStep);
+
+    memset(stepsDropped, 0, sizeof (stepsDropped));
+}
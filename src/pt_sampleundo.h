@@ -0,0 +1,16 @@
+#ifndef __PT_SAMPLEUNDO_H
+#define __PT_SAMPLEUNDO_H
+
+#include <stdint.h>
+
+// call before changing sample points from..to-1 (pass from == to if only length/loop/volume/finetune change)
+void sampleUndoSave(int8_t sample, int32_t from, int32_t to);
+void sampleUndoBeginGroup(void); // steps saved until sampleUndoEndGroup() are undone together
+void sampleUndoEndGroup(void);
+int8_t sampleUndo(int8_t sample, int8_t wholeGroup); // returns the number of samples restored (0 = nothing to undo)
+int8_t sampleUndoComplete(int8_t sample); // false if old steps were dropped because of the memory limit
+uint32_t sampleUndoSteps(int8_t sample);
+void sampleUndoReset(int8_t sample); // the sample was replaced as a whole (loaded, cleared etc.)
+void sampleUndoFree(void);
+
+#endif
@@ -12,92 +12,190 @@
 // for monoscope
 const int16_t mixScaleTable[AMIGA_VOICES] = { 388, 570, 595, 585 };
 
-scopeChannel_t scope[4];
-static SDL_Thread *scopeThread;
-static uint64_t timeNext64;
+scopeChannel_t scope[AMIGA_VOICES];
+static int8_t scopeWasIdle[AMIGA_VOICES], monoScopeWasIdle; // as last drawn, see drawScopes()
+
+// written by the audio thread only, snapshotCount is bumped after a slot is complete
+static scopeSnapshot_t snapshots[SCOPE_SNAPSHOTS];
+static SDL_atomic_t snapshotCount;
 
-extern int8_t forceMixerOff;  // pt_audio.c
 extern uint32_t *pixelBuffer; // pt_main.c
 
+scopeSnapshot_t *scopeGetSnapshotSlot(void)
+{
+    return (&snapshots[(uint32_t)(SDL_AtomicGet(&snapshotCount)) & (SCOPE_SNAPSHOTS - 1)]);
+}
+
+void scopePublishSnapshot(void)
+{
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicAdd(&snapshotCount, 1);
+}
+
+// call with the audio device locked, the old snapshots may point to freed sample data
+void scopeClearSnapshots(void)
+{
+    SDL_AtomicSet(&snapshotCount, 0);
+    memset(scope, 0, sizeof (scope));
+}
+
+// copies snapshot 'index', returns false if the audio thread could have overwritten it meanwhile
+static int8_t readSnapshot(uint32_t index, scopeSnapshot_t *dst)
+{
+    memcpy(dst, &snapshots[index & (SCOPE_SNAPSHOTS - 1)], sizeof (scopeSnapshot_t));
+    SDL_MemoryBarrierAcquire();
+
+    return (((uint32_t)(SDL_AtomicGet(&snapshotCount)) - index) < (SCOPE_SNAPSHOTS - 1));
+}
+
+// Finds the voice state that is audible right now: the audio clock from the last
+// callback, advanced by the time passed since, minus the output buffer latency.
+static int8_t findSnapshot(scopeSnapshot_t *snap, int64_t *samplesSince)
+{
+    uint32_t count, index, oldest;
+    int64_t elapsed, target;
+    uint64_t perfFreq;
+
+    SDL_MemoryBarrierAcquire();
+    count = (uint32_t)(SDL_AtomicGet(&snapshotCount));
+    if (count == 0)
+        return (false);
+
+    index = count - 1;
+    if (!readSnapshot(index, snap))
+        return (false);
+
+    perfFreq = SDL_GetPerformanceFrequency();
+    elapsed  = 0;
+
+    if (perfFreq > 0)
+    {
+        elapsed = (int64_t)(((double)(SDL_GetPerformanceCounter() - snap->clockTime64) * editor.outputFreq) / perfFreq);
+        elapsed = CLAMP(elapsed, 0, (int64_t)(editor.audioBufferSize));
+    }
+
+    target = ((int64_t)(snap->clockPos) + elapsed) - editor.audioBufferSize;
+
+    // walk back to the newest snapshot at or before the target position
+    oldest = (count > (SCOPE_SNAPSHOTS / 2)) ? (count - (SCOPE_SNAPSHOTS / 2)) : 0;
+    while (((int64_t)(snap->samplePos) > target) && (index > oldest))
+    {
+        if (!readSnapshot(--index, snap))
+            return (false);
+    }
+
+    *samplesSince = target - (int64_t)(snap->samplePos);
+    if (*samplesSince < 0)
+        *samplesSince = 0;
+
+    return (true);
+}
+
+// advances a voice like the mixer would, including the Paula register re-fetch on wrap
+static void advanceVoice(const scopeVoice_t *v, int64_t numSamples, scopeChannel_t *sc)
+{
+    double pos_d;
+    int64_t phase;
+
+    sc->active      = v->active;
+    sc->volume      = v->volume;
+    sc->data        = v->data;
+    sc->length      = v->length;
+    sc->loopFlag    = v->loopFlag;
+    sc->loopStart   = v->loopStart;
+    sc->didSwapData = v->didSwapData;
+    sc->phase       = v->phase;
+
+    if (!v->active || (v->length <= 0) || (v->newLength <= 0))
+        return;
+
+    pos_d = v->frac_f + ((double)(v->delta_f) * numSamples);
+    phase = (int64_t)(v->phase) + (int64_t)(pos_d);
+
+    if (phase >= sc->length)
+    {
+        // after the first wrap the length stays at the new one, so there's no need to loop
+        phase -= sc->length;
+        phase %= v->newLength;
+
+        sc->data        = v->newData;
+        sc->length      = v->newLength;
+        sc->loopFlag    = v->newLoopFlag;
+        sc->loopStart   = v->newLoopStart;
+        sc->didSwapData = true;
+    }
+
+    sc->phase = (int32_t)(phase);
+}
+
 void updateScopes(void)
 {
-    uint8_t i;
-    int32_t fracTrunc, samplePlayPos;
+    uint8_t i, scopesShown, posLineShown;
+    int32_t samplePlayPos;
+    int64_t samplesSince;
+    scopeSnapshot_t snap;
     scopeChannel_t *sc;
     moduleSample_t *s;
 
     if (editor.isWAVRendering)
         return;
 
-    s = &modEntry->samples[editor.currSample];
     hideSprite(SPRITE_SAMPLING_POS_LINE);
 
-    for (i = 0; i < AMIGA_VOICES; i++)
-    {
-        sc = &scope[i];
-        if (sc->retriggered)
-        {
-            sc->retriggered = false;
-
-            sc->frac_f = 0.0f;
-            sc->phase  = 0;
+    scopesShown = (editor.ui.visualizerMode != VISUAL_SPECTRUM) &&
+        !editor.ui.diskOpScreenShown && !editor.ui.posEdScreenShown &&
+        !editor.ui.editOpScreenShown && !editor.ui.aboutScreenShown &&
+        !editor.ui.disableVisualizer && !editor.ui.askScreenShown   &&
+        !editor.ui.terminalShown;
 
-            // data/length is already set from replayer thread (important)
-            sc->loopFlag  = sc->newLoopFlag;
-            sc->loopStart = sc->newLoopStart;
+    posLineShown = editor.ui.samplerScreenShown && !editor.ui.terminalShown &&
+        !editor.ui.samplerVolBoxShown && !editor.ui.samplerFiltersBoxShown;
 
-            sc->didSwapData = false;
-        }
-        else if (sc->active)
-        {
-            sc->frac_f += sc->delta_f;
-            if (sc->frac_f >= 1.0f)
-            {
-                fracTrunc = (int32_t)(sc->frac_f);
-
-                sc->frac_f -= fracTrunc;
-                sc->phase  += fracTrunc;
-
-                if (sc->phase >= sc->length)
-                {
-                    while (sc->phase >= sc->length)
-                    {
-                        sc->phase -= sc->length;
-                        sc->length = sc->newLength;
-                    }
+    if (!scopesShown && !posLineShown)
+        return; // nobody is looking, don't bother
 
-                    sc->data = sc->newData;
+    if (!findSnapshot(&snap, &samplesSince))
+    {
+        memset(scope, 0, sizeof (scope));
+        return;
+    }
 
-                    sc->loopFlag  = sc->newLoopFlag;
-                    sc->loopStart = sc->newLoopStart;
+    s = &modEntry->samples[editor.currSample];
 
-                    sc->didSwapData = true;
-                }
-            }
-        }
+    for (i = 0; i < AMIGA_VOICES; i++)
+    {
+        sc = &scope[i];
+        advanceVoice(&snap.voice[i], samplesSince, sc);
 
-        // update sample read position sprite (TODO: could use less extensive 'if' logic)
-        if (editor.ui.samplerScreenShown && !editor.muted[i] && (modEntry->channels[i].n_samplenum == editor.currSample) && !editor.ui.terminalShown)
+        // update sample read position sprite
+        if (posLineShown && !editor.muted[i] && (modEntry->channels[i].n_samplenum == editor.currSample) &&
+            sc->active && (sc->phase >= 2) && (sc->data != NULL))
         {
-            if (sc->active && (sc->phase >= 2) && !editor.ui.samplerVolBoxShown && !editor.ui.samplerFiltersBoxShown)
+            // get real sampling position regardless of where the scope data points to
+            samplePlayPos = (int32_t)(&sc->data[sc->phase] - &modEntry->sampleData[s->offset]);
+            if ((samplePlayPos >= 0) && (samplePlayPos < s->length))
             {
-                // get real sampling position regardless of where the scope data points to
-                samplePlayPos = (int32_t)(&sc->data[sc->phase] - &modEntry->sampleData[s->offset]);
-                if ((samplePlayPos >= 0) && (samplePlayPos < s->length))
-                {
-                    samplePlayPos = 3 + smpPos2Scr(samplePlayPos);
-                    if ((samplePlayPos >= 3) && (samplePlayPos <= 316))
-                        setSpritePos(SPRITE_SAMPLING_POS_LINE, samplePlayPos, 138);
-                }
+                samplePlayPos = 3 + smpPos2Scr(samplePlayPos);
+                if ((samplePlayPos >= 3) && (samplePlayPos <= 316))
+                    setSpritePos(SPRITE_SAMPLING_POS_LINE, samplePlayPos, 138);
             }
         }
     }
 }
 
-void drawScopes(void)
+// a scope is drawn as a flat line when it's idle, that only has to be done once
+static int8_t scopeIsIdle(uint8_t ch)
+{
+    const scopeChannel_t *sc;
+
+    sc = &scope[ch];
+    return (!sc->active || editor.muted[ch] || (sc->data == NULL) || (sc->length <= 0) || (sc->volume == 0));
+}
+
+void drawScopes(int8_t fullRedraw)
 {
     const int8_t *readPtr;
-    int8_t volume;
+    int8_t volume, idle;
     uint8_t i, y, totalVoicesActive, didSwapData;
     int16_t scopeData;
     int32_t x, readPos, monoScopeBuffer[MONOSCOPE_WIDTH], scopeTemp, dataLen, loopStart;
@@ -116,6 +214,15 @@ void drawScopes(void)
         {
             sc = &scope[i];
 
+            idle = scopeIsIdle(i);
+            if (idle && scopeWasIdle[i] && !fullRedraw)
+            {
+                scopePtr += (SCOPE_WIDTH + 8);
+                continue;
+            }
+
+            scopeWasIdle[i] = idle;
+
             // clear background
             ptr32Src = trackerFrameBMP + ((71 * SCREEN_W) + 128);
             ptr32Dst = pixelBuffer     + ((55 * SCREEN_W) + (128 + (i * (SCOPE_WIDTH + 8))));
@@ -189,6 +296,18 @@ void drawScopes(void)
     else
     {
         // -- monoscope --
+        idle = true;
+        for (i = 0; i < AMIGA_VOICES; ++i)
+        {
+            if (!scopeIsIdle(i))
+                idle = false;
+        }
+
+        if (idle && monoScopeWasIdle && !fullRedraw)
+            return;
+
+        monoScopeWasIdle = idle;
+
         scopePtr = pixelBuffer + ((76 * SCREEN_W) + 120);
 
         // clear background
@@ -267,63 +386,3 @@ void drawScopes(void)
         }
     }
 }
-
-int32_t scopeThreadFunc(void *ptr)
-{
-    int32_t time32;
-    uint64_t time64;
-    double time_f, perfFreq_f;
-
-    (void)(ptr);
-
-    SDL_SetThreadPriority(SDL_THREAD_PRIORITY_HIGH);
-    while (editor.programRunning)
-    {
-        updateScopes();
-
-        // sync scopes to 60Hz
-
-        perfFreq_f = (double)(SDL_GetPerformanceFrequency()); // should be safe for double
-        if (perfFreq_f <= 0.0)
-            continue; // panic!
-
-        time64 = SDL_GetPerformanceCounter();
-        if (time64 < timeNext64)
-        {
-            // calculate time remaining until next frame
-            time64 = timeNext64 - time64;
-
-            // convert to milliseconds
-            time_f = ((1000.0 * (double)(time64)) / perfFreq_f) + 0.5;
-            time32 = (int32_t)(time_f);
-
-            // delay until we reach next frame
-            if (time32 > 0)
-                SDL_Delay(time32);
-        }
-
-        // setup next frame time
-        time_f      = (perfFreq_f / VBLANK_HZ) + 0.5;
-        time32      = (int32_t)(time_f);
-        timeNext64 += time32;
-    }
-
-    return (true);
-}
-
-uint8_t initScopes(void)
-{
-    int32_t time32;
-    double time_f;
-
-    // setup next frame time
-    time_f     = ((double)(SDL_GetPerformanceFrequency()) / VBLANK_HZ) + 0.5;
-    time32     = (int32_t)(time_f);
-    timeNext64 = SDL_GetPerformanceCounter() + time32;
-
-    scopeThread = SDL_CreateThread(scopeThreadFunc, "PT Clone Scope Thread", NULL);
-    if (scopeThread == NULL)
-        return (false);
-
-    return (true);
-}
@@ -2,21 +2,40 @@
 #define __PT_SCOPES_H
 
 #include <stdint.h>
+#include "pt_header.h"
 
-typedef struct scopeChannel_t
+#define SCOPE_SNAPSHOTS 256 // must be a power of two
+
+// Paula voice state as seen by the mixer, published by the audio thread
+typedef struct scopeVoice_t
 {
-    volatile uint8_t active, retriggered, didSwapData;
-    int8_t volume, loopFlag, newLoopFlag;
+    const int8_t *data, *newData;
+    int8_t active, volume, loopFlag, newLoopFlag, didSwapData;
     int32_t length, newLength, phase, loopStart, newLoopStart;
-    const int8_t *newData, *data;
     float delta_f, frac_f;
+} scopeVoice_t;
+
+typedef struct scopeSnapshot_t
+{
+    uint64_t samplePos; // audio output position the voice state belongs to
+    uint64_t clockPos, clockTime64; // output position and performance counter at the start of the audio callback
+    scopeVoice_t voice[AMIGA_VOICES];
+} scopeSnapshot_t;
+
+// voice state resolved for the current video frame
+typedef struct scopeChannel_t
+{
+    const int8_t *data;
+    int8_t active, volume, loopFlag, didSwapData;
+    int32_t length, phase, loopStart;
 } scopeChannel_t;
 
-extern scopeChannel_t scope[4];
+extern scopeChannel_t scope[AMIGA_VOICES];
 
+scopeSnapshot_t *scopeGetSnapshotSlot(void);
+void scopePublishSnapshot(void);
+void scopeClearSnapshots(void);
 void updateScopes(void);
-void drawScopes(void);
-int32_t scopeThreadFunc(void *ptr);
-uint8_t initScopes(void);
+void drawScopes(int8_t fullRedraw); // fullRedraw = the background was redrawn, else idle scopes are left alone
 
 #endif
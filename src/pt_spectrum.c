@@ -0,0 +1,225 @@
+/*
+** Spectrum analyzer. The mixer hands over its filtered output (the signal you
+** actually hear, BLEP and Amiga filters included) through a lock-free ring,
+** and once per frame the last SPECTRUM_FFT_SIZE points before the audible
+** position are Hann-windowed and run through a radix-2 FFT. The bins are
+** grouped into SPECTRUM_BAR_NUM logarithmic bands, and each bar shows the
+** band's peak in dBFS over a SPECTRUM_RANGE_DB range. Bars rise instantly and
+** fall in sinkVisualizerBars().
+*/
+
+#include <SDL2/SDL.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "pt_header.h"
+#include "pt_helpers.h"
+#include "pt_spectrum.h"
+
+#define SPECTRUM_FFT_BITS 11
+#define SPECTRUM_FFT_SIZE (1 << SPECTRUM_FFT_BITS)
+#define SPECTRUM_RING_SIZE 16384 // must be a power of two
+#define SPECTRUM_RING_GUARD (SPECTRUM_RING_SIZE / 4) // room for the audio thread to write while we read
+#define SPECTRUM_MIN_HZ 40.0
+#define SPECTRUM_MAX_HZ 16000.0
+#define SPECTRUM_RANGE_DB 60.0f
+#define M_PI_D 3.14159265358979323846
+
+static float ring[SPECTRUM_RING_SIZE];
+static SDL_atomic_t ringWritePos;
+
+// twiddles for the butterflies of span 'half' are stored at [half + k]
+static float fftRe[SPECTRUM_FFT_SIZE], fftIm[SPECTRUM_FFT_SIZE], twRe[SPECTRUM_FFT_SIZE], twIm[SPECTRUM_FFT_SIZE];
+static float window[SPECTRUM_FFT_SIZE], fftInput[SPECTRUM_FFT_SIZE], power[SPECTRUM_FFT_SIZE / 2];
+static uint16_t bitRev[SPECTRUM_FFT_SIZE];
+static int32_t bandStart[SPECTRUM_BAR_NUM + 1];
+static uint32_t tablesFreq;
+
+void spectrumPushSamples(const float *left, const float *right, int32_t numSamples)
+{
+    int32_t i;
+    uint32_t pos;
+
+    pos = (uint32_t)(SDL_AtomicGet(&ringWritePos));
+    for (i = 0; i < numSamples; ++i)
+        ring[(pos + i) & (SPECTRUM_RING_SIZE - 1)] = (left[i] + right[i]) * 0.5f;
+
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicSet(&ringWritePos, (int32_t)(pos + numSamples));
+}
+
+static void makeTables(uint32_t outputFreq)
+{
+    int32_t i, j, half, bin;
+    double hz, hzMax;
+
+    for (i = 0; i < SPECTRUM_FFT_SIZE; ++i)
+    {
+        window[i] = (float)(0.5 - (0.5 * cos((2.0 * M_PI_D * i) / SPECTRUM_FFT_SIZE)));
+
+        bitRev[i] = 0;
+        for (j = 0; j < SPECTRUM_FFT_BITS; ++j)
+        {
+            if (i & (1 << j))
+                bitRev[i] |= 1 << ((SPECTRUM_FFT_BITS - 1) - j);
+        }
+    }
+
+    for (half = 1; half < SPECTRUM_FFT_SIZE; half <<= 1)
+    {
+        for (i = 0; i < half; ++i)
+        {
+            twRe[half + i] = (float)(cos((-M_PI_D * i) / half));
+            twIm[half + i] = (float)(sin((-M_PI_D * i) / half));
+        }
+    }
+
+    // logarithmic bands, at least one bin each
+    hzMax = MIN(SPECTRUM_MAX_HZ, outputFreq / 2.0);
+    for (i = 0; i <= SPECTRUM_BAR_NUM; ++i)
+    {
+        hz  = SPECTRUM_MIN_HZ * pow(hzMax / SPECTRUM_MIN_HZ, i / (double)(SPECTRUM_BAR_NUM));
+        bin = (int32_t)(((hz * SPECTRUM_FFT_SIZE) / outputFreq) + 0.5);
+
+        if ((i > 0) && (bin <= bandStart[i - 1]))
+            bin = bandStart[i - 1] + 1;
+
+        bandStart[i] = MIN(bin, SPECTRUM_FFT_SIZE / 2);
+    }
+
+    tablesFreq = outputFreq;
+}
+
+// in place, input must already be in bit-reversed order
+static void fft(float *re, float *im)
+{
+    int32_t half, start, a, b, k;
+    float tr, ti;
+
+    for (half = 1; half < SPECTRUM_FFT_SIZE; half <<= 1)
+    {
+        for (start = 0; start < SPECTRUM_FFT_SIZE; start += (half * 2))
+        {
+            k = 0;
+
+#ifdef PT_USE_SSE2
+            for (; k + 4 <= half; k += 4)
+            {
+                __m128 wr, wi, ar, ai, br, bi, vr, vi;
+
+                a  = start + k;
+                b  = a + half;
+                wr = _mm_loadu_ps(&twRe[half + k]);
+                wi = _mm_loadu_ps(&twIm[half + k]);
+                ar = _mm_loadu_ps(&re[a]);
+                ai = _mm_loadu_ps(&im[a]);
+                br = _mm_loadu_ps(&re[b]);
+                bi = _mm_loadu_ps(&im[b]);
+
+                vr = _mm_sub_ps(_mm_mul_ps(br, wr), _mm_mul_ps(bi, wi));
+                vi = _mm_add_ps(_mm_mul_ps(br, wi), _mm_mul_ps(bi, wr));
+
+                _mm_storeu_ps(&re[b], _mm_sub_ps(ar, vr));
+                _mm_storeu_ps(&im[b], _mm_sub_ps(ai, vi));
+                _mm_storeu_ps(&re[a], _mm_add_ps(ar, vr));
+                _mm_storeu_ps(&im[a], _mm_add_ps(ai, vi));
+            }
+#endif
+            for (; k < half; ++k)
+            {
+                a  = start + k;
+                b  = a + half;
+                tr = (re[b] * twRe[half + k]) - (im[b] * twIm[half + k]);
+                ti = (re[b] * twIm[half + k]) + (im[b] * twRe[half + k]);
+
+                re[b]  = re[a] - tr;
+                im[b]  = im[a] - ti;
+                re[a] += tr;
+                im[a] += ti;
+            }
+        }
+    }
+}
+
+void updateSpectrumAnalyzer(void)
+{
+    int32_t i, j, height;
+    uint32_t pos, start, latency;
+    float maxPower, level, scale;
+
+    if (editor.outputFreq == 0)
+        return;
+
+    if (tablesFreq != editor.outputFreq)
+        makeTables(editor.outputFreq);
+
+    // the last buffer handed to the audio device isn't audible yet
+    latency = MIN(editor.audioBufferSize, SPECTRUM_RING_SIZE - SPECTRUM_FFT_SIZE - (SPECTRUM_RING_GUARD * 2));
+
+    SDL_MemoryBarrierAcquire();
+    pos = (uint32_t)(SDL_AtomicGet(&ringWritePos));
+    if (pos < (latency + SPECTRUM_FFT_SIZE))
+        return; // not enough output yet
+
+    start = pos - latency - SPECTRUM_FFT_SIZE;
+    for (i = 0; i < SPECTRUM_FFT_SIZE; ++i)
+        fftInput[i] = ring[(start + i) & (SPECTRUM_RING_SIZE - 1)];
+
+    SDL_MemoryBarrierAcquire();
+    if (((uint32_t)(SDL_AtomicGet(&ringWritePos)) - start) > (SPECTRUM_RING_SIZE - SPECTRUM_RING_GUARD))
+        return; // overwritten while we read it (very long frame), try again next frame
+
+    // window
+    i = 0;
+#ifdef PT_USE_SSE2
+    for (; i + 4 <= SPECTRUM_FFT_SIZE; i += 4)
+        _mm_storeu_ps(&fftInput[i], _mm_mul_ps(_mm_loadu_ps(&fftInput[i]), _mm_loadu_ps(&window[i])));
+#endif
+    for (; i < SPECTRUM_FFT_SIZE; ++i)
+        fftInput[i] *= window[i];
+
+    for (i = 0; i < SPECTRUM_FFT_SIZE; ++i)
+        fftRe[bitRev[i]] = fftInput[i];
+
+    memset(fftIm, 0, sizeof (fftIm));
+    fft(fftRe, fftIm);
+
+    // power of the positive frequencies (SPECTRUM_FFT_SIZE / 2 is a multiple of four)
+#ifdef PT_USE_SSE2
+    for (i = 0; i < (SPECTRUM_FFT_SIZE / 2); i += 4)
+    {
+        __m128 re, im;
+
+        re = _mm_loadu_ps(&fftRe[i]);
+        im = _mm_loadu_ps(&fftIm[i]);
+        _mm_storeu_ps(&power[i], _mm_add_ps(_mm_mul_ps(re, re), _mm_mul_ps(im, im)));
+    }
+#else
+    for (i = 0; i < (SPECTRUM_FFT_SIZE / 2); ++i)
+        power[i] = (fftRe[i] * fftRe[i]) + (fftIm[i] * fftIm[i]);
+#endif
+
+    // a full scale sine (amplitude AMIGA_VOICES in the mixer) peaks at AMIGA_VOICES * (N / 4) with a Hann window
+    scale = 1.0f / ((AMIGA_VOICES * (SPECTRUM_FFT_SIZE / 4.0f)) * (AMIGA_VOICES * (SPECTRUM_FFT_SIZE / 4.0f)));
+
+    for (i = 0; i < SPECTRUM_BAR_NUM; ++i)
+    {
+        maxPower = 0.0f;
+        for (j = bandStart[i]; j < bandStart[i + 1]; ++j)
+        {
+            if (power[j] > maxPower)
+                maxPower = power[j];
+        }
+
+        maxPower *= scale;
+        if (maxPower <= 1e-12f)
+            continue;
+
+        level  = (10.0f * log10f(maxPower)) + SPECTRUM_RANGE_DB; // 0..SPECTRUM_RANGE_DB
+        height = (int32_t)(((level * SPECTRUM_BAR_HEIGHT) / SPECTRUM_RANGE_DB) + 0.5f);
+        height = CLAMP(height, 0, SPECTRUM_BAR_HEIGHT);
+
+        if (height > editor.spectrumVolumes[i])
+            editor.spectrumVolumes[i] = (int8_t)(height);
+    }
+}
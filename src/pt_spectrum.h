@@ -0,0 +1,12 @@
+#ifndef __PT_SPECTRUM_H
+#define __PT_SPECTRUM_H
+
+#include <stdint.h>
+
+// audio thread: feeds the final (filtered) mixer output, left/right as float
+void spectrumPushSamples(const float *left, const float *right, int32_t numSamples);
+
+// main thread, once per frame: analyzes the audible output and raises editor.spectrumVolumes[]
+void updateSpectrumAnalyzer(void);
+
+#endif
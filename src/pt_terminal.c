@@ -1,3 +1,4 @@
+#include <SDL2/SDL.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <string.h>
@@ -16,12 +17,31 @@
 
 #define TOPAZ_UNPACKED_LEN (760 * 8)
 
-static char *charBuffer, *textFormatBuffer;
-static uint8_t *topazFont, row, col, overflowFlag;
-static int32_t lastDragY, lastMouseY, numLines;
+#define TERMINAL_MSG_LEN 1024
+#define TERMINAL_QUEUE_SIZE 128 // must be a power of two
+
+/* Other threads don't print directly, their messages go through a bounded
+** lock-free queue (one sequence number per slot) that the main thread empties
+** once per frame, or before it prints itself. A full queue drops the message
+** instead of blocking the thread, the drops are reported when it's emptied.
+*/
+typedef struct termMsg_t
+{
+    SDL_atomic_t seq;
+    char text[TERMINAL_MSG_LEN];
+} termMsg_t;
+
+static char *charBuffer; // TERMINAL_HISTORY_LINES lines, used as a ring starting at firstLine
+static uint8_t *topazFont, col, overflowFlag, termDirty;
+static int32_t lastDragY, lastMouseY, numLines, firstLine;
 static int32_t scrollBufferPos, scrollBarEnd, scrollBarPage;
 static int32_t scrollBarThumbTop, scrollBarThumbBottom;
-static uint32_t textFgColor, dateFgColor, dateBgColor;
+static uint32_t textFgColor, dateFgColor, dateBgColor, thumbColor, msgReadPos;
+static uint32_t *termScreen; // the terminal as last rendered, minus the date
+static termMsg_t *msgQueue;
+static SDL_atomic_t msgWritePos, numDroppedMsgs;
+static SDL_threadID mainThreadID;
+static char earlyText[TERMINAL_MSG_LEN * 4]; // printed before terminalInit() (main thread only), shown by it
 
 static const char *monthDaysText[31] =
 {
@@ -80,6 +100,8 @@ static void updateScrollBar(void)
 
     scrollBarThumbTop    = SCROLL_AREA_TOP +  thumbTop;
     scrollBarThumbBottom = SCROLL_AREA_TOP + (thumbTop + thumbHeight);
+
+    termDirty = true;
 }
 
 void terminalScrollToStart(void)
@@ -146,35 +168,36 @@ void terminalScrollDown(void)
     }
 }
 
-static void putNewLine(void)
+// line 0 is the oldest line in the backlog, line numLines is the one being printed to
+static char *getLine(int32_t line)
 {
-    uint32_t i;
+    return (&charBuffer[((firstLine + line) % TERMINAL_HISTORY_LINES) * TERMINAL_WIDTH]);
+}
 
-    if (numLines < TERMINAL_HISTORY_LINES)
+static void putNewLine(void)
+{
+    if (numLines < (TERMINAL_HISTORY_LINES - 1))
     {
         numLines++;
     }
     else
     {
-        // we reached the maximum backlog lines,
-        // shift the buffer up so we can put our new line
-        // at the bottom without using more memory.
-        for (i = 0; i < (TERMINAL_HISTORY_LINES - 1); ++i)
-            memcpy(&charBuffer[(i * TERMINAL_WIDTH)], &charBuffer[((i + 1) * TERMINAL_WIDTH)], TERMINAL_WIDTH);
+        // we reached the maximum backlog lines, drop the
+        // oldest one by moving the start of the ring down
+        firstLine = (firstLine + 1) % TERMINAL_HISTORY_LINES;
     }
 
-    scrollBarEnd = numLines - 1;
-    terminalScrollDown();
+    memset(getLine(numLines), ' ', TERMINAL_WIDTH);
 
-    if (row < (TERMINAL_HEIGHT - 1))
-        row++;
+    scrollBarEnd = numLines;
+    terminalScrollDown();
 
     col = 0;
 }
 
 static void putChar(char chr)
 {
-    charBuffer[((scrollBufferPos + row) * TERMINAL_WIDTH) + col] = chr;
+    getLine(numLines)[col] = chr;
 
     if (++col == TERMINAL_WIDTH)
     {
@@ -202,6 +225,8 @@ static void printBuffer(const char *bufferPtr)
         updateScrollBar();
     }
 
+    termDirty = true;
+
     while (*bufferPtr != '\0')
     {
         // line feed
@@ -240,18 +265,98 @@ static void printBuffer(const char *bufferPtr)
     }
 }
 
+static int8_t pushMessage(const char *text)
+{
+    int32_t diff;
+    uint32_t pos;
+    termMsg_t *msg;
+
+    pos = (uint32_t)(SDL_AtomicGet(&msgWritePos));
+    for (;;)
+    {
+        msg  = &msgQueue[pos & (TERMINAL_QUEUE_SIZE - 1)];
+        diff = (int32_t)((uint32_t)(SDL_AtomicGet(&msg->seq)) - pos);
+
+        if (diff == 0)
+        {
+            // the slot is free, try to claim it
+            if (SDL_AtomicCAS(&msgWritePos, (int32_t)(pos), (int32_t)(pos + 1)))
+                break;
+        }
+        else if (diff < 0)
+        {
+            return (false); // queue is full
+        }
+
+        pos = (uint32_t)(SDL_AtomicGet(&msgWritePos));
+    }
+
+    strcpy(msg->text, text);
+
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicSet(&msg->seq, (int32_t)(pos + 1));
+
+    return (true);
+}
+
+// main thread only
+void terminalFlushMessages(void)
+{
+    char text[64];
+    int32_t numDropped;
+    termMsg_t *msg;
+
+    if (msgQueue == NULL)
+        return;
+
+    for (;;)
+    {
+        msg = &msgQueue[msgReadPos & (TERMINAL_QUEUE_SIZE - 1)];
+        if ((uint32_t)(SDL_AtomicGet(&msg->seq)) != (msgReadPos + 1))
+            break; // empty, or the next message isn't written yet
+
+        SDL_MemoryBarrierAcquire();
+        printBuffer(msg->text);
+
+        SDL_AtomicSet(&msg->seq, (int32_t)(msgReadPos + TERMINAL_QUEUE_SIZE));
+        msgReadPos++;
+    }
+
+    numDropped = SDL_AtomicSet(&numDroppedMsgs, 0);
+    if (numDropped > 0)
+    {
+        sprintf(text, "(%d terminal message(s) dropped)\n", numDropped);
+        printBuffer(text);
+    }
+}
+
+// can be called from any thread, never blocks
 void terminalPrintf(const char *format, ...)
 {
+    char text[TERMINAL_MSG_LEN];
     va_list args;
 
     if (format[0] == '\0')
         return;
 
     va_start(args, format);
-    vsnprintf(textFormatBuffer, 1024, format, args);
+    vsnprintf(text, sizeof (text), format, args);
     va_end(args);
 
-    printBuffer(textFormatBuffer);
+    if (msgQueue == NULL)
+    {
+        // not initialized yet (startup/config errors), keep it for terminalInit()
+        strncat(earlyText, text, sizeof (earlyText) - strlen(earlyText) - 1);
+    }
+    else if (SDL_ThreadID() == mainThreadID)
+    {
+        terminalFlushMessages(); // keep the order with what other threads printed before this
+        printBuffer(text);
+    }
+    else if (!pushMessage(text))
+    {
+        SDL_AtomicAdd(&numDroppedMsgs, 1);
+    }
 }
 
 void teriminalPutChar(const char chr)
@@ -261,14 +366,17 @@ void teriminalPutChar(const char chr)
 
 void terminalClear(void)
 {
-    row = 0;
+    terminalFlushMessages(); // what was printed before the clear goes too
+
     col = 0;
     numLines = 0;
+    firstLine = 0;
     overflowFlag = false;
     scrollBufferPos = 0;
     scrollBarEnd = 0;
     scrollBarThumbTop = 0;
     scrollBarThumbBottom = 0;
+    termDirty = true;
 
     memset(charBuffer, ' ', TERMINAL_BUFFER_SIZE);
 }
@@ -372,27 +480,23 @@ static void renderDate(uint32_t *frameBuffer)
     }
 }
 
-void terminalRender(uint32_t *frameBuffer)
+// redraws the cached terminal screen, only needed when the text, scroll position or thumb color changed
+static void renderTerminalScreen(void)
 {
+    char *line;
     int32_t y, x;
     const uint32_t *ptr32Src;
-    uint32_t *ptr32Dst, pixel;
-
-    // hide some sprites...
-    hideSprite(SPRITE_PATTERN_CURSOR);
-    hideSprite(SPRITE_LOOP_PIN_LEFT);
-    hideSprite(SPRITE_LOOP_PIN_RIGHT);
-    hideSprite(SPRITE_SAMPLING_POS_LINE);
+    uint32_t *ptr32Dst;
 
     // clear background with non-palette black
-    memset(frameBuffer, 0, SCREEN_W * SCREEN_H * sizeof (int32_t));
+    memset(termScreen, 0, SCREEN_W * SCREEN_H * sizeof (int32_t));
 
     // render window title graphics
-    memcpy(frameBuffer, termTopBMP, 320 * 11 * sizeof (uint32_t));
+    memcpy(termScreen, termTopBMP, 320 * 11 * sizeof (uint32_t));
 
     // render scrollbar graphics
     ptr32Src = termScrollBarBMP;
-    ptr32Dst = frameBuffer + ((11 * SCREEN_W) + 309);
+    ptr32Dst = termScreen + ((11 * SCREEN_W) + 309);
 
     y = 232;
     while (y--)
@@ -406,37 +510,57 @@ void terminalRender(uint32_t *frameBuffer)
     // render scrollbar thumb
     if (scrollBarEnd > scrollBarPage)
     {
-        ptr32Dst = frameBuffer + ((scrollBarThumbTop * SCREEN_W) + 311);
-        pixel    = palette[PAL_GENBKG2];
+        ptr32Dst = termScreen + ((scrollBarThumbTop * SCREEN_W) + 311);
 
         y = scrollBarThumbBottom - scrollBarThumbTop;
         while (y--)
         {
-            *(ptr32Dst + 0) = pixel;
-            *(ptr32Dst + 1) = pixel;
-            *(ptr32Dst + 2) = pixel;
-            *(ptr32Dst + 3) = pixel;
-            *(ptr32Dst + 4) = pixel;
-            *(ptr32Dst + 5) = pixel;
-            *(ptr32Dst + 6) = pixel;
+            *(ptr32Dst + 0) = thumbColor;
+            *(ptr32Dst + 1) = thumbColor;
+            *(ptr32Dst + 2) = thumbColor;
+            *(ptr32Dst + 3) = thumbColor;
+            *(ptr32Dst + 4) = thumbColor;
+            *(ptr32Dst + 5) = thumbColor;
+            *(ptr32Dst + 6) = thumbColor;
 
             ptr32Dst += SCREEN_W;
         }
     }
 
-    // render text
-    if (numLines > 0)
+    // render text (the background is already black, so spaces can be skipped)
+    for (y = 0; (y < TERMINAL_HEIGHT) && ((scrollBufferPos + y) <= numLines); ++y)
     {
-        for (y = 0; y < TERMINAL_HEIGHT; ++y)
+        line = getLine(scrollBufferPos + y);
+        for (x = 0; x < TERMINAL_WIDTH; ++x)
         {
-            for (x = 0; x < TERMINAL_WIDTH; ++x)
-            {
-                renderCharacter(frameBuffer, 3 + (x * TERMINAL_FONT_W), 12 + (y * TERMINAL_FONT_H),
-                    charBuffer[((scrollBufferPos + y) * TERMINAL_WIDTH) + x], textFgColor);
-            }
+            if (line[x] != ' ')
+                renderCharacter(termScreen, 3 + (x * TERMINAL_FONT_W), 12 + (y * TERMINAL_FONT_H), line[x], textFgColor);
         }
     }
 
+    termDirty = false;
+}
+
+void terminalRender(uint32_t *frameBuffer)
+{
+    // hide some sprites...
+    hideSprite(SPRITE_PATTERN_CURSOR);
+    hideSprite(SPRITE_LOOP_PIN_LEFT);
+    hideSprite(SPRITE_LOOP_PIN_RIGHT);
+    hideSprite(SPRITE_SAMPLING_POS_LINE);
+
+    if (thumbColor != palette[PAL_GENBKG2])
+    {
+        thumbColor = palette[PAL_GENBKG2];
+        termDirty  = true;
+    }
+
+    if (termDirty)
+        renderTerminalScreen();
+
+    // the rest of the GUI may have drawn over the frame, so the cached screen is always copied
+    memcpy(frameBuffer, termScreen, SCREEN_W * SCREEN_H * sizeof (int32_t));
+
     renderDate(frameBuffer);
 }
 
@@ -453,13 +577,29 @@ int8_t terminalInit(void)
         return (false);
     }
 
-    textFormatBuffer = (char *)(malloc(1024));
-    if (textFormatBuffer == NULL)
+    termScreen = (uint32_t *)(malloc(SCREEN_W * SCREEN_H * sizeof (int32_t)));
+    if (termScreen == NULL)
+    {
+        showErrorMsgBox("Out of memory!");
+        return (false);
+    }
+
+    msgQueue = (termMsg_t *)(malloc(TERMINAL_QUEUE_SIZE * sizeof (termMsg_t)));
+    if (msgQueue == NULL)
     {
         showErrorMsgBox("Out of memory!");
         return (false);
     }
 
+    for (i = 0; i < TERMINAL_QUEUE_SIZE; ++i)
+        SDL_AtomicSet(&msgQueue[i].seq, (int32_t)(i));
+
+    msgReadPos = 0;
+    SDL_AtomicSet(&msgWritePos, 0);
+    SDL_AtomicSet(&numDroppedMsgs, 0);
+
+    mainThreadID = SDL_ThreadID();
+
     topazFont = (uint8_t *)(malloc(TOPAZ_UNPACKED_LEN));
     if (topazFont == NULL)
     {
@@ -486,12 +626,21 @@ int8_t terminalInit(void)
     scrollBarPage = TERMINAL_HEIGHT - 1;
     terminalClear();
 
+    if (earlyText[0] != '\0')
+    {
+        printBuffer(earlyText);
+        earlyText[0] = '\0';
+    }
+
     return (true);
 }
 
 void terminalFree(void)
 {
     free(charBuffer);
-    free(textFormatBuffer);
+    free(termScreen);
+    free(msgQueue);
     free(topazFont);
+
+    msgQueue = NULL;
 }
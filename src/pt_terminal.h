@@ -13,9 +13,10 @@
 #define TERMINAL_FONT_H 8
 #define TERMINAL_WIDTH (TERMINAL_WINDOW_WIDTH / TERMINAL_FONT_W)
 #define TERMINAL_HEIGHT (TERMINAL_WINDOW_HEIGHT / TERMINAL_FONT_H)
-#define TERMINAL_BUFFER_SIZE (TERMINAL_WIDTH * (TERMINAL_HISTORY_LINES + TERMINAL_HEIGHT))
+#define TERMINAL_BUFFER_SIZE (TERMINAL_WIDTH * TERMINAL_HISTORY_LINES)
 
 void terminalPrintf(const char *format, ...);
+void terminalFlushMessages(void);
 void teriminalPutChar(const char chr);
 void terminalClear(void);
 void terminalScrollToStart(void);
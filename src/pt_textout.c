@@ -5,196 +5,221 @@
 #include "pt_tables.h"
 #include "pt_palette.h"
 #include "pt_visuals.h"
+#include "pt_textout.h"
 
-void charOut(uint32_t *frameBuffer, uint32_t x, uint32_t y, uint8_t ch, uint32_t fontColor)
+/*
+** Glyphs are drawn from small per-color caches instead of testing the font
+** bits on every call. A cache slot holds every glyph pre-colored as ARGB rows
+** for one color pair, built on first use. Opaque (Bg) text is a plain row
+** copy, transparent text blends through a per-glyph row mask.
+*/
+
+#define FONT_GLYPHS 129 // glyph 128 is the pattern editor's "empty" dot
+#define GLYPH_PIXELS (FONT_CHAR_W * FONT_CHAR_H)
+#define GLYPH_CACHE_SLOTS 8
+
+typedef struct glyphCache_t
 {
-    const uint8_t *fontPointer;
-    uint8_t line;
-    uint32_t *frameBufferPointer;
+    uint32_t fontColor, backColor, lastUse;
+    uint8_t opaque, used, built[FONT_GLYPHS];
+    uint32_t pixels[FONT_GLYPHS * GLYPH_PIXELS];
+} glyphCache_t;
 
-    if (ch < ' ')
-        return;
+static uint8_t glyphMasksBuilt, glyphEmpty[FONT_GLYPHS];
+static uint32_t glyphMask[FONT_GLYPHS * GLYPH_PIXELS]; // 0xFFFFFFFF where the font bit is set
+static uint32_t glyphCacheTick, textRunGeneration = 1;
+static glyphCache_t glyphCache[GLYPH_CACHE_SLOTS], *lastGlyphCache;
 
-    frameBufferPointer = frameBuffer + ((y * SCREEN_W) + x);
-    fontPointer = fontBMP + (ch * (FONT_CHAR_W * FONT_CHAR_H));
+static void buildGlyphMasks(void)
+{
+    uint32_t i, j;
+    const uint8_t *fontPointer;
 
-    line = FONT_CHAR_H;
-    while (line--)
+    for (i = 0; i < FONT_GLYPHS; ++i)
     {
-        if (*(fontPointer + 0)) *(frameBufferPointer + 0) = fontColor;
-        if (*(fontPointer + 1)) *(frameBufferPointer + 1) = fontColor;
-        if (*(fontPointer + 2)) *(frameBufferPointer + 2) = fontColor;
-        if (*(fontPointer + 3)) *(frameBufferPointer + 3) = fontColor;
-        if (*(fontPointer + 4)) *(frameBufferPointer + 4) = fontColor;
-        if (*(fontPointer + 5)) *(frameBufferPointer + 5) = fontColor;
-        if (*(fontPointer + 6)) *(frameBufferPointer + 6) = fontColor;
-        if (*(fontPointer + 7)) *(frameBufferPointer + 7) = fontColor;
+        fontPointer = fontBMP + (i * GLYPH_PIXELS);
 
-        fontPointer += FONT_CHAR_W;
-        frameBufferPointer += SCREEN_W;
+        glyphEmpty[i] = true;
+        for (j = 0; j < GLYPH_PIXELS; ++j)
+        {
+            glyphMask[(i * GLYPH_PIXELS) + j] = fontPointer[j] ? 0xFFFFFFFF : 0x00000000;
+            if (fontPointer[j])
+                glyphEmpty[i] = false;
+        }
     }
+
+    glyphMasksBuilt = true;
 }
 
-void charOutBig(uint32_t *frameBuffer, uint32_t x, uint32_t y, uint8_t ch, uint32_t fontColor)
+static glyphCache_t *getGlyphCache(uint32_t fontColor, uint32_t backColor, uint8_t opaque)
 {
-    const uint8_t *fontPointer;
-    uint8_t line;
-    uint32_t *frameBufferPointer;
+    uint8_t i;
+    glyphCache_t *c;
 
-    if (ch < ' ')
-        return;
+    if (!opaque)
+        backColor = 0; // transparent glyphs are stored as (fontColor & mask)
 
-    frameBufferPointer = frameBuffer + ((y * SCREEN_W) + x);
-    fontPointer = fontBMP + (ch * (FONT_CHAR_W * FONT_CHAR_H));
+    c = lastGlyphCache;
+    if ((c != NULL) && (c->fontColor == fontColor) && (c->backColor == backColor) && (c->opaque == opaque))
+    {
+        c->lastUse = ++glyphCacheTick;
+        return (c);
+    }
 
-    line = FONT_CHAR_H;
-    while (line--)
+    if (!glyphMasksBuilt)
+        buildGlyphMasks();
+
+    // find the slot for this color pair, or evict the least recently used one
+    c = &glyphCache[0];
+    for (i = 0; i < GLYPH_CACHE_SLOTS; ++i)
     {
-        if (*(fontPointer + 0)) *(frameBufferPointer + 0) = fontColor;
-        if (*(fontPointer + 1)) *(frameBufferPointer + 1) = fontColor;
-        if (*(fontPointer + 2)) *(frameBufferPointer + 2) = fontColor;
-        if (*(fontPointer + 3)) *(frameBufferPointer + 3) = fontColor;
-        if (*(fontPointer + 4)) *(frameBufferPointer + 4) = fontColor;
-        if (*(fontPointer + 5)) *(frameBufferPointer + 5) = fontColor;
-        if (*(fontPointer + 6)) *(frameBufferPointer + 6) = fontColor;
-        if (*(fontPointer + 7)) *(frameBufferPointer + 7) = fontColor;
+        if (glyphCache[i].used && (glyphCache[i].fontColor == fontColor) && (glyphCache[i].backColor == backColor)
+            && (glyphCache[i].opaque == opaque))
+        {
+            c = &glyphCache[i];
+            break;
+        }
 
-        frameBufferPointer += (SCREEN_W);
+        if (glyphCache[i].lastUse < c->lastUse)
+            c = &glyphCache[i];
+    }
 
-        if (*(fontPointer + 0)) *(frameBufferPointer + 0) = fontColor;
-        if (*(fontPointer + 1)) *(frameBufferPointer + 1) = fontColor;
-        if (*(fontPointer + 2)) *(frameBufferPointer + 2) = fontColor;
-        if (*(fontPointer + 3)) *(frameBufferPointer + 3) = fontColor;
-        if (*(fontPointer + 4)) *(frameBufferPointer + 4) = fontColor;
-        if (*(fontPointer + 5)) *(frameBufferPointer + 5) = fontColor;
-        if (*(fontPointer + 6)) *(frameBufferPointer + 6) = fontColor;
-        if (*(fontPointer + 7)) *(frameBufferPointer + 7) = fontColor;
+    if (i == GLYPH_CACHE_SLOTS)
+    {
+        c->fontColor = fontColor;
+        c->backColor = backColor;
+        c->opaque    = opaque;
+        c->used      = true;
 
-        fontPointer += FONT_CHAR_W;
-        frameBufferPointer += (SCREEN_W);
+        memset(c->built, 0, sizeof (c->built));
     }
+
+    c->lastUse = ++glyphCacheTick;
+    lastGlyphCache = c;
+
+    return (c);
 }
 
-void textOutNoSpace(uint32_t *frameBuffer, uint32_t x, uint32_t y, const char *text, uint32_t fontColor)
+static const uint32_t *getGlyph(glyphCache_t *c, uint8_t ch)
 {
+    uint32_t i, *glyph;
     const uint8_t *fontPointer;
-    uint8_t line;
-    uint32_t *frameBufferPointer, i;
 
-    frameBufferPointer = frameBuffer + ((y * SCREEN_W) + x);
-    for (i = 0; text[i]; ++i)
+    glyph = &c->pixels[ch * GLYPH_PIXELS];
+    if (!c->built[ch])
     {
-        if (text[i] <= ' ')
-        {
-            frameBufferPointer += FONT_CHAR_W;
-            continue;
-        }
+        fontPointer = fontBMP + (ch * GLYPH_PIXELS);
+        for (i = 0; i < GLYPH_PIXELS; ++i)
+            glyph[i] = fontPointer[i] ? c->fontColor : c->backColor;
 
-        fontPointer = fontBMP + (text[i] * (FONT_CHAR_W * FONT_CHAR_H));
+        c->built[ch] = true;
+    }
 
-        line = FONT_CHAR_H;
-        while (line--)
-        {
-            if (*(fontPointer + 0)) *(frameBufferPointer + 0) = fontColor;
-            if (*(fontPointer + 1)) *(frameBufferPointer + 1) = fontColor;
-            if (*(fontPointer + 2)) *(frameBufferPointer + 2) = fontColor;
-            if (*(fontPointer + 3)) *(frameBufferPointer + 3) = fontColor;
-            if (*(fontPointer + 4)) *(frameBufferPointer + 4) = fontColor;
-            if (*(fontPointer + 5)) *(frameBufferPointer + 5) = fontColor;
-            if (*(fontPointer + 6)) *(frameBufferPointer + 6) = fontColor;
-            if (*(fontPointer + 7)) *(frameBufferPointer + 7) = fontColor;
-
-            fontPointer += FONT_CHAR_W;
-            frameBufferPointer += SCREEN_W;
-        }
+    return (glyph);
+}
 
-        frameBufferPointer -= ((FONT_CHAR_H * SCREEN_W) - FONT_CHAR_W);
-    }
+static inline void blendGlyphRow(uint32_t *dst, const uint32_t *src, const uint32_t *mask)
+{
+#ifdef PT_USE_SSE2
+    __m128i d0, d1;
+
+    d0 = _mm_loadu_si128((const __m128i *)(dst + 0));
+    d1 = _mm_loadu_si128((const __m128i *)(dst + 4));
+    d0 = _mm_or_si128(_mm_andnot_si128(_mm_loadu_si128((const __m128i *)(mask + 0)), d0), _mm_loadu_si128((const __m128i *)(src + 0)));
+    d1 = _mm_or_si128(_mm_andnot_si128(_mm_loadu_si128((const __m128i *)(mask + 4)), d1), _mm_loadu_si128((const __m128i *)(src + 4)));
+    _mm_storeu_si128((__m128i *)(dst + 0), d0);
+    _mm_storeu_si128((__m128i *)(dst + 4), d1);
+#else
+    uint32_t i;
+
+    for (i = 0; i < FONT_CHAR_W; ++i)
+        dst[i] = (dst[i] & ~mask[i]) | src[i];
+#endif
 }
 
-void textOut(uint32_t *frameBuffer, uint32_t x, uint32_t y, const char *text, uint32_t fontColor)
+static void drawGlyph(uint32_t *frameBufferPointer, glyphCache_t *c, uint8_t ch, uint8_t big)
 {
-    const uint8_t *fontPointer;
     uint8_t line;
-    uint32_t *frameBufferPointer, i;
+    const uint32_t *glyph, *mask;
 
-    frameBufferPointer = frameBuffer + ((y * SCREEN_W) + x);
-    for (i = 0; text[i]; ++i)
+    if ((ch >= FONT_GLYPHS) || (!c->opaque && glyphEmpty[ch]))
+        return;
+
+    glyph = getGlyph(c, ch);
+    mask  = &glyphMask[ch * GLYPH_PIXELS];
+
+    line = FONT_CHAR_H;
+    while (line--)
     {
-        if (text[i] < ' ')
+        if (c->opaque)
         {
-            frameBufferPointer += FONT_CHAR_W;
-            continue;
+            memcpy(frameBufferPointer, glyph, FONT_CHAR_W * sizeof (int32_t));
+            if (big)
+            {
+                frameBufferPointer += SCREEN_W;
+                memcpy(frameBufferPointer, glyph, FONT_CHAR_W * sizeof (int32_t));
+            }
         }
-
-        fontPointer = fontBMP + (text[i] * (FONT_CHAR_W * FONT_CHAR_H));
-
-        line = FONT_CHAR_H;
-        while (line--)
+        else
         {
-            if (*(fontPointer + 0)) *(frameBufferPointer + 0) = fontColor;
-            if (*(fontPointer + 1)) *(frameBufferPointer + 1) = fontColor;
-            if (*(fontPointer + 2)) *(frameBufferPointer + 2) = fontColor;
-            if (*(fontPointer + 3)) *(frameBufferPointer + 3) = fontColor;
-            if (*(fontPointer + 4)) *(frameBufferPointer + 4) = fontColor;
-            if (*(fontPointer + 5)) *(frameBufferPointer + 5) = fontColor;
-            if (*(fontPointer + 6)) *(frameBufferPointer + 6) = fontColor;
-            if (*(fontPointer + 7)) *(frameBufferPointer + 7) = fontColor;
-
-            fontPointer += FONT_CHAR_W;
-            frameBufferPointer += SCREEN_W;
+            blendGlyphRow(frameBufferPointer, glyph, mask);
+            if (big)
+            {
+                frameBufferPointer += SCREEN_W;
+                blendGlyphRow(frameBufferPointer, glyph, mask);
+            }
         }
 
-        frameBufferPointer -= ((FONT_CHAR_H * SCREEN_W) - FONT_CHAR_W);
+        glyph += FONT_CHAR_W;
+        mask  += FONT_CHAR_W;
+        frameBufferPointer += SCREEN_W;
     }
 }
 
-void textOutBig(uint32_t *frameBuffer, uint32_t x, uint32_t y, const char *text, uint32_t fontColor)
+// chars below firstChar only advance the position
+static void drawText(uint32_t *frameBuffer, uint32_t x, uint32_t y, const char *text, char firstChar, glyphCache_t *c, uint8_t big)
 {
-    const uint8_t *fontPointer;
-    uint8_t line;
     uint32_t *frameBufferPointer, i;
 
     frameBufferPointer = frameBuffer + ((y * SCREEN_W) + x);
     for (i = 0; text[i]; ++i)
     {
-        if (text[i] < ' ')
-        {
-            frameBufferPointer += FONT_CHAR_W;
-            continue;
-        }
+        if (text[i] >= firstChar)
+            drawGlyph(frameBufferPointer, c, (uint8_t)(text[i]), big);
 
-        fontPointer = fontBMP  + (text[i] * (FONT_CHAR_W * FONT_CHAR_H));
+        frameBufferPointer += FONT_CHAR_W;
+    }
+}
 
-        line = FONT_CHAR_H;
-        while (line--)
-        {
-            if (*(fontPointer + 0)) *(frameBufferPointer + 0) = fontColor;
-            if (*(fontPointer + 1)) *(frameBufferPointer + 1) = fontColor;
-            if (*(fontPointer + 2)) *(frameBufferPointer + 2) = fontColor;
-            if (*(fontPointer + 3)) *(frameBufferPointer + 3) = fontColor;
-            if (*(fontPointer + 4)) *(frameBufferPointer + 4) = fontColor;
-            if (*(fontPointer + 5)) *(frameBufferPointer + 5) = fontColor;
-            if (*(fontPointer + 6)) *(frameBufferPointer + 6) = fontColor;
-            if (*(fontPointer + 7)) *(frameBufferPointer + 7) = fontColor;
-
-            frameBufferPointer += (SCREEN_W);
-
-            if (*(fontPointer + 0)) *(frameBufferPointer + 0) = fontColor;
-            if (*(fontPointer + 1)) *(frameBufferPointer + 1) = fontColor;
-            if (*(fontPointer + 2)) *(frameBufferPointer + 2) = fontColor;
-            if (*(fontPointer + 3)) *(frameBufferPointer + 3) = fontColor;
-            if (*(fontPointer + 4)) *(frameBufferPointer + 4) = fontColor;
-            if (*(fontPointer + 5)) *(frameBufferPointer + 5) = fontColor;
-            if (*(fontPointer + 6)) *(frameBufferPointer + 6) = fontColor;
-            if (*(fontPointer + 7)) *(frameBufferPointer + 7) = fontColor;
-
-            fontPointer += FONT_CHAR_W;
-            frameBufferPointer += (SCREEN_W);
-        }
+void charOut(uint32_t *frameBuffer, uint32_t x, uint32_t y, uint8_t ch, uint32_t fontColor)
+{
+    if (ch < ' ')
+        return;
 
-        frameBufferPointer -= (((FONT_CHAR_H * 2) * SCREEN_W) - FONT_CHAR_W);
-    }
+    drawGlyph(frameBuffer + ((y * SCREEN_W) + x), getGlyphCache(fontColor, 0, false), ch, false);
+}
+
+void charOutBig(uint32_t *frameBuffer, uint32_t x, uint32_t y, uint8_t ch, uint32_t fontColor)
+{
+    if (ch < ' ')
+        return;
+
+    drawGlyph(frameBuffer + ((y * SCREEN_W) + x), getGlyphCache(fontColor, 0, false), ch, true);
+}
+
+void textOutNoSpace(uint32_t *frameBuffer, uint32_t x, uint32_t y, const char *text, uint32_t fontColor)
+{
+    drawText(frameBuffer, x, y, text, ' ' + 1, getGlyphCache(fontColor, 0, false), false);
+}
+
+void textOut(uint32_t *frameBuffer, uint32_t x, uint32_t y, const char *text, uint32_t fontColor)
+{
+    drawText(frameBuffer, x, y, text, ' ', getGlyphCache(fontColor, 0, false), false);
+}
+
+void textOutBig(uint32_t *frameBuffer, uint32_t x, uint32_t y, const char *text, uint32_t fontColor)
+{
+    drawText(frameBuffer, x, y, text, ' ', getGlyphCache(fontColor, 0, false), true);
 }
 
 void printTwoDecimals(uint32_t *frameBuffer, uint32_t x, uint32_t y, uint32_t value, uint32_t fontColor)
@@ -407,193 +432,157 @@ void printFiveHex(uint32_t *frameBuffer, uint32_t x, uint32_t y, uint32_t value,
 
 void charOutBg(uint32_t *frameBuffer, uint32_t x, uint32_t y, uint8_t ch, uint32_t fontColor, uint32_t backColor)
 {
-    const uint8_t *fontPointer;
-    uint8_t line;
-    uint32_t *frameBufferPointer;
-
     if (ch < ' ')
         return;
 
-    frameBufferPointer = frameBuffer + ((y * SCREEN_W) + x);
-    fontPointer = fontBMP + (ch * (FONT_CHAR_W * FONT_CHAR_H));
-
-    line = FONT_CHAR_H;
-    while (line--)
-    {
-        if (*(fontPointer + 0)) *(frameBufferPointer + 0) = fontColor; else *(frameBufferPointer + 0) = backColor;
-        if (*(fontPointer + 1)) *(frameBufferPointer + 1) = fontColor; else *(frameBufferPointer + 1) = backColor;
-        if (*(fontPointer + 2)) *(frameBufferPointer + 2) = fontColor; else *(frameBufferPointer + 2) = backColor;
-        if (*(fontPointer + 3)) *(frameBufferPointer + 3) = fontColor; else *(frameBufferPointer + 3) = backColor;
-        if (*(fontPointer + 4)) *(frameBufferPointer + 4) = fontColor; else *(frameBufferPointer + 4) = backColor;
-        if (*(fontPointer + 5)) *(frameBufferPointer + 5) = fontColor; else *(frameBufferPointer + 5) = backColor;
-        if (*(fontPointer + 6)) *(frameBufferPointer + 6) = fontColor; else *(frameBufferPointer + 6) = backColor;
-        if (*(fontPointer + 7)) *(frameBufferPointer + 7) = fontColor; else *(frameBufferPointer + 7) = backColor;
-
-        fontPointer += FONT_CHAR_W;
-        frameBufferPointer += SCREEN_W;
-    }
+    drawGlyph(frameBuffer + ((y * SCREEN_W) + x), getGlyphCache(fontColor, backColor, true), ch, false);
 }
 
 void charOutBigBg(uint32_t *frameBuffer, uint32_t x, uint32_t y, uint8_t ch, uint32_t fontColor, uint32_t backColor)
 {
-    const uint8_t *fontPointer;
-    uint8_t line;
-    uint32_t *frameBufferPointer;
-
     if (ch < ' ')
         return;
 
-    frameBufferPointer = frameBuffer + ((y * SCREEN_W) + x);
-    fontPointer = fontBMP + (ch * (FONT_CHAR_W * FONT_CHAR_H));
-
-    line = FONT_CHAR_H;
-    while (line--)
-    {
-        if (*(fontPointer + 0)) *(frameBufferPointer + 0) = fontColor; else *(frameBufferPointer + 0) = backColor;
-        if (*(fontPointer + 1)) *(frameBufferPointer + 1) = fontColor; else *(frameBufferPointer + 1) = backColor;
-        if (*(fontPointer + 2)) *(frameBufferPointer + 2) = fontColor; else *(frameBufferPointer + 2) = backColor;
-        if (*(fontPointer + 3)) *(frameBufferPointer + 3) = fontColor; else *(frameBufferPointer + 3) = backColor;
-        if (*(fontPointer + 4)) *(frameBufferPointer + 4) = fontColor; else *(frameBufferPointer + 4) = backColor;
-        if (*(fontPointer + 5)) *(frameBufferPointer + 5) = fontColor; else *(frameBufferPointer + 5) = backColor;
-        if (*(fontPointer + 6)) *(frameBufferPointer + 6) = fontColor; else *(frameBufferPointer + 6) = backColor;
-        if (*(fontPointer + 7)) *(frameBufferPointer + 7) = fontColor; else *(frameBufferPointer + 7) = backColor;
+    drawGlyph(frameBuffer + ((y * SCREEN_W) + x), getGlyphCache(fontColor, backColor, true), ch, true);
+}
 
-        frameBufferPointer += (SCREEN_W);
+void textOutBgNoSpace(uint32_t *frameBuffer, uint32_t x, uint32_t y, const char *text, uint32_t fontColor, uint32_t backColor)
+{
+    drawText(frameBuffer, x, y, text, ' ' + 1, getGlyphCache(fontColor, backColor, true), false);
+}
 
-        if (*(fontPointer + 0)) *(frameBufferPointer + 0) = fontColor; else *(frameBufferPointer + 0) = backColor;
-        if (*(fontPointer + 1)) *(frameBufferPointer + 1) = fontColor; else *(frameBufferPointer + 1) = backColor;
-        if (*(fontPointer + 2)) *(frameBufferPointer + 2) = fontColor; else *(frameBufferPointer + 2) = backColor;
-        if (*(fontPointer + 3)) *(frameBufferPointer + 3) = fontColor; else *(frameBufferPointer + 3) = backColor;
-        if (*(fontPointer + 4)) *(frameBufferPointer + 4) = fontColor; else *(frameBufferPointer + 4) = backColor;
-        if (*(fontPointer + 5)) *(frameBufferPointer + 5) = fontColor; else *(frameBufferPointer + 5) = backColor;
-        if (*(fontPointer + 6)) *(frameBufferPointer + 6) = fontColor; else *(frameBufferPointer + 6) = backColor;
-        if (*(fontPointer + 7)) *(frameBufferPointer + 7) = fontColor; else *(frameBufferPointer + 7) = backColor;
+void textOutBg(uint32_t *frameBuffer, uint32_t x, uint32_t y, const char *text, uint32_t fontColor, uint32_t backColor)
+{
+    drawText(frameBuffer, x, y, text, ' ', getGlyphCache(fontColor, backColor, true), false);
+}
 
-        fontPointer += FONT_CHAR_W;
-        frameBufferPointer += (SCREEN_W);
-    }
+void textOutBigBg(uint32_t *frameBuffer, uint32_t x, uint32_t y, const char *text, uint32_t fontColor, uint32_t backColor)
+{
+    drawText(frameBuffer, x, y, text, ' ', getGlyphCache(fontColor, backColor, true), true);
 }
 
-void textOutBgNoSpace(uint32_t *frameBuffer, uint32_t x, uint32_t y, const char *text, uint32_t fontColor, uint32_t backColor)
+/*
+** Text runs: opaque text that remembers what it drew last time, and only
+** redraws the characters that changed. Unlike textOutBg(), chars are taken as
+** unsigned, so glyph 128 (the dot) can be used in a run.
+**
+** The run trusts that nothing else has drawn over it since the last call.
+** Call invalidateTextRuns() after restoring screen graphics underneath text
+** runs, or resetTextRun() when a single run's area was drawn over.
+*/
+
+static void textRunOut(textRun_t *run, uint32_t *frameBuffer, uint32_t x, uint32_t y, const char *text,
+    uint32_t fontColor, uint32_t backColor, uint8_t big)
 {
-    const uint8_t *fontPointer;
-    uint8_t line;
+    uint8_t ch, valid;
     uint32_t *frameBufferPointer, i;
+    glyphCache_t *c;
+
+    valid = (run->generation == textRunGeneration) && (run->frameBuffer == frameBuffer) && (run->x == x) && (run->y == y)
+        && (run->fontColor == fontColor) && (run->backColor == backColor) && (run->big == big);
+
+    c = getGlyphCache(fontColor, backColor, true);
 
     frameBufferPointer = frameBuffer + ((y * SCREEN_W) + x);
     for (i = 0; text[i]; ++i)
     {
-        if (text[i] <= ' ')
-        {
-            frameBufferPointer += FONT_CHAR_W;
-            continue;
-        }
-
-        fontPointer = fontBMP + (text[i] * (FONT_CHAR_W * FONT_CHAR_H));
+        ch = (uint8_t)(text[i]);
 
-        line = FONT_CHAR_H;
-        while (line--)
+        if (i < TEXT_RUN_LEN)
         {
-            if (*(fontPointer + 0)) *(frameBufferPointer + 0) = fontColor; else *(frameBufferPointer + 0) = backColor;
-            if (*(fontPointer + 1)) *(frameBufferPointer + 1) = fontColor; else *(frameBufferPointer + 1) = backColor;
-            if (*(fontPointer + 2)) *(frameBufferPointer + 2) = fontColor; else *(frameBufferPointer + 2) = backColor;
-            if (*(fontPointer + 3)) *(frameBufferPointer + 3) = fontColor; else *(frameBufferPointer + 3) = backColor;
-            if (*(fontPointer + 4)) *(frameBufferPointer + 4) = fontColor; else *(frameBufferPointer + 4) = backColor;
-            if (*(fontPointer + 5)) *(frameBufferPointer + 5) = fontColor; else *(frameBufferPointer + 5) = backColor;
-            if (*(fontPointer + 6)) *(frameBufferPointer + 6) = fontColor; else *(frameBufferPointer + 6) = backColor;
-            if (*(fontPointer + 7)) *(frameBufferPointer + 7) = fontColor; else *(frameBufferPointer + 7) = backColor;
-
-            fontPointer += FONT_CHAR_W;
-            frameBufferPointer += SCREEN_W;
+            if (valid && (i < run->len) && (run->text[i] == ch))
+            {
+                frameBufferPointer += FONT_CHAR_W;
+                continue;
+            }
+
+            run->text[i] = ch;
         }
 
-        frameBufferPointer -= ((FONT_CHAR_H * SCREEN_W) - FONT_CHAR_W);
+        if (ch >= ' ')
+            drawGlyph(frameBufferPointer, c, ch, big);
+
+        frameBufferPointer += FONT_CHAR_W;
     }
+
+    run->frameBuffer = frameBuffer;
+    run->generation  = textRunGeneration;
+    run->x           = x;
+    run->y           = y;
+    run->fontColor   = fontColor;
+    run->backColor   = backColor;
+    run->big         = big;
+    run->len         = (uint8_t)(MIN(i, TEXT_RUN_LEN));
 }
 
-void textOutBg(uint32_t *frameBuffer, uint32_t x, uint32_t y, const char *text, uint32_t fontColor, uint32_t backColor)
+void textRunOutBg(textRun_t *run, uint32_t *frameBuffer, uint32_t x, uint32_t y, const char *text, uint32_t fontColor, uint32_t backColor)
 {
-    const uint8_t *fontPointer;
-    uint8_t line;
-    uint32_t *frameBufferPointer, i;
+    textRunOut(run, frameBuffer, x, y, text, fontColor, backColor, false);
+}
 
-    frameBufferPointer = frameBuffer + ((y * SCREEN_W) + x);
-    for (i = 0; text[i]; ++i)
+void textRunOutBigBg(textRun_t *run, uint32_t *frameBuffer, uint32_t x, uint32_t y, const char *text, uint32_t fontColor, uint32_t backColor)
+{
+    textRunOut(run, frameBuffer, x, y, text, fontColor, backColor, true);
+}
+
+// moves a run's pixels and shadow to another run at a new y, for scrolling without redrawing
+void moveTextRun(textRun_t *dst, const textRun_t *src, uint32_t y)
+{
+    uint32_t width, height, line;
+    const uint32_t *srcPtr;
+    uint32_t *dstPtr;
+
+    if (src->generation != textRunGeneration)
     {
-        if (text[i] < ' ')
-        {
-            frameBufferPointer += FONT_CHAR_W;
-            continue;
-        }
+        dst->generation = 0; // nothing known about the source, the next call redraws
+        return;
+    }
 
-        fontPointer = fontBMP + (text[i] * (FONT_CHAR_W * FONT_CHAR_H));
+    width  = src->len * FONT_CHAR_W;
+    height = src->big ? (FONT_CHAR_H * 2) : FONT_CHAR_H;
 
-        line = FONT_CHAR_H;
-        while (line--)
-        {
-            if (*(fontPointer + 0)) *(frameBufferPointer + 0) = fontColor; else *(frameBufferPointer + 0) = backColor;
-            if (*(fontPointer + 1)) *(frameBufferPointer + 1) = fontColor; else *(frameBufferPointer + 1) = backColor;
-            if (*(fontPointer + 2)) *(frameBufferPointer + 2) = fontColor; else *(frameBufferPointer + 2) = backColor;
-            if (*(fontPointer + 3)) *(frameBufferPointer + 3) = fontColor; else *(frameBufferPointer + 3) = backColor;
-            if (*(fontPointer + 4)) *(frameBufferPointer + 4) = fontColor; else *(frameBufferPointer + 4) = backColor;
-            if (*(fontPointer + 5)) *(frameBufferPointer + 5) = fontColor; else *(frameBufferPointer + 5) = backColor;
-            if (*(fontPointer + 6)) *(frameBufferPointer + 6) = fontColor; else *(frameBufferPointer + 6) = backColor;
-            if (*(fontPointer + 7)) *(frameBufferPointer + 7) = fontColor; else *(frameBufferPointer + 7) = backColor;
-
-            fontPointer += FONT_CHAR_W;
-            frameBufferPointer += SCREEN_W;
-        }
+    srcPtr = src->frameBuffer + ((src->y * SCREEN_W) + src->x);
+    dstPtr = src->frameBuffer + ((y * SCREEN_W) + src->x);
 
-        frameBufferPointer -= ((FONT_CHAR_H * SCREEN_W) - FONT_CHAR_W);
-    }
-}
+    if (y > src->y) // copy from the bottom line up in case the areas overlap
+    {
+        srcPtr += ((height - 1) * SCREEN_W);
+        dstPtr += ((height - 1) * SCREEN_W);
 
-void textOutBigBg(uint32_t *frameBuffer, uint32_t x, uint32_t y, const char *text, uint32_t fontColor, uint32_t backColor)
-{
-    const uint8_t *fontPointer;
-    uint8_t line;
-    uint32_t *frameBufferPointer, i;
+        for (line = 0; line < height; ++line)
+        {
+            memcpy(dstPtr, srcPtr, width * sizeof (int32_t));
 
-    frameBufferPointer = frameBuffer + ((y * SCREEN_W) + x);
-    for (i = 0; text[i]; ++i)
+            srcPtr -= SCREEN_W;
+            dstPtr -= SCREEN_W;
+        }
+    }
+    else if (y < src->y)
     {
-        if (text[i] < ' ')
+        for (line = 0; line < height; ++line)
         {
-            frameBufferPointer += FONT_CHAR_W;
-            continue;
+            memcpy(dstPtr, srcPtr, width * sizeof (int32_t));
+
+            srcPtr += SCREEN_W;
+            dstPtr += SCREEN_W;
         }
+    }
 
-        fontPointer = fontBMP  + (text[i] * (FONT_CHAR_W * FONT_CHAR_H));
+    if (dst != src)
+        *dst = *src;
 
-        line = FONT_CHAR_H;
-        while (line--)
-        {
-            if (*(fontPointer + 0)) *(frameBufferPointer + 0) = fontColor; else *(frameBufferPointer + 0) = backColor;
-            if (*(fontPointer + 1)) *(frameBufferPointer + 1) = fontColor; else *(frameBufferPointer + 1) = backColor;
-            if (*(fontPointer + 2)) *(frameBufferPointer + 2) = fontColor; else *(frameBufferPointer + 2) = backColor;
-            if (*(fontPointer + 3)) *(frameBufferPointer + 3) = fontColor; else *(frameBufferPointer + 3) = backColor;
-            if (*(fontPointer + 4)) *(frameBufferPointer + 4) = fontColor; else *(frameBufferPointer + 4) = backColor;
-            if (*(fontPointer + 5)) *(frameBufferPointer + 5) = fontColor; else *(frameBufferPointer + 5) = backColor;
-            if (*(fontPointer + 6)) *(frameBufferPointer + 6) = fontColor; else *(frameBufferPointer + 6) = backColor;
-            if (*(fontPointer + 7)) *(frameBufferPointer + 7) = fontColor; else *(frameBufferPointer + 7) = backColor;
-
-            frameBufferPointer += (SCREEN_W);
-
-            if (*(fontPointer + 0)) *(frameBufferPointer + 0) = fontColor; else *(frameBufferPointer + 0) = backColor;
-            if (*(fontPointer + 1)) *(frameBufferPointer + 1) = fontColor; else *(frameBufferPointer + 1) = backColor;
-            if (*(fontPointer + 2)) *(frameBufferPointer + 2) = fontColor; else *(frameBufferPointer + 2) = backColor;
-            if (*(fontPointer + 3)) *(frameBufferPointer + 3) = fontColor; else *(frameBufferPointer + 3) = backColor;
-            if (*(fontPointer + 4)) *(frameBufferPointer + 4) = fontColor; else *(frameBufferPointer + 4) = backColor;
-            if (*(fontPointer + 5)) *(frameBufferPointer + 5) = fontColor; else *(frameBufferPointer + 5) = backColor;
-            if (*(fontPointer + 6)) *(frameBufferPointer + 6) = fontColor; else *(frameBufferPointer + 6) = backColor;
-            if (*(fontPointer + 7)) *(frameBufferPointer + 7) = fontColor; else *(frameBufferPointer + 7) = backColor;
-
-            fontPointer += FONT_CHAR_W;
-            frameBufferPointer += (SCREEN_W);
-        }
+    dst->y = y;
+}
 
-        frameBufferPointer -= (((FONT_CHAR_H * 2) * SCREEN_W) - FONT_CHAR_W);
-    }
+void resetTextRun(textRun_t *run)
+{
+    run->generation = 0;
+}
+
+void invalidateTextRuns(void)
+{
+    if (++textRunGeneration == 0)
+        textRunGeneration = 1; // 0 is never valid, see resetTextRun()
 }
 
 void printTwoDecimalsBg(uint32_t *frameBuffer, uint32_t x, uint32_t y, uint32_t value, uint32_t fontColor, uint32_t backColor)
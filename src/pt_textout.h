@@ -3,6 +3,15 @@
 
 #include <stdint.h>
 
+#define TEXT_RUN_LEN 16
+
+typedef struct textRun_t
+{
+    uint32_t *frameBuffer;
+    uint32_t generation, x, y, fontColor, backColor;
+    uint8_t big, len, text[TEXT_RUN_LEN];
+} textRun_t;
+
 void charOut(uint32_t *frameBuffer, uint32_t x, uint32_t y, uint8_t ch, uint32_t fontColor);
 void textOutNoSpace(uint32_t *frameBuffer, uint32_t x, uint32_t y, const char *text, uint32_t fontColor);
 void textOut(uint32_t *frameBuffer, uint32_t x, uint32_t y, const char *text, uint32_t fontColor);
@@ -41,6 +50,12 @@ void printFiveDecimalsBg(uint32_t *frameBuffer, uint32_t x, uint32_t y, uint32_t
 void printThreeDecimalsBg(uint32_t *frameBuffer, uint32_t x, uint32_t y, uint32_t value, uint32_t fontColor, uint32_t backColor);
 void printTwoDecimalsBigBg(uint32_t *frameBuffer, uint32_t x, uint32_t y, uint32_t value, uint32_t fontColor, uint32_t backColor);
 
+void textRunOutBg(textRun_t *run, uint32_t *frameBuffer, uint32_t x, uint32_t y, const char *text, uint32_t fontColor, uint32_t backColor);
+void textRunOutBigBg(textRun_t *run, uint32_t *frameBuffer, uint32_t x, uint32_t y, const char *text, uint32_t fontColor, uint32_t backColor);
+void moveTextRun(textRun_t *dst, const textRun_t *src, uint32_t y);
+void resetTextRun(textRun_t *run);
+void invalidateTextRuns(void);
+
 void setPrevStatusMessage(void);
 void setStatusMessage(const char *message, uint8_t carry);
 void displayMsg(const char *msg);
@@ -5,6 +5,7 @@
 #include <SDL2/SDL_syswm.h>
 #endif
 #include <stdint.h>
+#include <string.h>
 #include <ctype.h> // tolower()
 #include "pt_header.h"
 #include "pt_keyboard.h"
@@ -18,17 +19,24 @@
 #include "pt_sampleloader.h"
 #include "pt_patternviewer.h"
 #include "pt_sampler.h"
+#include "pt_sampleundo.h"
 #include "pt_diskop.h"
 #include "pt_visuals.h"
 #include "pt_helpers.h"
 #include "pt_terminal.h"
 #include "pt_scopes.h"
+#include "pt_spectrum.h"
+#include "pt_meters.h"
+#include "pt_samplebatch.h"
+#include "pt_config.h"
+#include "pt_bench.h"
+#include "pt_pacer.h"
 
 typedef struct sprite_t
 {
     int8_t visible, pixelType;
-    uint16_t newX, newY, x, y, w, h;
-    uint32_t colorKey, *refreshBuffer;
+    uint16_t newX, newY, x, y, w, h, drawW, drawH;
+    uint32_t colorKey, *refreshBuffer, *argb, *mask; // argb is zero where mask is (transparent pixels)
     const void *data;
 } sprite_t;
 
@@ -37,14 +45,33 @@ extern uint32_t *pixelBuffer;    // pt_main.c
 extern SDL_Window *window;       // pt_main.c
 extern SDL_Renderer *renderer;   // pt_main.c
 extern SDL_Texture *texture;     // pt_main.c
-extern uint8_t vsync60HzPresent; // pt_main.c
+extern uint8_t vsyncPresent;     // pt_main.c
 extern uint8_t fullscreen;       // pt_main.c
 sprite_t sprites[SPRITE_NUM];
+static uint32_t spritePalette[PALETTE_NUM]; // palette the sprite images were converted with
+
+static void convertSprites(void);
 
 // sprite background refresh buffers
 static uint32_t vuMetersBg[4 * (10 * 48)];
+static int8_t vuMetersDrawn; // vuMetersBg holds what the last drawn meters covered
 // -------------------------
 
+// what the visualizer area shows, so that unchanged parts aren't redrawn (see updateVisualizer())
+static int8_t visualizerShown, visualizerBgDrawn, lastVisualizerMode = -1;
+static int8_t drawnSpectrumVolumes[SPECTRUM_BAR_NUM];
+static uint32_t visualizerPalette[PALETTE_NUM];
+
+// what the texture currently holds, to find the regions that changed since the last upload
+#define DIRTY_BAND_H 8
+#define DIRTY_MAX_RECTS (((SCREEN_H + DIRTY_BAND_H) - 1) / DIRTY_BAND_H)
+static uint32_t uploadedFrame[SCREEN_W * SCREEN_H];
+static int8_t frameInvalid = true;
+
+// software scaler state, see presentSoftware()
+static int32_t swScale, swOffsetX, swOffsetY, swSurfaceW, swSurfaceH;
+static SDL_Surface *swWindowSurface, *swScaleSurface;
+
 int8_t intMusic(void);                     // pt_modplayer.c
 extern int32_t samplesPerTick;             // pt_audio.c
 void storeTempVariables(void);             // pt_modplayer.c
@@ -55,22 +82,47 @@ void updateSampler(void);
 void updatePatternData(void);
 void updateMOD2WAVDialog(void);
 
+// the parts of a frame that aren't drawing, these also run while the window is minimized
+void updateBackgroundTasks(void)
+{
+    updateMOD2WAVDialog(); // must be before renderFrame() to avoid flickering issues
+    updateModSave();
+    terminalFlushMessages(); // prints what other threads queued up
+}
+
 void renderFrame(void)
 {
-    updateMOD2WAVDialog(); // must be first to avoid flickering issues
+    // benchLap() calls are for the offscreen benchmark (pt_bench.c), they return right away otherwise
 
     updateSongInfo1(); // top left side of screen, when "disk op"/"pos ed" is hidden
     updateSongInfo2(); // two middle rows of screen, always visible
+    benchLap(BENCH_SONG_INFO);
+
     updateEditOp();
+    benchLap(BENCH_OTHER);
+
     updatePatternData();
+    benchLap(BENCH_PATTERN);
+
     updateDiskOp();
+    benchLap(BENCH_DISK_OP);
+
     updateSampler();
+    benchLap(BENCH_SAMPLER);
+
     updatePosEd();
+    benchLap(BENCH_OTHER);
+
     updateVisualizer();
+    benchLap(BENCH_SCOPES);
+
     updateDragBars();
+    benchLap(BENCH_OTHER);
 
     if (editor.ui.terminalShown) // FIXME: needs optimizations... (copy framebuffer to a temp buffer and restore?)
         terminalRender(pixelBuffer);
+
+    benchLap(BENCH_TERMINAL);
 }
 
 void removeAskDialog(void)
@@ -111,6 +163,11 @@ void fillFromVuMetersBgBuffer(void)
     const uint32_t *ptr32Src;
     uint32_t *ptr32Dst;
 
+    if (!vuMetersDrawn)
+        return; // nothing was drawn over the background last frame
+
+    vuMetersDrawn = false;
+
     if (!editor.ui.samplerScreenShown && !editor.ui.terminalShown)
     {
         for (i = 0; i < AMIGA_VOICES; ++i)
@@ -177,17 +234,14 @@ void renderVuMeters(void)
 {
     const uint32_t *ptr32Src;
     uint32_t *ptr32Dst;
-    uint8_t i, y;
-
-    fillToVuMetersBgBuffer();
+    uint8_t i, y, heights[AMIGA_VOICES];
+    int8_t anyShown;
 
     if (!editor.ui.samplerScreenShown && !editor.ui.terminalShown && !editor.isWAVRendering && !editor.isSMPRendering)
     {
+        anyShown = false;
         for (i = 0; i < AMIGA_VOICES; ++i)
         {
-            ptr32Src = vuMeterBMP;
-            ptr32Dst = pixelBuffer + ((187 * SCREEN_W) + (55 + (i * 72)));
-
             if (editor.ui.realVuMeters)
             {
                 y = (uint8_t)(editor.realVuMeterVolumes[i] + 0.5f);
@@ -198,6 +252,24 @@ void renderVuMeters(void)
                 y = editor.vuMeterVolumes[i];
             }
 
+            heights[i] = y;
+            if (y > 0)
+                anyShown = true;
+        }
+
+        // silent meters draw nothing, so there is no background to save/restore either
+        if (!anyShown)
+            return;
+
+        fillToVuMetersBgBuffer();
+        vuMetersDrawn = true;
+
+        for (i = 0; i < AMIGA_VOICES; ++i)
+        {
+            ptr32Src = vuMeterBMP;
+            ptr32Dst = pixelBuffer + ((187 * SCREEN_W) + (55 + (i * 72)));
+
+            y = heights[i];
             while (y--)
             {
                 *(ptr32Dst + 0) = *(ptr32Src + 0);
@@ -1109,6 +1181,7 @@ void updateDragBars(void)
 
 void updateVisualizer(void)
 {
+    int8_t fullRedraw;
     uint8_t i, y;
     int32_t tmpVol;
     const uint32_t *ptr32Src;
@@ -1119,15 +1192,35 @@ void updateVisualizer(void)
         !editor.ui.disableVisualizer && !editor.ui.askScreenShown   &&
         !editor.isWAVRendering       && !editor.ui.terminalShown)
     {
+        // only redraw what changed, unless the area was covered, cleared or recolored since the last frame
+        fullRedraw = !visualizerShown || visualizerBgDrawn || (lastVisualizerMode != editor.ui.visualizerMode) ||
+                     (memcmp(visualizerPalette, palette, sizeof (visualizerPalette)) != 0);
+
+        if (fullRedraw)
+        {
+            memcpy(visualizerPalette, palette, sizeof (visualizerPalette));
+
+            visualizerShown    = true;
+            visualizerBgDrawn  = false;
+            lastVisualizerMode = editor.ui.visualizerMode;
+        }
+
         if (editor.ui.visualizerMode == VISUAL_SPECTRUM)
         {
             // spectrum analyzer
+            updateSpectrumAnalyzer();
+
             for (i = 0; i < SPECTRUM_BAR_NUM; ++i)
             {
+                tmpVol = editor.spectrumVolumes[i];
+                if (!fullRedraw && (tmpVol == drawnSpectrumVolumes[i]))
+                    continue;
+
+                drawnSpectrumVolumes[i] = (int8_t)(tmpVol);
+
                 ptr32Src = spectrumAnaBMP + (SPECTRUM_BAR_HEIGHT - 1);
                 ptr32Dst = pixelBuffer    + ((59 * SCREEN_W) + (129 + (i * (SPECTRUM_BAR_WIDTH + 2))));
                 pixel    = palette[PAL_GENBKG];
-                tmpVol   = editor.spectrumVolumes[i];
 
                 y = SPECTRUM_BAR_HEIGHT;
                 while (y--)
@@ -1149,9 +1242,13 @@ void updateVisualizer(void)
         }
         else
         {
-            drawScopes();
+            drawScopes(fullRedraw);
         }
     }
+    else
+    {
+        visualizerShown = false;
+    }
 }
 
 void renderQuadrascopeBg(void)
@@ -1160,6 +1257,8 @@ void renderQuadrascopeBg(void)
     const uint32_t *ptr32Src;
     uint32_t *ptr32Dst;
 
+    visualizerBgDrawn = true;
+
     ptr32Src = trackerFrameBMP  + (44 * SCREEN_W) + 120;
     ptr32Dst = pixelBuffer      + (44 * SCREEN_W) + 120;
 
@@ -1183,6 +1282,8 @@ void renderSpectrumAnalyzerBg(void)
     const uint32_t *ptr32Src;
     uint32_t *ptr32Dst;
 
+    visualizerBgDrawn = true;
+
     ptr32Src = spectrumVisualsBMP;
     ptr32Dst = pixelBuffer + (44 * SCREEN_W) + 120;
 
@@ -1206,6 +1307,8 @@ void renderMonoscopeBg(void)
     const uint32_t *ptr32Src;
     uint32_t *ptr32Dst;
 
+    visualizerBgDrawn = true;
+
     ptr32Src = monoScopeBMP;
     ptr32Dst = pixelBuffer + (44 * SCREEN_W) + 120;
 
@@ -1411,6 +1514,35 @@ void renderMOD2WAVDialog(void)
     }
 }
 
+static float levelToDb(float level)
+{
+    return ((level > 0.00001f) ? (20.0f * log10f(level)) : -100.0f);
+}
+
+static void printMod2WavLevels(void)
+{
+    uint8_t i;
+    audioMeters_t meters;
+
+    // the audio thread can keep us out for a moment, give it a few ms before giving up
+    for (i = 0; i < 10; ++i)
+    {
+        if (meterRead(&meters))
+            break;
+
+        SDL_Delay(1);
+    }
+
+    if (i == 10)
+    {
+        terminalPrintf("Peak levels not available (meters busy)\n");
+        return;
+    }
+
+    terminalPrintf("Peak: %.1fdBFS, true peak: %.1fdBFS, clipped sample points: %u\n",
+        levelToDb(meters.maxPeak), levelToDb(meters.maxTruePeak), meters.clipCount);
+}
+
 void updateMOD2WAVDialog(void)
 {
     uint8_t x, y, barLength, percent;
@@ -1444,6 +1576,8 @@ void updateMOD2WAVDialog(void)
                         terminalPrintf("Module \"untitled\" rendered to WAV\n");
                     else
                         terminalPrintf("Module \"%s\" rendered to WAV\n", modEntry->head.moduleTitle);
+
+                    printMod2WavLevels();
                 }
 
                 editor.isWAVRendering = false;
@@ -1662,6 +1796,8 @@ void displayMainScreen(void)
 {
     editor.blockMarkFlag = false;
 
+    invalidateTextRuns(); // the backgrounds below are restored over them
+
     editor.ui.updateSongTime     = true;
     editor.ui.updateSongName     = true;
     editor.ui.updateSongSize     = true;
@@ -1893,6 +2029,8 @@ void handleAskYes(void)
 
             s = &modEntry->samples[editor.currSample];
 
+            sampleUndoSave(editor.currSample, 0, s->length);
+
             // clear all of the old sample
             memset(&modEntry->sampleData[s->offset], 0, MAX_SAMPLE_LEN);
 
@@ -1981,17 +2119,24 @@ void handleAskYes(void)
             pointerSetPreviousMode();
             setPrevStatusMessage();
 
-            for (i = 0; i < MOD_SAMPLES; ++i)
-                boostSample(i, true);
+            sampleBatchStart(SAMPLE_BATCH_BOOST);
+        }
+        break;
 
-            if (editor.ui.samplerScreenShown)
-                redrawSample();
+        case ASK_FILTER_ALL_SAMPLES: // for insane minds
+        {
+            editor.errorMsgActive  = false;
+            editor.errorMsgBlock   = false;
+            editor.errorMsgCounter = 0;
 
-            updateWindowTitle(MOD_IS_MODIFIED);
+            pointerSetPreviousMode();
+            setPrevStatusMessage();
+
+            sampleBatchStart(SAMPLE_BATCH_FILTER);
         }
         break;
 
-        case ASK_FILTER_ALL_SAMPLES: // for insane minds
+        case ASK_NORMALIZE_ALL_SAMPLES:
         {
             editor.errorMsgActive  = false;
             editor.errorMsgBlock   = false;
@@ -2000,13 +2145,33 @@ void handleAskYes(void)
             pointerSetPreviousMode();
             setPrevStatusMessage();
 
-            for (i = 0; i < MOD_SAMPLES; ++i)
-                filterSample(i, true);
+            sampleBatchStart(SAMPLE_BATCH_NORMALIZE);
+        }
+        break;
+
+        case ASK_DC_ALL_SAMPLES:
+        {
+            editor.errorMsgActive  = false;
+            editor.errorMsgBlock   = false;
+            editor.errorMsgCounter = 0;
 
-            if (editor.ui.samplerScreenShown)
-                redrawSample();
+            pointerSetPreviousMode();
+            setPrevStatusMessage();
 
-            updateWindowTitle(MOD_IS_MODIFIED);
+            sampleBatchStart(SAMPLE_BATCH_DC_REMOVE);
+        }
+        break;
+
+        case ASK_RESAMPLE_ALL_SAMPLES:
+        {
+            editor.errorMsgActive  = false;
+            editor.errorMsgBlock   = false;
+            editor.errorMsgCounter = 0;
+
+            pointerSetPreviousMode();
+            setPrevStatusMessage();
+
+            sampleBatchStart(SAMPLE_BATCH_RESAMPLE);
         }
         break;
 
@@ -2036,6 +2201,8 @@ void handleAskYes(void)
 
             turnOffVoices();
 
+            sampleUndoSave(editor.currSample, 0, s->length);
+
             memcpy(tmpSmpBuffer, &modEntry->sampleData[s->offset], s->length);
             memset(&modEntry->sampleData[s->offset], 0, MAX_SAMPLE_LEN);
 
@@ -2096,6 +2263,8 @@ void handleAskYes(void)
 
             turnOffVoices();
 
+            sampleUndoSave(editor.currSample, 0, s->length);
+
             memcpy(tmpSmpBuffer, &modEntry->sampleData[s->offset], s->length);
             memset(&modEntry->sampleData[s->offset], 0, MAX_SAMPLE_LEN);
 
@@ -2138,6 +2307,8 @@ void handleAskYes(void)
 
             turnOffVoices();
 
+            sampleUndoSave(editor.currSample, 0, modEntry->samples[editor.currSample].length);
+
             modEntry->samples[editor.currSample].fineTune   = 0;
             modEntry->samples[editor.currSample].volume     = 0;
             modEntry->samples[editor.currSample].length     = 0;
@@ -2583,8 +2754,15 @@ int8_t unpackBMPs(void)
 
 void videoClose(void)
 {
-    SDL_DestroyTexture(texture);
-    SDL_DestroyRenderer(renderer);
+    if (renderer != NULL)
+    {
+        SDL_DestroyTexture(texture);
+        SDL_DestroyRenderer(renderer);
+    }
+
+    if ((swScaleSurface != NULL) && (swScaleSurface != swWindowSurface))
+        SDL_FreeSurface(swScaleSurface); // the window surface goes with the window
+
     SDL_DestroyWindow(window);
 
     free(pixelBuffer);
@@ -2641,9 +2819,15 @@ void setupSprites(void)
     sprites[SPRITE_SAMPLING_POS_LINE].y = SCREEN_H; // initial state (hidden)
     hideSprite(SPRITE_SAMPLING_POS_LINE);
 
-    // setup refresh buffer (used to clear sprites after each frame)
+    // setup refresh buffer (used to clear sprites after each frame) and the converted images
     for (i = 0; i < SPRITE_NUM; ++i)
+    {
         sprites[i].refreshBuffer = (uint32_t *)(malloc(sprites[i].w * sprites[i].h * sizeof (int32_t)));
+        sprites[i].argb          = (uint32_t *)(malloc(sprites[i].w * sprites[i].h * sizeof (int32_t)));
+        sprites[i].mask          = (uint32_t *)(malloc(sprites[i].w * sprites[i].h * sizeof (int32_t)));
+    }
+
+    convertSprites();
 }
 
 void freeSprites(void)
@@ -2651,7 +2835,11 @@ void freeSprites(void)
     uint8_t i;
 
     for (i = 0; i < SPRITE_NUM; ++i)
+    {
         free(sprites[i].refreshBuffer);
+        free(sprites[i].argb);
+        free(sprites[i].mask);
+    }
 }
 
 void setSpritePos(uint8_t sprite, uint16_t x, uint16_t y)
@@ -2669,200 +2857,486 @@ void hideSprite(uint8_t sprite)
 void eraseSprites(void)
 {
     int8_t i;
-    uint16_t x, y, sx, sy, sw, sh, dstAdd;
+    uint16_t y;
     const uint32_t *src32;
     uint32_t *dst32;
+    sprite_t *s;
 
     for (i = (SPRITE_NUM - 1); i >= 0; --i) // reverse order, or else it will mess up
     {
-        if ((sprites[i].y >= SCREEN_H) || (sprites[i].x >= SCREEN_W)) continue;
+        s = &sprites[i];
+        if (!s->visible)
+            continue;
 
-        sw = sprites[i].w;
-        sh = sprites[i].h;
-        sx = sprites[i].x;
-        sy = sprites[i].y;
+        src32 = s->refreshBuffer;
+        dst32 = pixelBuffer + ((s->y * SCREEN_W) + s->x);
 
-        src32  = sprites[i].refreshBuffer;
-        if (src32 == NULL)
-            return;
+        for (y = 0; y < s->drawH; ++y)
+        {
+            memcpy(dst32, src32, s->drawW * sizeof (int32_t));
 
-        dst32  = pixelBuffer + ((sy * SCREEN_W) + sx);
-        dstAdd = SCREEN_W - sw;
+            src32 += s->drawW;
+            dst32 += SCREEN_W;
+        }
 
-        for (y = 0; y < sh; ++y)
-        {
-            if ((y + sy) >= SCREEN_H) break;
+        s->visible = false;
+    }
 
-            for (x = 0; x < sw; ++x)
-            {
-                if ((x + sx) >= SCREEN_W)
-                {
-                    x = sw - x;
-                    dst32 += x;
-                    src32 += x;
-                    break;
-                }
+    fillFromVuMetersBgBuffer(); // works differently, but let's put it here
+}
+
+// converts the sprite images to ARGB + mask, palette sprites are redone when the palette changes (pointer colors)
+static void convertSprites(void)
+{
+    uint8_t i;
+    int32_t j, numPixels;
+    uint32_t color;
+    int8_t opaque;
+    const uint8_t *src8;
+    const uint32_t *src32;
+    sprite_t *s;
 
-                *dst32++ = *src32++;
+    for (i = 0; i < SPRITE_NUM; ++i)
+    {
+        s = &sprites[i];
+        if ((s->data == NULL) || (s->argb == NULL) || (s->mask == NULL))
+            continue;
+
+        src8  = (const uint8_t *)(s->data);
+        src32 = (const uint32_t *)(s->data);
+
+        numPixels = s->w * s->h;
+        for (j = 0; j < numPixels; ++j)
+        {
+            if (s->pixelType == SPRITE_TYPE_RGB)
+            {
+                color  = src32[j];
+                opaque = (color != s->colorKey);
+            }
+            else
+            {
+                opaque = (src8[j] != s->colorKey) && (src8[j] < PALETTE_NUM);
+                color  = opaque ? palette[src8[j]] : 0;
             }
 
-            dst32 += dstAdd;
+            s->argb[j] = opaque ? color : 0;
+            s->mask[j] = opaque ? 0 : 0xFFFFFFFF;
         }
     }
 
-    fillFromVuMetersBgBuffer(); // works differently, but let's put it here
+    memcpy(spritePalette, palette, sizeof (spritePalette));
+}
+
+// dst = (dst & mask) | argb
+static void blitMaskedRow(uint32_t *dst, const uint32_t *argb, const uint32_t *mask, int32_t numPixels)
+{
+    int32_t x;
+
+    x = 0;
+
+#ifdef PT_USE_SSE2
+    for (; x + 4 <= numPixels; x += 4)
+    {
+        __m128i d, m, a;
+
+        d = _mm_loadu_si128((const __m128i *)(&dst[x]));
+        m = _mm_loadu_si128((const __m128i *)(&mask[x]));
+        a = _mm_loadu_si128((const __m128i *)(&argb[x]));
+
+        _mm_storeu_si128((__m128i *)(&dst[x]), _mm_or_si128(_mm_and_si128(d, m), a));
+    }
+#endif
+
+    for (; x < numPixels; ++x)
+        dst[x] = (dst[x] & mask[x]) | argb[x];
 }
 
 void renderSprites(void)
 {
     uint8_t i;
-    const uint8_t *src8;
-    uint16_t x, y, sx, sy, sw, sh, pitch;
-    const uint32_t *src32;
-    uint32_t *dst32, *clr32, colorKey;
+    uint16_t y;
+    const uint32_t *argb, *mask;
+    uint32_t *dst32, *clr32;
+    sprite_t *s;
 
     renderVuMeters(); // works differently, but let's put it here
 
+    if (memcmp(spritePalette, palette, sizeof (spritePalette)) != 0)
+        convertSprites();
+
     for (i = 0; i < SPRITE_NUM; ++i)
     {
-        sprites[i].x = sprites[i].newX;
-        sprites[i].y = sprites[i].newY;
-        if ((sprites[i].y >= SCREEN_H) || (sprites[i].x >= SCREEN_W)) continue;
+        s = &sprites[i];
 
-        sw = sprites[i].w;
-        sh = sprites[i].h;
-        sx = sprites[i].x;
-        sy = sprites[i].y;
+        s->x = s->newX;
+        s->y = s->newY;
+        if ((s->y >= SCREEN_H) || (s->x >= SCREEN_W) || (s->refreshBuffer == NULL) || (s->argb == NULL) || (s->mask == NULL))
+            continue;
 
-        dst32 = pixelBuffer + ((sy * SCREEN_W) + sx);
-        clr32 = sprites[i].refreshBuffer;
-        if (clr32 == NULL)
-            return;
+        // clip once
+        s->drawW = MIN(s->w, SCREEN_W - s->x);
+        s->drawH = MIN(s->h, SCREEN_H - s->y);
+        s->visible = true;
 
-        pitch = SCREEN_W - sw;
+        dst32 = pixelBuffer + ((s->y * SCREEN_W) + s->x);
+        clr32 = s->refreshBuffer;
+        argb  = s->argb;
+        mask  = s->mask;
 
-        colorKey = sprites[i].colorKey;
-        if (sprites[i].pixelType == SPRITE_TYPE_RGB)
+        for (y = 0; y < s->drawH; ++y)
         {
-            src32 = (uint32_t *)(sprites[i].data);
-            if (src32 == NULL)
-                return;
+            memcpy(clr32, dst32, s->drawW * sizeof (int32_t)); // fill refresh buffer
+            blitMaskedRow(dst32, argb, mask, s->drawW);
 
-            for (y = 0; y < sh; ++y)
-            {
-                if ((y + sy) >= SCREEN_H) break;
+            clr32 += s->drawW;
+            dst32 += SCREEN_W;
+            argb  += s->w;
+            mask  += s->w;
+        }
+    }
+}
 
-                for (x = 0; x < sw; ++x)
-                {
-                    if ((x + sx) >= SCREEN_W)
-                    {
-                        x = sw - x;
-                        clr32 += x;
-                        dst32 += x;
-                        src32 += x;
-                        break;
-                    }
+// the texture (or the window) lost its contents, upload and present everything next frame
+void invalidateFrame(void)
+{
+    frameInvalid = true;
+}
 
-                    *clr32++ = *dst32; // fill refresh buffer
-                    if (*src32 != colorKey)
-                        *dst32  = *src32;
+/* Compares the frame against the last uploaded one in bands of DIRTY_BAND_H
+** lines. Only the changed span of each band is uploaded, and vertically
+** adjacent bands are merged into one rectangle. This is done here rather than
+** in the hundreds of routines that draw into pixelBuffer. Returns the number
+** of rectangles put in rects (up to DIRTY_MAX_RECTS), 0 if nothing changed.
+*/
+static int32_t findDirtyRegions(SDL_Rect *rects)
+{
+    int32_t band, y, y2, x1, x2, left, right, numRects;
+    const uint32_t *src32;
+    uint32_t *dst32;
+    SDL_Rect *r;
 
-                    dst32++;
-                    src32++;
-                }
+    if (frameInvalid)
+    {
+        frameInvalid = false;
 
-                dst32 += pitch;
-            }
+        memcpy(uploadedFrame, pixelBuffer, sizeof (uploadedFrame));
+
+        rects[0].x = 0;
+        rects[0].y = 0;
+        rects[0].w = SCREEN_W;
+        rects[0].h = SCREEN_H;
+
+        return (1);
+    }
+
+    numRects = 0;
+    for (band = 0; band < SCREEN_H; band += DIRTY_BAND_H)
+    {
+        y2 = MIN(band + DIRTY_BAND_H, SCREEN_H);
+        x1 = SCREEN_W;
+        x2 = -1;
+
+        for (y = band; y < y2; ++y)
+        {
+            src32 = pixelBuffer    + (y * SCREEN_W);
+            dst32 = uploadedFrame + (y * SCREEN_W);
+
+            if (memcmp(src32, dst32, SCREEN_W * sizeof (int32_t)) == 0)
+                continue;
+
+            for (left = 0; src32[left] == dst32[left]; ++left);
+            for (right = SCREEN_W - 1; src32[right] == dst32[right]; --right);
+
+            x1 = MIN(x1, left);
+            x2 = MAX(x2, right);
+        }
+
+        if (x2 < x1)
+            continue;
+
+        for (y = band; y < y2; ++y)
+            memcpy(&uploadedFrame[(y * SCREEN_W) + x1], &pixelBuffer[(y * SCREEN_W) + x1], ((x2 - x1) + 1) * sizeof (int32_t));
+
+        r = (numRects > 0) ? &rects[numRects - 1] : NULL;
+        if ((r != NULL) && ((r->y + r->h) == band))
+        {
+            // continues the previous band, grow it
+            x2   = MAX(x2, (r->x + r->w) - 1);
+            x1   = MIN(x1, r->x);
+            r->x = x1;
+            r->w = (x2 - x1) + 1;
+            r->h = y2 - r->y;
         }
         else
         {
-            src8 = (uint8_t *)(sprites[i].data);
-            if (src8 == NULL)
-                return;
+            r = &rects[numRects++];
+            r->x = x1;
+            r->y = band;
+            r->w = (x2 - x1) + 1;
+            r->h = y2 - band;
+        }
+    }
+
+    return (numRects);
+}
+
+/* Built-in software scaler, for machines without an accelerated SDL renderer
+** (renderer is NULL then). Changed regions are scaled with integer nearest
+** neighbour straight into the window surface, centered, and only those
+** rectangles are sent to the window.
+*/
 
-            for (y = 0; y < sh; ++y)
+#ifdef PT_USE_SSE2
+#define SHUFFLE_PIXELS(v, a, b, c, d) _mm_shuffle_epi32(v, _MM_SHUFFLE(d, c, b, a))
+#endif
+
+static void scaleLine(uint32_t *dst, const uint32_t *src, int32_t width, int32_t scale)
+{
+    int32_t x, i;
+    uint32_t pixel;
+
+    x = 0;
+
+#ifdef PT_USE_SSE2
+    if ((scale >= 2) && (scale <= 6))
+    {
+        __m128i v;
+
+        // four source pixels make 'scale' output vectors
+        for (; x <= (width - 4); x += 4)
+        {
+            v = _mm_loadu_si128((const __m128i *)(&src[x]));
+
+            switch (scale)
             {
-                if ((y + sy) >= SCREEN_H) break;
+                case 2:
+                {
+                    _mm_storeu_si128((__m128i *)(dst + 0), _mm_unpacklo_epi32(v, v));
+                    _mm_storeu_si128((__m128i *)(dst + 4), _mm_unpackhi_epi32(v, v));
+                }
+                break;
 
-                for (x = 0; x < sw; ++x)
+                case 3:
                 {
-                    if ((x + sx) >= SCREEN_W)
-                    {
-                        x = sw - x;
-                        clr32 += x;
-                        dst32 += x;
-                        src8  += x;
-                        break;
-                    }
+                    _mm_storeu_si128((__m128i *)(dst + 0), SHUFFLE_PIXELS(v, 0, 0, 0, 1));
+                    _mm_storeu_si128((__m128i *)(dst + 4), SHUFFLE_PIXELS(v, 1, 1, 2, 2));
+                    _mm_storeu_si128((__m128i *)(dst + 8), SHUFFLE_PIXELS(v, 2, 3, 3, 3));
+                }
+                break;
 
-                    *clr32++ = *dst32; // fill refresh buffer
-                    if (*src8 != colorKey)
-                    {
-                        if (*src8 < PALETTE_NUM)
-                            *dst32 = palette[*src8];
-                    }
+                case 4:
+                {
+                    _mm_storeu_si128((__m128i *)(dst +  0), SHUFFLE_PIXELS(v, 0, 0, 0, 0));
+                    _mm_storeu_si128((__m128i *)(dst +  4), SHUFFLE_PIXELS(v, 1, 1, 1, 1));
+                    _mm_storeu_si128((__m128i *)(dst +  8), SHUFFLE_PIXELS(v, 2, 2, 2, 2));
+                    _mm_storeu_si128((__m128i *)(dst + 12), SHUFFLE_PIXELS(v, 3, 3, 3, 3));
+                }
+                break;
 
-                    dst32++;
-                    src8++;
+                case 5:
+                {
+                    _mm_storeu_si128((__m128i *)(dst +  0), SHUFFLE_PIXELS(v, 0, 0, 0, 0));
+                    _mm_storeu_si128((__m128i *)(dst +  4), SHUFFLE_PIXELS(v, 0, 1, 1, 1));
+                    _mm_storeu_si128((__m128i *)(dst +  8), SHUFFLE_PIXELS(v, 1, 1, 2, 2));
+                    _mm_storeu_si128((__m128i *)(dst + 12), SHUFFLE_PIXELS(v, 2, 2, 2, 3));
+                    _mm_storeu_si128((__m128i *)(dst + 16), SHUFFLE_PIXELS(v, 3, 3, 3, 3));
                 }
+                break;
 
-                dst32 += pitch;
+                default: // 6
+                {
+                    _mm_storeu_si128((__m128i *)(dst +  0), SHUFFLE_PIXELS(v, 0, 0, 0, 0));
+                    _mm_storeu_si128((__m128i *)(dst +  4), SHUFFLE_PIXELS(v, 0, 0, 1, 1));
+                    _mm_storeu_si128((__m128i *)(dst +  8), SHUFFLE_PIXELS(v, 1, 1, 1, 1));
+                    _mm_storeu_si128((__m128i *)(dst + 12), SHUFFLE_PIXELS(v, 2, 2, 2, 2));
+                    _mm_storeu_si128((__m128i *)(dst + 16), SHUFFLE_PIXELS(v, 2, 2, 3, 3));
+                    _mm_storeu_si128((__m128i *)(dst + 20), SHUFFLE_PIXELS(v, 3, 3, 3, 3));
+                }
+                break;
             }
+
+            dst += (scale * 4);
         }
     }
+#endif
+
+    for (; x < width; ++x)
+    {
+        pixel = src[x];
+        for (i = 0; i < scale; ++i)
+            *dst++ = pixel;
+    }
 }
 
-void flipFrame(void)
+static void scaleRect(const SDL_Rect *r)
 {
-    renderSprites();
+    int32_t y, i, lineBytes;
+    uint8_t *dst;
 
-    SDL_UpdateTexture(texture, NULL, pixelBuffer, SCREEN_W * sizeof (int32_t));
+    lineBytes = (r->w * swScale) * sizeof (int32_t);
+    dst = (uint8_t *)(swScaleSurface->pixels) + (((swOffsetY + (r->y * swScale)) * swScaleSurface->pitch)
+        + ((swOffsetX + (r->x * swScale)) * sizeof (int32_t)));
 
-    SDL_RenderClear(renderer);
-    SDL_RenderCopy(renderer, texture, NULL, NULL);
-    SDL_RenderPresent(renderer);
+    for (y = r->y; y < (r->y + r->h); ++y)
+    {
+        scaleLine((uint32_t *)(dst), &pixelBuffer[(y * SCREEN_W) + r->x], r->w, swScale);
 
-    eraseSprites();
+        // the other lines of this pixel row are copies
+        for (i = 1; i < swScale; ++i)
+            memcpy(dst + (i * swScaleSurface->pitch), dst, lineBytes);
+
+        dst += (swScale * swScaleSurface->pitch);
+    }
+}
+
+// gets the window surface and redoes the layout if it changed. Returns false if there's nothing to draw to
+static int8_t updateSoftwareLayout(int8_t *layoutChanged)
+{
+    SDL_Surface *surface;
+
+    *layoutChanged = false;
+
+    surface = SDL_GetWindowSurface(window);
+    if ((surface == NULL) || (surface->w < SCREEN_W) || (surface->h < SCREEN_H))
+        return (false);
+
+    if ((surface == swWindowSurface) && (surface->w == swSurfaceW) && (surface->h == swSurfaceH))
+        return (true);
+
+    if ((swScaleSurface != NULL) && (swScaleSurface != swWindowSurface))
+        SDL_FreeSurface(swScaleSurface);
+
+    swWindowSurface = surface;
+    swSurfaceW = surface->w;
+    swSurfaceH = surface->h;
+
+    // scale straight into the window if it's 32-bit XRGB, through a surface of our own (and a blit) if not
+    if ((surface->format->format == SDL_PIXELFORMAT_ARGB8888) || (surface->format->format == SDL_PIXELFORMAT_RGB888))
+    {
+        swScaleSurface = surface;
+    }
+    else
+    {
+        swScaleSurface = SDL_CreateRGBSurface(0, surface->w, surface->h, 32, 0x00FF0000, 0x0000FF00, 0x000000FF, 0);
+        if (swScaleSurface == NULL)
+        {
+            swWindowSurface = NULL;
+            return (false);
+        }
+    }
+
+    swScale   = MIN(surface->w / SCREEN_W, surface->h / SCREEN_H);
+    swOffsetX = (surface->w - (SCREEN_W * swScale)) / 2;
+    swOffsetY = (surface->h - (SCREEN_H * swScale)) / 2;
+
+    SDL_FillRect(surface, NULL, 0);
+    updateMouseScaling();
+
+    *layoutChanged = true;
+    return (true);
 }
 
-void updateSpectrumAnalyzer(uint8_t ch, int8_t vol, int16_t period)
+static void presentSoftware(SDL_Rect *rects, int32_t numRects)
 {
-    int16_t scaledVol, scaledNote;
+    int8_t layoutChanged;
+    int32_t i;
+    SDL_Rect dstRect;
+
+    if (!updateSoftwareLayout(&layoutChanged))
+        return;
 
-    if ((editor.ui.visualizerMode == VISUAL_SPECTRUM) && !editor.muted[ch] && (vol > 0))
+    if (layoutChanged)
     {
-        scaledVol  = (vol * 256) / 682;                 //   682 = (64 * 256) / 24    (64 = max sample vol)
-        scaledNote = 743 - (period - 113);              //   743 = 856 - 113          (856 = C-1 period, 113 = B-3 period)
-        scaledNote = (scaledNote * scaledNote) / 25093; // 25093 = (743 * 743) / 22   (22 = num of spectrum bars-1)
+        // everything, including the black border
+        rects[0].x = 0;
+        rects[0].y = 0;
+        rects[0].w = SCREEN_W;
+        rects[0].h = SCREEN_H;
 
-        // scaledNote now ranges 0..22, no need to clamp
+        numRects = 1;
+    }
+
+    if (SDL_MUSTLOCK(swScaleSurface))
+        SDL_LockSurface(swScaleSurface);
+
+    for (i = 0; i < numRects; ++i)
+        scaleRect(&rects[i]);
 
-        // increment main spectrum bar
-        editor.spectrumVolumes[scaledNote] += scaledVol;
-        if (editor.spectrumVolumes[scaledNote] > SPECTRUM_BAR_HEIGHT)
-            editor.spectrumVolumes[scaledNote] = SPECTRUM_BAR_HEIGHT;
+    if (SDL_MUSTLOCK(swScaleSurface))
+        SDL_UnlockSurface(swScaleSurface);
+
+    // from here on the rectangles are in window coordinates
+    for (i = 0; i < numRects; ++i)
+    {
+        rects[i].x = swOffsetX + (rects[i].x * swScale);
+        rects[i].y = swOffsetY + (rects[i].y * swScale);
+        rects[i].w *= swScale;
+        rects[i].h *= swScale;
 
-        // increment left side of spectrum bar with half volume
-        if (scaledNote > 0)
+        if (swScaleSurface != swWindowSurface)
         {
-            editor.spectrumVolumes[scaledNote - 1] += (scaledVol / 2);
-            if (editor.spectrumVolumes[scaledNote - 1] > SPECTRUM_BAR_HEIGHT)
-                editor.spectrumVolumes[scaledNote - 1] = SPECTRUM_BAR_HEIGHT;
+            dstRect = rects[i];
+            SDL_BlitSurface(swScaleSurface, &rects[i], swWindowSurface, &dstRect);
         }
+    }
+
+    if (layoutChanged)
+        SDL_UpdateWindowSurface(window);
+    else
+        SDL_UpdateWindowSurfaceRects(window, rects, numRects);
+}
 
-        // increment right side of spectrum bar with half volume
-        if (scaledNote < (SPECTRUM_BAR_NUM - 1))
+// the last frame flipFrame() put out, sprites included
+const uint32_t *getPresentedFrame(void)
+{
+    return (uploadedFrame);
+}
+
+void getSoftwareVideoLayout(int32_t *scale, int32_t *offsetX, int32_t *offsetY)
+{
+    *scale   = (swScale > 0) ? swScale : 1;
+    *offsetX = swOffsetX;
+    *offsetY = swOffsetY;
+}
+
+void flipFrame(void)
+{
+    int32_t i, numRects;
+    uint64_t time64;
+    SDL_Rect rects[DIRTY_MAX_RECTS];
+
+    renderSprites();
+
+    // nothing changed, the window already shows this frame (frame pacing is done by pacerWait())
+    numRects = findDirtyRegions(rects);
+    if (numRects > 0)
+    {
+        if (renderer == NULL)
         {
-            editor.spectrumVolumes[scaledNote + 1] += (scaledVol / 2);
-            if (editor.spectrumVolumes[scaledNote + 1] > SPECTRUM_BAR_HEIGHT)
-                editor.spectrumVolumes[scaledNote + 1] = SPECTRUM_BAR_HEIGHT;
+            if (window != NULL) // no window in the offscreen benchmark
+                presentSoftware(rects, numRects);
+        }
+        else
+        {
+            for (i = 0; i < numRects; ++i)
+                SDL_UpdateTexture(texture, &rects[i], &pixelBuffer[(rects[i].y * SCREEN_W) + rects[i].x], SCREEN_W * sizeof (int32_t));
+
+            SDL_RenderClear(renderer);
+            SDL_RenderCopy(renderer, texture, NULL, NULL);
+
+            time64 = SDL_GetPerformanceCounter();
+            SDL_RenderPresent(renderer);
+            pacerPresentDone(SDL_GetPerformanceCounter() - time64); // tells if vsync paces the frames
         }
     }
+
+    eraseSprites();
 }
 
 void sinkVisualizerBars(void)
 {
     uint8_t i;
+    audioMeters_t meters;
 
     // decrease VU-Meters
     if (editor.ui.realVuMeters)
@@ -2873,6 +3347,16 @@ void sinkVisualizerBars(void)
             if (editor.realVuMeterVolumes[i] < 0.0f)
                 editor.realVuMeterVolumes[i] = 0.0f;
         }
+
+        // raise them to the voice peaks mixed since the last frame
+        if (!editor.isWAVRendering && meterRead(&meters))
+        {
+            for (i = 0; i < AMIGA_VOICES; ++i)
+            {
+                if ((meters.voicePeak[i] * 48.0f) > editor.realVuMeterVolumes[i])
+                    editor.realVuMeterVolumes[i] = meters.voicePeak[i] * 48.0f;
+            }
+        }
     }
     else
     {
@@ -2891,6 +3375,32 @@ void sinkVisualizerBars(void)
     }
 }
 
+// true if the screen changes without any input (playback, meters falling, busy tasks...)
+int8_t isScreenAnimating(void)
+{
+    uint8_t i;
+
+    if (editor.songPlaying || editor.isWAVRendering || editor.isSMPRendering || editor.isModSaving ||
+        editor.diskop.isFilling || editor.errorMsgActive || sampleBatchRunning() || mixerVoicesActive())
+    {
+        return (true);
+    }
+
+    for (i = 0; i < AMIGA_VOICES; ++i)
+    {
+        if ((editor.vuMeterVolumes[i] > 0) || (editor.realVuMeterVolumes[i] > 0.0f))
+            return (true);
+    }
+
+    for (i = 0; i < SPECTRUM_BAR_NUM; ++i)
+    {
+        if (editor.spectrumVolumes[i] > 0)
+            return (true);
+    }
+
+    return (false);
+}
+
 uint32_t _50HzCallBack(uint32_t interval, void *param)
 {
     if ((editor.playMode != PLAY_MODE_PATTERN) ||
@@ -2939,11 +3449,12 @@ void toggleFullscreen(void)
     SDL_WarpMouseInWindow(window, w / 2, h / 2);
 
     updateMouseScaling();
+    invalidateFrame();
 }
 
 int8_t setupVideo(void)
 {
-    int32_t screenW, screenH;
+    int32_t screenW, screenH, refreshRate;
     uint32_t rendererFlags;
     SDL_DisplayMode dm;
 #ifdef _WIN32
@@ -2969,14 +3480,16 @@ int8_t setupVideo(void)
     SDL_SetHint(SDL_HINT_MOUSE_FOCUS_CLICKTHROUGH, "1");
 #endif
 
-    vsync60HzPresent = false;
+    refreshRate = 0; // unknown
     if (SDL_GetDesktopDisplayMode(0, &dm) == 0)
+        refreshRate = (dm.refresh_rate == 59) ? 60 : dm.refresh_rate; // 59Hz is a wrong NTSC legacy value from EDID. It's 60Hz!
+
+    // any refresh rate will do, the emulation logic runs on its own 60Hz clock (see pt_pacer.c)
+    vsyncPresent = false;
+    if (ptConfig.vsync && (refreshRate > 0))
     {
-        if ((dm.refresh_rate == 59) || (dm.refresh_rate == 60)) // 59Hz is a wrong NTSC legacy value from EDID. It's 60Hz!
-        {
-            vsync60HzPresent = true;
-            rendererFlags |= SDL_RENDERER_PRESENTVSYNC;
-        }
+        vsyncPresent = true;
+        rendererFlags |= SDL_RENDERER_PRESENTVSYNC;
     }
 
     SDL_SetWindowTitle(window, "ProTracker v2.3D");
@@ -3002,47 +3515,48 @@ int8_t setupVideo(void)
     editor.ui.hWnd = wmInfo.info.win.window;
 #endif
 
-    renderer = SDL_CreateRenderer(window, -1, rendererFlags);
-    if (renderer == NULL)
+    renderer = NULL;
+    if (!ptConfig.softwareVideo)
     {
-        if (vsync60HzPresent)
+        renderer = SDL_CreateRenderer(window, -1, rendererFlags);
+        if ((renderer == NULL) && vsyncPresent)
         {
             // try again without vsync flag
-            vsync60HzPresent = false;
-
             rendererFlags &= ~SDL_RENDERER_PRESENTVSYNC;
             renderer = SDL_CreateRenderer(window, -1, rendererFlags);
         }
+    }
 
-        if (renderer == NULL)
-        {
-            showErrorMsgBox("Couldn't create SDL renderer:\n" \
-                           "%s\n\n" \
-                           "Is your GPU (+ driver) too old?", SDL_GetError());
-
-            return (false);
-        }
+    if (renderer == NULL)
+    {
+        // no accelerated renderer (or it was turned off), present with the built-in software scaler
+        vsyncPresent = false;
     }
+    else
+    {
+        if (!(rendererFlags & SDL_RENDERER_PRESENTVSYNC))
+            vsyncPresent = false;
 
-    SDL_RenderSetLogicalSize(renderer, SCREEN_W, SCREEN_H);
+        SDL_RenderSetLogicalSize(renderer, SCREEN_W, SCREEN_H);
 
 #if SDL_PATCHLEVEL >= 5
-    SDL_RenderSetIntegerScale(renderer, SDL_TRUE);
+        SDL_RenderSetIntegerScale(renderer, SDL_TRUE);
 #endif
 
-    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_NONE);
+        SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_NONE);
 
-    texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, SCREEN_W, SCREEN_H);
-    if (texture == NULL)
-    {
-        showErrorMsgBox("Couldn't create a %dx%d GPU texture:\n" \
-                        "%s\n\n" \
-                        "Is your GPU (+ driver) too old?", SCREEN_W, SCREEN_H, SDL_GetError());
+        texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, SCREEN_W, SCREEN_H);
+        if (texture == NULL)
+        {
+            showErrorMsgBox("Couldn't create a %dx%d GPU texture:\n" \
+                            "%s\n\n" \
+                            "Is your GPU (+ driver) too old?", SCREEN_W, SCREEN_H, SDL_GetError());
 
-        return (false);
-    }
+            return (false);
+        }
 
-    SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_NONE);
+        SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_NONE);
+    }
 
     // frame buffer used by SDL (for texture)
     pixelBuffer = (uint32_t *)(malloc(SCREEN_W * SCREEN_H * sizeof (int32_t)));
@@ -3052,8 +3566,31 @@ int8_t setupVideo(void)
         return (false);
     }
 
+    if (refreshRate <= 0)
+        refreshRate = VBLANK_HZ;
+
+    // without vsync, the frames are timed at FRAMERATE if set (variable refresh rate displays), else at the display's rate
+    pacerInit((!vsyncPresent && (ptConfig.frameRate > 0)) ? ptConfig.frameRate : refreshRate, vsyncPresent);
+
     SDL_ShowCursor(SDL_DISABLE);
     updateMouseScaling();
 
     return (true);
 }
+
+// offscreen benchmark: frames go to pixelBuffer only, there's no window (and no frame pacing)
+int8_t setupOffscreenVideo(void)
+{
+    vsyncPresent = false;
+
+    pixelBuffer = (uint32_t *)(malloc(SCREEN_W * SCREEN_H * sizeof (int32_t)));
+    if (pixelBuffer == NULL)
+    {
+        showErrorMsgBox("Out of memory!");
+        return (false);
+    }
+
+    updateMouseScaling();
+
+    return (true);
+}
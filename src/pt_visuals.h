@@ -8,10 +8,15 @@ void freeBMPs(void);
 void handleAskNo(void);
 void handleAskYes(void);
 int8_t setupVideo(void);
+int8_t setupOffscreenVideo(void);
+void updateBackgroundTasks(void);
 void renderFrame(void);
 void flipFrame(void);
-void updateSpectrumAnalyzer(uint8_t ch, int8_t vol, int16_t period);
+void invalidateFrame(void);
+const uint32_t *getPresentedFrame(void);
+void getSoftwareVideoLayout(int32_t *scale, int32_t *offsetX, int32_t *offsetY);
 void sinkVisualizerBars(void);
+int8_t isScreenAnimating(void);
 void updatePosEd(void);
 void updateVisualizer(void);
 void updateEditOp(void);
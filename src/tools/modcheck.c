@@ -0,0 +1,339 @@
+/* modcheck - headless .MOD loader validation tool
+**
+** Walks a directory tree and runs the module loader (modFileLoad() from
+** pt_modfile.c) on every file, spread over a pool of threads. Prints one line
+** per file (status, detected format, load time, estimated size of the loaded
+** module data), and a summary with throughput and time spent per format at the
+** end.
+**
+** Build (from the root folder): make modcheck
+** Usage: modcheck <directory> [threads]
+*/
+
+#define SDL_MAIN_HANDLED
+
+#include <SDL2/SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include "../pt_header.h"
+#include "../pt_helpers.h"
+#include "../pt_dirent.h"
+#include "../pt_unicode.h"
+#include "../pt_modfile.h"
+
+#ifdef _WIN32
+#define DIR_SEPARATOR L"\\"
+#define DIR_DOT       L"."
+#define DIR_DOTDOT    L".."
+#define UNICHAR_PRINTF_STR "%ls"
+#else
+#define DIR_SEPARATOR "/"
+#define DIR_DOT       "."
+#define DIR_DOTDOT    ".."
+#define UNICHAR_PRINTF_STR "%s"
+#endif
+
+#define MAX_THREADS 64
+#define NUM_FORMATS (FORMAT_UNKNOWN + 1)
+
+typedef struct fileResult_t
+{
+    UNICHAR *path;
+    modLoadInfo_t info;
+    uint8_t loaded;
+    uint32_t moduleSize;
+    double loadTimeMs;
+} fileResult_t;
+
+static const char *formatNames[NUM_FORMATS] =
+{
+    "M.K.", "M!K!", "FLT4", "4CHN", "STK", "N.T.", "FEST", "unknown"
+};
+
+static fileResult_t *files;
+static uint32_t numFiles, maxFiles;
+static SDL_atomic_t nextFile;
+static double perfFreqMs;
+
+static int8_t addFile(const UNICHAR *path)
+{
+    fileResult_t *newFiles;
+
+    if (numFiles == maxFiles)
+    {
+        maxFiles = (maxFiles == 0) ? 1024 : (maxFiles * 2);
+
+        newFiles = (fileResult_t *)(realloc(files, maxFiles * sizeof (fileResult_t)));
+        if (newFiles == NULL)
+            return (false);
+
+        files = newFiles;
+    }
+
+    memset(&files[numFiles], 0, sizeof (fileResult_t));
+
+    files[numFiles].path = (UNICHAR *)(malloc((UNICHAR_STRLEN(path) + 1) * sizeof (UNICHAR)));
+    if (files[numFiles].path == NULL)
+        return (false);
+
+    UNICHAR_STRCPY(files[numFiles].path, path);
+    numFiles++;
+
+    return (true);
+}
+
+static int8_t isDirectory(const UNICHAR *path, struct dirent *ent)
+{
+#ifdef _WIN32
+    (void)(path);
+    return (ent->d_type == DT_DIR);
+#else
+    struct stat statBuffer;
+
+    if (ent->d_type != DT_UNKNOWN)
+        return (ent->d_type == DT_DIR);
+
+    return ((stat(path, &statBuffer) == 0) && S_ISDIR(statBuffer.st_mode));
+#endif
+}
+
+static int8_t scanDirectory(const UNICHAR *dirPath)
+{
+    UNICHAR *path;
+    uint32_t pathLen;
+    DIR *dir;
+    struct dirent *ent;
+
+    dir = opendir((UNICHAR *)(dirPath));
+    if (dir == NULL)
+    {
+        fprintf(stderr, "Couldn't open directory \"" UNICHAR_PRINTF_STR "\"\n", dirPath);
+        return (true); // not fatal, keep scanning the rest
+    }
+
+    while ((ent = readdir(dir)) != NULL)
+    {
+        if ((UNICHAR_STRCMP(ent->d_name, DIR_DOT) == 0) || (UNICHAR_STRCMP(ent->d_name, DIR_DOTDOT) == 0))
+            continue;
+
+        pathLen = UNICHAR_STRLEN(dirPath) + 1 + UNICHAR_STRLEN(ent->d_name) + 1;
+
+        path = (UNICHAR *)(malloc(pathLen * sizeof (UNICHAR)));
+        if (path == NULL)
+        {
+            closedir(dir);
+            return (false);
+        }
+
+        UNICHAR_STRCPY(path, dirPath);
+        UNICHAR_STRCAT(path, DIR_SEPARATOR);
+        UNICHAR_STRCAT(path, ent->d_name);
+
+        if (isDirectory(path, ent))
+        {
+            if (!scanDirectory(path))
+            {
+                free(path);
+                closedir(dir);
+
+                return (false);
+            }
+        }
+        else if (!addFile(path))
+        {
+            free(path);
+            closedir(dir);
+
+            return (false);
+        }
+
+        free(path);
+    }
+
+    closedir(dir);
+    return (true);
+}
+
+/* An estimate of what a loaded module keeps allocated (module, pattern store
+** and sample data), computed from its sizes. The loader's temporary buffers
+** (file data, PowerPacker output) are freed again and not included, so this
+** isn't the peak memory use while loading.
+*/
+static uint32_t moduleDataSize(const module_t *module)
+{
+    return ((uint32_t)(sizeof (module_t)) + (module->allocatedPatterns * (MOD_ROWS * AMIGA_VOICES) * sizeof (note_t)) +
+            ((MOD_SAMPLES + 1) * MAX_SAMPLE_LEN));
+}
+
+static int32_t loaderThreadFunc(void *ptr)
+{
+    int32_t i;
+    uint64_t timeStart;
+    fileResult_t *f;
+    module_t *module;
+
+    (void)(ptr);
+
+    while ((i = SDL_AtomicAdd(&nextFile, 1)) < (int32_t)(numFiles))
+    {
+        f = &files[i];
+
+        timeStart = SDL_GetPerformanceCounter();
+        module = modFileLoad(f->path, &f->info);
+        f->loadTimeMs = (double)(SDL_GetPerformanceCounter() - timeStart) / perfFreqMs;
+
+        if (module != NULL)
+        {
+            f->loaded  = true;
+            f->moduleSize = moduleDataSize(module);
+
+            modFileFree(module);
+        }
+    }
+
+    return (0);
+}
+
+int main(int argc, char *argv[])
+{
+    int32_t numThreads, i;
+    uint32_t numLoaded, numPacked, formatCount[NUM_FORMATS];
+    uint64_t totalBytes, timeStart;
+    double wallTimeMs, formatTimeMs[NUM_FORMATS], packedTimeMs;
+    UNICHAR *rootPath;
+    SDL_Thread *threads[MAX_THREADS];
+    fileResult_t *f;
+#ifdef _WIN32
+    uint32_t rootLen;
+#endif
+
+    if ((argc < 2) || (argc > 3))
+    {
+        printf("Usage: modcheck <directory> [threads]\n");
+        return (1);
+    }
+
+    if (!modFileCheckNoteLayout())
+    {
+        fprintf(stderr, "Unexpected note_t bitfield layout, patterns would get corrupted!\n");
+        return (1);
+    }
+
+    numThreads = (argc == 3) ? atoi(argv[2]) : SDL_GetCPUCount();
+    numThreads = CLAMP(numThreads, 1, MAX_THREADS);
+
+#ifdef _WIN32
+    rootLen  = (uint32_t)(strlen(argv[1]));
+    rootPath = (UNICHAR *)(calloc(rootLen + 1, sizeof (UNICHAR)));
+    if (rootPath == NULL)
+        return (1);
+
+    MultiByteToWideChar(CP_ACP, 0, argv[1], -1, rootPath, rootLen + 1);
+#else
+    rootPath = argv[1];
+#endif
+
+    if (SDL_Init(0) != 0)
+    {
+        fprintf(stderr, "SDL_Init() failed: %s\n", SDL_GetError());
+        return (1);
+    }
+
+    if (!scanDirectory(rootPath))
+    {
+        fprintf(stderr, "Out of memory while scanning directories!\n");
+        SDL_Quit();
+
+        return (1);
+    }
+
+    perfFreqMs = (double)(SDL_GetPerformanceFrequency()) / 1000.0;
+    SDL_AtomicSet(&nextFile, 0);
+
+    timeStart = SDL_GetPerformanceCounter();
+
+    for (i = 0; i < numThreads; ++i)
+        threads[i] = SDL_CreateThread(loaderThreadFunc, "modcheck loader thread", NULL);
+
+    for (i = 0; i < numThreads; ++i)
+    {
+        if (threads[i] != NULL)
+            SDL_WaitThread(threads[i], NULL);
+    }
+
+    // all threads failed to start? do it here then
+    if (SDL_AtomicGet(&nextFile) == 0)
+        loaderThreadFunc(NULL);
+
+    wallTimeMs = (double)(SDL_GetPerformanceCounter() - timeStart) / perfFreqMs;
+
+    // per-file report
+    numLoaded    = 0;
+    numPacked    = 0;
+    totalBytes   = 0;
+    packedTimeMs = 0.0;
+
+    memset(formatCount, 0, sizeof (formatCount));
+    memset(formatTimeMs, 0, sizeof (formatTimeMs));
+
+    for (i = 0; i < (int32_t)(numFiles); ++i)
+    {
+        f = &files[i];
+
+        totalBytes += f->info.fileSize;
+
+        if (f->info.powerPacked)
+        {
+            numPacked++;
+            packedTimeMs += f->loadTimeMs;
+        }
+
+        if (f->loaded)
+        {
+            numLoaded++;
+
+            formatCount[f->info.format]++;
+            formatTimeMs[f->info.format] += f->loadTimeMs;
+
+            printf("OK    %-7s %s %8.3fms ~%7ukB  " UNICHAR_PRINTF_STR "\n", formatNames[f->info.format],
+                f->info.powerPacked ? "PP" : "  ", f->loadTimeMs, f->moduleSize / 1024, f->path);
+        }
+        else
+        {
+            printf("FAIL  %-7s %s %8.3fms %8s    " UNICHAR_PRINTF_STR " (%s)\n", "-",
+                f->info.powerPacked ? "PP" : "  ", f->loadTimeMs, "-", f->path, f->info.errorDetails);
+        }
+    }
+
+    // summary
+    printf("\n%u files, %u loaded, %u failed, %u PowerPacked\n", numFiles, numLoaded, numFiles - numLoaded, numPacked);
+    printf("%.1fMB in %.1fms with %d thread(s): %.1f files/s, %.1fMB/s\n", totalBytes / (1024.0 * 1024.0), wallTimeMs,
+        numThreads, (wallTimeMs > 0.0) ? (numFiles / (wallTimeMs / 1000.0)) : 0.0,
+        (wallTimeMs > 0.0) ? ((totalBytes / (1024.0 * 1024.0)) / (wallTimeMs / 1000.0)) : 0.0);
+
+    for (i = 0; i < NUM_FORMATS; ++i)
+    {
+        if (formatCount[i] > 0)
+        {
+            printf("  %-7s %6u files, %10.3fms total, %8.3fms avg\n", formatNames[i], formatCount[i],
+                formatTimeMs[i], formatTimeMs[i] / formatCount[i]);
+        }
+    }
+
+    if (numPacked > 0)
+        printf("  PP20    %6u files, %10.3fms total, %8.3fms avg (incl. failures)\n", numPacked, packedTimeMs, packedTimeMs / numPacked);
+
+    for (i = 0; i < (int32_t)(numFiles); ++i)
+        free(files[i].path);
+
+    free(files);
+#ifdef _WIN32
+    free(rootPath);
+#endif
+
+    SDL_Quit();
+    return ((numLoaded == numFiles) ? 0 : 2);
+}